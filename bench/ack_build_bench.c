@@ -0,0 +1,129 @@
+// Ack build cost: memset + field copies (the old oms_listener code) vs the in-place
+// builder vs a per-connection template patched with fixed-width stores.
+//
+//   gcc -O2 -Iinclude bench/ack_build_bench.c -o ack_build_bench
+//   ./ack_build_bench [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <oms_fep_krx_struct.h>
+#include <fep_codec.h>
+
+#define ORDER_COUNT 1024     // distinct orders cycled through, power of 2
+#define DEFAULT_ITERATIONS 20000000L
+
+static fkq_order orders[ORDER_COUNT];
+static int rejects[ORDER_COUNT];
+
+// keep the compiler from dropping or merging the stores into the ack
+#define CLOBBER(p) __asm__ volatile("" : : "r"(p) : "memory")
+
+static long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void fill_orders() {
+    char text[32];     // room for any int, the fields take what fits
+
+    srand(7);
+    for (int i = 0; i < ORDER_COUNT; i++) {
+        fkq_order *order = &orders[i];
+        memset(order, 0, sizeof(fkq_order));
+        order->hdr.tr_id = FEP_TR_fkq_order;
+        order->hdr.length = sizeof(fkq_order);
+        snprintf(text, sizeof(text), "%06d", rand() % 1000000);
+        fep_copy_str(order->transaction_code, sizeof(order->transaction_code), text);
+        snprintf(text, sizeof(text), "user%d", rand() % 100000);
+        fep_copy_str(order->user_id, sizeof(order->user_id), text);
+        snprintf(text, sizeof(text), "20250121%06d", rand() % 240000);
+        fep_copy_str(order->order_time, sizeof(order->order_time), text);
+        // mostly accepted, some of every reject
+        rejects[i] = (i % 8 == 0) ? 1 + (i / 8) % (FEP_REJECT_COUNT - 1) : FEP_ACCEPTED;
+    }
+}
+
+// what oms_listener did for every ack and in send_error_to_oms: clear the whole
+// ack, then copy field by field
+static void build_legacy(fot_order_is_submitted *out, const fkq_order *order, const char *reject_code) {
+    memset(out, 0, sizeof(fot_order_is_submitted));
+    out->hdr.tr_id = 10;
+    out->hdr.length = sizeof(fot_order_is_submitted);
+    FEP_COPY_FIELD(out->transaction_code, order->transaction_code);
+    FEP_COPY_FIELD(out->user_id, order->user_id);
+    FEP_COPY_FIELD(out->time, order->order_time);
+    strncpy(out->reject_code, reject_code, sizeof(out->reject_code));
+    out->reject_code[sizeof(out->reject_code) - 1] = '\0';
+}
+
+static double run_legacy(long iterations) {
+    fot_order_is_submitted ack;
+    long start = now_ns();
+    for (long n = 0; n < iterations; n++) {
+        int i = n & (ORDER_COUNT - 1);
+        build_legacy(&ack, &orders[i], fep_reject_codes[rejects[i]]);
+        CLOBBER(&ack);
+    }
+    return (double)(now_ns() - start) / iterations;
+}
+
+static double run_builder(long iterations) {
+    fot_order_is_submitted ack;
+    long start = now_ns();
+    for (long n = 0; n < iterations; n++) {
+        int i = n & (ORDER_COUNT - 1);
+        fep_build_fot_order_is_submitted(&ack, &orders[i], fep_reject_codes[rejects[i]]);
+        CLOBBER(&ack);
+    }
+    return (double)(now_ns() - start) / iterations;
+}
+
+static double run_template(long iterations) {
+    fot_order_is_submitted tmpl;
+    fep_ack_template_init(&tmpl);
+    long start = now_ns();
+    for (long n = 0; n < iterations; n++) {
+        int i = n & (ORDER_COUNT - 1);
+        const fot_order_is_submitted *ack = fep_ack_patch(&tmpl, &orders[i], rejects[i]);
+        CLOBBER(ack);
+    }
+    return (double)(now_ns() - start) / iterations;
+}
+
+// all three must put the same bytes on the wire, up to the bytes after each terminator
+static int check_same() {
+    for (int i = 0; i < ORDER_COUNT; i++) {
+        fot_order_is_submitted a, b, tmpl;
+        build_legacy(&a, &orders[i], fep_reject_codes[rejects[i]]);
+        fep_build_fot_order_is_submitted(&b, &orders[i], fep_reject_codes[rejects[i]]);
+        fep_ack_template_init(&tmpl);
+        fep_ack_patch(&tmpl, &orders[i], rejects[i]);
+        if (memcmp(&a, &b, sizeof(a)) != 0 || memcmp(&a, &tmpl, sizeof(a)) != 0) {
+            fprintf(stderr, "ack mismatch for order %d\n", i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+
+    fill_orders();
+    if (check_same() != 0) {
+        return EXIT_FAILURE;
+    }
+    run_legacy(iterations / 10);  // warm up
+
+    double legacy = run_legacy(iterations);
+    double builder = run_builder(iterations);
+    double tmpl = run_template(iterations);
+    printf("ack build, %ld iterations\n", iterations);
+    printf("  memset + copies    %6.2f ns/ack\n", legacy);
+    printf("  in-place builder   %6.2f ns/ack  (%.1fx)\n", builder, legacy / builder);
+    printf("  patched template   %6.2f ns/ack  (%.1fx)\n", tmpl, legacy / tmpl);
+    return 0;
+}
@@ -0,0 +1,162 @@
+#!/bin/bash
+# Loopback failover drill for the journal replication (include/fep_repl.h, replication/).
+#
+# Runs the multi-process FEP with the embedded sqlite store on $OUT/primary, fep_standby on
+# $OUT/standby and fep_replicator between them, all on one box. loadgen drives the primary.
+# After -k seconds every primary process gets SIGKILL, as if the host died, and the
+# standby is promoted. The FEP is then started on the standby's journals and a short
+# second loadgen run checks that it carries on from the promoted positions.
+#
+# Reports:
+#   - the orders and executions the primary had journaled and sent against what the standby has
+#   - how long the promotion took
+#   - whether the new primary resumed without a gap
+#   - the orders that were being sent when the primary died, which are not sent again
+# In sync mode, no order that reached KRX may be missing on the standby, and none is sent twice.
+#
+# usage: bench/failover_drill.sh [-b bin_dir] [-m sync|async] [-r rate] [-k seconds] [-o out_dir]
+#   -b  directory with fep_standby fep_replicator oms_listener krx_sender krx_listener db_updator
+#       db_inserter simple_receiver loadgen, built with -DFEP_WITH_SQLITE (default ./build)
+#   -m  replication mode, default sync
+#   -r  orders per second, default 5000
+#   -k  seconds of load before the primary is killed, default 3
+#   -o  where the two $HOMEs, the store and the logs go, default /tmp/fep_failover_drill.<pid>
+#
+# Journal counters (/W_count ...) and queues are shared system-wide, so nothing else
+# may run the pipeline on the box meanwhile.
+
+set -u
+
+BIN=./build
+MODE=sync
+RATE=5000
+KILL_AFTER=3
+OUT=/tmp/fep_failover_drill.$$
+
+while getopts "b:m:r:k:o:" opt; do
+    case $opt in
+    b) BIN=$OPTARG ;;
+    m) MODE=$OPTARG ;;
+    r) RATE=$OPTARG ;;
+    k) KILL_AFTER=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,27p' "$0" >&2; exit 1 ;;
+    esac
+done
+
+FEP="krx_listener db_updator db_inserter oms_listener simple_receiver krx_sender"
+for p in fep_standby fep_replicator $FEP loadgen; do
+    if [ ! -x "$BIN/$p" ]; then
+        echo "missing $BIN/$p" >&2
+        exit 1
+    fi
+done
+for p in fep_standby fep_replicator $FEP; do
+    if pgrep -x "$p" > /dev/null; then
+        echo "$p is already running, stop it first" >&2
+        exit 1
+    fi
+done
+
+mkdir -p "$OUT/primary" "$OUT/standby"
+OUT=$(cd "$OUT" && pwd)
+rm -f "$OUT"/primary/* "$OUT"/standby/* "$OUT"/fep.db*
+rm -f /dev/shm/W_count /dev/shm/R_count /dev/shm/DB_R_count /dev/shm/KRX_W_count /dev/shm/KRX_R_count /dev/shm/fep_repl
+export FEP_STORE=sqlite
+export FEP_STORE_PATH=$OUT/fep.db      # the DB is not on the FEP host
+export FEP_REPL_MODE=$MODE
+
+PIDS=""
+cleanup() {
+    for pid in $PIDS; do
+        kill "$pid" 2> /dev/null
+    done
+    wait 2> /dev/null
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+# start <home> <program> [args]
+start() {
+    HOME=$1 "$BIN/$2" "${@:3}" > "$OUT/$2.$(basename "$1").log" 2>&1 &
+    PIDS="$! $PIDS"
+    sleep 0.5
+    if ! kill -0 $! 2> /dev/null; then
+        echo "$2 did not start, see $OUT/$2.$(basename "$1").log" >&2
+        exit 1
+    fi
+}
+
+start_fep() {
+    for p in $FEP; do
+        if [ "$p" = simple_receiver ]; then
+            start "$1" simple_receiver -q -m 100 -p 1
+        else
+            start "$1" "$p"
+        fi
+    done
+}
+
+counter() {
+    od -An -td4 -N4 "/dev/shm/$1" 2> /dev/null | tr -d ' ' || echo -
+}
+
+start "$OUT/standby" fep_standby
+STANDBY_PID=$(echo $PIDS | cut -d' ' -f1)
+start_fep "$OUT/primary"
+start "$OUT/primary" fep_replicator
+PRIMARY_PIDS=$(echo $PIDS | cut -d' ' -f1-7)
+sleep 0.5
+
+HOME=$OUT/primary "$BIN/loadgen" -r "$RATE" -d $((KILL_AFTER + 5)) > "$OUT/loadgen.primary.log" 2>&1 &
+LOADGEN=$!
+sleep "$KILL_AFTER"
+
+# the primary host dies: no process gets to clean up
+{
+    pkill -KILL -x fep_replicator
+    for p in $FEP; do
+        pkill -KILL -x "$p"
+    done
+    kill "$LOADGEN"
+    # shellcheck disable=SC2086
+    wait "$LOADGEN" $PRIMARY_PIDS
+} 2> /dev/null
+P_ORDERS=$(counter W_count)
+P_SENT=$(counter R_count)
+P_EXECS=$(counter KRX_W_count)
+
+STANDBY_LOG=/home/ubuntu/logs/fep_standby.log
+LOG_LINES=$(wc -l < "$STANDBY_LOG" 2> /dev/null || echo 0)
+START_NS=$(date +%s%N)
+kill -USR1 "$STANDBY_PID"
+wait "$STANDBY_PID"
+PROMOTE_MS=$(( ($(date +%s%N) - START_NS) / 1000000 ))
+S_ORDERS=$(counter W_count)
+S_SENT=$(counter R_count)
+S_EXECS=$(counter KRX_W_count)
+
+# the standby's journals become the FEP's
+start_fep "$OUT/standby"
+HOME=$OUT/standby "$BIN/loadgen" -r 1000 -d 2 > "$OUT/loadgen.standby.log" 2>&1
+sleep 2
+N_ORDERS=$(counter W_count)
+N_SENT=$(counter R_count)
+RESUMED=$(sed -n 's/^sent \([0-9]*\), acked \([0-9]*\).*/\1 \2/p' "$OUT/loadgen.standby.log")
+
+{
+    echo "failover drill $(date '+%Y-%m-%d %H:%M:%S'), $MODE replication, $RATE orders/s, primary killed after ${KILL_AFTER} s"
+    echo
+    printf "%-28s %10s %10s\n" "" "primary" "standby"
+    printf "%-28s %10s %10s\n" "orders journaled" "$P_ORDERS" "$S_ORDERS"
+    printf "%-28s %10s %10s\n" "orders sent to KRX" "$P_SENT" "$S_SENT"
+    printf "%-28s %10s %10s\n" "executions journaled" "$P_EXECS" "$S_EXECS"
+    echo
+    echo "lost orders:            $((P_ORDERS - S_ORDERS)) (journaled on the primary only)"
+    echo "sent, not on standby:   $(( P_SENT > S_ORDERS ? P_SENT - S_ORDERS : 0 )) (0 in sync mode)"
+    echo "to send again:          $((S_ORDERS - S_SENT)) (krx_sender resends from /R_count)"
+    echo "in doubt:               $(tail -n +$((LOG_LINES + 1)) "$STANDBY_LOG" | grep -c "transaction_code") (maybe at KRX, not sent again, see $STANDBY_LOG)"
+    echo "promotion:              ${PROMOTE_MS} ms from the signal until the standby exited"
+    echo "after restart:          loadgen sent/acked ${RESUMED:-?}, journaled $N_ORDERS, sent $N_SENT"
+    grep -h "promoted in" "$STANDBY_LOG" | tail -n 1
+} | tee "$OUT/results.txt"
@@ -0,0 +1,277 @@
+#ifndef FEP_BENCH_H
+#define FEP_BENCH_H
+
+// Micro-benchmark harness: runs a benchmark function, reports ns/op, ops/s and
+// hardware counters per op, and saves or compares a baseline file.
+//
+// A benchmark is a function running its operation `iterations` times. It runs
+// once to warm up, then `repeats` times; the median run by ns/op is reported
+// together with its counters. Counters come from one perf_event group (cycles,
+// instructions, cache misses, dTLB load misses) counting user space only, so that
+// it also works at perf_event_paranoid 2. Where perf events are unavailable
+// (containers, VMs without a PMU) the counters are reported as "-" and the timings
+// still work; so is dtlb_miss alone on CPUs that do not expose it.
+//
+// Baseline file: the CPU it was recorded on, then one line per benchmark,
+// "name ns_per_op cycles instructions cache_misses dtlb_misses". Baselines
+// without the last column still compare.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define FEP_BENCH_MAX 64
+#define FEP_BENCH_MAX_REPEATS 31
+#define FEP_BENCH_COUNTERS 4
+#define FEP_BENCH_REQUIRED 3     // without these no counters at all; the rest are optional
+
+// keep the compiler from dropping or merging work on p
+#define FEP_BENCH_CLOBBER(p) __asm__ volatile("" : : "r"(p) : "memory")
+
+typedef void (*fep_bench_fn)(long iterations);
+
+typedef struct {
+    char name[48];
+    double ns_per_op;
+    double counters[FEP_BENCH_COUNTERS];    // per op, < 0 if unavailable
+} fep_bench_result;
+
+typedef struct {
+    int leader;
+    int fds[FEP_BENCH_COUNTERS];        // -1 for an optional counter that did not open
+    int opened;                         // values in a group read
+    int repeats;
+    const char *filter;         // run only benchmarks whose name contains it
+    fep_bench_result results[FEP_BENCH_MAX];
+    int count;
+} fep_bench;
+
+static const char *fep_bench_counter_names[FEP_BENCH_COUNTERS] = {"cycles", "instr", "cache_miss", "dtlb_miss"};
+
+static inline uint64_t fep_bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int fep_bench_perf_open(uint32_t type, uint64_t config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static inline void fep_bench_init(fep_bench *bench, int repeats, const char *filter) {
+    static const struct {
+        uint32_t type;
+        uint64_t config;
+    } events[FEP_BENCH_COUNTERS] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    };
+    memset(bench, 0, sizeof(*bench));
+    bench->repeats = repeats < 1 ? 1 : repeats > FEP_BENCH_MAX_REPEATS ? FEP_BENCH_MAX_REPEATS : repeats;
+    bench->filter = filter;
+    bench->leader = -1;
+    for (int c = 0; c < FEP_BENCH_COUNTERS; c++) {
+        bench->fds[c] = fep_bench_perf_open(events[c].type, events[c].config, bench->leader);
+        if (bench->fds[c] == -1 && c >= FEP_BENCH_REQUIRED) {
+            continue;
+        }
+        if (bench->fds[c] == -1) {
+            for (int k = 0; k < c; k++) {
+                close(bench->fds[k]);
+            }
+            bench->leader = -1;
+            fprintf(stderr, "perf events unavailable, reporting timings only\n");
+            return;
+        }
+        if (c == 0) {
+            bench->leader = bench->fds[0];
+        }
+        bench->opened++;
+    }
+}
+
+// One timed run; counters[] is left < 0 without perf events
+static inline double fep_bench_run_once(fep_bench *bench, fep_bench_fn fn, long iterations, double *counters) {
+    struct {
+        uint64_t nr;
+        uint64_t values[FEP_BENCH_COUNTERS];
+    } group;
+
+    if (bench->leader != -1) {
+        ioctl(bench->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(bench->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    uint64_t start = fep_bench_now_ns();
+    fn(iterations);
+    uint64_t elapsed = fep_bench_now_ns() - start;
+    if (bench->leader != -1) {
+        ioctl(bench->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    for (int c = 0; c < FEP_BENCH_COUNTERS; c++) {
+        counters[c] = -1;
+    }
+    ssize_t group_size = (1 + bench->opened) * sizeof(uint64_t);
+    if (bench->leader != -1 && read(bench->leader, &group, group_size) == group_size) {
+        // group values come in open order, skipping the counters that did not open
+        for (int c = 0, v = 0; c < FEP_BENCH_COUNTERS; c++) {
+            if (bench->fds[c] != -1) {
+                counters[c] = (double)group.values[v++] / iterations;
+            }
+        }
+    }
+    return (double)elapsed / iterations;
+}
+
+static inline void fep_bench_run(fep_bench *bench, const char *name, fep_bench_fn fn, long iterations) {
+    if ((bench->filter != NULL && strstr(name, bench->filter) == NULL) || bench->count == FEP_BENCH_MAX) {
+        return;
+    }
+    if (iterations < 1) {
+        iterations = 1;
+    }
+    double ns[FEP_BENCH_MAX_REPEATS];
+    double counters[FEP_BENCH_MAX_REPEATS][FEP_BENCH_COUNTERS];
+
+    fep_bench_run_once(bench, fn, iterations / 10 + 1, counters[0]);   // warm up
+    for (int r = 0; r < bench->repeats; r++) {
+        ns[r] = fep_bench_run_once(bench, fn, iterations, counters[r]);
+    }
+
+    // median run by ns/op, reported with its own counters
+    int order[FEP_BENCH_MAX_REPEATS];
+    for (int r = 0; r < bench->repeats; r++) {
+        order[r] = r;
+    }
+    for (int i = 1; i < bench->repeats; i++) {
+        for (int j = i; j > 0 && ns[order[j]] < ns[order[j - 1]]; j--) {
+            int tmp = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = tmp;
+        }
+    }
+    int median = order[bench->repeats / 2];
+
+    fep_bench_result *result = &bench->results[bench->count++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->ns_per_op = ns[median];
+    memcpy(result->counters, counters[median], sizeof(result->counters));
+}
+
+static inline void fep_bench_print(const fep_bench *bench) {
+    printf("%-28s %10s %12s", "benchmark", "ns/op", "ops/s");
+    for (int c = 0; c < FEP_BENCH_COUNTERS; c++) {
+        printf(" %10s", fep_bench_counter_names[c]);
+    }
+    printf("\n");
+    for (int i = 0; i < bench->count; i++) {
+        const fep_bench_result *result = &bench->results[i];
+        printf("%-28s %10.1f %12.0f", result->name, result->ns_per_op, 1e9 / result->ns_per_op);
+        for (int c = 0; c < FEP_BENCH_COUNTERS; c++) {
+            if (result->counters[c] < 0) {
+                printf(" %10s", "-");
+            } else {
+                printf(" %10.1f", result->counters[c]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+static inline int fep_bench_save(const fep_bench *bench, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    // timings only compare on the same machine, so record which one
+    char line[256], cpu[128] = "unknown";
+    FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+    while (cpuinfo != NULL && fgets(line, sizeof(line), cpuinfo) != NULL) {
+        if (strncmp(line, "model name", 10) == 0 && strchr(line, ':') != NULL) {
+            snprintf(cpu, sizeof(cpu), "%s", strchr(line, ':') + 2);
+            cpu[strcspn(cpu, "\n")] = '\0';
+            break;
+        }
+    }
+    if (cpuinfo != NULL) {
+        fclose(cpuinfo);
+    }
+    fprintf(file, "# cpu: %s, %ld online\n", cpu, sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(file, "# name ns_per_op cycles instructions cache_misses dtlb_misses (per op, -1 = unavailable)\n");
+    for (int i = 0; i < bench->count; i++) {
+        const fep_bench_result *result = &bench->results[i];
+        fprintf(file, "%s %.2f %.2f %.2f %.3f %.3f\n", result->name, result->ns_per_op,
+                result->counters[0], result->counters[1], result->counters[2], result->counters[3]);
+    }
+    fclose(file);
+    return 0;
+}
+
+// Compare against a saved baseline. A benchmark regresses when its ns/op grew
+// by more than threshold percent. Returns the number of regressions, -1 on error.
+static inline int fep_bench_compare(const fep_bench *bench, const char *path, double threshold) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    fep_bench_result base[FEP_BENCH_MAX];
+    int base_count = 0;
+    char line[256];
+    while (base_count < FEP_BENCH_MAX && fgets(line, sizeof(line), file) != NULL) {
+        fep_bench_result *b = &base[base_count];
+        b->counters[3] = -1;
+        if (line[0] != '#' && sscanf(line, "%47s %lf %lf %lf %lf %lf", b->name, &b->ns_per_op,
+                                     &b->counters[0], &b->counters[1], &b->counters[2], &b->counters[3]) >= 5) {
+            base_count++;
+        }
+    }
+    fclose(file);
+
+    int regressions = 0;
+    printf("\n%-28s %10s %10s %8s %10s\n", "vs baseline", "base ns", "ns/op", "delta", "instr");
+    for (int i = 0; i < bench->count; i++) {
+        const fep_bench_result *result = &bench->results[i];
+        const fep_bench_result *b = NULL;
+        for (int k = 0; k < base_count && b == NULL; k++) {
+            if (strcmp(base[k].name, result->name) == 0) {
+                b = &base[k];
+            }
+        }
+        if (b == NULL || b->ns_per_op <= 0) {
+            printf("%-28s %10s %10.1f\n", result->name, "new", result->ns_per_op);
+            continue;
+        }
+        double delta = (result->ns_per_op / b->ns_per_op - 1.0) * 100.0;
+        char instr[16] = "-";
+        if (b->counters[1] > 0 && result->counters[1] >= 0) {
+            snprintf(instr, sizeof(instr), "%+.1f%%", (result->counters[1] / b->counters[1] - 1.0) * 100.0);
+        }
+        int regressed = delta > threshold;
+        regressions += regressed;
+        printf("%-28s %10.1f %10.1f %+7.1f%% %10s%s\n", result->name, b->ns_per_op, result->ns_per_op,
+               delta, instr, regressed ? "  REGRESSED" : "");
+    }
+    return regressions;
+}
+
+#endif //FEP_BENCH_H
@@ -0,0 +1,452 @@
+// Hot-path micro-benchmarks: the per-order and per-execution work of the pipeline.
+//
+//   validate_order        fep_validate_order, the oms_listener validation chain
+//   order_time_future     is_order_time_future alone, against the clock page
+//   ack_patch             per-connection ack template patch (send_error_to_oms and accepts)
+//   log_message           the listeners' log_message, one line to a file
+//   log_time_shared       the log timestamp copied from the clock page (fep_clock.h); the
+//                         page is private to the bench and updated by a thread every ms
+//   log_time_local        the same formatted with gettimeofday + localtime + snprintf
+//   journal_order         save_order_to_file_bin: fwrite + fflush of one fkq_order
+//   journal_execution     the same for a kft_execution (krx_listener)
+//   mq_handoff            mq_send + mq_receive of a wc, the W_count wakeup between processes
+//   spsc_handoff          spsc_ring push + pop of an order, the integrated FEP's handoff
+//   sql_build_insert      the tx_history INSERT built for each accepted order
+//   sql_build_update_64   executions -> status updates -> one CASE UPDATE of 64 orders
+//                         (db_updator's read_exec_from_bin_file batch)
+//   ring_walk_4k          random 64-byte record updates across a 64 MB ring on 4 KB pages
+//   ring_walk_huge        the same on huge pages from fep_mem_map(); FEP_HUGEPAGES picks
+//                         hugetlb (default here) or thp. The dtlb_miss column of the two
+//                         shows what huge pages save, and a summary line follows the table.
+//
+//   gcc -O2 -Iinclude -Ibench bench/hotpath_bench.c -o hotpath_bench -lpthread -lrt
+//   ./hotpath_bench [-n scale] [-r repeats] [-f filter] [-s save_baseline] [-b baseline] [-t percent]
+//     -n  multiply every benchmark's iteration count, default 1
+//     -r  runs per benchmark, the median is reported, default 5
+//     -f  only benchmarks whose name contains filter
+//     -s  write the results as a baseline file
+//     -b  compare against a baseline file; exits 2 when a benchmark is more than -t percent slower
+//     -t  regression threshold in percent, default 10
+//
+// The SQL builders come from fep_store_mysql.h and need the MySQL headers (not the
+// library); build with -DFEP_WITHOUT_MYSQL to leave them out.
+// The journal and log files are written under /tmp and removed at exit.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <sys/time.h>
+#include <oms_fep_krx_struct.h>
+#include <fep_codec.h>
+#include <fep_validate.h>
+#include <fep_store.h>
+#include <spsc_ring.h>
+#include <fep_clock.h>
+#include <fep_bench.h>
+
+#define ORDER_COUNT 1024     // distinct orders cycled through, power of 2
+#define UPDATE_BATCH 64
+#define LOG_PATH "/tmp/fep_bench.log"
+#define JOURNAL_PATH "/tmp/fep_bench_journal.bin"
+#define BENCH_MQ_NAME "/fep_bench_mq"
+#define RING_WALK_BYTES (64UL << 20)   // well past the reach of the dTLB on 4 KB pages
+#define RING_WALK_RECORD 64
+
+static fkq_order orders[ORDER_COUNT];
+static int rejects[ORDER_COUNT];
+static kft_execution executions[ORDER_COUNT];
+static long scale = 1;
+
+static FILE *log_file = NULL;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *journal = NULL;
+static mqd_t mq = (mqd_t)-1;
+static spsc_ring ring;
+static char *walk_small = NULL;     // RING_WALK_BYTES on 4 KB pages
+static char *walk_huge = NULL;      // on huge pages
+static int walk_huge_flags = 0;
+static fep_clock_page clock_page;
+static pthread_t clock_thread;
+static volatile int clock_running = 1;
+
+// Same as oms_listener.c
+void log_message(const char *level, const char *module, const char *format, ...) {
+    pthread_mutex_lock(&log_mutex);
+    if (!log_file) {
+        pthread_mutex_unlock(&log_mutex);
+        return;
+    }
+
+    // YYYY-MM-DD HH:MM:SS.mmm, copied from the shared clock page
+    char time_buffer[FEP_CLOCK_LOG_TIME_LEN + 1];
+    fep_clock_log_time(time_buffer);
+
+    fprintf(log_file, "[%s] [%s] [%s] ", time_buffer, level, module);
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(log_file, format, args);
+    va_end(args);
+    fflush(log_file);
+    pthread_mutex_unlock(&log_mutex);
+}
+
+// Same as oms_listener.c / krx_listener.c
+void save_order_to_file_bin(const fkq_order *order, FILE *file) {
+    fwrite(order, sizeof(fkq_order), 1, file);
+    fflush(file);
+}
+
+void save_execution_to_file_bin(const kft_execution *execution, FILE *file) {
+    fwrite(execution, sizeof(kft_execution), 1, file);
+    fflush(file);
+}
+
+// Same as db_updator.c
+char status_of(const kft_execution *execution) {
+    if (execution->status_code == 0) {
+        return 'D';
+    } else if (execution->status_code == 1) {
+        return 'C';
+    } else if (execution->status_code == 99) {
+        return 'R';
+    }
+    return 0;
+}
+
+static void fill_data() {
+    char now[15];
+    char text[32];     // room for any int, the fields take what fits
+    time_t t = time(NULL);
+    strftime(now, sizeof(now), ORDER_TIME_FORMAT, localtime(&t));
+
+    srand(7);
+    for (int i = 0; i < ORDER_COUNT; i++) {
+        fkq_order *order = &orders[i];
+        memset(order, 0, sizeof(fkq_order));
+        order->hdr.tr_id = FEP_TR_fkq_order;
+        order->hdr.length = sizeof(fkq_order);
+        snprintf(text, sizeof(text), "%06d", rand() % 1000000);
+        fep_copy_str(order->transaction_code, sizeof(order->transaction_code), text);
+        snprintf(text, sizeof(text), "%06d", rand() % 3000);
+        fep_copy_str(order->stock_code, sizeof(order->stock_code), text);
+        snprintf(text, sizeof(text), "stock%d", rand() % 3000);
+        fep_copy_str(order->stock_name, sizeof(order->stock_name), text);
+        snprintf(text, sizeof(text), "user%d", rand() % 100000);
+        fep_copy_str(order->user_id, sizeof(order->user_id), text);
+        memcpy(order->order_time, now, sizeof(order->order_time));
+        order->order_type = "BS"[i & 1];
+        order->quantity = 1 + rand() % 100;
+        order->price = 1000 + rand() % 100000;
+        strcpy(order->original_order, "NA");
+        // mostly accepted, some of every reject
+        rejects[i] = (i % 8 == 0) ? 1 + (i / 8) % (FEP_REJECT_COUNT - 1) : FEP_ACCEPTED;
+
+        kft_execution *exec = &executions[i];
+        memset(exec, 0, sizeof(kft_execution));
+        exec->hdr.tr_id = FEP_TR_kft_execution;
+        exec->hdr.length = sizeof(kft_execution);
+        memcpy(exec->transaction_code, order->transaction_code, sizeof(exec->transaction_code));
+        exec->status_code = (i % 16 == 0) ? 99 : (i % 16 == 1) ? 1 : 0;
+        memcpy(exec->time, now, sizeof(exec->time));
+        exec->executed_price = order->price;
+        strcpy(exec->original_order, "NA");
+        strcpy(exec->reject_code, exec->status_code == 99 ? "E901" : "0000");
+        exec->seq_no = i + 1;
+    }
+}
+
+static void bench_validate_order(long iterations) {
+    for (long n = 0; n < iterations; n++) {
+        int reject = fep_validate_order(&orders[n & (ORDER_COUNT - 1)]);
+        FEP_BENCH_CLOBBER(reject);
+    }
+}
+
+static void bench_order_time_future(long iterations) {
+    for (long n = 0; n < iterations; n++) {
+        int future = is_order_time_future(orders[n & (ORDER_COUNT - 1)].order_time);
+        FEP_BENCH_CLOBBER(future);
+    }
+}
+
+static void bench_ack_patch(long iterations) {
+    fot_order_is_submitted tmpl;
+    fep_ack_template_init(&tmpl);
+    for (long n = 0; n < iterations; n++) {
+        int i = n & (ORDER_COUNT - 1);
+        const fot_order_is_submitted *ack = fep_ack_patch(&tmpl, &orders[i], rejects[i]);
+        FEP_BENCH_CLOBBER(ack);
+    }
+}
+
+static void bench_log_message(long iterations) {
+    for (long n = 0; n < iterations; n++) {
+        const fkq_order *order = &orders[n & (ORDER_COUNT - 1)];
+        log_message("INFO", "order", "received order %s for %s\n", order->transaction_code, order->stock_code);
+    }
+    // keep the file from growing across repeats
+    fseek(log_file, 0, SEEK_SET);
+    ftruncate(fileno(log_file), 0);
+}
+
+static void bench_log_time_shared(long iterations) {
+    char time_buffer[FEP_CLOCK_LOG_TIME_LEN + 1];
+    for (long n = 0; n < iterations; n++) {
+        fep_clock_log_time(time_buffer);
+        FEP_BENCH_CLOBBER(time_buffer);
+    }
+}
+
+static void bench_log_time_local(long iterations) {
+    char time_buffer[FEP_CLOCK_LOG_TIME_LEN + 1];
+    for (long n = 0; n < iterations; n++) {
+        fep_clock_log_time_local(time_buffer);
+        FEP_BENCH_CLOBBER(time_buffer);
+    }
+}
+
+static void bench_journal_order(long iterations) {
+    for (long n = 0; n < iterations; n++) {
+        save_order_to_file_bin(&orders[n & (ORDER_COUNT - 1)], journal);
+    }
+    fseek(journal, 0, SEEK_SET);
+    ftruncate(fileno(journal), 0);
+}
+
+static void bench_journal_execution(long iterations) {
+    for (long n = 0; n < iterations; n++) {
+        save_execution_to_file_bin(&executions[n & (ORDER_COUNT - 1)], journal);
+    }
+    fseek(journal, 0, SEEK_SET);
+    ftruncate(fileno(journal), 0);
+}
+
+static void bench_mq_handoff(long iterations) {
+    int wc, received;
+    for (long n = 0; n < iterations; n++) {
+        wc = (int)n;
+        if (mq_send(mq, (char *)&wc, sizeof(int), 0) == -1
+                || mq_receive(mq, (char *)&received, sizeof(int), NULL) == -1) {
+            perror("mq handoff");
+            exit(EXIT_FAILURE);
+        }
+        FEP_BENCH_CLOBBER(received);
+    }
+}
+
+static void bench_spsc_handoff(long iterations) {
+    fkq_order out;
+    for (long n = 0; n < iterations; n++) {
+        spsc_ring_push(&ring, &orders[n & (ORDER_COUNT - 1)]);
+        spsc_ring_pop(&ring, &out);
+        FEP_BENCH_CLOBBER(&out);
+    }
+}
+
+// Touch one record per iteration, spread over the whole buffer like a ring's slots
+// under load: the TLB reach decides how often the page walk is paid.
+static void ring_walk(char *base, long iterations) {
+    const uint64_t records = RING_WALK_BYTES / RING_WALK_RECORD;
+    for (long n = 0; n < iterations; n++) {
+        uint64_t *record = (uint64_t *)(base + ((n * 2654435761u) & (records - 1)) * RING_WALK_RECORD);
+        record[0]++;
+        FEP_BENCH_CLOBBER(record);
+    }
+}
+
+static void bench_ring_walk_small(long iterations) {
+    ring_walk(walk_small, iterations);
+}
+
+static void bench_ring_walk_huge(long iterations) {
+    ring_walk(walk_huge, iterations);
+}
+
+#ifndef FEP_WITHOUT_MYSQL
+static void bench_sql_build_insert(long iterations) {
+    char query[512];
+    for (long n = 0; n < iterations; n++) {
+        int len = fep_mysql_build_insert(query, sizeof(query), &orders[n & (ORDER_COUNT - 1)]);
+        FEP_BENCH_CLOBBER(len);
+    }
+}
+
+static void bench_sql_build_update(long iterations) {
+    static char query[FEP_STORE_UPDATE_QUERY_SIZE];
+    fep_status_update updates[UPDATE_BATCH];
+    for (long n = 0; n < iterations; n++) {
+        const kft_execution *execs = &executions[(n * UPDATE_BATCH) & (ORDER_COUNT - 1)];
+        for (int i = 0; i < UPDATE_BATCH; i++) {
+            memcpy(updates[i].transaction_code, execs[i].transaction_code, sizeof(updates[i].transaction_code));
+            updates[i].transaction_code[sizeof(updates[i].transaction_code) - 1] = '\0';
+            updates[i].status = status_of(&execs[i]);
+            strncpy(updates[i].reject_code, execs[i].reject_code, 4);
+            updates[i].reject_code[4] = '\0';
+        }
+        int len = fep_mysql_build_status_update(query, sizeof(query), updates, UPDATE_BATCH);
+        FEP_BENCH_CLOBBER(len);
+    }
+}
+#endif
+
+// fep_clockd in a thread, on a page of our own
+static void *clock_updater(void *arg) {
+    fep_clock_writer *writer = arg;
+    struct timespec tick = {0, 1000000};
+    while (clock_running) {
+        nanosleep(&tick, NULL);
+        fep_clock_update(writer);
+    }
+    return NULL;
+}
+
+static void setup() {
+    log_file = fopen(LOG_PATH, "w");
+    journal = fopen(JOURNAL_PATH, "wb");
+    if (log_file == NULL || journal == NULL) {
+        perror("bench files");
+        exit(EXIT_FAILURE);
+    }
+
+    struct mq_attr attr = {0};
+    attr.mq_maxmsg = 10;
+    attr.mq_msgsize = sizeof(int);
+    mq_unlink(BENCH_MQ_NAME);
+    mq = mq_open(BENCH_MQ_NAME, O_CREAT | O_RDWR, 0644, &attr);
+    if (mq == (mqd_t)-1) {
+        perror("mq_open");
+        exit(EXIT_FAILURE);
+    }
+
+    if (spsc_ring_init(&ring, 1024, sizeof(fkq_order)) != 0) {
+        fprintf(stderr, "spsc_ring_init failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // both walk buffers prefaulted, so only the page size differs
+    walk_small = mmap(NULL, RING_WALK_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    setenv("FEP_HUGEPAGES", "hugetlb", 0);
+    walk_huge = fep_mem_map(RING_WALK_BYTES, &walk_huge_flags);
+    if (walk_small == MAP_FAILED || walk_huge == NULL) {
+        perror("ring walk buffers");
+        exit(EXIT_FAILURE);
+    }
+    madvise(walk_small, RING_WALK_BYTES, MADV_NOHUGEPAGE);
+    memset(walk_small, 0, RING_WALK_BYTES);
+    walk_huge_flags = fep_mem_prepare(walk_huge, RING_WALK_BYTES, walk_huge_flags);
+
+    static fep_clock_writer writer;
+    fep_clock_writer_init(&writer, &clock_page);
+    fep_clock_update(&writer);
+    fep_clock = &clock_page;
+    if (pthread_create(&clock_thread, NULL, clock_updater, &writer) != 0) {
+        perror("clock thread");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// dTLB misses and time per op of the huge page walk against the 4 KB one
+static void print_huge_page_summary(const fep_bench *bench) {
+    const fep_bench_result *small = NULL, *huge = NULL;
+    for (int i = 0; i < bench->count; i++) {
+        if (strcmp(bench->results[i].name, "ring_walk_4k") == 0) {
+            small = &bench->results[i];
+        } else if (strcmp(bench->results[i].name, "ring_walk_huge") == 0) {
+            huge = &bench->results[i];
+        }
+    }
+    if (small == NULL || huge == NULL) {
+        return;
+    }
+    printf("\nhuge pages (%s): %.1f -> %.1f ns/op (%+.1f%%)", walk_huge_flags & FEP_MEM_HUGETLB ? "hugetlb"
+           : walk_huge_flags & FEP_MEM_THP ? "thp" : "none available, 4 KB",
+           small->ns_per_op, huge->ns_per_op, (huge->ns_per_op / small->ns_per_op - 1.0) * 100.0);
+    if (small->counters[3] > 0 && huge->counters[3] >= 0) {
+        printf(", dtlb misses %.3f -> %.3f per op (%+.1f%%)", small->counters[3], huge->counters[3],
+               (huge->counters[3] / small->counters[3] - 1.0) * 100.0);
+    }
+    printf("\n");
+}
+
+static void cleanup() {
+    clock_running = 0;
+    pthread_join(clock_thread, NULL);
+    fclose(log_file);
+    fclose(journal);
+    unlink(LOG_PATH);
+    unlink(JOURNAL_PATH);
+    mq_close(mq);
+    mq_unlink(BENCH_MQ_NAME);
+    munmap(walk_small, RING_WALK_BYTES);
+    munmap(walk_huge, fep_mem_round_up(RING_WALK_BYTES, FEP_HUGE_PAGE_SIZE));
+}
+
+int main(int argc, char *argv[]) {
+    int repeats = 5;
+    const char *filter = NULL, *save_path = NULL, *baseline_path = NULL;
+    double threshold = 10.0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:f:s:b:t:")) != -1) {
+        switch (opt) {
+        case 'n': scale = atol(optarg); break;
+        case 'r': repeats = atoi(optarg); break;
+        case 'f': filter = optarg; break;
+        case 's': save_path = optarg; break;
+        case 'b': baseline_path = optarg; break;
+        case 't': threshold = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n scale] [-r repeats] [-f filter] [-s save_baseline] [-b baseline] [-t percent]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (scale < 1) {
+        scale = 1;
+    }
+
+    // order times are KST, as in the listeners
+    setenv("TZ", "Asia/Seoul", 1);
+    tzset();
+    fill_data();
+    setup();
+
+    fep_bench bench;
+    fep_bench_init(&bench, repeats, filter);
+    fep_bench_run(&bench, "validate_order", bench_validate_order, 200000 * scale);
+    fep_bench_run(&bench, "order_time_future", bench_order_time_future, 200000 * scale);
+    fep_bench_run(&bench, "ack_patch", bench_ack_patch, 20000000 * scale);
+    fep_bench_run(&bench, "log_message", bench_log_message, 100000 * scale);
+    fep_bench_run(&bench, "log_time_shared", bench_log_time_shared, 5000000 * scale);
+    fep_bench_run(&bench, "log_time_local", bench_log_time_local, 500000 * scale);
+    fep_bench_run(&bench, "journal_order", bench_journal_order, 100000 * scale);
+    fep_bench_run(&bench, "journal_execution", bench_journal_execution, 100000 * scale);
+    fep_bench_run(&bench, "mq_handoff", bench_mq_handoff, 200000 * scale);
+    fep_bench_run(&bench, "spsc_handoff", bench_spsc_handoff, 5000000 * scale);
+    fep_bench_run(&bench, "ring_walk_4k", bench_ring_walk_small, 5000000 * scale);
+    fep_bench_run(&bench, "ring_walk_huge", bench_ring_walk_huge, 5000000 * scale);
+#ifndef FEP_WITHOUT_MYSQL
+    fep_bench_run(&bench, "sql_build_insert", bench_sql_build_insert, 500000 * scale);
+    fep_bench_run(&bench, "sql_build_update_64", bench_sql_build_update, 20000 * scale);
+#endif
+    cleanup();
+
+    fep_bench_print(&bench);
+    print_huge_page_summary(&bench);
+    if (save_path != NULL && fep_bench_save(&bench, save_path) == 0) {
+        printf("\nbaseline saved to %s\n", save_path);
+    }
+    if (baseline_path != NULL) {
+        int regressions = fep_bench_compare(&bench, baseline_path, threshold);
+        if (regressions != 0) {
+            return regressions > 0 ? 2 : EXIT_FAILURE;
+        }
+    }
+    return 0;
+}
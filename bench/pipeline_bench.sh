@@ -0,0 +1,198 @@
+#!/bin/bash
+# End-to-end capacity benchmark of the multi-process FEP on one box.
+#
+# Starts fep_clockd, krx_listener, db_updator, db_inserter, oms_listener, the mock exchange (simple_receiver)
+# and krx_sender on loopback, with the embedded sqlite store standing in for MySQL.
+# It then drives loadgen at each rate in turn. Every step:
+#   - clears the fep_stat histograms
+#   - sends at the rate for -d seconds with the configured mix of new, cancel and invalid orders
+#   - waits until every journal reader caught up and nothing is left to persist
+#   - records acked and persisted throughput, loadgen's client-side ack latency and
+#     the per-stage latencies from fep_stat (tick_to_trade = recv -> sent to KRX,
+#     persist = executed -> status committed)
+# A step is sustained when nothing went unanswered, the drain took at most -g seconds
+# and the corrected ack p99 stayed under -l. The capacity is the highest sustained rate.
+#
+# usage: bench/pipeline_bench.sh [-b bin_dir] [-r "rates"] [-d seconds] [-x cancel%] [-j invalid%]
+#                                [-l p99_us] [-g drain_s] [-m "mock options"] [-o out_dir]
+#   -b  directory with fep_clockd oms_listener krx_sender krx_listener db_updator db_inserter
+#       simple_receiver loadgen fep_stat fep_top, built with -DFEP_WITH_SQLITE (default ./build)
+#   -r  order rates per second, default "1000 2000 5000 10000 20000"
+#   -d  seconds per step, default 10
+#   -x  cancel share, default 5;  -j  invalid share (E103), default 2
+#   -l  ack p99 limit in microseconds, default 10000
+#   -g  drain limit in seconds, default 2
+#   -m  simple_receiver options, default "-m 70 -p 2 -L exp:200"
+#   -o  where logs, the journals and results.txt go, default /tmp/fep_pipeline_bench.<pid>
+#
+# Journal counters (/W_count ...) and queues are shared system-wide, so nothing else
+# may run the pipeline on the box meanwhile.
+
+set -u
+
+BIN=./build
+RATES="1000 2000 5000 10000 20000"
+SECONDS_PER_STEP=10
+CANCEL=5
+INVALID=2
+P99_LIMIT_US=10000
+DRAIN_LIMIT=2
+MOCK_OPTS="-m 70 -p 2 -L exp:200"
+OUT=/tmp/fep_pipeline_bench.$$
+
+while getopts "b:r:d:x:j:l:g:m:o:" opt; do
+    case $opt in
+    b) BIN=$OPTARG ;;
+    r) RATES=$OPTARG ;;
+    d) SECONDS_PER_STEP=$OPTARG ;;
+    x) CANCEL=$OPTARG ;;
+    j) INVALID=$OPTARG ;;
+    l) P99_LIMIT_US=$OPTARG ;;
+    g) DRAIN_LIMIT=$OPTARG ;;
+    m) MOCK_OPTS=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,30p' "$0" >&2; exit 1 ;;
+    esac
+done
+
+PROCESSES="fep_clockd krx_listener db_updator db_inserter oms_listener simple_receiver krx_sender"
+for p in $PROCESSES loadgen fep_stat fep_top; do
+    if [ ! -x "$BIN/$p" ]; then
+        echo "missing $BIN/$p" >&2
+        exit 1
+    fi
+done
+for p in $PROCESSES; do
+    if pgrep -x "$p" > /dev/null; then
+        echo "$p is already running, stop it first" >&2
+        exit 1
+    fi
+done
+
+mkdir -p "$OUT"
+OUT=$(cd "$OUT" && pwd)
+RESULTS=$OUT/results.txt
+
+# journals live in $HOME; start from empty ones and fresh counters
+export HOME=$OUT
+export FEP_STORE=sqlite
+export FEP_STORE_PATH=$OUT/fep.db
+rm -f "$OUT"/received_data.txt "$OUT"/krx_received_data.txt "$OUT"/fep.db*
+rm -f /dev/shm/W_count /dev/shm/R_count /dev/shm/DB_R_count /dev/shm/KRX_W_count /dev/shm/KRX_R_count
+
+PIDS=""
+cleanup() {
+    for pid in $PIDS; do
+        kill "$pid" 2> /dev/null
+    done
+    wait 2> /dev/null
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+start() {
+    "$BIN/$1" "${@:2}" > "$OUT/$1.log" 2>&1 &
+    PIDS="$! $PIDS"
+    sleep 0.5
+    if ! kill -0 $! 2> /dev/null; then
+        echo "$1 did not start, see $OUT/$1.log" >&2
+        exit 1
+    fi
+}
+
+# the order matters: each one opens what the previous ones created
+start fep_clockd
+start krx_listener
+start db_updator
+start db_inserter
+start oms_listener
+# shellcheck disable=SC2086
+start simple_receiver -q $MOCK_OPTS
+start krx_sender
+sleep 1
+
+# counter value from one fep_top report
+metric() {
+    awk -v name="$1" '$1 == name { print $2; exit }' "$2"
+}
+
+# wait until every journal reader caught up and execs_persisted stopped moving; prints seconds waited
+drain() {
+    local start_ns now_ns previous="" snapshot=$OUT/top.snapshot
+    start_ns=$(date +%s%N)
+    while :; do
+        "$BIN/fep_top" -b -n 1 -i 0.2 > "$snapshot" 2> /dev/null
+        local lag persisted
+        lag=$(awk '$1 == "orders" || $1 == "inserts" || $1 == "executions" { sum += $4 } END { print sum + 0 }' "$snapshot")
+        persisted=$(metric execs_persisted "$snapshot")
+        now_ns=$(date +%s%N)
+        if [ "$lag" = 0 ] && [ "$persisted" = "$previous" ]; then
+            break
+        fi
+        if [ $(( (now_ns - start_ns) / 1000000000 )) -ge 60 ]; then
+            echo "pipeline did not drain in 60 s" >&2
+            break
+        fi
+        previous=$persisted
+    done
+    awk -v ns=$(( now_ns - start_ns )) 'BEGIN { printf "%.2f", ns / 1e9 }'
+}
+
+{
+    echo "pipeline benchmark $(date '+%Y-%m-%d %H:%M:%S')  commit $(git -C "$(dirname "$0")" rev-parse --short HEAD 2> /dev/null || echo unknown)"
+    echo "mix: cancel ${CANCEL}%, invalid ${INVALID}%, ${SECONDS_PER_STEP} s per step, mock: $MOCK_OPTS"
+    echo "sustained: no unanswered orders, drain <= ${DRAIN_LIMIT} s, ack p99 <= ${P99_LIMIT_US} us"
+    echo
+    printf "%8s %9s %9s %9s %9s %9s %9s %9s %9s %7s  %s\n" "rate" "acked/s" "persist/s" \
+        "ack_p50" "ack_p99" "t2t_p50" "t2t_p99" "pers_p50" "pers_p99" "drain" "result"
+} > "$RESULTS"
+
+CAPACITY=0
+drain > /dev/null
+for rate in $RATES; do
+    step=$OUT/step_$rate
+    "$BIN/fep_stat" -r > /dev/null
+    "$BIN/fep_top" -b -n 1 -i 0.1 > "$step.top_before" 2> /dev/null
+
+    "$BIN/loadgen" -r "$rate" -d "$SECONDS_PER_STEP" -x "$CANCEL" -j "$INVALID" > "$step.loadgen" 2>&1
+    drain_s=$(drain)
+
+    "$BIN/fep_top" -b -n 1 -i 0.1 > "$step.top_after" 2> /dev/null
+    "$BIN/fep_stat" -c -n 1 -i 0.1 > "$step.stat" 2> /dev/null
+
+    # loadgen: "sent N, acked N (R/s), rejected N, unanswered N" and the corrected percentile row
+    acked_rate=$(sed -n 's/^sent.*acked [0-9]* (\([0-9.]*\)\/s).*/\1/p' "$step.loadgen")
+    unanswered=$(awk '/unanswered/ { print $NF; exit }' "$step.loadgen")
+    ack_p50=$(awk '$1 == "corrected" { print $2; exit }' "$step.loadgen")
+    ack_p99=$(awk '$1 == "corrected" { print $4; exit }' "$step.loadgen")
+    t2t_p50=$(awk '$1 == "tick_to_trade" { print $4 }' "$step.stat")
+    t2t_p99=$(awk '$1 == "tick_to_trade" { print $5 }' "$step.stat")
+    pers_p50=$(awk '$1 == "persist" { print $4 }' "$step.stat")
+    pers_p99=$(awk '$1 == "persist" { print $5 }' "$step.stat")
+    persisted=$(( $(metric execs_persisted "$step.top_after") - $(metric execs_persisted "$step.top_before") ))
+    persist_rate=$(awk -v n="$persisted" -v s="$SECONDS_PER_STEP" -v d="$drain_s" 'BEGIN { printf "%.0f", n / (s + d) }')
+
+    result=sustained
+    if [ -z "$unanswered" ] || [ "$unanswered" != 0 ]; then
+        result="lost ${unanswered:-?}"
+    elif awk -v d="$drain_s" -v l="$DRAIN_LIMIT" 'BEGIN { exit !(d > l) }'; then
+        result="backlog"
+    elif awk -v p="${ack_p99:-0}" -v l="$P99_LIMIT_US" 'BEGIN { exit !(p > l) }'; then
+        result="p99"
+    else
+        CAPACITY=$rate
+    fi
+
+    printf "%8s %9s %9s %9s %9s %9s %9s %9s %9s %6ss  %s\n" "$rate" "${acked_rate:--}" "$persist_rate" \
+        "${ack_p50:--}" "${ack_p99:--}" "${t2t_p50:--}" "${t2t_p99:--}" "${pers_p50:--}" "${pers_p99:--}" \
+        "$drain_s" "$result" >> "$RESULTS"
+    tail -1 "$RESULTS"
+done
+
+{
+    echo
+    echo "latencies in us; ack = loadgen, corrected for coordinated omission"
+    echo "capacity: $CAPACITY orders/s"
+} >> "$RESULTS"
+echo
+cat "$RESULTS"
@@ -0,0 +1,716 @@
+#ifndef DB_POOL_H
+#define DB_POOL_H
+
+// Shared MySQL connection pool.
+// One pool thread drives every connection through the MariaDB non-blocking API
+// (mysql_*_start / mysql_*_cont), so producers never block on the DB. submit()
+// tells the producer when the DB is lagging instead of stalling it.
+//
+// The pool keeps between min and max connections open. Every DB_POOL_SCALE_INTERVAL_MS
+// it looks at the queue depth, how busy the open connections were and the mean
+// statement time per row. Callers say how many rows a query writes: a bulk INSERT
+// of a thousand rows takes longer than a single one without the DB being slower.
+//   grow    queries are waiting, connections were busy most of the interval and
+//           the time per row has not risen well above the best seen (the DB has room)
+//   shrink  the queue stayed empty with mostly idle connections for a while, or
+//           the time per row climbed far above the best seen (the DB is the
+//           bottleneck and more connections only contend)
+// A new connection is connected before it gets work, and idle ones are pinged, so
+// every open connection is warm. With min == max the size is fixed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <mysql/mysql.h>
+#include <mysql/errmsg.h>
+#include <envs.h>
+#include <fep_metrics.h>
+#include <fep_affinity.h>
+
+#define DB_POOL_MAX_CONNS 32
+#define DB_POOL_QUEUE_SIZE 4096          // pending queries, power of 2
+#define DB_POOL_HEALTH_INTERVAL_MS 5000  // ping connections idle for this long
+#define DB_POOL_RETRY_MAX 5              // attempts for deadlocks and lock wait timeouts
+#define DB_POOL_BACKOFF_MAX_MS 5000
+#define DB_POOL_TIMEOUT_SEC 5            // connect/read/write timeout per connection
+
+// adaptive sizing
+#define DB_POOL_SCALE_INTERVAL_MS 500
+#define DB_POOL_GROW_UTIL 75             // % busy of the open connections to grow
+#define DB_POOL_SHRINK_UTIL 25           // % busy below which a quiet pool shrinks
+#define DB_POOL_IDLE_INTERVALS 10        // quiet intervals in a row before shrinking
+#define DB_POOL_LATENCY_GROW_LIMIT 2     // no growing above this multiple of the best time per row
+#define DB_POOL_LATENCY_SHRINK_LIMIT 4   // shrink above this multiple of the best time per row
+
+#define ER_LOCK_WAIT_TIMEOUT_CODE 1205
+#define ER_LOCK_DEADLOCK_CODE 1213
+
+// submit() results
+#define DB_POOL_OK 0
+#define DB_POOL_BACKPRESSURE 1           // accepted, but the DB is lagging: slow down
+#define DB_POOL_FULL -1                  // not accepted
+
+// Outcome of a query. Connection losses are not one: the query is run again once
+// the DB is back.
+#define DB_POOL_DONE 0
+#define DB_POOL_CONFLICT 1               // deadlocks or lock wait timeouts DB_POOL_RETRY_MAX times
+#define DB_POOL_REFUSED 2                // the DB refuses the statement itself, e.g. a constraint
+
+// Called on the pool thread when a query finishes with DB_POOL_DONE or why it failed
+typedef void (*db_pool_done_fn)(void *arg, int result, const char *error);
+
+typedef struct {
+    char *query;
+    unsigned long length;
+    db_pool_done_fn done;
+    void *arg;
+    int rows;                 // rows the statement writes, for the time per row
+    int attempts;
+} db_pool_job;
+
+typedef enum {
+    DB_CONN_DOWN,
+    DB_CONN_CONNECTING,
+    DB_CONN_IDLE,
+    DB_CONN_QUERY,
+    DB_CONN_PING,
+    DB_CONN_PARKED            // beyond the current pool size, closed
+} db_conn_state;
+
+typedef struct {
+    MYSQL *mysql;
+    db_conn_state state;
+    int wait_status;          // MYSQL_WAIT_* the pending call is blocked on
+    long long deadline_ms;    // for MYSQL_WAIT_TIMEOUT, 0 if none
+    long long started_us;     // start of the current query
+    long long last_used_ms;
+    long long retry_at_ms;    // next connect attempt while DOWN
+    int backoff_ms;
+    db_pool_job job;          // query in flight
+} db_conn;
+
+typedef struct {
+    const char *name;         // for logs
+    int size;                 // connection slots, the upper bound
+    int min_size;
+    int active;               // slots [0, active) are in use, the rest parked
+    int adaptive;             // min_size < size: scale and export the pool metrics
+    db_conn conns[DB_POOL_MAX_CONNS];
+
+    pthread_mutex_t lock;     // guards the queue
+    pthread_cond_t space;     // producers waiting for room
+    db_pool_job queue[DB_POOL_QUEUE_SIZE];
+    unsigned int head, tail;
+    int high_watermark;       // depth that turns backpressure on
+    int low_watermark;        // depth that turns it back off
+    volatile int backpressure;
+
+    int wake_fd[2];           // submit() -> pool thread
+    pthread_t thread;
+    volatile int stop;
+
+    // stats, written by the pool thread
+    volatile long submitted;
+    volatile long completed;
+    volatile long failed;
+    volatile long retried;
+    volatile long reconnects;
+    volatile long long latency_us_ewma;
+
+    // scaling, pool thread only
+    long long next_scale_ms;
+    long long interval_busy_us;     // statement time completed this interval
+    long interval_completed;
+    long interval_rows;             // rows of the statements completed this interval
+    long long best_row_ns;          // lowest interval time per row seen, drifts up slowly
+    int idle_intervals;
+} db_pool;
+
+void log_message(const char *level, const char *module, const char *format, ...);
+
+static inline long long db_pool_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static inline long long db_pool_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static inline int db_pool_depth(db_pool *pool) {
+    return (int)(pool->tail - pool->head);
+}
+
+static inline int db_pool_is_connection_error(unsigned int err) {
+    return err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST ||
+           err == CR_CONN_HOST_ERROR || err == CR_CONNECTION_ERROR;
+}
+
+static inline void db_pool_wake(db_pool *pool) {
+    char c = 1;
+    if (write(pool->wake_fd[1], &c, 1) < 0 && errno != EAGAIN) {
+        log_message("ERROR", "db_pool", "%s: wake pipe write failed\n", pool->name);
+    }
+}
+
+// Caller holds pool->lock
+static inline void db_pool_update_backpressure(db_pool *pool) {
+    int depth = db_pool_depth(pool);
+    if (!pool->backpressure && depth >= pool->high_watermark) {
+        pool->backpressure = 1;
+        log_message("ERROR", "db_pool", "%s: backpressure on, %d queries queued\n", pool->name, depth);
+    } else if (pool->backpressure && depth <= pool->low_watermark) {
+        pool->backpressure = 0;
+        log_message("INFO", "db_pool", "%s: backpressure off, %d queries queued\n", pool->name, depth);
+    }
+}
+
+// Caller holds pool->lock. Requeued jobs go to the front so statement order is kept.
+static inline void db_pool_requeue_front(db_pool *pool, db_pool_job *job) {
+    pool->head--;
+    pool->queue[pool->head & (DB_POOL_QUEUE_SIZE - 1)] = *job;
+}
+
+static inline int db_pool_submit_locked(db_pool *pool, const char *query, int rows, db_pool_done_fn done, void *arg) {
+    // keep room for jobs requeued from connections that dropped mid-query
+    if (db_pool_depth(pool) >= DB_POOL_QUEUE_SIZE - DB_POOL_MAX_CONNS) {
+        return DB_POOL_FULL;
+    }
+    db_pool_job *job = &pool->queue[pool->tail & (DB_POOL_QUEUE_SIZE - 1)];
+    job->length = strlen(query);
+    job->query = malloc(job->length + 1);
+    if (job->query == NULL) {
+        return DB_POOL_FULL;
+    }
+    memcpy(job->query, query, job->length + 1);
+    job->done = done;
+    job->arg = arg;
+    job->rows = rows > 0 ? rows : 1;
+    job->attempts = 0;
+    pool->tail++;
+    pool->submitted++;
+    db_pool_update_backpressure(pool);
+    return pool->backpressure ? DB_POOL_BACKPRESSURE : DB_POOL_OK;
+}
+
+// Queue a query writing `rows` rows without blocking. Returns DB_POOL_OK,
+// DB_POOL_BACKPRESSURE or DB_POOL_FULL.
+static inline int db_pool_submit(db_pool *pool, const char *query, int rows, db_pool_done_fn done, void *arg) {
+    pthread_mutex_lock(&pool->lock);
+    int rc = db_pool_submit_locked(pool, query, rows, done, arg);
+    pthread_mutex_unlock(&pool->lock);
+    if (rc != DB_POOL_FULL) {
+        db_pool_wake(pool);
+    }
+    return rc;
+}
+
+// Queue a query, waiting for room if the queue is full.
+static inline int db_pool_submit_wait(db_pool *pool, const char *query, int rows, db_pool_done_fn done, void *arg) {
+    pthread_mutex_lock(&pool->lock);
+    int rc;
+    while ((rc = db_pool_submit_locked(pool, query, rows, done, arg)) == DB_POOL_FULL) {
+        pthread_cond_wait(&pool->space, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    db_pool_wake(pool);
+    return rc;
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int finished;
+    int result;
+} db_pool_waiter;
+
+static inline void db_pool_waiter_done(void *arg, int result, const char *error) {
+    db_pool_waiter *waiter = arg;
+    pthread_mutex_lock(&waiter->lock);
+    waiter->finished = 1;
+    waiter->result = result;
+    pthread_cond_signal(&waiter->cond);
+    pthread_mutex_unlock(&waiter->lock);
+}
+
+// Run a query and wait for its outcome, DB_POOL_DONE or why it failed. Connection
+// errors are retried by the pool until the DB is back.
+static inline int db_pool_query(db_pool *pool, const char *query, int rows) {
+    db_pool_waiter waiter = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0};
+
+    db_pool_submit_wait(pool, query, rows, db_pool_waiter_done, &waiter);
+    pthread_mutex_lock(&waiter.lock);
+    while (!waiter.finished) {
+        pthread_cond_wait(&waiter.cond, &waiter.lock);
+    }
+    pthread_mutex_unlock(&waiter.lock);
+    return waiter.result;
+}
+
+// A set of independent queries run side by side on the pool's connections,
+// e.g. the statements of one bulk load. Wait for all of them with db_pool_group_wait().
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;
+    int conflicts;
+    int refused;
+} db_pool_group;
+
+static inline void db_pool_group_init(db_pool_group *group) {
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->cond, NULL);
+    group->pending = 0;
+    group->conflicts = 0;
+    group->refused = 0;
+}
+
+static inline void db_pool_group_done(void *arg, int result, const char *error) {
+    db_pool_group *group = arg;
+    pthread_mutex_lock(&group->lock);
+    group->conflicts += result == DB_POOL_CONFLICT;
+    group->refused += result == DB_POOL_REFUSED;
+    if (--group->pending == 0) {
+        pthread_cond_signal(&group->cond);
+    }
+    pthread_mutex_unlock(&group->lock);
+}
+
+// Queue one query of the group, waiting for room if the queue is full
+static inline void db_pool_group_submit(db_pool *pool, db_pool_group *group, const char *query, int rows) {
+    pthread_mutex_lock(&group->lock);
+    group->pending++;
+    pthread_mutex_unlock(&group->lock);
+    db_pool_submit_wait(pool, query, rows, db_pool_group_done, group);
+}
+
+// Wait until every query of the group finished. DB_POOL_DONE if all were done,
+// DB_POOL_REFUSED if the DB refused any, DB_POOL_CONFLICT otherwise.
+static inline int db_pool_group_wait(db_pool_group *group) {
+    pthread_mutex_lock(&group->lock);
+    while (group->pending > 0) {
+        pthread_cond_wait(&group->cond, &group->lock);
+    }
+    int result = group->refused > 0 ? DB_POOL_REFUSED : group->conflicts > 0 ? DB_POOL_CONFLICT : DB_POOL_DONE;
+    pthread_mutex_unlock(&group->lock);
+    pthread_mutex_destroy(&group->lock);
+    pthread_cond_destroy(&group->cond);
+    return result;
+}
+
+static inline void db_conn_wait(db_conn *c, int status) {
+    c->wait_status = status;
+    c->deadline_ms = (status & MYSQL_WAIT_TIMEOUT) ? db_pool_now_ms() + mysql_get_timeout_value_ms(c->mysql) : 0;
+}
+
+static inline void db_conn_down(db_pool *pool, db_conn *c) {
+    if (c->mysql) {
+        mysql_close(c->mysql);
+        c->mysql = NULL;
+    }
+    c->state = DB_CONN_DOWN;
+    c->wait_status = 0;
+    c->retry_at_ms = db_pool_now_ms() + c->backoff_ms;
+    c->backoff_ms = c->backoff_ms * 2 > DB_POOL_BACKOFF_MAX_MS ? DB_POOL_BACKOFF_MAX_MS : c->backoff_ms * 2;
+}
+
+static inline void db_conn_connected(db_pool *pool, db_conn *c, MYSQL *ret) {
+    if (ret == NULL) {
+        log_message("ERROR", "db_pool", "%s: connect failed: %s, retry in %d ms\n",
+                    pool->name, mysql_error(c->mysql), c->backoff_ms);
+        db_conn_down(pool, c);
+        return;
+    }
+    c->state = DB_CONN_IDLE;
+    c->wait_status = 0;
+    c->backoff_ms = 100;
+    c->last_used_ms = db_pool_now_ms();
+    log_message("INFO", "db_pool", "%s: connection %ld up\n", pool->name, (long)(c - pool->conns));
+}
+
+static inline void db_conn_start_connect(db_pool *pool, db_conn *c) {
+    unsigned int timeout = DB_POOL_TIMEOUT_SEC;
+    MYSQL *ret = NULL;
+
+    c->mysql = mysql_init(NULL);
+    if (c->mysql == NULL) {
+        log_message("ERROR", "db_pool", "%s: mysql_init() failed\n", pool->name);
+        db_conn_down(pool, c);
+        return;
+    }
+    mysql_options(c->mysql, MYSQL_OPT_NONBLOCK, 0);
+    mysql_options(c->mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+    mysql_options(c->mysql, MYSQL_OPT_READ_TIMEOUT, &timeout);
+    mysql_options(c->mysql, MYSQL_OPT_WRITE_TIMEOUT, &timeout);
+    pool->reconnects++;
+
+    c->state = DB_CONN_CONNECTING;
+    int status = mysql_real_connect_start(&ret, c->mysql, MYSQL_IP, MYSQL_USER, MYSQL_PW, MYSQL_DBNAME, 0, NULL, 0);
+    if (status) {
+        db_conn_wait(c, status);
+    } else {
+        db_conn_connected(pool, c, ret);
+    }
+}
+
+static inline void db_conn_query_finished(db_pool *pool, db_conn *c, int err) {
+    db_pool_job job = c->job;
+    c->state = DB_CONN_IDLE;
+    c->wait_status = 0;
+    c->last_used_ms = db_pool_now_ms();
+
+    long long latency_us = db_pool_now_us() - c->started_us;
+    pool->interval_busy_us += latency_us;
+    if (err == 0) {
+        pool->latency_us_ewma = pool->latency_us_ewma ? (pool->latency_us_ewma * 7 + latency_us) / 8 : latency_us;
+        pool->interval_completed++;
+        pool->interval_rows += job.rows;
+        pool->completed++;
+        if (job.done) {
+            job.done(job.arg, DB_POOL_DONE, NULL);
+        }
+        free(job.query);
+        return;
+    }
+
+    unsigned int errnum = mysql_errno(c->mysql);
+    if (db_pool_is_connection_error(errnum)) {
+        // the statement may not have run: put it back and reconnect
+        log_message("ERROR", "db_pool", "%s: connection lost: %s\n", pool->name, mysql_error(c->mysql));
+        pthread_mutex_lock(&pool->lock);
+        db_pool_requeue_front(pool, &job);
+        pthread_mutex_unlock(&pool->lock);
+        pool->retried++;
+        db_conn_down(pool, c);
+        return;
+    }
+    if ((errnum == ER_LOCK_DEADLOCK_CODE || errnum == ER_LOCK_WAIT_TIMEOUT_CODE) && ++job.attempts < DB_POOL_RETRY_MAX) {
+        pthread_mutex_lock(&pool->lock);
+        db_pool_requeue_front(pool, &job);
+        pthread_mutex_unlock(&pool->lock);
+        pool->retried++;
+        return;
+    }
+
+    log_message("ERROR", "db_pool", "%s: query failed: %s\n", pool->name, mysql_error(c->mysql));
+    pool->failed++;
+    if (job.done) {
+        int lock = errnum == ER_LOCK_DEADLOCK_CODE || errnum == ER_LOCK_WAIT_TIMEOUT_CODE;
+        job.done(job.arg, lock ? DB_POOL_CONFLICT : DB_POOL_REFUSED, mysql_error(c->mysql));
+    }
+    free(job.query);
+}
+
+static inline void db_conn_start_query(db_pool *pool, db_conn *c, db_pool_job *job) {
+    int err = 0;
+    c->job = *job;
+    c->state = DB_CONN_QUERY;
+    c->started_us = db_pool_now_us();
+    int status = mysql_real_query_start(&err, c->mysql, job->query, job->length);
+    if (status) {
+        db_conn_wait(c, status);
+    } else {
+        db_conn_query_finished(pool, c, err);
+    }
+}
+
+static inline void db_conn_ping_finished(db_pool *pool, db_conn *c, int err) {
+    if (err) {
+        log_message("ERROR", "db_pool", "%s: health check failed: %s\n", pool->name, mysql_error(c->mysql));
+        db_conn_down(pool, c);
+        return;
+    }
+    c->state = DB_CONN_IDLE;
+    c->wait_status = 0;
+    c->last_used_ms = db_pool_now_ms();
+}
+
+static inline void db_conn_start_ping(db_pool *pool, db_conn *c) {
+    int err = 0;
+    c->state = DB_CONN_PING;
+    int status = mysql_ping_start(&err, c->mysql);
+    if (status) {
+        db_conn_wait(c, status);
+    } else {
+        db_conn_ping_finished(pool, c, err);
+    }
+}
+
+// Resume a pending async call once its socket is ready or its timer expired
+static inline void db_conn_continue(db_pool *pool, db_conn *c, int ready) {
+    int status;
+    int err = 0;
+    MYSQL *ret = NULL;
+
+    switch (c->state) {
+    case DB_CONN_CONNECTING:
+        status = mysql_real_connect_cont(&ret, c->mysql, ready);
+        if (status) {
+            db_conn_wait(c, status);
+        } else {
+            db_conn_connected(pool, c, ret);
+        }
+        break;
+    case DB_CONN_QUERY:
+        status = mysql_real_query_cont(&err, c->mysql, ready);
+        if (status) {
+            db_conn_wait(c, status);
+        } else {
+            db_conn_query_finished(pool, c, err);
+        }
+        break;
+    case DB_CONN_PING:
+        status = mysql_ping_cont(&err, c->mysql, ready);
+        if (status) {
+            db_conn_wait(c, status);
+        } else {
+            db_conn_ping_finished(pool, c, err);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static inline void db_conn_park(db_pool *pool, db_conn *c) {
+    if (c->mysql) {
+        mysql_close(c->mysql);
+        c->mysql = NULL;
+    }
+    c->state = DB_CONN_PARKED;
+    c->wait_status = 0;
+    log_message("INFO", "db_pool", "%s: connection %ld closed\n", pool->name, (long)(c - pool->conns));
+}
+
+// One scaling decision per interval, see the top of the file
+static inline void db_pool_scale(db_pool *pool, long long now) {
+    long long interval_us = (now - pool->next_scale_ms + DB_POOL_SCALE_INTERVAL_MS) * 1000LL;
+    int open = 0;
+    for (int i = 0; i < pool->active; i++) {
+        open += pool->conns[i].state != DB_CONN_DOWN && pool->conns[i].state != DB_CONN_CONNECTING;
+    }
+    int util = open > 0 && interval_us > 0 ? (int)(pool->interval_busy_us * 100 / (interval_us * open)) : 0;
+    long long latency_us = pool->interval_completed ? pool->interval_busy_us / pool->interval_completed : 0;
+    // batches grow with the load, so the DB is judged by its time per row
+    long long row_ns = pool->interval_rows ? pool->interval_busy_us * 1000 / pool->interval_rows : 0;
+    if (row_ns > 0) {
+        pool->best_row_ns = pool->best_row_ns == 0 || row_ns < pool->best_row_ns
+                          ? row_ns : pool->best_row_ns + pool->best_row_ns / 64;
+    }
+    int depth = db_pool_depth(pool);
+    int db_slow = row_ns > pool->best_row_ns * DB_POOL_LATENCY_SHRINK_LIMIT;
+    pool->idle_intervals = depth == 0 && util < DB_POOL_SHRINK_UTIL ? pool->idle_intervals + 1 : 0;
+
+    if (pool->active < pool->size && depth > open && util >= DB_POOL_GROW_UTIL
+            && row_ns <= pool->best_row_ns * DB_POOL_LATENCY_GROW_LIMIT) {
+        db_conn *c = &pool->conns[pool->active++];
+        if (c->state == DB_CONN_PARKED) {
+            c->state = DB_CONN_DOWN;    // connects on this pass, gets work once connected
+            c->retry_at_ms = now;
+            c->backoff_ms = 100;
+        }                               // else retired but still open: simply kept
+        fep_counter_add(FEP_M_DB_POOL_GROWS, 1);
+        log_message("INFO", "db_pool", "%s: growing to %d connections (%d queued, %d%% busy, %lld ns/row)\n",
+                    pool->name, pool->active, depth, util, row_ns);
+    } else if (pool->active > pool->min_size && (pool->idle_intervals >= DB_POOL_IDLE_INTERVALS || (db_slow && depth > 0))) {
+        pool->active--;             // parked by the pool loop once its statement is done
+        pool->idle_intervals = 0;
+        fep_counter_add(FEP_M_DB_POOL_SHRINKS, 1);
+        log_message("INFO", "db_pool", "%s: shrinking to %d connections (%d queued, %d%% busy, %lld ns/row, best %lld ns/row)\n",
+                    pool->name, pool->active, depth, util, row_ns, pool->best_row_ns);
+    }
+
+    fep_gauge_set(FEP_G_DB_CONNS, pool->active);
+    fep_gauge_set(FEP_G_DB_UTIL_PCT, util);
+    fep_gauge_set(FEP_G_DB_LATENCY_US, latency_us);
+    pool->interval_busy_us = 0;
+    pool->interval_completed = 0;
+    pool->interval_rows = 0;
+    pool->next_scale_ms = now + DB_POOL_SCALE_INTERVAL_MS;
+}
+
+static inline void *db_pool_thread(void *arg) {
+    db_pool *pool = arg;
+    struct pollfd fds[DB_POOL_MAX_CONNS + 1];
+    int owner[DB_POOL_MAX_CONNS + 1];
+
+    fep_affinity_pin(FEP_ROLE_DB_WORKER);
+
+    while (!pool->stop) {
+        long long now = db_pool_now_ms();
+        int timeout = DB_POOL_HEALTH_INTERVAL_MS;
+
+        if (pool->adaptive) {
+            if (now >= pool->next_scale_ms) {
+                db_pool_scale(pool, now);
+            }
+            timeout = (int)(pool->next_scale_ms - now);
+        }
+        for (int i = 0; i < pool->size; i++) {
+            db_conn *c = &pool->conns[i];
+            if (i >= pool->active) {
+                // retired: close once nothing is in flight on it
+                if (c->state == DB_CONN_IDLE || c->state == DB_CONN_DOWN) {
+                    db_conn_park(pool, c);
+                }
+                continue;
+            }
+            if (c->state == DB_CONN_DOWN && now >= c->retry_at_ms) {
+                db_conn_start_connect(pool, c);
+            }
+            if (c->state == DB_CONN_IDLE) {
+                db_pool_job job;
+                int has_job = 0;
+                pthread_mutex_lock(&pool->lock);
+                if (db_pool_depth(pool) > 0) {
+                    job = pool->queue[pool->head & (DB_POOL_QUEUE_SIZE - 1)];
+                    pool->head++;
+                    has_job = 1;
+                    fep_gauge_set(FEP_G_INSERT_QUEUE, db_pool_depth(pool));
+                    db_pool_update_backpressure(pool);
+                    pthread_cond_broadcast(&pool->space);
+                }
+                pthread_mutex_unlock(&pool->lock);
+
+                if (has_job) {
+                    db_conn_start_query(pool, c, &job);
+                } else if (now - c->last_used_ms >= DB_POOL_HEALTH_INTERVAL_MS) {
+                    db_conn_start_ping(pool, c);
+                }
+            }
+        }
+
+        int nfds = 0;
+        fds[nfds].fd = pool->wake_fd[0];
+        fds[nfds].events = POLLIN;
+        owner[nfds++] = -1;
+        for (int i = 0; i < pool->size; i++) {
+            db_conn *c = &pool->conns[i];
+            if (c->state == DB_CONN_PARKED) {
+                continue;
+            }
+            if (c->state == DB_CONN_DOWN) {
+                int until_retry = (int)(c->retry_at_ms - now);
+                timeout = until_retry < timeout ? (until_retry > 0 ? until_retry : 0) : timeout;
+                continue;
+            }
+            if (!c->wait_status) {
+                continue;
+            }
+            fds[nfds].fd = mysql_get_socket(c->mysql);
+            fds[nfds].events = (c->wait_status & MYSQL_WAIT_READ ? POLLIN : 0) |
+                               (c->wait_status & MYSQL_WAIT_WRITE ? POLLOUT : 0) |
+                               (c->wait_status & MYSQL_WAIT_EXCEPT ? POLLPRI : 0);
+            owner[nfds++] = i;
+            if (c->deadline_ms) {
+                int until_deadline = (int)(c->deadline_ms - now);
+                timeout = until_deadline < timeout ? (until_deadline > 0 ? until_deadline : 0) : timeout;
+            }
+        }
+
+        if (poll(fds, nfds, timeout) < 0 && errno != EINTR) {
+            log_message("ERROR", "db_pool", "%s: poll failed: %s\n", pool->name, strerror(errno));
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char drain[64];
+            while (read(pool->wake_fd[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+
+        now = db_pool_now_ms();
+        for (int k = 1; k < nfds; k++) {
+            db_conn *c = &pool->conns[owner[k]];
+            int ready = 0;
+            if (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ready |= MYSQL_WAIT_READ;
+            }
+            if (fds[k].revents & POLLOUT) {
+                ready |= MYSQL_WAIT_WRITE;
+            }
+            if (fds[k].revents & POLLPRI) {
+                ready |= MYSQL_WAIT_EXCEPT;
+            }
+            if (c->deadline_ms && now >= c->deadline_ms) {
+                ready |= MYSQL_WAIT_TIMEOUT;
+            }
+            if (ready) {
+                db_conn_continue(pool, c, ready);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Create a pool of min_size to max_size connections. FEP_DB_POOL_MIN and
+// FEP_DB_POOL_MAX override the bounds, FEP_DB_POOL_SIZE fixes the size.
+static inline db_pool *db_pool_create(const char *name, int min_size, int max_size) {
+    const char *min_env = getenv("FEP_DB_POOL_MIN");
+    const char *max_env = getenv("FEP_DB_POOL_MAX");
+    const char *size_env = getenv("FEP_DB_POOL_SIZE");
+    if (min_env != NULL && atoi(min_env) > 0) {
+        min_size = atoi(min_env);
+    }
+    if (max_env != NULL && atoi(max_env) > 0) {
+        max_size = atoi(max_env);
+    }
+    if (size_env != NULL && atoi(size_env) > 0) {
+        min_size = max_size = atoi(size_env);
+    }
+    int size = max_size > DB_POOL_MAX_CONNS ? DB_POOL_MAX_CONNS : max_size < 1 ? 1 : max_size;
+    min_size = min_size < 1 ? 1 : min_size > size ? size : min_size;
+
+    db_pool *pool = calloc(1, sizeof(db_pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->name = name;
+    pool->size = size;
+    pool->min_size = min_size;
+    pool->active = min_size;
+    pool->adaptive = min_size < size;
+    pool->next_scale_ms = db_pool_now_ms() + DB_POOL_SCALE_INTERVAL_MS;
+    pool->high_watermark = DB_POOL_QUEUE_SIZE * 3 / 4;
+    pool->low_watermark = DB_POOL_QUEUE_SIZE / 4;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->space, NULL);
+    for (int i = 0; i < size; i++) {
+        pool->conns[i].state = i < min_size ? DB_CONN_DOWN : DB_CONN_PARKED;
+        pool->conns[i].backoff_ms = 100;
+    }
+
+    if (pipe(pool->wake_fd) == -1) {
+        log_message("ERROR", "db_pool", "%s: pipe failed\n", name);
+        free(pool);
+        return NULL;
+    }
+    fcntl(pool->wake_fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(pool->wake_fd[1], F_SETFL, O_NONBLOCK);
+
+    if (pthread_create(&pool->thread, NULL, db_pool_thread, pool) != 0) {
+        log_message("ERROR", "db_pool", "%s: failed to start pool thread\n", name);
+        close(pool->wake_fd[0]);
+        close(pool->wake_fd[1]);
+        free(pool);
+        return NULL;
+    }
+    if (pool->adaptive) {
+        fep_gauge_set(FEP_G_DB_CONNS, min_size);
+        log_message("INFO", "db_pool", "%s: pool started with %d connections, up to %d\n", name, min_size, size);
+    } else {
+        log_message("INFO", "db_pool", "%s: pool started with %d connections\n", name, size);
+    }
+    return pool;
+}
+
+#endif //DB_POOL_H
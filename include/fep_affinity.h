@@ -0,0 +1,248 @@
+#ifndef FEP_AFFINITY_H
+#define FEP_AFFINITY_H
+
+// CPU and NUMA placement of the FEP threads by role.
+//
+// FEP_AFFINITY maps roles to CPU sets, e.g.
+//     FEP_AFFINITY="reactor=2;sender=3;listener=4;updator=5;inserter=6;db_worker=node1"
+// A set is a cpu list ("2", "2,3", "8-11") or "nodeN" for every cpu of NUMA node N.
+// A role without an entry is not pinned: it runs on the cpus the process started
+// with, even in a thread created by a pinned one. Memory owned by a role (rings, buffers) is
+// placed on the node of its first cpu with fep_affinity_bind_memory().
+//
+// Each thread calls fep_affinity_pin() for its own role when it starts, and the
+// placement is logged so it can be checked against lscpu / numactl -H.
+// Needs _GNU_SOURCE before the first system header for pthread_setaffinity_np.
+
+#ifndef _GNU_SOURCE
+#error "define _GNU_SOURCE before any #include to use fep_affinity.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#define FEP_AFFINITY_ENV "FEP_AFFINITY"
+#define FEP_AFFINITY_MAX_NODES 64
+#define FEP_NODE_PATH "/sys/devices/system/node"
+#define FEP_MPOL_PREFERRED 1            // linux/mempolicy.h
+
+#define FEP_ROLES(R) \
+    R(FEP_ROLE_REACTOR,   "reactor")   /* OMS socket reactor: oms_listener, integrated */ \
+    R(FEP_ROLE_SENDER,    "sender")    /* journal -> KRX: krx_sender, integrated */ \
+    R(FEP_ROLE_LISTENER,  "listener")  /* KRX executions: krx_listener, integrated */ \
+    R(FEP_ROLE_UPDATOR,   "updator")   /* status writer: db_updator, integrated */ \
+    R(FEP_ROLE_INSERTER,  "inserter")  /* tx_history INSERT batches: db_inserter */ \
+    R(FEP_ROLE_DB_WORKER, "db_worker") /* db_pool thread, sqlite writer thread */ \
+    R(FEP_ROLE_CLOCK,     "clock")     /* fep_clockd, the shared clock page */ \
+    R(FEP_ROLE_REPLICATOR, "replicator") /* fep_replicator and fep_standby */
+
+#define FEP_ROLE_ENUM(id, name) id,
+#define FEP_ROLE_NAME(id, name) name,
+enum { FEP_ROLES(FEP_ROLE_ENUM) FEP_ROLE_COUNT };
+static const char *fep_role_names[FEP_ROLE_COUNT] = { FEP_ROLES(FEP_ROLE_NAME) };
+
+typedef struct {
+    int configured;
+    cpu_set_t cpus;
+    int node;               // memory node, -1 if unknown
+} fep_placement;
+
+static fep_placement fep_placements[FEP_ROLE_COUNT];
+static cpu_set_t fep_original_cpus;     // of the first caller, before anything was pinned
+static int fep_original_known = 0;
+static pthread_once_t fep_affinity_once = PTHREAD_ONCE_INIT;
+static int fep_node_count = 0;
+
+void log_message(const char *level, const char *module, const char *format, ...);
+
+// "0-3,8,10-11" -> set. Returns the number of cpus, -1 if malformed.
+static inline int fep_parse_cpulist(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char *p = list;
+    while (*p != '\0' && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0) {
+            return -1;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return -1;
+            }
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        p = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0' && *end != '\n') {
+            return -1;
+        }
+    }
+    return CPU_COUNT(set);
+}
+
+// cpus of a NUMA node from sysfs. Returns 0 on success.
+static inline int fep_node_cpus(int node, cpu_set_t *set) {
+    char path[128], list[1024];
+    snprintf(path, sizeof(path), FEP_NODE_PATH "/node%d/cpulist", node);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    int ok = fgets(list, sizeof(list), f) != NULL && fep_parse_cpulist(list, set) > 0;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+// NUMA node of a cpu, 0 on machines without node information
+static inline int fep_cpu_node(int cpu) {
+    cpu_set_t set;
+    for (int node = 0; node < FEP_AFFINITY_MAX_NODES; node++) {
+        if (fep_node_cpus(node, &set) == 0 && CPU_ISSET(cpu, &set)) {
+            return node;
+        }
+    }
+    return 0;
+}
+
+static inline int fep_first_cpu(const cpu_set_t *set) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, set)) {
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+static inline void fep_affinity_load(void) {
+    cpu_set_t set;
+    fep_original_known = sched_getaffinity(0, sizeof(cpu_set_t), &fep_original_cpus) == 0;
+    for (int node = 0; node < FEP_AFFINITY_MAX_NODES; node++) {
+        if (fep_node_cpus(node, &set) == 0) {
+            fep_node_count = node + 1;
+        }
+    }
+
+    const char *env = getenv(FEP_AFFINITY_ENV);
+    if (env == NULL || env[0] == '\0') {
+        return;
+    }
+    char config[1024];
+    strncpy(config, env, sizeof(config) - 1);
+    config[sizeof(config) - 1] = '\0';
+
+    char *save = NULL;
+    for (char *entry = strtok_r(config, "; ", &save); entry != NULL; entry = strtok_r(NULL, "; ", &save)) {
+        char *value = strchr(entry, '=');
+        int role = -1;
+        if (value != NULL) {
+            *value++ = '\0';
+            for (int r = 0; r < FEP_ROLE_COUNT; r++) {
+                if (strcmp(entry, fep_role_names[r]) == 0) {
+                    role = r;
+                }
+            }
+        }
+        if (role < 0) {
+            log_message("ERROR", "affinity", "%s: unknown role in '%s'\n", FEP_AFFINITY_ENV, entry);
+            continue;
+        }
+
+        fep_placement *placement = &fep_placements[role];
+        if (strncmp(value, "node", 4) == 0) {
+            placement->node = atoi(value + 4);
+            if (fep_node_cpus(placement->node, &placement->cpus) != 0) {
+                log_message("ERROR", "affinity", "%s: %s has no cpus\n", fep_role_names[role], value);
+                continue;
+            }
+        } else if (fep_parse_cpulist(value, &placement->cpus) > 0) {
+            placement->node = fep_cpu_node(fep_first_cpu(&placement->cpus));
+        } else {
+            log_message("ERROR", "affinity", "%s: bad cpu list '%s'\n", fep_role_names[role], value);
+            continue;
+        }
+        placement->configured = 1;
+    }
+}
+
+static inline void fep_affinity_init(void) {
+    pthread_once(&fep_affinity_once, fep_affinity_load);
+}
+
+// Place a role on one cpu unless FEP_AFFINITY already does
+static inline void fep_affinity_default(int role, int cpu) {
+    fep_affinity_init();
+    fep_placement *placement = &fep_placements[role];
+    if (!placement->configured && cpu >= 0 && cpu < CPU_SETSIZE) {
+        CPU_ZERO(&placement->cpus);
+        CPU_SET(cpu, &placement->cpus);
+        placement->node = fep_cpu_node(cpu);
+        placement->configured = 1;
+    }
+}
+
+// Pin the calling thread to its role's cpus and log where it runs. A thread of a
+// role without placement gets the original cpus back instead of its creator's.
+static inline void fep_affinity_pin(int role) {
+    char list[256];
+    int len = 0;
+
+    fep_affinity_init();
+    fep_placement *placement = &fep_placements[role];
+    if (!placement->configured) {
+        if (fep_original_known) {
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &fep_original_cpus);
+        }
+        log_message("INFO", "affinity", "%s is not pinned, running on cpu %d\n", fep_role_names[role], sched_getcpu());
+        return;
+    }
+    list[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE && len < (int)sizeof(list) - 8; cpu++) {
+        if (CPU_ISSET(cpu, &placement->cpus)) {
+            len += snprintf(list + len, sizeof(list) - len, "%s%d", len ? "," : "", cpu);
+        }
+    }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &placement->cpus) != 0) {
+        log_message("ERROR", "affinity", "%s could not be pinned to cpus %s\n", fep_role_names[role], list);
+        return;
+    }
+    log_message("INFO", "affinity", "%s pinned to cpus %s (node %d of %d), running on cpu %d\n",
+                fep_role_names[role], list, placement->node, fep_node_count > 0 ? fep_node_count : 1, sched_getcpu());
+}
+
+// Prefer the role's node for the pages of [addr, addr + len). Call before the memory
+// is first touched; pages already faulted in stay where they are. Partial pages at
+// either end are left to the first-touch default.
+static inline void fep_affinity_bind_memory(void *addr, size_t len, int role, const char *what) {
+    fep_affinity_init();
+    fep_placement *placement = &fep_placements[role];
+    if (fep_node_count < 2 || !placement->configured || placement->node < 0) {
+        return;     // one node or no placement: nothing to choose
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)addr + page - 1) & ~(uintptr_t)(page - 1);
+    uintptr_t end = ((uintptr_t)addr + len) & ~(uintptr_t)(page - 1);
+    unsigned long nodemask[FEP_AFFINITY_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+    nodemask[placement->node / (8 * sizeof(unsigned long))] |= 1UL << (placement->node % (8 * sizeof(unsigned long)));
+
+    if (end <= start) {
+        return;
+    }
+    if (syscall(SYS_mbind, start, end - start, FEP_MPOL_PREFERRED, nodemask, FEP_AFFINITY_MAX_NODES + 1, 0) != 0) {
+        log_message("ERROR", "affinity", "%s could not be placed on node %d\n", what, placement->node);
+    } else {
+        log_message("INFO", "affinity", "%s (%zu KB) placed on node %d with %s\n",
+                    what, (size_t)(end - start) / 1024, placement->node, fep_role_names[role]);
+    }
+}
+
+#endif //FEP_AFFINITY_H
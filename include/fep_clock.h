@@ -0,0 +1,201 @@
+#ifndef FEP_CLOCK_H
+#define FEP_CLOCK_H
+
+// Shared KST clock page "/fep_clock".
+//
+// fep_clockd rewrites the page every millisecond: epoch, UTC offset and the two
+// strings the FEP formats all day, the order time "YYYYMMDDHHMMSS" and the log stamp
+// "YYYY-MM-DD HH:MM:SS.mmm". Readers copy them out under a seqlock instead of calling
+// gettimeofday + localtime + strftime. The date part is only reformatted when the
+// second changes; the other ticks rewrite the milliseconds.
+//
+// Readers map the page read-only. While it is missing or the updater stopped (no
+// tick for FEP_CLOCK_STALE_MS), they format locally as before and look for the page
+// again once a second, so fep_clockd may start, stop and restart at any time.
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define FEP_CLOCK_SHM_NAME "/fep_clock"
+#define FEP_CLOCK_MAGIC 0x4645434Bu     // "FECK"
+#define FEP_CLOCK_VERSION 1
+#define FEP_CLOCK_STALE_MS 50           // older than this and readers format locally
+#define FEP_CLOCK_ORDER_TIME_LEN 14     // YYYYMMDDHHMMSS
+#define FEP_CLOCK_LOG_TIME_LEN 23       // YYYY-MM-DD HH:MM:SS.mmm
+#define FEP_CLOCK_ORDER_TIME_FORMAT "%Y%m%d%H%M%S"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pid;                       // updater
+    _Alignas(64) uint32_t seq;          // odd while the updater is writing
+    int64_t epoch_ms;                   // UTC
+    int32_t utc_offset_s;               // +32400 for KST
+    char order_time[FEP_CLOCK_ORDER_TIME_LEN + 1];
+    char log_time[FEP_CLOCK_LOG_TIME_LEN + 1];
+} fep_clock_page;
+
+static const fep_clock_page *fep_clock = NULL;
+static ino_t fep_clock_ino = 0;
+static time_t fep_clock_retry_at = 0;
+
+// Map the page for reading. 0 on success. Threads may race here: a replaced page
+// (the shm object was unlinked and created again) is left mapped, not unmapped
+// under a reader.
+static inline int fep_clock_open() {
+    int fd = shm_open(FEP_CLOCK_SHM_NAME, O_RDONLY, 0);
+    struct stat st;
+
+    if (fd == -1) {
+        return -1;
+    }
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(fep_clock_page)) {
+        close(fd);
+        return -1;
+    }
+    if (__atomic_load_n(&fep_clock, __ATOMIC_ACQUIRE) != NULL && st.st_ino == fep_clock_ino) {
+        close(fd);
+        return 0;   // same page, the updater restarts on it
+    }
+    const fep_clock_page *page = mmap(NULL, sizeof(fep_clock_page), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        return -1;
+    }
+    if (__atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != FEP_CLOCK_MAGIC || page->version != FEP_CLOCK_VERSION) {
+        munmap((void *)page, sizeof(fep_clock_page));
+        return -1;
+    }
+    fep_clock_ino = st.st_ino;
+    __atomic_store_n(&fep_clock, page, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Copy len bytes at offset out of the page under the seqlock. 0 when the page is
+// missing or stale: the caller formats locally.
+static inline int fep_clock_copy(size_t offset, void *out, size_t len) {
+    const fep_clock_page *page = __atomic_load_n(&fep_clock, __ATOMIC_ACQUIRE);
+    struct timespec now;
+
+    if (page != NULL) {
+        int64_t epoch_ms;
+        uint32_t seq;
+        do {
+            seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+            epoch_ms = page->epoch_ms;
+            memcpy(out, (const char *)page + offset, len);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        } while ((seq & 1) || seq != __atomic_load_n(&page->seq, __ATOMIC_RELAXED));
+
+        // vDSO, no syscall
+        clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        int64_t age_ms = now.tv_sec * 1000LL + now.tv_nsec / 1000000 - epoch_ms;
+        if (age_ms < FEP_CLOCK_STALE_MS && age_ms > -FEP_CLOCK_STALE_MS) {
+            return 1;
+        }
+    } else {
+        clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    }
+    if (now.tv_sec >= fep_clock_retry_at) {
+        fep_clock_retry_at = now.tv_sec + 1;
+        fep_clock_open();
+    }
+    return 0;
+}
+
+// the "mmm" of a log stamp
+static inline void fep_clock_put_ms(char *log_time, int ms) {
+    log_time[20] = '0' + ms / 100;
+    log_time[21] = '0' + ms / 10 % 10;
+    log_time[22] = '0' + ms % 10;
+}
+
+// Formatted here, without the page
+static inline void fep_clock_log_time_local(char *out) {
+    struct timeval tv;
+    struct tm tm_info;
+    gettimeofday(&tv, NULL);
+    localtime_r(&tv.tv_sec, &tm_info);
+    strftime(out, FEP_CLOCK_LOG_TIME_LEN + 1, "%Y-%m-%d %H:%M:%S.000", &tm_info);
+    fep_clock_put_ms(out, (int)(tv.tv_usec / 1000));
+}
+
+static inline void fep_clock_order_time_local(char *out) {
+    time_t now = time(NULL);
+    struct tm tm_info;
+    localtime_r(&now, &tm_info);
+    strftime(out, FEP_CLOCK_ORDER_TIME_LEN + 1, FEP_CLOCK_ORDER_TIME_FORMAT, &tm_info);
+}
+
+// "YYYY-MM-DD HH:MM:SS.mmm" of now, local time. out has room for FEP_CLOCK_LOG_TIME_LEN + 1.
+static inline void fep_clock_log_time(char *out) {
+    if (!fep_clock_copy(offsetof(fep_clock_page, log_time), out, FEP_CLOCK_LOG_TIME_LEN + 1)) {
+        fep_clock_log_time_local(out);
+    }
+}
+
+// "YYYYMMDDHHMMSS" of now, local time. out has room for FEP_CLOCK_ORDER_TIME_LEN + 1.
+static inline void fep_clock_order_time(char *out) {
+    if (!fep_clock_copy(offsetof(fep_clock_page, order_time), out, FEP_CLOCK_ORDER_TIME_LEN + 1)) {
+        fep_clock_order_time_local(out);
+    }
+}
+
+// Updater side, one thread only. Call at least every millisecond.
+typedef struct {
+    fep_clock_page *page;
+    time_t second;                      // the second the strings were formatted for
+    char order_time[FEP_CLOCK_ORDER_TIME_LEN + 1];
+    char log_time[FEP_CLOCK_LOG_TIME_LEN + 1];
+    int32_t utc_offset_s;
+} fep_clock_writer;
+
+static inline void fep_clock_writer_init(fep_clock_writer *writer, fep_clock_page *page) {
+    memset(writer, 0, sizeof(fep_clock_writer));
+    writer->page = page;
+    writer->second = -1;
+    page->version = FEP_CLOCK_VERSION;
+    page->pid = (uint32_t)getpid();
+}
+
+static inline void fep_clock_update(fep_clock_writer *writer) {
+    fep_clock_page *page = writer->page;
+    struct timespec now;
+    int ms;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    ms = (int)(now.tv_nsec / 1000000);
+    if (now.tv_sec != writer->second) {
+        struct tm tm_info;
+        localtime_r(&now.tv_sec, &tm_info);
+        strftime(writer->order_time, sizeof(writer->order_time), FEP_CLOCK_ORDER_TIME_FORMAT, &tm_info);
+        strftime(writer->log_time, sizeof(writer->log_time), "%Y-%m-%d %H:%M:%S.000", &tm_info);
+        writer->utc_offset_s = (int32_t)tm_info.tm_gmtoff;
+        writer->second = now.tv_sec;
+    }
+    fep_clock_put_ms(writer->log_time, ms);
+
+    uint32_t seq = page->seq;
+    __atomic_store_n(&page->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    page->epoch_ms = now.tv_sec * 1000LL + ms;
+    page->utc_offset_s = writer->utc_offset_s;
+    memcpy(page->order_time, writer->order_time, sizeof(page->order_time));
+    memcpy(page->log_time, writer->log_time, sizeof(page->log_time));
+    __atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE);
+
+    if (page->magic != FEP_CLOCK_MAGIC) {
+        __atomic_store_n(&page->magic, FEP_CLOCK_MAGIC, __ATOMIC_RELEASE);
+    }
+}
+
+#endif //FEP_CLOCK_H
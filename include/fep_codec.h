@@ -0,0 +1,147 @@
+#ifndef FEP_CODEC_H
+#define FEP_CODEC_H
+
+// Zero-copy codec over the wire structs: read-only views of receive buffers and
+// builders that fill a send buffer in place, padding included, with no memset.
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <oms_fep_krx_struct.h>
+
+#define FEP_RX_SIZE 4096            // receive buffer per connection
+
+// tr_id of a received message, -1 if not even the header has arrived
+static inline int fep_msg_tr_id(const void *buf, size_t len) {
+    if (len < sizeof(hdr)) {
+        return -1;
+    }
+    return ((const hdr *)buf)->tr_id;
+}
+
+// fep_view_<name>(buf, len): the buffer as a const <name>, or NULL if it is
+// shorter than the message or not aligned for it. tr_id is left to the caller.
+#define FEP_VIEW_DECL(name, tr_id, size, FIELDS) \
+    static inline const name *fep_view_##name(const void *buf, size_t len) { \
+        if (len < sizeof(name) || ((uintptr_t)buf & (_Alignof(name) - 1)) != 0) { \
+            return NULL; \
+        } \
+        return (const name *)buf; \
+    }
+FEP_MESSAGES(FEP_VIEW_DECL)
+
+// Per-connection receive buffer for a poll loop. Bytes accumulate over recv()s and
+// only whole messages are handed out, so a message split over two segments waits
+// for its tail instead of shifting every later one, and a slow sender never holds
+// up the other connections.
+typedef struct {
+    _Alignas(16) char buf[FEP_RX_SIZE];
+    size_t len;                     // bytes received
+    size_t off;                     // bytes handed out
+} fep_rx;
+
+static inline void fep_rx_reset(fep_rx *rx) {
+    rx->len = rx->off = 0;
+}
+
+// One recv() into the free space, after moving a partial message to the front.
+// recv()'s result: 0 when the peer closed, -1 on error.
+static inline ssize_t fep_rx_recv(fep_rx *rx, int fd) {
+    if (rx->off > 0) {
+        memmove(rx->buf, rx->buf + rx->off, rx->len - rx->off);
+        rx->len -= rx->off;
+        rx->off = 0;
+    }
+    ssize_t n = recv(fd, rx->buf + rx->len, sizeof(rx->buf) - rx->len, 0);
+    if (n > 0) {
+        rx->len += n;
+    }
+    return n;
+}
+
+// The next whole message of size bytes, NULL until all of it has arrived. Messages
+// are multiples of their alignment, so fep_view_<name>() accepts the result.
+static inline const void *fep_rx_next(fep_rx *rx, size_t size) {
+    if (rx->len - rx->off < size) {
+        return NULL;
+    }
+    const void *message = rx->buf + rx->off;
+    rx->off += size;
+    return message;
+}
+
+// Copy a fixed-width field of the same width and terminate it. A constant-size
+// memcpy compiles to a couple of moves, unlike strncpy's byte loop and zero fill.
+#define FEP_COPY_FIELD(dst, src) do { \
+        _Static_assert(sizeof(dst) == sizeof(src), "field widths differ"); \
+        memcpy((dst), (src), sizeof(dst) - 1); \
+        (dst)[sizeof(dst) - 1] = '\0'; \
+    } while (0)
+
+// Copy a C string into a fixed-width field, zero filled
+static inline void fep_copy_str(char *dst, size_t size, const char *src) {
+    size_t i = 0;
+    for (; i < size - 1 && src[i] != '\0'; i++) {
+        dst[i] = src[i];
+    }
+    for (; i < size; i++) {
+        dst[i] = '\0';
+    }
+}
+
+// fep_build_fot_order_is_submitted / fep_build_kft_order(buf, order, reject_code):
+// the ack for order written over buf, every byte set.
+#define FEP_BUILD_ORDER_ACK(name) \
+    static inline name *fep_build_##name(void *buf, const fkq_order *order, const char *reject_code) { \
+        name *ack = buf; \
+        ack->hdr.tr_id = FEP_TR_##name; \
+        ack->hdr.length = sizeof(name); \
+        FEP_COPY_FIELD(ack->transaction_code, order->transaction_code); \
+        ack->padding1 = 0; \
+        FEP_COPY_FIELD(ack->user_id, order->user_id); \
+        memset(ack->padding2, 0, sizeof(ack->padding2)); \
+        FEP_COPY_FIELD(ack->time, order->order_time); \
+        ack->padding3 = 0; \
+        fep_copy_str(ack->reject_code, sizeof(ack->reject_code), reject_code); \
+        ack->padding4 = 0; \
+        return ack; \
+    }
+FEP_BUILD_ORDER_ACK(fot_order_is_submitted)
+FEP_BUILD_ORDER_ACK(kft_order)
+
+// Order reject codes. The table holds them as zero-filled 7-byte wire fields so
+// patching one into an ack is a single fixed-width store.
+#define FEP_REJECT_CODES(R) \
+    R(FEP_ACCEPTED, "0000")  /* 정상 접수 */ \
+    R(FEP_E001,     "E001")  /* 전문 길이 오류 */ \
+    R(FEP_E002,     "E002")  /* tr_id 오류 */ \
+    R(FEP_E102,     "E102")  /* 가격 오류 */ \
+    R(FEP_E103,     "E103")  /* 수량 오류 */ \
+    R(FEP_E104,     "E104")  /* 주문 유형 오류 */ \
+    R(FEP_E105,     "E105")  /* 주문 시간 오류 */ \
+    R(FEP_E106,     "E106")  /* 취소 주문 원주문번호 오류 */
+
+#define FEP_REJECT_ENUM(id, code) id,
+#define FEP_REJECT_FIELD(id, code) code,
+enum { FEP_REJECT_CODES(FEP_REJECT_ENUM) FEP_REJECT_COUNT };
+static const char fep_reject_codes[FEP_REJECT_COUNT][7] = { FEP_REJECT_CODES(FEP_REJECT_FIELD) };
+
+// Per-connection ack template: header, terminators and padding are written once
+// here, fep_ack_patch() then only stores the variable fields.
+static inline void fep_ack_template_init(fot_order_is_submitted *tmpl) {
+    memset(tmpl, 0, sizeof(fot_order_is_submitted));
+    tmpl->hdr.tr_id = FEP_TR_fot_order_is_submitted;
+    tmpl->hdr.length = sizeof(fot_order_is_submitted);
+}
+
+// Patch the template for order. reject is one of FEP_ACCEPTED, FEP_E001, ...
+static inline const fot_order_is_submitted *fep_ack_patch(fot_order_is_submitted *tmpl, const fkq_order *order, int reject) {
+    memcpy(tmpl->transaction_code, order->transaction_code, sizeof(tmpl->transaction_code) - 1);
+    memcpy(tmpl->user_id, order->user_id, sizeof(tmpl->user_id) - 1);
+    memcpy(tmpl->time, order->order_time, sizeof(tmpl->time) - 1);
+    memcpy(tmpl->reject_code, fep_reject_codes[reject], sizeof(tmpl->reject_code));
+    return tmpl;
+}
+
+#endif //FEP_CODEC_H
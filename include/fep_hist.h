@@ -0,0 +1,126 @@
+#ifndef FEP_HIST_H
+#define FEP_HIST_H
+
+// Fixed-size log-linear latency histogram, HdrHistogram style: values below
+// 2^FEP_HIST_SUB_BITS are counted exactly, larger ones in buckets of relative
+// width 1/2^(FEP_HIST_SUB_BITS-1) (under 1.6%). No pointers and no allocation, so
+// a histogram can live in shared memory.
+//
+// Recording is single-writer: one thread per histogram. Readers may snapshot it
+// at any time; counts are read with relaxed atomics, so a snapshot can be off by
+// the few values recorded while it was being copied.
+
+#include <stdint.h>
+#include <string.h>
+
+#define FEP_HIST_SUB_BITS 7                              // 64 buckets per power of 2
+#define FEP_HIST_MAX_BITS 40                             // values up to 2^40 ns (~18 minutes)
+#define FEP_HIST_HALF (1 << (FEP_HIST_SUB_BITS - 1))
+#define FEP_HIST_BUCKETS ((FEP_HIST_MAX_BITS - FEP_HIST_SUB_BITS + 2) * FEP_HIST_HALF)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[FEP_HIST_BUCKETS];
+} fep_hist;
+
+static inline int fep_hist_index(uint64_t value) {
+    if (value >= (1ULL << FEP_HIST_MAX_BITS)) {
+        value = (1ULL << FEP_HIST_MAX_BITS) - 1;
+    }
+    if (value < (1ULL << FEP_HIST_SUB_BITS)) {
+        return (int)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - FEP_HIST_SUB_BITS + 1;
+    return shift * FEP_HIST_HALF + (int)(value >> shift);
+}
+
+// Highest value that lands in bucket index
+static inline uint64_t fep_hist_value_at(int index) {
+    if (index < 2 * FEP_HIST_HALF) {
+        return (uint64_t)index;
+    }
+    int shift = index / FEP_HIST_HALF - 1;
+    return ((uint64_t)(index - shift * FEP_HIST_HALF + 1) << shift) - 1;
+}
+
+static inline void fep_hist_record(fep_hist *h, uint64_t value) {
+    int i = fep_hist_index(value);
+    __atomic_store_n(&h->buckets[i], h->buckets[i] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum, h->sum + value, __ATOMIC_RELAXED);
+    if (value > h->max) {
+        __atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+}
+
+static inline void fep_hist_reset(fep_hist *h) {
+    memset(h, 0, sizeof(fep_hist));
+}
+
+static inline void fep_hist_snapshot(fep_hist *dst, const fep_hist *src) {
+    dst->count = __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+    dst->sum = __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+    dst->max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+    for (int i = 0; i < FEP_HIST_BUCKETS; i++) {
+        dst->buckets[i] = __atomic_load_n(&src->buckets[i], __ATOMIC_RELAXED);
+    }
+}
+
+// dst = later - earlier, for per-interval figures from two snapshots.
+// max becomes the top of the highest non-empty bucket of the difference.
+static inline void fep_hist_diff(fep_hist *dst, const fep_hist *later, const fep_hist *earlier) {
+    dst->count = 0;
+    dst->sum = later->sum - earlier->sum;
+    dst->max = 0;
+    for (int i = 0; i < FEP_HIST_BUCKETS; i++) {
+        dst->buckets[i] = later->buckets[i] >= earlier->buckets[i] ? later->buckets[i] - earlier->buckets[i] : 0;
+        dst->count += dst->buckets[i];
+        if (dst->buckets[i] != 0) {
+            dst->max = fep_hist_value_at(i);
+        }
+    }
+}
+
+static inline void fep_hist_merge(fep_hist *dst, const fep_hist *src) {
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+    for (int i = 0; i < FEP_HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+}
+
+// Value at percentile (0-100), 0 for an empty histogram
+static inline uint64_t fep_hist_percentile(const fep_hist *h, double percentile) {
+    uint64_t total = 0;
+    for (int i = 0; i < FEP_HIST_BUCKETS; i++) {
+        total += h->buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < FEP_HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t value = fep_hist_value_at(i);
+            return h->max != 0 && value > h->max ? h->max : value;
+        }
+    }
+    return h->max;
+}
+
+static inline double fep_hist_mean(const fep_hist *h) {
+    return h->count ? (double)h->sum / h->count : 0.0;
+}
+
+#endif //FEP_HIST_H
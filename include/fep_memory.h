@@ -0,0 +1,219 @@
+#ifndef FEP_MEMORY_H
+#define FEP_MEMORY_H
+
+// Huge pages, prefaulting and locking for the memory on the order path.
+//
+// The journal counters, the stat/trace/metrics pages and the rings would otherwise
+// be faulted in page by page on first touch, i.e. in the first burst after startup.
+// FEP_HUGEPAGES selects the pages behind them:
+//   off      4 KB pages (default)
+//   thp      transparent huge pages, MADV_HUGEPAGE on every prepared mapping. Private
+//            memory needs /sys/kernel/mm/transparent_hugepage/enabled at madvise or
+//            always, /dev/shm needs .../shmem_enabled at advise, within_size or always.
+//   hugetlb  rings from the hugetlb pool (vm.nr_hugepages), thp when the pool is
+//            empty; shm pages as with thp
+// Prepared memory is always prefaulted. FEP_MLOCK=1 also locks it (ulimit -l).
+// FEP_JOURNAL_RESERVE_MB allocates disk blocks ahead of the journal writers so their
+// appends do not allocate; size the reserve for a trading day.
+//
+// fep_mem_map() and fep_mem_prepare() do not log, so the shm headers use them from
+// the tools as well; processes report with fep_mem_report().
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/falloc.h>
+
+#define FEP_HUGE_PAGE_SIZE (2UL << 20)
+#define FEP_MADV_POPULATE_WRITE 23      // linux 5.14; older kernels touch page by page
+
+// what fep_mem_map / fep_mem_prepare did
+#define FEP_MEM_HUGETLB 0x1
+#define FEP_MEM_THP 0x2
+#define FEP_MEM_PREFAULTED 0x4
+#define FEP_MEM_LOCKED 0x8
+
+enum { FEP_PAGES_SMALL, FEP_PAGES_THP, FEP_PAGES_HUGETLB };
+
+void log_message(const char *level, const char *module, const char *format, ...);
+
+static inline int fep_mem_page_mode(void) {
+    const char *mode = getenv("FEP_HUGEPAGES");
+    if (mode != NULL && strcmp(mode, "thp") == 0) {
+        return FEP_PAGES_THP;
+    }
+    if (mode != NULL && strcmp(mode, "hugetlb") == 0) {
+        return FEP_PAGES_HUGETLB;
+    }
+    return FEP_PAGES_SMALL;
+}
+
+static inline int fep_mem_lock_wanted(void) {
+    const char *lock = getenv("FEP_MLOCK");
+    return lock != NULL && atoi(lock) != 0;
+}
+
+static inline size_t fep_mem_round_up(size_t size, size_t unit) {
+    return (size + unit - 1) / unit * unit;
+}
+
+// Private memory for a ring or buffer, 2 MB aligned and not yet touched, so it can
+// be placed (fep_affinity_bind_memory) before fep_mem_prepare() faults it in.
+// *flags gets FEP_MEM_HUGETLB when it came from the hugetlb pool. NULL on failure.
+static inline void *fep_mem_map(size_t size, int *flags) {
+    size_t len = fep_mem_round_up(size, FEP_HUGE_PAGE_SIZE);
+
+    *flags = 0;
+    if (fep_mem_page_mode() == FEP_PAGES_HUGETLB) {
+        void *addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED) {
+            *flags = FEP_MEM_HUGETLB;
+            return addr;
+        }
+    }
+    // over-map and trim, so that huge pages can back all of it
+    char *raw = mmap(NULL, len + FEP_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    char *addr = (char *)fep_mem_round_up((uintptr_t)raw, FEP_HUGE_PAGE_SIZE);
+    if (addr > raw) {
+        munmap(raw, addr - raw);
+    }
+    munmap(addr + len, raw + FEP_HUGE_PAGE_SIZE - addr);
+    return addr;
+}
+
+// Fault [addr, addr + len) in for writing, with huge pages and locked as configured.
+// Shared pages may be in use by other processes: they are touched with an atomic
+// add of 0, which changes nothing. Returns the FEP_MEM_* flags, starting from `flags`.
+static inline int fep_mem_prepare(void *addr, size_t len, int flags) {
+    long page = sysconf(_SC_PAGESIZE);
+    char *start = (char *)((uintptr_t)addr & ~(uintptr_t)(page - 1));
+    size_t span = fep_mem_round_up((char *)addr + len - start, page);
+
+    if (!(flags & FEP_MEM_HUGETLB) && fep_mem_page_mode() != FEP_PAGES_SMALL
+            && madvise(start, span, MADV_HUGEPAGE) == 0) {
+        flags |= FEP_MEM_THP;
+    }
+    if (madvise(start, span, FEP_MADV_POPULATE_WRITE) != 0) {
+        for (size_t off = 0; off < span; off += page) {
+            __atomic_fetch_add(start + off, 0, __ATOMIC_RELAXED);
+        }
+    }
+    flags |= FEP_MEM_PREFAULTED;
+    if (fep_mem_lock_wanted() && mlock(start, span) == 0) {
+        flags |= FEP_MEM_LOCKED;
+    }
+    return flags;
+}
+
+// Map the shared page `name` of `size` bytes, which starts with a uint32_t magic and a
+// uint32_t version. Writable: created on first use and prepared; the creator fills it
+// in with init() before it publishes the magic. Everyone else waits up to a second for
+// the magic. NULL on failure, or when the page has another version.
+static inline void *fep_mem_open_page(const char *name, size_t size, int writable,
+                                      uint32_t magic, uint32_t version, void (*init)(void *page)) {
+    int created = 0;
+    int fd = -1;
+    struct stat st;
+
+    if (writable) {
+        created = 1;
+        fd = shm_open(name, O_CREAT | O_RDWR | O_EXCL, 0666);
+    }
+    if (fd == -1) {
+        if ((writable && errno != EEXIST) || (fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0666)) == -1) {
+            return NULL;
+        }
+        created = 0;
+    }
+    // a writer sizes the page even when it lost the race to create it
+    if ((writable && ftruncate(fd, size) == -1) || fstat(fd, &st) == -1 || (size_t)st.st_size < size) {
+        close(fd);
+        return NULL;
+    }
+    void *page = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        return NULL;
+    }
+    if (writable) {
+        fep_mem_prepare(page, size, 0);
+    }
+
+    uint32_t *header = page;    // magic, version
+    if (created) {
+        if (init != NULL) {
+            init(page);
+        }
+        header[1] = version;
+        __atomic_store_n(&header[0], magic, __ATOMIC_RELEASE);
+    } else {
+        for (int i = 0; i < 100 && __atomic_load_n(&header[0], __ATOMIC_ACQUIRE) != magic; i++) {
+            struct timespec wait = {0, 10000000};
+            nanosleep(&wait, NULL);
+        }
+        if (__atomic_load_n(&header[0], __ATOMIC_ACQUIRE) != magic || header[1] != version) {
+            munmap(page, size);
+            return NULL;
+        }
+    }
+    return page;
+}
+
+// Log how a mapping was prepared; a failed mlock is an error
+static inline void fep_mem_report(const char *what, size_t len, int flags) {
+    int lock_failed = fep_mem_lock_wanted() && !(flags & FEP_MEM_LOCKED);
+    log_message(lock_failed ? "ERROR" : "INFO", "memory", "%s: %zu %s, %s%s%s\n", what,
+                len >= 1024 ? len / 1024 : len, len >= 1024 ? "KB" : "bytes",
+                flags & FEP_MEM_HUGETLB ? "hugetlb pages" : flags & FEP_MEM_THP ? "huge pages advised" : "4 KB pages",
+                flags & FEP_MEM_PREFAULTED ? ", prefaulted" : "",
+                flags & FEP_MEM_LOCKED ? ", locked" : lock_failed ? ", NOT locked (ulimit -l)" : "");
+}
+
+// Allocate disk blocks for the next FEP_JOURNAL_RESERVE_MB of an append-only journal.
+// The file size does not change: readers count records by it. Logs what it did.
+static inline void fep_journal_reserve(int fd, const char *what) {
+    const char *reserve = getenv("FEP_JOURNAL_RESERVE_MB");
+    long mb = reserve != NULL ? atol(reserve) : 0;
+    struct stat st;
+
+    if (mb <= 0) {
+        return;
+    }
+    if (fstat(fd, &st) != 0
+            || syscall(SYS_fallocate, fd, FALLOC_FL_KEEP_SIZE, (off_t)st.st_size, (off_t)mb << 20) != 0) {
+        log_message("ERROR", "memory", "%s: cannot reserve %ld MB\n", what, mb);
+        return;
+    }
+    log_message("INFO", "memory", "%s: %ld MB reserved after %ld KB\n", what, mb, (long)st.st_size / 1024);
+}
+
+// 0 if the journal holds whole records. Anything else was written with another record
+// layout (kft_execution was 56 bytes before seq_no) or cut mid-record, and reading it
+// by position would misframe every record after the first: logs and returns -1.
+static inline int fep_journal_check(int fd, const char *what, size_t record_size) {
+    struct stat st;
+
+    if (fstat(fd, &st) != 0) {
+        log_message("ERROR", "file", "%s: cannot stat\n", what);
+        return -1;
+    }
+    if (st.st_size % record_size != 0) {
+        log_message("ERROR", "file", "%s: %ld bytes is not a whole number of %zu-byte records, refusing it\n",
+                    what, (long)st.st_size, record_size);
+        return -1;
+    }
+    return 0;
+}
+
+#endif //FEP_MEMORY_H
@@ -0,0 +1,136 @@
+#ifndef FEP_METRICS_H
+#define FEP_METRICS_H
+
+// Pipeline counters and gauges in the shared page "/fep_metrics".
+//
+// Counters only grow (fep_top turns them into rates), gauges hold the current
+// value. Each counter and each added-to gauge has exactly one writing thread, so
+// updates are a relaxed load and store on the writer's own cache line; readers
+// never block a writer. fep_gauge_set may come from any thread, last one wins.
+// The page is versioned: a reader that finds another layout refuses to map it.
+//
+// All functions are no-ops when the page could not be opened.
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fep_codec.h>
+#include <fep_memory.h>
+
+#define FEP_METRICS_SHM_NAME "/fep_metrics"
+#define FEP_METRICS_MAGIC 0x4645504Du   // "FEPM"
+#define FEP_METRICS_VERSION 6
+
+#define FEP_METRIC_COUNTERS(C) \
+    C(FEP_M_ORDERS_RECEIVED,  "orders_received")  /* oms_listener */ \
+    C(FEP_M_ORDERS_ACCEPTED,  "orders_accepted")  \
+    C(FEP_M_INSERTS_SPILLED,  "inserts_spilled")  /* handed to the store via the journal */ \
+    C(FEP_M_ORDERS_SENT,      "orders_sent")      /* krx_sender */ \
+    C(FEP_M_ORDERS_PERSISTED, "orders_persisted") /* db_inserter */ \
+    C(FEP_M_INSERT_BATCHES,   "insert_batches")   \
+    C(FEP_M_INSERT_BATCH_NS,  "insert_batch_ns")  /* total, / insert_batches = mean */ \
+    C(FEP_M_ORDERS_DIVERTED,  "orders_diverted")  /* refused by the DB, see db_inserter.c */ \
+    C(FEP_M_EXECS_RECEIVED,   "execs_received")   /* krx_listener */ \
+    C(FEP_M_EXECS_INVALID,    "execs_invalid")    \
+    C(FEP_M_EXECS_JOURNALED,  "execs_journaled")  \
+    C(FEP_M_RESEND_REQUESTS,  "resend_requests")  \
+    C(FEP_M_EXECS_PERSISTED,  "execs_persisted")  /* db_updator */ \
+    C(FEP_M_DB_BATCHES,       "db_batches")       \
+    C(FEP_M_DB_BATCH_NS,      "db_batch_ns")      /* total, / db_batches = mean */ \
+    C(FEP_M_EXECS_DIVERTED,   "execs_diverted")   /* refused by the DB, see db_updator.c */ \
+    C(FEP_M_DB_POOL_GROWS,    "db_pool_grows")    /* the scaling db_pool (db_inserter) */ \
+    C(FEP_M_DB_POOL_SHRINKS,  "db_pool_shrinks")
+
+#define FEP_METRIC_GAUGES(G) \
+    G(FEP_G_OMS_CONNECTIONS,  "oms_connections")  /* oms_listener */ \
+    G(FEP_G_INSERT_QUEUE,     "insert_queue")     /* store writes not yet persisted */ \
+    G(FEP_G_INSERT_SPILL,     "insert_spill")     /* journaled orders not yet handed to the store */ \
+    G(FEP_G_KRX_CONNECTIONS,  "krx_connections")  /* krx_listener */ \
+    G(FEP_G_SUBSCRIBERS,      "subscribers")      \
+    G(FEP_G_DB_BATCH_LAST_NS, "db_batch_last_ns") /* db_updator */ \
+    G(FEP_G_DB_CONNS,         "db_conns")         /* the scaling db_pool: connections in use */ \
+    G(FEP_G_DB_UTIL_PCT,      "db_util_pct")      /* % of the last interval they were busy */ \
+    G(FEP_G_DB_LATENCY_US,    "db_latency_us")    /* mean statement time in the last interval */
+
+#define FEP_METRICS_PROCESSES(P) \
+    P(FEP_P_OMS_LISTENER, "oms_listener") \
+    P(FEP_P_KRX_SENDER,   "krx_sender")   \
+    P(FEP_P_DB_INSERTER,  "db_inserter")  \
+    P(FEP_P_KRX_LISTENER, "krx_listener") \
+    P(FEP_P_DB_UPDATOR,   "db_updator")   \
+    P(FEP_P_INTEGRATED,   "fep_integrated")
+
+#define FEP_METRIC_ENUM(id, name) id,
+#define FEP_METRIC_NAME(id, name) name,
+enum { FEP_METRIC_COUNTERS(FEP_METRIC_ENUM) FEP_M_COUNT };
+enum { FEP_METRIC_GAUGES(FEP_METRIC_ENUM) FEP_G_COUNT };
+enum { FEP_METRICS_PROCESSES(FEP_METRIC_ENUM) FEP_P_COUNT };
+static const char *const fep_counter_names[FEP_M_COUNT] = { FEP_METRIC_COUNTERS(FEP_METRIC_NAME) };
+static const char *const fep_gauge_names[FEP_G_COUNT] = { FEP_METRIC_GAUGES(FEP_METRIC_NAME) };
+static const char *const fep_process_names[FEP_P_COUNT] = { FEP_METRICS_PROCESSES(FEP_METRIC_NAME) };
+
+typedef struct {
+    _Alignas(64) uint64_t value;
+} fep_metric;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pids[FEP_P_COUNT];         // last process to open the page in each role
+    fep_metric counters[FEP_M_COUNT];
+    fep_metric gauges[FEP_G_COUNT];
+    _Alignas(64) uint64_t rejects[FEP_REJECT_COUNT];  // by fep_reject_codes index, oms_listener
+} fep_metrics_page;
+
+static fep_metrics_page *fep_metrics = NULL;
+
+static inline fep_metrics_page *fep_metrics_map(int writable) {
+    return fep_mem_open_page(FEP_METRICS_SHM_NAME, sizeof(fep_metrics_page), writable,
+                             FEP_METRICS_MAGIC, FEP_METRICS_VERSION, NULL);
+}
+
+// Map the page for writing as `process` (FEP_P_*). 0 on success.
+static inline int fep_metrics_open(int process) {
+    fep_metrics_page *page = fep_metrics_map(1);
+    if (page == NULL) {
+        return -1;
+    }
+    __atomic_store_n(&page->pids[process], (uint32_t)getpid(), __ATOMIC_RELAXED);
+    fep_metrics = page;
+    return 0;
+}
+
+static inline void fep_metric_add_to(uint64_t *value, uint64_t n) {
+    __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static inline void fep_counter_add(int counter, uint64_t n) {
+    if (fep_metrics != NULL) {
+        fep_metric_add_to(&fep_metrics->counters[counter].value, n);
+    }
+}
+
+static inline void fep_gauge_set(int gauge, int64_t value) {
+    if (fep_metrics != NULL) {
+        __atomic_store_n(&fep_metrics->gauges[gauge].value, (uint64_t)value, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void fep_gauge_add(int gauge, int64_t delta) {
+    if (fep_metrics != NULL) {
+        fep_metric_add_to(&fep_metrics->gauges[gauge].value, (uint64_t)delta);
+    }
+}
+
+static inline void fep_metric_reject(int reject) {
+    if (fep_metrics != NULL && reject > FEP_ACCEPTED && reject < FEP_REJECT_COUNT) {
+        fep_metric_add_to(&fep_metrics->rejects[reject], 1);
+    }
+}
+
+#endif //FEP_METRICS_H
@@ -0,0 +1,100 @@
+#ifndef FEP_MSG_SCHEMA_H
+#define FEP_MSG_SCHEMA_H
+
+// Wire message schema. Every struct in oms_fep_krx_struct.h, its size, tr_id and
+// field offsets are generated from the tables below, so a layout change is made
+// here once and checked at compile time.
+//
+// FEP_MESSAGES(M)   M(name, tr_id, size, FIELDS)
+// FIELDS(X, name)   X(name, type, field, array_dim, offset)
+//
+// The layout is the x86-64 one (4-byte int, natural alignment) and is sent as is,
+// padding included, so padding fields are listed explicitly.
+
+// 헤더 구성
+#define FEP_HDR_SIZE 8
+
+#define FKQ_ORDER_FIELDS(X, M) \
+    X(M, hdr,  hdr,              ,     0)   \
+    X(M, char, stock_code,       [7],  8)   /* 종목코드 */ \
+    X(M, char, padding1,         ,     15)  \
+    X(M, char, stock_name,       [51], 16)  /* 종목명 */ \
+    X(M, char, padding2,         ,     67)  \
+    X(M, char, transaction_code, [7],  68)  /* 거래코드 */ \
+    X(M, char, padding3,         ,     75)  \
+    X(M, char, user_id,          [21], 76)  /* 유저 ID */ \
+    X(M, char, padding4,         [3],  97)  \
+    X(M, char, order_type,       ,     100) /* 매수(B) / 매도(S) / 취소(C) */ \
+    X(M, char, padding5,         [3],  101) \
+    X(M, int,  quantity,         ,     104) /* 수량 */ \
+    X(M, char, order_time,       [15], 108) /* 주문시간 (YYYYMMDDHHMMSS) */ \
+    X(M, char, padding6,         ,     123) \
+    X(M, int,  price,            ,     124) /* 호가 */ \
+    X(M, char, original_order,   [7],  128) /* 원주문번호 */ \
+    X(M, char, padding7,         ,     135)
+
+// 주문 접수 응답 (fot_order_is_submitted: FEP -> OMS, kft_order: KRX -> FEP)
+#define ORDER_ACK_FIELDS(X, M) \
+    X(M, hdr,  hdr,              ,     0)   \
+    X(M, char, transaction_code, [7],  8)   /* 거래코드 */ \
+    X(M, char, padding1,         ,     15)  \
+    X(M, char, user_id,          [21], 16)  /* 유저 ID */ \
+    X(M, char, padding2,         [3],  37)  \
+    X(M, char, time,             [15], 40)  /* 응답시간 (YYYYMMDDHHMMSS) */ \
+    X(M, char, padding3,         ,     55)  \
+    X(M, char, reject_code,      [7],  56)  /* 거부사유코드 ("0000": 정상) */ \
+    X(M, char, padding4,         ,     63)
+
+#define KFT_EXECUTION_FIELDS(X, M) \
+    X(M, hdr,  hdr,              ,     0)   \
+    X(M, char, transaction_code, [7],  8)   /* 거래코드 */ \
+    X(M, char, padding1,         ,     15)  \
+    X(M, int,  status_code,      ,     16)  /* 상태 코드 (0: 체결, 1: 취소, 99: 오류) */ \
+    X(M, char, time,             [15], 20)  /* 응답시간 (YYYYMMDDHHMMSS) */ \
+    X(M, char, padding2,         ,     35)  \
+    X(M, int,  executed_price,   ,     36)  /* 체결 가격 */ \
+    X(M, char, original_order,   [7],  40)  /* 원주문번호 */ \
+    X(M, char, padding3,         ,     47)  \
+    X(M, char, reject_code,      [7],  48)  /* 거부사유코드 */ \
+    X(M, char, padding4,         ,     55)  \
+    X(M, int,  seq_no,           ,     56)  /* 세션별 체결 순번 (1부터, 0: 순번 없음) */
+
+#define FKQ_RESEND_REQUEST_FIELDS(X, M) \
+    X(M, hdr,  hdr,              ,     0)   \
+    X(M, int,  begin_seq,        ,     8)   /* 재전송 요청 시작 순번 */ \
+    X(M, int,  end_seq,          ,     12)  /* 재전송 요청 끝 순번 (포함) */
+
+#define OFQ_SUBSCRIBE_FIELDS(X, M) \
+    X(M, hdr,  hdr,              ,     0)   \
+    X(M, char, user_id,          [21], 8)   /* 구독 유저 ID (빈 문자열: 세션 전체 체결 수신) */ \
+    X(M, char, padding1,         [3],  29)  \
+    X(M, int,  last_seq,         ,     32)  /* 마지막으로 수신한 체결 순번 (0: 처음부터 재전송) */
+
+#define FOT_EXECUTION_REPORT_FIELDS(X, M) \
+    X(M, hdr,  hdr,              ,     0)   \
+    X(M, int,  seq,              ,     8)   /* 체결 순번 (krx 체결 저널 위치, 1부터 시작) */ \
+    X(M, char, transaction_code, [7],  12)  /* 거래코드 */ \
+    X(M, char, padding1,         ,     19)  \
+    X(M, char, user_id,          [21], 20)  /* 유저 ID */ \
+    X(M, char, padding2,         [3],  41)  \
+    X(M, int,  status_code,      ,     44)  /* 상태 코드 (0: 체결, 1: 취소, 99: 오류) */ \
+    X(M, char, time,             [15], 48)  /* 응답시간 (YYYYMMDDHHMMSS) */ \
+    X(M, char, padding3,         ,     63)  \
+    X(M, int,  executed_price,   ,     64)  /* 체결 가격 */ \
+    X(M, char, original_order,   [7],  68)  /* 원주문번호 */ \
+    X(M, char, padding4,         ,     75)  \
+    X(M, char, reject_code,      [7],  76)  /* 거부사유코드 */ \
+    X(M, char, padding5,         ,     83)
+
+//          name                    tr_id size fields
+#define FEP_MESSAGES(M) \
+    M(fkq_order,              9,  136, FKQ_ORDER_FIELDS)            /* OMS -> FEP -> KRX 주문 */ \
+    M(ofq_order,              9,  136, FKQ_ORDER_FIELDS)            /* OMS -> FEP 주문 (fkq_order 와 동일) */ \
+    M(fot_order_is_submitted, 10, 64,  ORDER_ACK_FIELDS)            /* FEP -> OMS 접수 응답 */ \
+    M(kft_execution,          11, 60,  KFT_EXECUTION_FIELDS)        /* KRX -> FEP 체결 */ \
+    M(ofq_subscribe,          12, 36,  OFQ_SUBSCRIBE_FIELDS)        /* OMS -> FEP 체결 통보 구독 */ \
+    M(fot_execution_report,   13, 84,  FOT_EXECUTION_REPORT_FIELDS) /* FEP -> OMS 체결 통보 */ \
+    M(fkq_resend_request,     14, 16,  FKQ_RESEND_REQUEST_FIELDS)   /* FEP -> KRX 체결 재전송 요청 */ \
+    M(kft_order,              15, 64,  ORDER_ACK_FIELDS)            /* KRX -> FEP 접수 응답 */
+
+#endif //FEP_MSG_SCHEMA_H
@@ -0,0 +1,218 @@
+#ifndef FEP_REPL_H
+#define FEP_REPL_H
+
+// Journal replication to a hot standby.
+//
+// fep_replicator runs next to the FEP and follows /W_count and /KRX_W_count. It streams
+// the new records of received_data.txt and krx_received_data.txt over TCP to the
+// fep_standby on the standby host, which appends them to its own copies and acks. The
+// reader counters (/R_count, /DB_R_count, /KRX_R_count) follow whenever they change.
+// SIGUSR1 promotes the standby: it drops the link, writes the journal and reader
+// positions into the counters in /dev/shm and exits. The FEP then starts on the
+// standby's $HOME as after any restart.
+//
+//   FEP_REPL_HOST, FEP_REPL_PORT   standby address, default 127.0.0.1:9300
+//   FEP_REPL_MODE                  async (default) or sync
+//   FEP_REPL_SYNC_TIMEOUT_MS       sync falls back to async when the standby has not
+//                                  acked for this long, default 1000
+//   FEP_REPL_BATCH                 records per batch, default 256
+//   FEP_REPL_FSYNC=1               the standby fdatasyncs before every ack
+//
+// Before sending, krx_sender and the integrated sender publish how far they are about
+// to send (order_sending), which is replicated with the reader counters. In sync mode
+// they wait in fep_repl_wait() until the standby has both the orders and that
+// position, so no order reaches KRX before the standby has it, and a promoted standby
+// never sends one twice. The orders between /R_count and order_sending may or may not
+// have reached KRX; the standby logs their transaction codes on promotion and skips
+// them, so they have to be reconciled with KRX. In async mode nothing waits and the
+// standby may be behind both ways: orders can be lost or sent again.
+//
+// Sync mode does not hold back the ack to the OMS: oms_listener acks an order once it
+// is in the primary's journal. An order acked in the last moments before the primary
+// is lost may not be on the standby, and the promoted FEP does not know about it.
+// Executions and the other reader counters are always streamed asynchronously.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#define FEP_REPL_SHM_NAME "/fep_repl"
+#define FEP_REPL_MAGIC 0x46455052u      // "FEPR", page and frames
+#define FEP_REPL_VERSION 2
+#define FEP_REPL_DEFAULT_HOST "127.0.0.1"
+#define FEP_REPL_DEFAULT_PORT 9300
+#define FEP_REPL_DEFAULT_SYNC_TIMEOUT_MS 1000
+#define FEP_REPL_DEFAULT_BATCH 256
+
+enum { FEP_REPL_OFF, FEP_REPL_ASYNC, FEP_REPL_SYNC };
+
+// frames
+enum { FEP_REPL_HELLO, FEP_REPL_BATCH, FEP_REPL_POSITIONS, FEP_REPL_ACK };
+enum { FEP_REPL_ORDERS, FEP_REPL_EXECS };
+
+typedef struct {
+    uint32_t magic;
+    uint16_t type;
+    uint16_t stream;                // BATCH
+    int32_t first;                  // BATCH: index of the first record
+    int32_t count;                  // BATCH: records in the payload
+    uint32_t length;                // payload bytes
+} fep_repl_frame;
+
+// HELLO (standby: what it has), ACK (standby: what it has written) and
+// POSITIONS (primary: its counters). -1 for a counter that does not exist.
+typedef struct {
+    int32_t order_wc;
+    int32_t order_rc;
+    int32_t db_rc;
+    int32_t exec_wc;
+    int32_t exec_rc;
+    int32_t order_sending;          // orders the sender may have sent, >= order_rc
+} fep_repl_positions;
+
+// /fep_repl, written by the replicator, read by the senders
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t configured;            // FEP_REPL_MODE of the replicator
+    uint32_t mode;                  // in effect: SYNC falls back to ASYNC while the standby lags
+    uint32_t connected;
+    uint32_t sync_timeout_ms;
+    int32_t order_acked;            // orders the standby has
+    int32_t exec_acked;
+    int32_t order_sending;          // written by the sender before it sends up to there
+    int32_t sending_acked;          // order_sending the standby has
+    uint64_t heartbeat_ns;          // fep_repl_now_ns() of the replicator's last round
+} fep_repl_page;
+
+static fep_repl_page *fep_repl = NULL;
+
+static inline uint64_t fep_repl_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int fep_repl_env(const char *name, int fallback) {
+    const char *value = getenv(name);
+    return value != NULL && value[0] != '\0' ? atoi(value) : fallback;
+}
+
+// Map the page, creating it (replication off) on first use. 0 on success.
+static inline int fep_repl_open() {
+    int fd = shm_open(FEP_REPL_SHM_NAME, O_CREAT | O_RDWR, 0666);
+    if (fd == -1) {
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(fep_repl_page)) == -1) {
+        close(fd);
+        return -1;
+    }
+    fep_repl_page *page = mmap(NULL, sizeof(fep_repl_page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        return -1;
+    }
+    uint32_t expected = 0;
+    if (__atomic_compare_exchange_n(&page->magic, &expected, FEP_REPL_MAGIC, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        page->version = FEP_REPL_VERSION;
+    } else if (expected != FEP_REPL_MAGIC) {
+        munmap(page, sizeof(fep_repl_page));
+        return -1;
+    }
+    fep_repl = page;
+    return 0;
+}
+
+// The sender may send the orders below `orders` from now on. Also at startup with
+// /R_count, so the replicator does not pick up a position of an earlier run.
+static inline void fep_repl_sending(int orders) {
+    if (fep_repl != NULL) {
+        __atomic_store_n(&fep_repl->order_sending, orders, __ATOMIC_RELEASE);
+    }
+}
+
+// Publish that the first `orders` orders are about to be sent and, in sync mode, wait
+// until the standby has them and that position. Returns at once in async mode, while
+// sync has fallen back, and when the replicator stopped.
+static inline void fep_repl_wait(int orders) {
+    fep_repl_page *page = fep_repl;
+    unsigned int spins = 0;
+
+    if (page == NULL) {
+        return;
+    }
+    fep_repl_sending(orders);
+    while (__atomic_load_n(&page->mode, __ATOMIC_ACQUIRE) == FEP_REPL_SYNC
+            && (__atomic_load_n(&page->order_acked, __ATOMIC_ACQUIRE) < orders
+                || __atomic_load_n(&page->sending_acked, __ATOMIC_ACQUIRE) < orders)) {
+        uint64_t heartbeat = __atomic_load_n(&page->heartbeat_ns, __ATOMIC_ACQUIRE);
+        if (fep_repl_now_ns() - heartbeat > (uint64_t)page->sync_timeout_ms * 1000000ULL) {
+            return;     // no replicator
+        }
+        if (spins < 1000) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        } else if (spins < 2000) {
+            sched_yield();
+        } else {
+            struct timespec nap = {0, 20000};
+            nanosleep(&nap, NULL);
+        }
+        spins++;
+    }
+}
+
+// Send one frame and its payload. 0 on success.
+static inline int fep_repl_send(int sock, int type, int stream, int first, int count, const void *payload, size_t length) {
+    fep_repl_frame frame = {FEP_REPL_MAGIC, (uint16_t)type, (uint16_t)stream, first, count, (uint32_t)length};
+    struct iovec iov[2] = {{&frame, sizeof(frame)}, {(void *)payload, length}};
+    int iovcnt = length > 0 ? 2 : 1;
+    size_t left = sizeof(frame) + length;
+
+    while (left > 0) {
+        ssize_t sent = writev(sock, iov, iovcnt);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        left -= sent;
+        for (int i = 0; i < iovcnt && sent > 0; i++) {
+            size_t step = (size_t)sent < iov[i].iov_len ? (size_t)sent : iov[i].iov_len;
+            iov[i].iov_base = (char *)iov[i].iov_base + step;
+            iov[i].iov_len -= step;
+            sent -= step;
+        }
+    }
+    return 0;
+}
+
+// Read exactly len bytes. 0 on success, -1 on error, EOF or a signal once *stop is set.
+static inline int fep_repl_read(int sock, void *buf, size_t len, const volatile int *stop) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = read(sock, p, len);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR && (stop == NULL || !*stop)) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+#endif //FEP_REPL_H
@@ -0,0 +1,92 @@
+#ifndef FEP_SPILL_H
+#define FEP_SPILL_H
+
+// Non-blocking tx_history insert handoff with the order journal as overflow.
+//
+// The reactor never waits for the DB. While the store accepts, orders are handed
+// to it directly. When it is full, the reactor keeps journaling and acking, and
+// remembers the journal position of the first order the store did not take.
+// From then on every order goes through the journal: fep_spill_catch_up() reads
+// the spilled orders back and hands them over as the store frees up, in journal
+// order, until it reaches the journal end and direct handoff resumes.
+//
+// Orders reach KRX through the journal either way, so a slow DB only delays
+// tx_history rows. Call everything from the reactor thread. Other threads may
+// read spilling and next (acquire): next is stored before spilling changes, so a
+// reader that sees spilling set also sees the order it started at.
+
+#include <unistd.h>
+#include <fep_store.h>
+#include <fep_metrics.h>
+
+#define FEP_SPILL_BATCH 64              // journal records read back per pread
+#define FEP_SPILL_POLL_MS 10            // reactor poll timeout while spilled
+
+typedef struct {
+    fep_store *store;
+    int journal_fd;         // readable order journal, one fkq_order per record
+    int spilling;           // read by other threads, see above
+    int lagging;            // last direct handoff reported backpressure
+    int next;               // journal index of the first order not yet in the store
+} fep_spill;
+
+static inline void fep_spill_init(fep_spill *spill, fep_store *store, int journal_fd) {
+    spill->store = store;
+    spill->journal_fd = journal_fd;
+    spill->spilling = 0;
+    spill->lagging = 0;
+    spill->next = 0;
+}
+
+// Hand over the order about to be journaled at `index`. Never blocks.
+static inline void fep_spill_submit(fep_spill *spill, const fkq_order *order, int index) {
+    if (!spill->spilling) {
+        int rc = fep_store_insert_order(spill->store, order, 0);
+        if (rc == FEP_STORE_BACKPRESSURE && !spill->lagging) {
+            log_message("ERROR", "db", "DB is lagging, %d inserts queued\n", fep_store_depth(spill->store));
+        }
+        spill->lagging = (rc == FEP_STORE_BACKPRESSURE);
+        if (rc != FEP_STORE_FULL) {
+            return;
+        }
+        __atomic_store_n(&spill->next, index, __ATOMIC_RELEASE);
+        __atomic_store_n(&spill->spilling, 1, __ATOMIC_RELEASE);
+        log_message("ERROR", "db", "insert queue is full (%d queued), spilling to the journal from order %d\n",
+                    fep_store_depth(spill->store), index);
+    }
+    fep_counter_add(FEP_M_INSERTS_SPILLED, 1);
+}
+
+// Move spilled orders up to `journaled` into the store while it has room.
+// Returns 1 while orders are still waiting in the journal.
+static inline int fep_spill_catch_up(fep_spill *spill, int journaled) {
+    fkq_order orders[FEP_SPILL_BATCH];
+
+    if (!spill->spilling) {
+        return 0;
+    }
+    while (spill->next < journaled) {
+        int want = journaled - spill->next < FEP_SPILL_BATCH ? journaled - spill->next : FEP_SPILL_BATCH;
+        ssize_t n = pread(spill->journal_fd, orders, sizeof(fkq_order) * want, (off_t)spill->next * sizeof(fkq_order));
+        if (n < (ssize_t)sizeof(fkq_order)) {
+            log_message("ERROR", "db", "cannot read spilled order %d back from the journal\n", spill->next);
+            break;
+        }
+        int count = n / sizeof(fkq_order), taken = 0;
+        while (taken < count && fep_store_insert_order(spill->store, &orders[taken], 0) != FEP_STORE_FULL) {
+            taken++;
+        }
+        __atomic_store_n(&spill->next, spill->next + taken, __ATOMIC_RELEASE);
+        if (taken < count) {
+            break;  // full again
+        }
+    }
+    if (spill->next >= journaled) {
+        __atomic_store_n(&spill->spilling, 0, __ATOMIC_RELEASE);
+        log_message("INFO", "db", "insert spill drained at order %d\n", journaled);
+    }
+    fep_gauge_set(FEP_G_INSERT_SPILL, journaled - spill->next);
+    return spill->spilling;
+}
+
+#endif //FEP_SPILL_H
@@ -0,0 +1,179 @@
+#ifndef FEP_STAT_H
+#define FEP_STAT_H
+
+// Per-stage latency histograms in the shared page "/fep_stat".
+//
+// Each process stamps its stage boundaries with the TSC (fep_tick) and records
+// the segment between two boundaries into a fep_hist. Boundaries that happen in
+// another process travel through stamp rings indexed by journal position:
+//   order path: recv -> validated -> journaled (oms_listener) -> dequeued -> sent (krx_sender)
+//   exec path:  executed (krx_listener) -> persisted (db_updator)
+// `fep_stat` reads the page and prints p50/p99/p99.9 per segment.
+//
+// All functions are no-ops when the page could not be opened.
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fep_hist.h>
+#include <fep_memory.h>
+
+#define FEP_STAT_SHM_NAME "/fep_stat"
+#define FEP_STAT_MAGIC 0x46455053u    // "FEPS"
+#define FEP_STAT_VERSION 1
+#define FEP_STAT_RING 65536           // stamps kept per path, power of 2
+#define FEP_STAT_CALIBRATE_NS 20000000L
+
+#define FEP_STAT_SEGMENTS(S) \
+    S(FEP_SEG_VALIDATE,      "validate")      /* recv -> validated */ \
+    S(FEP_SEG_JOURNAL,       "journal")       /* validated -> journaled, store handoff included */ \
+    S(FEP_SEG_HANDOFF,       "handoff")       /* journaled -> dequeued by the sender */ \
+    S(FEP_SEG_SEND,          "send")          /* dequeued -> sent to KRX */ \
+    S(FEP_SEG_TICK_TO_TRADE, "tick_to_trade") /* recv -> sent to KRX */ \
+    S(FEP_SEG_EXEC_JOURNAL,  "exec_journal")  /* executed -> execution journaled */ \
+    S(FEP_SEG_PERSIST,       "persist")       /* executed -> status committed */
+
+#define FEP_SEG_ENUM(id, name) id,
+enum { FEP_STAT_SEGMENTS(FEP_SEG_ENUM) FEP_SEG_COUNT };
+#define FEP_SEG_NAME(id, name) name,
+static const char *const fep_seg_names[FEP_SEG_COUNT] = { FEP_STAT_SEGMENTS(FEP_SEG_NAME) };
+
+typedef struct {
+    uint64_t pos;        // journal position + 1, 0 = empty
+    uint64_t first;      // recv (orders) / executed (executions)
+    uint64_t last;       // journaled
+} fep_stat_stamp;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    double ns_per_tick;
+    fep_hist hist[FEP_SEG_COUNT];
+    fep_stat_stamp order_stamps[FEP_STAT_RING];
+    fep_stat_stamp exec_stamps[FEP_STAT_RING];
+} fep_stat_page;
+
+static fep_stat_page *fep_stat = NULL;
+static double fep_stat_ns_per_tick = 1.0;
+
+static inline uint64_t fep_clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Invariant TSC on x86, the monotonic clock elsewhere
+static inline uint64_t fep_tick() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return fep_clock_ns();
+#endif
+}
+
+static inline double fep_stat_calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t ns0 = fep_clock_ns(), t0 = fep_tick();
+    struct timespec wait = {0, FEP_STAT_CALIBRATE_NS};
+    nanosleep(&wait, NULL);
+    uint64_t ns1 = fep_clock_ns(), t1 = fep_tick();
+    return t1 > t0 ? (double)(ns1 - ns0) / (double)(t1 - t0) : 1.0;
+#else
+    return 1.0;
+#endif
+}
+
+static inline void fep_stat_init(void *page) {
+    ((fep_stat_page *)page)->ns_per_tick = fep_stat_calibrate();
+}
+
+// Map the stat page, creating and calibrating it on first use. 0 on success.
+static inline int fep_stat_open() {
+    fep_stat_page *page = fep_mem_open_page(FEP_STAT_SHM_NAME, sizeof(fep_stat_page), 1,
+                                            FEP_STAT_MAGIC, FEP_STAT_VERSION, fep_stat_init);
+    if (page == NULL) {
+        return -1;
+    }
+    fep_stat_ns_per_tick = page->ns_per_tick;
+    fep_stat = page;
+    return 0;
+}
+
+static inline uint64_t fep_ticks_to_ns(uint64_t ticks) {
+    return (uint64_t)(ticks * fep_stat_ns_per_tick);
+}
+
+// Record the segment from tick `from` to tick `to`
+static inline void fep_stat_record(int segment, uint64_t from, uint64_t to) {
+    if (fep_stat != NULL && to >= from) {
+        fep_hist_record(&fep_stat->hist[segment], fep_ticks_to_ns(to - from));
+    }
+}
+
+static inline void fep_stat_stamp_put(fep_stat_stamp *ring, uint64_t pos, uint64_t first, uint64_t last) {
+    fep_stat_stamp *s = &ring[pos & (FEP_STAT_RING - 1)];
+    __atomic_store_n(&s->pos, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->first, first, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->last, last, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->pos, pos + 1, __ATOMIC_RELEASE);
+}
+
+// 1 if the stamp for pos is still in the ring
+static inline int fep_stat_stamp_get(const fep_stat_stamp *ring, uint64_t pos, fep_stat_stamp *out) {
+    const fep_stat_stamp *s = &ring[pos & (FEP_STAT_RING - 1)];
+    if (__atomic_load_n(&s->pos, __ATOMIC_ACQUIRE) != pos + 1) {
+        return 0;
+    }
+    out->first = __atomic_load_n(&s->first, __ATOMIC_RELAXED);
+    out->last = __atomic_load_n(&s->last, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&s->pos, __ATOMIC_RELAXED) == pos + 1;
+}
+
+// oms_listener: order at journal position pos received at recv, journaled at journaled
+static inline void fep_stat_order_journaled(uint64_t pos, uint64_t recv, uint64_t journaled) {
+    if (fep_stat != NULL) {
+        fep_stat_stamp_put(fep_stat->order_stamps, pos, recv, journaled);
+    }
+}
+
+// krx_sender: order at pos dequeued at `dequeued` and sent at `sent`
+static inline void fep_stat_order_sent(uint64_t pos, uint64_t dequeued, uint64_t sent) {
+    fep_stat_stamp stamp;
+    if (fep_stat == NULL) {
+        return;
+    }
+    fep_stat_record(FEP_SEG_SEND, dequeued, sent);
+    if (fep_stat_stamp_get(fep_stat->order_stamps, pos, &stamp)) {
+        fep_stat_record(FEP_SEG_HANDOFF, stamp.last, dequeued);
+        fep_stat_record(FEP_SEG_TICK_TO_TRADE, stamp.first, sent);
+    }
+}
+
+// krx_listener: execution at journal position pos received at executed
+static inline void fep_stat_exec_journaled(uint64_t pos, uint64_t executed, uint64_t journaled) {
+    if (fep_stat != NULL) {
+        fep_stat_record(FEP_SEG_EXEC_JOURNAL, executed, journaled);
+        fep_stat_stamp_put(fep_stat->exec_stamps, pos, executed, journaled);
+    }
+}
+
+// db_updator: executions at positions [begin, end) committed at persisted
+static inline void fep_stat_exec_persisted(uint64_t begin, uint64_t end, uint64_t persisted) {
+    fep_stat_stamp stamp;
+    if (fep_stat == NULL) {
+        return;
+    }
+    for (uint64_t pos = begin; pos < end; pos++) {
+        if (fep_stat_stamp_get(fep_stat->exec_stamps, pos, &stamp)) {
+            fep_stat_record(FEP_SEG_PERSIST, stamp.first, persisted);
+        }
+    }
+}
+
+#endif //FEP_STAT_H
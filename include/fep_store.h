@@ -0,0 +1,124 @@
+#ifndef FEP_STORE_H
+#define FEP_STORE_H
+
+// tx_history persistence interface.
+// FEP_STORE selects the backend at startup:
+//   mysql  (default) libmysqlclient through db_pool, build without -DFEP_WITHOUT_MYSQL
+//   sqlite embedded WAL-mode database at FEP_STORE_PATH, build with -DFEP_WITH_SQLITE
+// The embedded backend lets the whole pipeline run on one box without a MySQL server.
+
+#include <stdlib.h>
+#include <string.h>
+#include <oms_fep_krx_struct.h>
+
+// insert_order() results, same meaning as the db_pool ones
+#define FEP_STORE_OK 0
+#define FEP_STORE_BACKPRESSURE 1   // accepted, the backend is lagging
+#define FEP_STORE_FULL -1          // not accepted
+
+// update_status() and load_rows() failures. Lost connections are waited out by the
+// backend and never returned. Either may leave part of a load committed.
+#define FEP_STORE_RETRY -1         // busy or locked, the same rows may go through later
+#define FEP_STORE_REJECTED -2      // the DB refuses the rows (constraint, type, schema)
+
+typedef struct {
+    char transaction_code[7];
+    char status;                   // 'D' 체결, 'C' 취소, 'R' 거부
+    char reject_code[5];
+} fep_status_update;
+
+typedef struct {
+    char stock_code[7];
+    char stock_name[51];
+    char transaction_code[7];
+    char user_id[21];
+    char order_type;
+    int quantity;
+    int price;
+    char order_time[15];
+    char original_order[7];
+    char status;
+    char reject_code[5];
+} fep_order_row;
+
+typedef struct fep_store fep_store;
+
+typedef struct {
+    const char *name;
+    // queue a new order with status 'W'. wait != 0 blocks while the backend is full.
+    int (*insert_order)(fep_store *store, const fkq_order *order, int wait);
+    // apply the updates atomically, at most one per transaction_code. 0 on success,
+    // FEP_STORE_RETRY or FEP_STORE_REJECTED.
+    int (*update_status)(fep_store *store, const fep_status_update *updates, int count);
+    // 1 if found, 0 if not, -1 on error
+    int (*lookup)(fep_store *store, const char *transaction_code, fep_order_row *row);
+    // bulk upsert of complete rows, final status included: a transaction_code already
+    // in tx_history only takes the row's status and reject_code. 0 on success,
+    // FEP_STORE_RETRY or FEP_STORE_REJECTED.
+    int (*load_rows)(fep_store *store, const fep_order_row *rows, int count);
+    // writes queued but not yet persisted
+    int (*depth)(fep_store *store);
+    void (*close)(fep_store *store);
+} fep_store_ops;
+
+struct fep_store {
+    const fep_store_ops *ops;
+    void *impl;
+};
+
+void log_message(const char *level, const char *module, const char *format, ...);
+
+static inline int fep_store_insert_order(fep_store *store, const fkq_order *order, int wait) {
+    return store->ops->insert_order(store, order, wait);
+}
+
+static inline int fep_store_update_status(fep_store *store, const fep_status_update *updates, int count) {
+    return store->ops->update_status(store, updates, count);
+}
+
+static inline int fep_store_lookup(fep_store *store, const char *transaction_code, fep_order_row *row) {
+    return store->ops->lookup(store, transaction_code, row);
+}
+
+static inline int fep_store_load_rows(fep_store *store, const fep_order_row *rows, int count) {
+    return store->ops->load_rows(store, rows, count);
+}
+
+static inline int fep_store_depth(fep_store *store) {
+    return store->ops->depth(store);
+}
+
+static inline void fep_store_close(fep_store *store) {
+    store->ops->close(store);
+}
+
+#ifndef FEP_WITHOUT_MYSQL
+#include <fep_store_mysql.h>
+#endif
+#ifdef FEP_WITH_SQLITE
+#include <fep_store_sqlite.h>
+#endif
+
+// Open the backend named by FEP_STORE. The MySQL pool keeps between pool_min and
+// pool_max connections, scaling with load; pass the same value for a fixed size.
+static inline fep_store *fep_store_open(const char *name, int pool_min, int pool_max) {
+    const char *backend = getenv("FEP_STORE");
+    if (backend == NULL || backend[0] == '\0') {
+        backend = "mysql";
+    }
+
+#ifndef FEP_WITHOUT_MYSQL
+    if (strcmp(backend, "mysql") == 0) {
+        return fep_store_mysql_open(name, pool_min, pool_max);
+    }
+#endif
+#ifdef FEP_WITH_SQLITE
+    if (strcmp(backend, "sqlite") == 0) {
+        return fep_store_sqlite_open(name);
+    }
+#endif
+    log_message("ERROR", "store", "storage backend '%s' is not built in\n", backend);
+    return NULL;
+}
+
+#endif //FEP_STORE_H
@@ -0,0 +1,252 @@
+#ifndef FEP_STORE_MYSQL_H
+#define FEP_STORE_MYSQL_H
+
+// MySQL backend of fep_store. Writes go through db_pool; lookups use their own
+// blocking connection so they never queue behind inserts.
+
+#include <stdio.h>
+#include <pthread.h>
+#include <db_pool.h>
+
+#define FEP_STORE_UPDATE_MAX 512                              // updates per statement
+#define FEP_STORE_UPDATE_QUERY_SIZE (FEP_STORE_UPDATE_MAX * 96 + 256)
+#define FEP_STORE_LOAD_MAX 256                                // rows per multi-row INSERT
+#define FEP_STORE_LOAD_QUERY_SIZE (FEP_STORE_LOAD_MAX * 320 + 256)
+
+typedef struct {
+    db_pool *pool;
+    MYSQL *lookup_conn;
+    pthread_mutex_t lookup_lock;
+    char update_query[FEP_STORE_UPDATE_QUERY_SIZE];
+} fep_store_mysql;
+
+// Build the tx_history INSERT for an accepted order
+static inline int fep_mysql_build_insert(char *query, size_t size, const fkq_order *order) {
+    return snprintf(query, size,
+            "INSERT INTO tx_history (stock_code, stock_name, transaction_code, user_id, order_type, quantity, order_time, price, original_order, status) "
+            "VALUES ('%.*s', '%.*s', '%.*s', '%.*s', '%c', %d, '%.*s', %d, '%.*s', 'W')",
+            (int)sizeof(order->stock_code), order->stock_code, (int)sizeof(order->stock_name), order->stock_name,
+            (int)sizeof(order->transaction_code), order->transaction_code, (int)sizeof(order->user_id), order->user_id,
+            order->order_type, order->quantity, (int)sizeof(order->order_time), order->order_time,
+            order->price, (int)sizeof(order->original_order), order->original_order);
+}
+
+// Build one CASE-based UPDATE. Every transaction_code appears at most once.
+static inline int fep_mysql_build_status_update(char *query, size_t size, const fep_status_update *updates, int count) {
+    int len = snprintf(query, size, "UPDATE tx_history SET status = CASE transaction_code");
+    for (int i = 0; i < count && len < (int)size; i++) {
+        len += snprintf(query + len, size - len, " WHEN '%.6s' THEN '%c'", updates[i].transaction_code, updates[i].status);
+    }
+    if (len < (int)size) {
+        len += snprintf(query + len, size - len, " END, reject_code = CASE transaction_code");
+    }
+    for (int i = 0; i < count && len < (int)size; i++) {
+        len += snprintf(query + len, size - len, " WHEN '%.6s' THEN '%.4s'", updates[i].transaction_code, updates[i].reject_code);
+    }
+    if (len < (int)size) {
+        len += snprintf(query + len, size - len, " END WHERE transaction_code IN (");
+    }
+    for (int i = 0; i < count && len < (int)size; i++) {
+        len += snprintf(query + len, size - len, "%s'%.6s'", i ? "," : "", updates[i].transaction_code);
+    }
+    if (len < (int)size) {
+        len += snprintf(query + len, size - len, ")");
+    }
+    return len < (int)size ? len : -1;
+}
+
+static inline void fep_mysql_insert_done(void *arg, int result, const char *error) {
+    if (result != DB_POOL_DONE) {
+        log_message("ERROR", "db", "INSERT failed: %s\n", error);
+    }
+}
+
+static inline int fep_mysql_insert_order(fep_store *store, const fkq_order *order, int wait) {
+    fep_store_mysql *impl = store->impl;
+    char insert_query[512];  // Large enough to hold the full query
+    fep_mysql_build_insert(insert_query, sizeof(insert_query), order);
+
+    if (wait) {
+        return db_pool_submit_wait(impl->pool, insert_query, 1, fep_mysql_insert_done, NULL);
+    }
+    return db_pool_submit(impl->pool, insert_query, 1, fep_mysql_insert_done, NULL);
+}
+
+static inline int fep_mysql_result(int pool_result) {
+    return pool_result == DB_POOL_DONE ? 0 : pool_result == DB_POOL_CONFLICT ? FEP_STORE_RETRY : FEP_STORE_REJECTED;
+}
+
+// A single UPDATE statement commits atomically under autocommit
+static inline int fep_mysql_update_status(fep_store *store, const fep_status_update *updates, int count) {
+    fep_store_mysql *impl = store->impl;
+
+    for (int done = 0; done < count; done += FEP_STORE_UPDATE_MAX) {
+        int n = count - done < FEP_STORE_UPDATE_MAX ? count - done : FEP_STORE_UPDATE_MAX;
+        if (fep_mysql_build_status_update(impl->update_query, sizeof(impl->update_query), updates + done, n) < 0) {
+            log_message("ERROR", "db", "update query for %d executions does not fit\n", n);
+            return FEP_STORE_REJECTED;
+        }
+        int result = db_pool_query(impl->pool, impl->update_query, n);
+        if (result != DB_POOL_DONE) {
+            return fep_mysql_result(result);
+        }
+    }
+    return 0;
+}
+
+static inline int fep_mysql_lookup(fep_store *store, const char *transaction_code, fep_order_row *row) {
+    fep_store_mysql *impl = store->impl;
+    char query[256];
+    int found = -1;
+
+    pthread_mutex_lock(&impl->lookup_lock);
+    if (impl->lookup_conn == NULL) {
+        unsigned int timeout = DB_POOL_TIMEOUT_SEC;
+        impl->lookup_conn = mysql_init(NULL);
+        mysql_options(impl->lookup_conn, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+        mysql_options(impl->lookup_conn, MYSQL_OPT_READ_TIMEOUT, &timeout);
+        if (mysql_real_connect(impl->lookup_conn, MYSQL_IP, MYSQL_USER, MYSQL_PW, MYSQL_DBNAME, 0, NULL, 0) == NULL) {
+            log_message("ERROR", "db", "lookup connection failed: %s\n", mysql_error(impl->lookup_conn));
+            mysql_close(impl->lookup_conn);
+            impl->lookup_conn = NULL;
+            pthread_mutex_unlock(&impl->lookup_lock);
+            return -1;
+        }
+    }
+
+    snprintf(query, sizeof(query),
+             "SELECT stock_code, transaction_code, user_id, order_type, quantity, price, order_time, original_order, status, reject_code, stock_name "
+             "FROM tx_history WHERE transaction_code = '%.6s' LIMIT 1", transaction_code);
+    if (mysql_query(impl->lookup_conn, query) == 0) {
+        MYSQL_RES *res = mysql_store_result(impl->lookup_conn);
+        MYSQL_ROW r = res ? mysql_fetch_row(res) : NULL;
+        found = 0;
+        if (r) {
+            memset(row, 0, sizeof(fep_order_row));
+            strncpy(row->stock_code, r[0] ? r[0] : "", sizeof(row->stock_code) - 1);
+            strncpy(row->transaction_code, r[1] ? r[1] : "", sizeof(row->transaction_code) - 1);
+            strncpy(row->user_id, r[2] ? r[2] : "", sizeof(row->user_id) - 1);
+            row->order_type = r[3] ? r[3][0] : 0;
+            row->quantity = r[4] ? atoi(r[4]) : 0;
+            row->price = r[5] ? atoi(r[5]) : 0;
+            strncpy(row->order_time, r[6] ? r[6] : "", sizeof(row->order_time) - 1);
+            strncpy(row->original_order, r[7] ? r[7] : "", sizeof(row->original_order) - 1);
+            row->status = r[8] ? r[8][0] : 0;
+            strncpy(row->reject_code, r[9] ? r[9] : "", sizeof(row->reject_code) - 1);
+            strncpy(row->stock_name, r[10] ? r[10] : "", sizeof(row->stock_name) - 1);
+            found = 1;
+        }
+        if (res) {
+            mysql_free_result(res);
+        }
+    } else {
+        log_message("ERROR", "db", "lookup failed: %s\n", mysql_error(impl->lookup_conn));
+        mysql_close(impl->lookup_conn);
+        impl->lookup_conn = NULL;
+    }
+    pthread_mutex_unlock(&impl->lookup_lock);
+    return found;
+}
+
+// Copy at most max bytes of a fixed-width field with quotes and backslashes escaped
+static inline int fep_mysql_escape(char *dst, const char *src, int max) {
+    int len = 0;
+    for (int i = 0; i < max && src[i] != '\0'; i++) {
+        if (src[i] == '\'' || src[i] == '\\') {
+            dst[len++] = '\\';
+        }
+        dst[len++] = src[i];
+    }
+    dst[len] = '\0';
+    return len;
+}
+
+// The statements of one load are independent, so they all go to the pool at once
+// and run on as many connections as it has open. The upsert needs tx_history's
+// unique key on transaction_code.
+static inline int fep_mysql_load_rows(fep_store *store, const fep_order_row *rows, int count) {
+    fep_store_mysql *impl = store->impl;
+    char *query = malloc(FEP_STORE_LOAD_QUERY_SIZE);
+    char stock_name[103], user_id[43];
+    db_pool_group group;
+    int rc = 0;
+
+    if (query == NULL) {
+        return FEP_STORE_RETRY;
+    }
+    db_pool_group_init(&group);
+    for (int done = 0; done < count && rc == 0; done += FEP_STORE_LOAD_MAX) {
+        int n = count - done < FEP_STORE_LOAD_MAX ? count - done : FEP_STORE_LOAD_MAX;
+        int len = snprintf(query, FEP_STORE_LOAD_QUERY_SIZE,
+                "INSERT INTO tx_history (stock_code, stock_name, transaction_code, user_id, order_type, quantity, order_time, price, original_order, status, reject_code) VALUES ");
+        for (int i = 0; i < n; i++) {
+            const fep_order_row *row = &rows[done + i];
+            fep_mysql_escape(stock_name, row->stock_name, sizeof(row->stock_name) - 1);
+            fep_mysql_escape(user_id, row->user_id, sizeof(row->user_id) - 1);
+            len += snprintf(query + len, FEP_STORE_LOAD_QUERY_SIZE - len,
+                    "%s('%.6s', '%s', '%.6s', '%s', '%c', %d, '%.14s', %d, '%.6s', '%c', %s%.4s%s)",
+                    i ? "," : "", row->stock_code, stock_name, row->transaction_code, user_id,
+                    row->order_type, row->quantity, row->order_time, row->price, row->original_order, row->status,
+                    row->reject_code[0] ? "'" : "NULL", row->reject_code, row->reject_code[0] ? "'" : "");
+        }
+        len += snprintf(query + len, len < FEP_STORE_LOAD_QUERY_SIZE ? FEP_STORE_LOAD_QUERY_SIZE - len : 0,
+                " ON DUPLICATE KEY UPDATE status = VALUES(status), reject_code = VALUES(reject_code)");
+        if (len >= FEP_STORE_LOAD_QUERY_SIZE) {
+            log_message("ERROR", "db", "load query for %d rows does not fit\n", n);
+            rc = FEP_STORE_REJECTED;
+        } else {
+            db_pool_group_submit(impl->pool, &group, query, n);    // the pool keeps its own copy
+        }
+    }
+    free(query);
+    int result = db_pool_group_wait(&group);
+    return rc != 0 ? rc : fep_mysql_result(result);
+}
+
+static inline int fep_mysql_depth(fep_store *store) {
+    fep_store_mysql *impl = store->impl;
+    return db_pool_depth(impl->pool);
+}
+
+static inline void fep_mysql_close(fep_store *store) {
+    fep_store_mysql *impl = store->impl;
+    if (impl->lookup_conn) {
+        mysql_close(impl->lookup_conn);
+    }
+    // the pool thread lives as long as the process
+    free(impl);
+    free(store);
+}
+
+static const fep_store_ops fep_store_mysql_ops = {
+    "mysql",
+    fep_mysql_insert_order,
+    fep_mysql_update_status,
+    fep_mysql_lookup,
+    fep_mysql_load_rows,
+    fep_mysql_depth,
+    fep_mysql_close,
+};
+
+static inline fep_store *fep_store_mysql_open(const char *name, int pool_min, int pool_max) {
+    fep_store *store = calloc(1, sizeof(fep_store));
+    fep_store_mysql *impl = calloc(1, sizeof(fep_store_mysql));
+    if (store == NULL || impl == NULL) {
+        free(store);
+        free(impl);
+        return NULL;
+    }
+
+    impl->pool = db_pool_create(name, pool_min, pool_max);
+    if (impl->pool == NULL) {
+        free(store);
+        free(impl);
+        return NULL;
+    }
+    pthread_mutex_init(&impl->lookup_lock, NULL);
+    store->ops = &fep_store_mysql_ops;
+    store->impl = impl;
+    return store;
+}
+
+#endif //FEP_STORE_MYSQL_H
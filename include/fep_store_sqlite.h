@@ -0,0 +1,402 @@
+#ifndef FEP_STORE_SQLITE_H
+#define FEP_STORE_SQLITE_H
+
+// Embedded SQLite backend of fep_store, included by fep_store.h under FEP_WITH_SQLITE.
+// WAL mode lets oms_listener and db_updator open the same file from separate
+// processes. Inserts are queued to a writer thread that commits them in batches.
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <fep_metrics.h>
+#include <fep_affinity.h>
+
+#define FEP_SQLITE_QUEUE_SIZE 8192      // queued inserts, power of 2
+#define FEP_SQLITE_BATCH_MAX 512        // inserts per transaction
+#define FEP_SQLITE_BUSY_TIMEOUT_MS 5000
+
+typedef struct {
+    sqlite3 *writer_db;                 // writer thread only
+    sqlite3 *db;                        // update_status / lookup, under lock
+    pthread_mutex_t lock;
+
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_ready;
+    pthread_cond_t queue_space;
+    fkq_order queue[FEP_SQLITE_QUEUE_SIZE];
+    unsigned int head, tail;
+    unsigned int committed;             // inserts committed so far, same scale as tail
+    int backpressure;
+    pthread_t writer;
+} fep_store_sqlite;
+
+static inline int fep_sqlite_exec(sqlite3 *db, const char *sql) {
+    char *error = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &error) != SQLITE_OK) {
+        log_message("ERROR", "db", "sqlite: %s: %s\n", sql, error ? error : "unknown error");
+        sqlite3_free(error);
+        return -1;
+    }
+    return 0;
+}
+
+// What a failed statement means for its rows: a busy or failing database may take
+// them later, anything else is in the rows or the schema
+static inline int fep_sqlite_failure(sqlite3 *db) {
+    switch (sqlite3_errcode(db) & 0xff) {
+    case SQLITE_BUSY:
+    case SQLITE_LOCKED:
+    case SQLITE_IOERR:
+    case SQLITE_FULL:
+    case SQLITE_NOMEM:
+    case SQLITE_CANTOPEN:
+    case SQLITE_PROTOCOL:
+        return FEP_STORE_RETRY;
+    default:
+        return FEP_STORE_REJECTED;
+    }
+}
+
+static inline sqlite3 *fep_sqlite_connect(const char *path) {
+    sqlite3 *db = NULL;
+    if (sqlite3_open(path, &db) != SQLITE_OK) {
+        log_message("ERROR", "db", "sqlite open %s failed: %s\n", path, db ? sqlite3_errmsg(db) : "out of memory");
+        sqlite3_close(db);
+        return NULL;
+    }
+    sqlite3_busy_timeout(db, FEP_SQLITE_BUSY_TIMEOUT_MS);
+    if (fep_sqlite_exec(db, "PRAGMA journal_mode=WAL") != 0 ||
+        fep_sqlite_exec(db, "PRAGMA synchronous=NORMAL") != 0 ||
+        fep_sqlite_exec(db,
+            "CREATE TABLE IF NOT EXISTS tx_history ("
+            "stock_code TEXT, stock_name TEXT, transaction_code TEXT, user_id TEXT, order_type TEXT, "
+            "quantity INTEGER, order_time TEXT, price INTEGER, original_order TEXT, status TEXT, reject_code TEXT)") != 0 ||
+        fep_sqlite_exec(db, "CREATE INDEX IF NOT EXISTS tx_history_transaction_code ON tx_history (transaction_code)") != 0) {
+        sqlite3_close(db);
+        return NULL;
+    }
+    return db;
+}
+
+static inline void *fep_sqlite_writer(void *arg) {
+    fep_store_sqlite *impl = arg;
+    fkq_order *batch = malloc(sizeof(fkq_order) * FEP_SQLITE_BATCH_MAX);
+    sqlite3_stmt *insert = NULL;
+
+    fep_affinity_pin(FEP_ROLE_DB_WORKER);
+    if (sqlite3_prepare_v2(impl->writer_db,
+            "INSERT INTO tx_history (stock_code, stock_name, transaction_code, user_id, order_type, quantity, order_time, price, original_order, status) "
+            "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, 'W')", -1, &insert, NULL) != SQLITE_OK) {
+        log_message("ERROR", "db", "sqlite prepare failed: %s\n", sqlite3_errmsg(impl->writer_db));
+        free(batch);
+        return NULL;
+    }
+
+    while (1) {
+        pthread_mutex_lock(&impl->queue_lock);
+        while (impl->tail == impl->head) {
+            pthread_cond_wait(&impl->queue_ready, &impl->queue_lock);
+        }
+        int count = 0;
+        while (impl->head != impl->tail && count < FEP_SQLITE_BATCH_MAX) {
+            batch[count++] = impl->queue[impl->head++ & (FEP_SQLITE_QUEUE_SIZE - 1)];
+        }
+        fep_gauge_set(FEP_G_INSERT_QUEUE, impl->tail - impl->head);
+        pthread_mutex_unlock(&impl->queue_lock);
+
+        fep_sqlite_exec(impl->writer_db, "BEGIN IMMEDIATE");
+        // wire fields: nothing guarantees the NUL, so the length stops at the field's end
+        for (int i = 0; i < count; i++) {
+            char order_type[2] = {batch[i].order_type, '\0'};
+            sqlite3_bind_text(insert, 1, batch[i].stock_code, strnlen(batch[i].stock_code, sizeof(batch[i].stock_code)), SQLITE_STATIC);
+            sqlite3_bind_text(insert, 2, batch[i].stock_name, strnlen(batch[i].stock_name, sizeof(batch[i].stock_name)), SQLITE_STATIC);
+            sqlite3_bind_text(insert, 3, batch[i].transaction_code, strnlen(batch[i].transaction_code, sizeof(batch[i].transaction_code)), SQLITE_STATIC);
+            sqlite3_bind_text(insert, 4, batch[i].user_id, strnlen(batch[i].user_id, sizeof(batch[i].user_id)), SQLITE_STATIC);
+            sqlite3_bind_text(insert, 5, order_type, -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(insert, 6, batch[i].quantity);
+            sqlite3_bind_text(insert, 7, batch[i].order_time, strnlen(batch[i].order_time, sizeof(batch[i].order_time)), SQLITE_STATIC);
+            sqlite3_bind_int(insert, 8, batch[i].price);
+            sqlite3_bind_text(insert, 9, batch[i].original_order, strnlen(batch[i].original_order, sizeof(batch[i].original_order)), SQLITE_STATIC);
+            if (sqlite3_step(insert) != SQLITE_DONE) {
+                log_message("ERROR", "db", "INSERT failed: %s\n", sqlite3_errmsg(impl->writer_db));
+            }
+            sqlite3_reset(insert);
+        }
+        fep_sqlite_exec(impl->writer_db, "COMMIT");
+
+        pthread_mutex_lock(&impl->queue_lock);
+        impl->committed += count;
+        if (impl->backpressure && impl->tail - impl->head <= FEP_SQLITE_QUEUE_SIZE / 4) {
+            impl->backpressure = 0;
+        }
+        pthread_cond_broadcast(&impl->queue_space);
+        pthread_mutex_unlock(&impl->queue_lock);
+    }
+    return NULL;
+}
+
+static inline int fep_sqlite_insert_order(fep_store *store, const fkq_order *order, int wait) {
+    fep_store_sqlite *impl = store->impl;
+
+    pthread_mutex_lock(&impl->queue_lock);
+    while (impl->tail - impl->head >= FEP_SQLITE_QUEUE_SIZE) {
+        if (!wait) {
+            pthread_mutex_unlock(&impl->queue_lock);
+            return FEP_STORE_FULL;
+        }
+        pthread_cond_wait(&impl->queue_space, &impl->queue_lock);
+    }
+    impl->queue[impl->tail++ & (FEP_SQLITE_QUEUE_SIZE - 1)] = *order;
+    if (impl->tail - impl->head >= FEP_SQLITE_QUEUE_SIZE * 3 / 4) {
+        impl->backpressure = 1;
+    }
+    int rc = impl->backpressure ? FEP_STORE_BACKPRESSURE : FEP_STORE_OK;
+    pthread_cond_signal(&impl->queue_ready);
+    pthread_mutex_unlock(&impl->queue_lock);
+    return rc;
+}
+
+static inline int fep_sqlite_update_status(fep_store *store, const fep_status_update *updates, int count) {
+    fep_store_sqlite *impl = store->impl;
+    sqlite3_stmt *update = NULL;
+    int rc = 0;
+
+    // never overtake an insert queued earlier on this store, or the UPDATE matches no row
+    pthread_mutex_lock(&impl->queue_lock);
+    unsigned int queued = impl->tail;
+    while ((int)(impl->committed - queued) < 0) {
+        pthread_cond_wait(&impl->queue_space, &impl->queue_lock);
+    }
+    pthread_mutex_unlock(&impl->queue_lock);
+
+    pthread_mutex_lock(&impl->lock);
+    if (sqlite3_prepare_v2(impl->db, "UPDATE tx_history SET status = ?, reject_code = ? WHERE transaction_code = ?",
+                           -1, &update, NULL) != SQLITE_OK) {
+        log_message("ERROR", "db", "sqlite prepare failed: %s\n", sqlite3_errmsg(impl->db));
+        rc = fep_sqlite_failure(impl->db);
+        pthread_mutex_unlock(&impl->lock);
+        return rc;
+    }
+
+    if (fep_sqlite_exec(impl->db, "BEGIN IMMEDIATE") != 0) {
+        rc = fep_sqlite_failure(impl->db);
+        sqlite3_finalize(update);
+        pthread_mutex_unlock(&impl->lock);
+        return rc;
+    }
+    for (int i = 0; i < count; i++) {
+        char status[2] = {updates[i].status, '\0'};
+        sqlite3_bind_text(update, 1, status, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(update, 2, updates[i].reject_code, strnlen(updates[i].reject_code, 4), SQLITE_STATIC);
+        sqlite3_bind_text(update, 3, updates[i].transaction_code, strnlen(updates[i].transaction_code, 6), SQLITE_STATIC);
+        if (sqlite3_step(update) != SQLITE_DONE) {
+            log_message("ERROR", "db", "UPDATE failed: %s\n", sqlite3_errmsg(impl->db));
+            rc = fep_sqlite_failure(impl->db);
+            break;
+        }
+        sqlite3_reset(update);
+    }
+    if (rc == 0 && fep_sqlite_exec(impl->db, "COMMIT") != 0) {
+        rc = fep_sqlite_failure(impl->db);
+    }
+    if (rc != 0) {
+        fep_sqlite_exec(impl->db, "ROLLBACK");
+    }
+    sqlite3_finalize(update);
+    pthread_mutex_unlock(&impl->lock);
+    return rc;
+}
+
+static inline void fep_sqlite_copy(char *dst, size_t size, const unsigned char *src) {
+    strncpy(dst, src ? (const char *)src : "", size - 1);
+    dst[size - 1] = '\0';
+}
+
+static inline int fep_sqlite_lookup(fep_store *store, const char *transaction_code, fep_order_row *row) {
+    fep_store_sqlite *impl = store->impl;
+    sqlite3_stmt *select = NULL;
+    int found = -1;
+
+    pthread_mutex_lock(&impl->lock);
+    if (sqlite3_prepare_v2(impl->db,
+            "SELECT stock_code, transaction_code, user_id, order_type, quantity, price, order_time, original_order, status, reject_code, stock_name "
+            "FROM tx_history WHERE transaction_code = ? LIMIT 1", -1, &select, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(select, 1, transaction_code, strnlen(transaction_code, 6), SQLITE_STATIC);
+        int step = sqlite3_step(select);
+        if (step == SQLITE_ROW) {
+            memset(row, 0, sizeof(fep_order_row));
+            fep_sqlite_copy(row->stock_code, sizeof(row->stock_code), sqlite3_column_text(select, 0));
+            fep_sqlite_copy(row->transaction_code, sizeof(row->transaction_code), sqlite3_column_text(select, 1));
+            fep_sqlite_copy(row->user_id, sizeof(row->user_id), sqlite3_column_text(select, 2));
+            const unsigned char *order_type = sqlite3_column_text(select, 3);
+            row->order_type = order_type ? order_type[0] : 0;
+            row->quantity = sqlite3_column_int(select, 4);
+            row->price = sqlite3_column_int(select, 5);
+            fep_sqlite_copy(row->order_time, sizeof(row->order_time), sqlite3_column_text(select, 6));
+            fep_sqlite_copy(row->original_order, sizeof(row->original_order), sqlite3_column_text(select, 7));
+            const unsigned char *status = sqlite3_column_text(select, 8);
+            row->status = status ? status[0] : 0;
+            fep_sqlite_copy(row->reject_code, sizeof(row->reject_code), sqlite3_column_text(select, 9));
+            fep_sqlite_copy(row->stock_name, sizeof(row->stock_name), sqlite3_column_text(select, 10));
+            found = 1;
+        } else if (step == SQLITE_DONE) {
+            found = 0;
+        }
+    }
+    if (found < 0) {
+        log_message("ERROR", "db", "lookup failed: %s\n", sqlite3_errmsg(impl->db));
+    }
+    sqlite3_finalize(select);
+    pthread_mutex_unlock(&impl->lock);
+    return found;
+}
+
+// The transaction_code index is not unique, so the upsert is an UPDATE and, when it
+// found nothing, an INSERT, inside the one transaction.
+static inline int fep_sqlite_load_rows(fep_store *store, const fep_order_row *rows, int count) {
+    fep_store_sqlite *impl = store->impl;
+    sqlite3_stmt *update = NULL, *insert = NULL;
+    int rc = 0;
+
+    pthread_mutex_lock(&impl->lock);
+    if (sqlite3_prepare_v2(impl->db,
+            "UPDATE tx_history SET status = ?, reject_code = ? WHERE transaction_code = ?", -1, &update, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(impl->db,
+            "INSERT INTO tx_history (stock_code, stock_name, transaction_code, user_id, order_type, quantity, order_time, price, original_order, status, reject_code) "
+            "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)", -1, &insert, NULL) != SQLITE_OK) {
+        log_message("ERROR", "db", "sqlite prepare failed: %s\n", sqlite3_errmsg(impl->db));
+        rc = fep_sqlite_failure(impl->db);
+        sqlite3_finalize(update);
+        pthread_mutex_unlock(&impl->lock);
+        return rc;
+    }
+
+    if (fep_sqlite_exec(impl->db, "BEGIN IMMEDIATE") != 0) {
+        rc = fep_sqlite_failure(impl->db);
+        sqlite3_finalize(update);
+        sqlite3_finalize(insert);
+        pthread_mutex_unlock(&impl->lock);
+        return rc;
+    }
+    for (int i = 0; i < count; i++) {
+        const fep_order_row *row = &rows[i];
+        char order_type[2] = {row->order_type, '\0'};
+        char status[2] = {row->status, '\0'};
+        sqlite3_bind_text(update, 1, status, -1, SQLITE_TRANSIENT);
+        if (row->reject_code[0]) {
+            sqlite3_bind_text(update, 2, row->reject_code, strnlen(row->reject_code, sizeof(row->reject_code)), SQLITE_STATIC);
+        } else {
+            sqlite3_bind_null(update, 2);
+        }
+        sqlite3_bind_text(update, 3, row->transaction_code, strnlen(row->transaction_code, sizeof(row->transaction_code)), SQLITE_STATIC);
+        if (sqlite3_step(update) != SQLITE_DONE) {
+            log_message("ERROR", "db", "UPDATE failed: %s\n", sqlite3_errmsg(impl->db));
+            rc = fep_sqlite_failure(impl->db);
+            break;
+        }
+        sqlite3_reset(update);
+        if (sqlite3_changes(impl->db) > 0) {
+            continue;
+        }
+        sqlite3_bind_text(insert, 1, row->stock_code, strnlen(row->stock_code, sizeof(row->stock_code)), SQLITE_STATIC);
+        sqlite3_bind_text(insert, 2, row->stock_name, strnlen(row->stock_name, sizeof(row->stock_name)), SQLITE_STATIC);
+        sqlite3_bind_text(insert, 3, row->transaction_code, strnlen(row->transaction_code, sizeof(row->transaction_code)), SQLITE_STATIC);
+        sqlite3_bind_text(insert, 4, row->user_id, strnlen(row->user_id, sizeof(row->user_id)), SQLITE_STATIC);
+        sqlite3_bind_text(insert, 5, order_type, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(insert, 6, row->quantity);
+        sqlite3_bind_text(insert, 7, row->order_time, strnlen(row->order_time, sizeof(row->order_time)), SQLITE_STATIC);
+        sqlite3_bind_int(insert, 8, row->price);
+        sqlite3_bind_text(insert, 9, row->original_order, strnlen(row->original_order, sizeof(row->original_order)), SQLITE_STATIC);
+        sqlite3_bind_text(insert, 10, status, -1, SQLITE_TRANSIENT);
+        if (row->reject_code[0]) {
+            sqlite3_bind_text(insert, 11, row->reject_code, strnlen(row->reject_code, sizeof(row->reject_code)), SQLITE_STATIC);
+        } else {
+            sqlite3_bind_null(insert, 11);
+        }
+        if (sqlite3_step(insert) != SQLITE_DONE) {
+            log_message("ERROR", "db", "INSERT failed: %s\n", sqlite3_errmsg(impl->db));
+            rc = fep_sqlite_failure(impl->db);
+            break;
+        }
+        sqlite3_reset(insert);
+    }
+    if (rc == 0 && fep_sqlite_exec(impl->db, "COMMIT") != 0) {
+        rc = fep_sqlite_failure(impl->db);
+    }
+    if (rc != 0) {
+        fep_sqlite_exec(impl->db, "ROLLBACK");
+    }
+    sqlite3_finalize(update);
+    sqlite3_finalize(insert);
+    pthread_mutex_unlock(&impl->lock);
+    return rc;
+}
+
+static inline int fep_sqlite_depth(fep_store *store) {
+    fep_store_sqlite *impl = store->impl;
+    return (int)(impl->tail - impl->head);
+}
+
+static inline void fep_sqlite_close(fep_store *store) {
+    fep_store_sqlite *impl = store->impl;
+    pthread_mutex_lock(&impl->lock);
+    sqlite3_close(impl->db);
+    impl->db = NULL;
+    pthread_mutex_unlock(&impl->lock);
+    // the writer thread and its connection live as long as the process
+}
+
+static const fep_store_ops fep_store_sqlite_ops = {
+    "sqlite",
+    fep_sqlite_insert_order,
+    fep_sqlite_update_status,
+    fep_sqlite_lookup,
+    fep_sqlite_load_rows,
+    fep_sqlite_depth,
+    fep_sqlite_close,
+};
+
+static inline fep_store *fep_store_sqlite_open(const char *name) {
+    char path[256];
+    const char *path_env = getenv("FEP_STORE_PATH");
+    const char *home_dir = getenv("HOME");
+    if (path_env != NULL) {
+        snprintf(path, sizeof(path), "%s", path_env);
+    } else if (home_dir != NULL) {
+        snprintf(path, sizeof(path), "%s/tx_history.db", home_dir);
+    } else {
+        strncpy(path, "./tx_history.db", sizeof(path));
+    }
+
+    fep_store *store = calloc(1, sizeof(fep_store));
+    fep_store_sqlite *impl = calloc(1, sizeof(fep_store_sqlite));
+    if (store == NULL || impl == NULL) {
+        free(store);
+        free(impl);
+        return NULL;
+    }
+    impl->writer_db = fep_sqlite_connect(path);
+    impl->db = fep_sqlite_connect(path);
+    if (impl->writer_db == NULL || impl->db == NULL) {
+        sqlite3_close(impl->writer_db);
+        sqlite3_close(impl->db);
+        free(store);
+        free(impl);
+        return NULL;
+    }
+    pthread_mutex_init(&impl->lock, NULL);
+    pthread_mutex_init(&impl->queue_lock, NULL);
+    pthread_cond_init(&impl->queue_ready, NULL);
+    pthread_cond_init(&impl->queue_space, NULL);
+    store->ops = &fep_store_sqlite_ops;
+    store->impl = impl;
+
+    if (pthread_create(&impl->writer, NULL, fep_sqlite_writer, impl) != 0) {
+        log_message("ERROR", "db", "%s: failed to start sqlite writer\n", name);
+        return NULL;
+    }
+    log_message("INFO", "db", "%s: sqlite store at %s\n", name, path);
+    return store;
+}
+
+#endif //FEP_STORE_SQLITE_H
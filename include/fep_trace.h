@@ -0,0 +1,128 @@
+#ifndef FEP_TRACE_H
+#define FEP_TRACE_H
+
+// Per-order trace events in the shared ring "/fep_trace".
+//
+// Every process appends (transaction_code, stage, tick) events for the orders it
+// samples. The sample is a hash of transaction_code, so all four processes pick
+// the same orders and `fep_trace` can join their events into one timeline.
+// sample_every lives in the page: 0 = off, 1 = every order, N = about 1 in N.
+// FEP_TRACE_SAMPLE sets it when the page is created, `fep_trace -s N` changes it live.
+//
+// The ring is a flight recorder: producers claim slots with one atomic add and
+// old events are overwritten once it wraps.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fep_stat.h>
+
+#define FEP_TRACE_SHM_NAME "/fep_trace"
+#define FEP_TRACE_MAGIC 0x46455054u   // "FEPT"
+#define FEP_TRACE_VERSION 1
+#define FEP_TRACE_RING (1 << 19)      // events, power of 2 (16 MB)
+#define FEP_TRACE_DEFAULT_SAMPLE 128
+
+#define FEP_TRACE_STAGES(S) \
+    S(FEP_TRACE_RECV,           "recv")           /* oms_listener */ \
+    S(FEP_TRACE_VALIDATED,      "validated")      \
+    S(FEP_TRACE_JOURNALED,      "journaled")      \
+    S(FEP_TRACE_DEQUEUED,       "dequeued")       /* krx_sender */ \
+    S(FEP_TRACE_SENT,           "sent")           \
+    S(FEP_TRACE_EXECUTED,       "executed")       /* krx_listener */ \
+    S(FEP_TRACE_EXEC_JOURNALED, "exec_journaled") \
+    S(FEP_TRACE_PERSISTED,      "persisted")      /* db_updator */
+
+#define FEP_TRACE_ENUM(id, name) id,
+enum { FEP_TRACE_STAGES(FEP_TRACE_ENUM) FEP_TRACE_STAGE_COUNT };
+#define FEP_TRACE_NAME(id, name) name,
+static const char *const fep_trace_stage_names[FEP_TRACE_STAGE_COUNT] = { FEP_TRACE_STAGES(FEP_TRACE_NAME) };
+
+typedef struct {
+    uint64_t seq;                 // claim ticket + 1 once the event is complete, 0 = empty
+    uint64_t tick;
+    char transaction_code[7];
+    uint8_t stage;
+    uint32_t pid;
+    uint32_t pos;                 // journal position when the stage has one
+} fep_trace_event;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    double ns_per_tick;
+    uint32_t sample_every;
+    uint32_t padding1;
+    uint64_t head;                // next claim ticket
+    char padding2[32];
+    fep_trace_event ring[FEP_TRACE_RING];
+} fep_trace_page;
+
+static fep_trace_page *fep_trace = NULL;
+static uint32_t fep_trace_pid = 0;
+
+static inline void fep_trace_init(void *page) {
+    fep_trace_page *trace = page;
+    const char *sample = getenv("FEP_TRACE_SAMPLE");
+    trace->sample_every = sample != NULL ? (uint32_t)atoi(sample) : FEP_TRACE_DEFAULT_SAMPLE;
+    trace->ns_per_tick = fep_stat_calibrate();
+}
+
+// Map the trace ring, creating it on first use. 0 on success.
+static inline int fep_trace_open() {
+    fep_trace_page *page = fep_mem_open_page(FEP_TRACE_SHM_NAME, sizeof(fep_trace_page), 1,
+                                             FEP_TRACE_MAGIC, FEP_TRACE_VERSION, fep_trace_init);
+    if (page == NULL) {
+        return -1;
+    }
+    fep_trace_pid = (uint32_t)getpid();
+    fep_trace = page;
+    return 0;
+}
+
+static inline uint32_t fep_trace_hash(const char *transaction_code) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (int i = 0; i < 6 && transaction_code[i] != '\0'; i++) {
+        h ^= (unsigned char)transaction_code[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 1 if this order's events should be recorded
+static inline int fep_trace_sampled(const char *transaction_code) {
+    if (fep_trace == NULL) {
+        return 0;
+    }
+    uint32_t every = __atomic_load_n(&fep_trace->sample_every, __ATOMIC_RELAXED);
+    return every != 0 && fep_trace_hash(transaction_code) % every == 0;
+}
+
+static inline void fep_trace_put(int stage, const char *transaction_code, uint64_t tick, uint32_t pos) {
+    uint64_t ticket = __atomic_fetch_add(&fep_trace->head, 1, __ATOMIC_RELAXED);
+    fep_trace_event *e = &fep_trace->ring[ticket & (FEP_TRACE_RING - 1)];
+
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e->tick = tick;
+    memcpy(e->transaction_code, transaction_code, 6);
+    e->transaction_code[6] = '\0';
+    e->stage = (uint8_t)stage;
+    e->pid = fep_trace_pid;
+    e->pos = pos;
+    __atomic_store_n(&e->seq, ticket + 1, __ATOMIC_RELEASE);
+}
+
+// Copy a consistent event out of the ring. 1 if slot held a complete event.
+static inline int fep_trace_read(const fep_trace_event *slot, fep_trace_event *out) {
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq == 0) {
+        return 0;
+    }
+    memcpy(out, slot, sizeof(fep_trace_event));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq && out->seq == seq;
+}
+
+#endif //FEP_TRACE_H
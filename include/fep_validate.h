@@ -0,0 +1,105 @@
+#ifndef FEP_VALIDATE_H
+#define FEP_VALIDATE_H
+
+// Order and execution validation chains, shared by the listeners and the integrated FEP
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <oms_fep_krx_struct.h>
+#include <fep_codec.h>
+#include <fep_clock.h>
+
+#define ORDER_TIME_FORMAT FEP_CLOCK_ORDER_TIME_FORMAT
+
+// YYYYMMDDHHMMSS within the ranges strptime accepts
+static inline int is_order_time_wellformed(const char *order_time) {
+    for (int i = 0; i < FEP_CLOCK_ORDER_TIME_LEN; i++) {
+        if (order_time[i] < '0' || order_time[i] > '9') {
+            return 0;
+        }
+    }
+    int month = (order_time[4] - '0') * 10 + order_time[5] - '0';
+    int day = (order_time[6] - '0') * 10 + order_time[7] - '0';
+    int hour = (order_time[8] - '0') * 10 + order_time[9] - '0';
+    int minute = (order_time[10] - '0') * 10 + order_time[11] - '0';
+    int second = (order_time[12] - '0') * 10 + order_time[13] - '0';
+    return month >= 1 && month <= 12 && day >= 1 && day <= 31 && hour <= 23 && minute <= 59 && second <= 61;
+}
+
+static inline int is_order_time_future(const char *order_time) {
+    struct tm order_tm = {0};
+    time_t order_epoch, current_time;
+    char now[FEP_CLOCK_ORDER_TIME_LEN + 1];
+
+    // Same format and time zone as the clock page: not after now compares as a string.
+    // Only times ahead of now are parsed, to apply the 2 second tolerance.
+    fep_clock_order_time(now);
+    if (is_order_time_wellformed(order_time) && memcmp(order_time, now, FEP_CLOCK_ORDER_TIME_LEN) <= 0) {
+        return 0;
+    }
+
+    // Convert order_time string to struct tm
+    if (strptime(order_time, ORDER_TIME_FORMAT, &order_tm) == NULL) {
+        fprintf(stderr, "Error parsing order_time: %s\n", order_time);
+        return -1; // Error case
+    }
+
+    // Convert struct tm to epoch time
+    order_epoch = mktime(&order_tm);
+    if (order_epoch == -1) {
+        fprintf(stderr, "Error converting order_time to epoch\n");
+        return -1;
+    }
+
+    // Get the current epoch time
+    current_time = time(NULL);
+    if (current_time == -1) {
+        fprintf(stderr, "Error getting current time\n");
+        return -1;
+    }
+
+    // Check if current time is more than 2 second past order time
+    if (order_epoch > current_time + 2) {
+        return 1; // order time is future => error
+    } else {
+        return 0; // within range
+    }
+}
+
+// Returns FEP_ACCEPTED or the reject (index into fep_reject_codes) for an order from the OMS
+static inline int fep_validate_order(const fkq_order *order) {
+    // records are framed by size, a length that disagrees means the OMS sent another layout
+    if (order->hdr.length != (int)sizeof(fkq_order)) {
+        return FEP_E001;
+    } else if (order->hdr.tr_id != FEP_TR_fkq_order) {
+        return FEP_E002;
+    } else if (order->price < 0) {
+        return FEP_E102;
+    } else if (order->quantity <= 0) {
+        return FEP_E103;
+    } else if (!((order->order_type != 'B') || (order->order_type != 'C') || (order->order_type != 'S'))) {
+        return FEP_E104;
+    } else if (is_order_time_future(order->order_time)) {
+        return FEP_E105;
+    } else if (order->order_type == 'C' && strcmp(order->original_order, "NA") == 0) {
+        return FEP_E106;
+    }
+    return FEP_ACCEPTED;
+}
+
+// Returns the validation code for an execution from KRX, or NULL if it is accepted
+static inline const char *fep_validate_execution(const kft_execution *execution) {
+    if (!((execution->status_code == 0) || (execution->status_code == 1) || (execution->status_code == 99))) {
+        return "E301"; // status code
+    } else if (is_order_time_future(execution->time)) {
+        return "E302"; // execution time
+    } else if (execution->executed_price < 0) {
+        return "E303"; // executed price
+    } else if (!((strncmp(execution->reject_code, "0000", 4) == 0) || (execution->reject_code[0] == 'E'))) {
+        return "E304"; // reject code
+    }
+    return NULL;
+}
+
+#endif //FEP_VALIDATE_H
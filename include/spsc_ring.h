@@ -0,0 +1,101 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+// Single-producer single-consumer ring of fixed-size records.
+// Each side keeps its index and a cached copy of the other side's index on its
+// own cache line, so the shared lines are only touched when the cache runs out.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <time.h>
+#include <fep_memory.h>
+
+#define SPSC_CACHE_LINE 64
+
+typedef struct {
+    _Alignas(SPSC_CACHE_LINE) atomic_uint_fast64_t tail;  // written by the producer
+    uint64_t cached_head;                                   // producer's view of head
+    _Alignas(SPSC_CACHE_LINE) atomic_uint_fast64_t head;  // written by the consumer
+    uint64_t cached_tail;                                   // consumer's view of tail
+    _Alignas(SPSC_CACHE_LINE) uint64_t mask;
+    size_t elem_size;
+    char *data;                 // fep_mem_map(), see fep_memory.h
+    int mem_flags;
+} spsc_ring;
+
+// capacity must be a power of 2. Returns 0 on success. The records are not touched
+// yet: place and prefault them with fep_mem_prepare() before use.
+static inline int spsc_ring_init(spsc_ring *ring, uint64_t capacity, size_t elem_size) {
+    memset(ring, 0, sizeof(spsc_ring));
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return -1;
+    }
+    ring->data = fep_mem_map(capacity * elem_size, &ring->mem_flags);
+    if (ring->data == NULL) {
+        return -1;
+    }
+    ring->mask = capacity - 1;
+    ring->elem_size = elem_size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return 0;
+}
+
+// Producer side. Returns 1 if the record was queued, 0 if the ring is full.
+static inline int spsc_ring_push(spsc_ring *ring, const void *elem) {
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - ring->cached_head > ring->mask) {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail - ring->cached_head > ring->mask) {
+            return 0;
+        }
+    }
+    memcpy(ring->data + (tail & ring->mask) * ring->elem_size, elem, ring->elem_size);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+// Consumer side. Copies up to max records into out and returns how many.
+static inline int spsc_ring_pop_batch(spsc_ring *ring, void *out, int max) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (ring->cached_tail == head) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (ring->cached_tail == head) {
+            return 0;
+        }
+    }
+    int count = (int)(ring->cached_tail - head) < max ? (int)(ring->cached_tail - head) : max;
+    for (int i = 0; i < count; i++) {
+        memcpy((char *)out + i * ring->elem_size, ring->data + ((head + i) & ring->mask) * ring->elem_size, ring->elem_size);
+    }
+    atomic_store_explicit(&ring->head, head + count, memory_order_release);
+    return count;
+}
+
+static inline int spsc_ring_pop(spsc_ring *ring, void *out) {
+    return spsc_ring_pop_batch(ring, out, 1);
+}
+
+static inline uint64_t spsc_ring_depth(spsc_ring *ring) {
+    return atomic_load_explicit(&ring->tail, memory_order_relaxed) - atomic_load_explicit(&ring->head, memory_order_relaxed);
+}
+
+// Idle strategy for a pinned stage: spin, then yield, then nap so an idle box stays cool
+static inline void spsc_ring_idle(unsigned int *spins) {
+    if (*spins < 1000) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else if (*spins < 2000) {
+        sched_yield();
+    } else {
+        struct timespec nap = {0, 50000};
+        nanosleep(&nap, NULL);
+    }
+    (*spins)++;
+}
+
+#endif //SPSC_RING_H
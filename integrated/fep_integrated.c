@@ -0,0 +1,759 @@
+// Integrated FEP: oms_listener, krx_sender, krx_listener and db_updator as pinned
+// threads of one process, handing orders and executions over in-memory SPSC rings
+// instead of mqs. The journals and shm counters are kept exactly as the separate
+// processes keep them, so a restart recovers the same way and either mode can take
+// over the other's files. Do not run it next to the multi-process FEP.
+
+#define _GNU_SOURCE  // pthread_setaffinity_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h> // For open()
+#include <errno.h>
+#include <sched.h>
+#include <oms_fep_krx_struct.h>
+#include <envs.h>
+#include <fep_store.h>
+#include <fep_spill.h>
+#include <fep_validate.h>
+#include <fep_codec.h>
+#include <spsc_ring.h>
+#include <fep_stat.h>
+#include <fep_trace.h>
+#include <fep_metrics.h>
+#include <fep_affinity.h>
+#include <fep_memory.h>
+#include <fep_clock.h>
+#include <fep_repl.h>
+
+// shared memory
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+//log
+#include <stdarg.h>
+#include <time.h>
+
+#include <pthread.h>
+
+#define LOG_FILE_PATH "/home/ubuntu/logs/fep_integrated.log"
+
+// socket
+#define MAX_CLIENTS 20
+
+// rings
+#define ORDER_RING_SIZE 65536       // reactor -> sender, power of 2
+#define EXEC_RING_SIZE 65536        // listener -> updator, power of 2
+#define SEND_BATCH 64               // orders per send() when the sender falls behind
+
+#define DB_POOL_MIN 2               // tx_history connections, scaled with the insert load
+#define DB_POOL_MAX 8               // (FEP_DB_POOL_MIN / FEP_DB_POOL_MAX override)
+#define EXEC_BATCH_MAX 512          // executions per status transaction
+#define COALESCE_SLOTS (EXEC_BATCH_MAX * 2)
+#define KRX_RETRY_SEC 1
+
+#define DEFAULT_CPUS "1,2,3,4"      // reactor, sender, listener, updator. FEP_CPUS / FEP_AFFINITY override
+
+typedef struct {
+    fkq_order order;
+    uint64_t recv_tick;             // fep_tick() when the order came off the OMS socket
+    uint64_t journaled_tick;
+} order_slot;
+
+typedef struct {
+    const char *name;
+    void *(*run)(void *);
+    int role;                       // placement, see fep_affinity.h
+    int recover_end;                // sender: last order wc journaled before startup
+    pthread_t thread;
+} fep_stage;
+
+FILE *log_file = NULL;
+pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;  // every stage logs
+
+fep_store *store = NULL;
+spsc_ring order_ring;
+spsc_ring exec_ring;
+
+// same shm objects as the separate processes
+int *order_wc;      // /W_count, written by the reactor
+int *order_rc;      // /R_count, written by the sender
+int *exec_wc;       // /KRX_W_count, written by the listener
+int *exec_rc;       // /KRX_R_count, written by the updator
+
+int order_journal_fd = -1;
+int exec_journal_fd = -1;
+int oms_server_fd = -1;
+int krx_server_fd = -1;
+int krx_sock = -1;
+int busy_poll = 0;  // FEP_BUSY_POLL=1 spins the socket stages instead of sleeping in poll()
+fep_spill spill;    // inserts the store could not take yet, waiting in the order journal
+
+// Initialize logging
+void init_log() {
+    mkdir("/home/ubuntu/logs", 0777);
+    log_file = fopen(LOG_FILE_PATH, "a");
+    if (!log_file) {
+        perror("Failed to open log file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Log function (thread-safe)
+void log_message(const char *level, const char *module, const char *format, ...) {
+    pthread_mutex_lock(&log_mutex);
+    if (!log_file) {
+        pthread_mutex_unlock(&log_mutex);
+        return;
+    }
+
+    char time_buffer[FEP_CLOCK_LOG_TIME_LEN + 1];
+    fep_clock_log_time(time_buffer);
+    time_buffer[19] = '\0';     // YYYY-MM-DD HH:MM:SS
+    fprintf(log_file, "[%s] [%s] [%s] ", time_buffer, level, module);
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(log_file, format, args);
+    va_end(args);
+    fflush(log_file);
+    pthread_mutex_unlock(&log_mutex);
+}
+
+// Create or open one of the pipeline counters
+int *map_counter(const char *shared_mem_name) {
+    int is_initialized = 0;
+    int shm_fd = shm_open(shared_mem_name, O_CREAT | O_RDWR | O_EXCL, 0666);
+    if (shm_fd == -1) {
+        if (errno != EEXIST || (shm_fd = shm_open(shared_mem_name, O_RDWR, 0666)) == -1) {
+            log_message("ERROR", "shm", "shm_open %s failed\n", shared_mem_name);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        is_initialized = 1;
+    }
+
+    if (ftruncate(shm_fd, sizeof(int)) == -1) {
+        log_message("ERROR", "shm", "ftruncate %s failed\n", shared_mem_name);
+        close(shm_fd);
+        exit(EXIT_FAILURE);
+    }
+    int *counter = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (counter == MAP_FAILED) {
+        log_message("ERROR", "shm", "mmap %s failed\n", shared_mem_name);
+        exit(EXIT_FAILURE);
+    }
+    fep_mem_report(shared_mem_name, sizeof(int), fep_mem_prepare(counter, sizeof(int), 0));
+    if (is_initialized) {
+        *counter = 0;
+    }
+    log_message("DEBUG", "shm", "%s = %d\n", shared_mem_name, *counter);
+    return counter;
+}
+
+int open_journal(const char *name, size_t record_size) {
+    const char *home_dir = getenv("HOME");
+    char filepath[256];
+    if (home_dir != NULL) {
+        snprintf(filepath, sizeof(filepath), "%s/%s", home_dir, name);
+    } else {
+        // Fallback to current directory if $HOME is not set
+        snprintf(filepath, sizeof(filepath), "./%s", name);
+    }
+    int fd = open(filepath, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        log_message("ERROR", "file", "Error opening %s\n", filepath);
+        exit(EXIT_FAILURE);
+    }
+    if (fep_journal_check(fd, filepath, record_size) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    fep_journal_reserve(fd, filepath);
+    return fd;
+}
+
+int open_server_socket(int port) {
+    struct sockaddr_in address;
+    int opt = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        log_message("ERROR", "socket", "Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, MAX_CLIENTS) < 0) {
+        log_message("ERROR", "socket", "bind/listen failed on port %d\n", port);
+        exit(EXIT_FAILURE);
+    }
+    log_message("DEBUG", "socket", "Server listening on port %d\n", port);
+    return fd;
+}
+
+int send_all(int sock, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t sent = send(sock, p, len, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+void send_ack(const fkq_order *order, int reject, fot_order_is_submitted *ack_template, int sock) {
+    const fot_order_is_submitted *ack = fep_ack_patch(ack_template, order, reject);
+
+    fep_metric_reject(reject);
+
+    if (send_all(sock, ack, sizeof(fot_order_is_submitted)) != 0) {
+        log_message("ERROR", "socket", "Failed to send ack for %s\n", order->transaction_code);
+    }
+}
+
+// KRX accepts the sender only once its execution feed reaches our listener, so keep retrying
+void connect_krx() {
+    struct sockaddr_in server_addr;
+    int nodelay = 1;
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(KRX_PORT);
+    if (inet_pton(AF_INET, KRX_IP, &server_addr.sin_addr) <= 0) {
+        log_message("ERROR", "socket", "Invalid IP address or format");
+        exit(EXIT_FAILURE);
+    }
+    while (1) {
+        if ((krx_sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+            log_message("ERROR", "socket", "Socket creation failed");
+            exit(EXIT_FAILURE);
+        }
+        if (connect(krx_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) == 0) {
+            break;
+        }
+        log_message("ERROR", "socket", "Connection to KRX failed, retrying in %d s\n", KRX_RETRY_SEC);
+        close(krx_sock);
+        sleep(KRX_RETRY_SEC);
+    }
+    setsockopt(krx_sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    log_message("INFO", "socket", "connected to KRX %s:%d\n", KRX_IP, KRX_PORT);
+}
+
+// One whole order off an OMS connection
+void receive_order(const void *message, uint64_t recv_tick, fot_order_is_submitted *ack_template, int fd) {
+    order_slot slot;
+    memset(&slot, 0, sizeof(slot));
+    memcpy(&slot.order, message, sizeof(fkq_order));
+    slot.recv_tick = recv_tick;
+    fep_counter_add(FEP_M_ORDERS_RECEIVED, 1);
+
+    int reject = fep_validate_order(&slot.order);
+    if (reject != FEP_ACCEPTED) {
+        send_ack(&slot.order, reject, ack_template, fd);
+        log_message("INFO", "validation", "sent oms back reject code: %s.\n", fep_reject_codes[reject]);
+        return;
+    }
+    uint64_t t_valid = fep_tick();
+    fep_stat_record(FEP_SEG_VALIDATE, slot.recv_tick, t_valid);
+
+    fep_spill_submit(&spill, &slot.order, *order_wc);
+    fep_gauge_set(FEP_G_INSERT_QUEUE, fep_store_depth(store));
+
+    if (write(order_journal_fd, &slot.order, sizeof(fkq_order)) != sizeof(fkq_order)) {
+        log_message("ERROR", "file", "order journal write failed\n");
+        exit(EXIT_FAILURE);
+    }
+    (*order_wc)++;
+    slot.journaled_tick = fep_tick();
+    fep_stat_record(FEP_SEG_JOURNAL, t_valid, slot.journaled_tick);
+    fep_counter_add(FEP_M_ORDERS_ACCEPTED, 1);
+    if (fep_trace_sampled(slot.order.transaction_code)) {
+        fep_trace_put(FEP_TRACE_RECV, slot.order.transaction_code, slot.recv_tick, *order_wc - 1);
+        fep_trace_put(FEP_TRACE_VALIDATED, slot.order.transaction_code, t_valid, *order_wc - 1);
+        fep_trace_put(FEP_TRACE_JOURNALED, slot.order.transaction_code, slot.journaled_tick, *order_wc - 1);
+    }
+
+    unsigned int spins = 0;
+    while (!spsc_ring_push(&order_ring, &slot)) {
+        spsc_ring_idle(&spins);  // the sender is behind KRX
+    }
+    send_ack(&slot.order, FEP_ACCEPTED, ack_template, fd);
+}
+
+// oms_listener: validate, persist, journal, hand to the sender, ack
+void *reactor_stage(void *arg) {
+    fep_stage *stage = arg;
+    struct pollfd fds[MAX_CLIENTS];
+    fot_order_is_submitted ack_templates[MAX_CLIENTS];
+    static fep_rx rx[MAX_CLIENTS];
+
+    fep_affinity_pin(stage->role);
+    fep_spill_init(&spill, store, order_journal_fd);
+    fds[0].fd = oms_server_fd;
+    fds[0].events = POLLIN;
+    for (int i = 1; i < MAX_CLIENTS; i++) {
+        fds[i].fd = -1;
+    }
+
+    while (1) {
+        int activity = poll(fds, MAX_CLIENTS, busy_poll ? 0 : spill.spilling ? FEP_SPILL_POLL_MS : -1);
+        fep_spill_catch_up(&spill, *order_wc);
+        if (activity < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_message("ERROR", "socket", "Poll error");
+            exit(EXIT_FAILURE);
+        } else if (activity == 0) {
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int client_fd = accept(oms_server_fd, NULL, NULL);
+            if (client_fd >= 0) {
+                int nodelay = 1;
+                setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+                int i = 1;
+                while (i < MAX_CLIENTS && fds[i].fd != -1) {
+                    i++;
+                }
+                if (i == MAX_CLIENTS) {
+                    log_message("ERROR", "socket", "too many OMS connections, connection refused\n");
+                    close(client_fd);
+                } else {
+                    fds[i].fd = client_fd;
+                    fds[i].events = POLLIN;
+                    fep_ack_template_init(&ack_templates[i]);
+                    fep_rx_reset(&rx[i]);
+                    fep_gauge_add(FEP_G_OMS_CONNECTIONS, 1);
+                    log_message("INFO", "socket", "New OMS connection\n");
+                }
+            }
+        }
+
+        for (int i = 1; i < MAX_CLIENTS; i++) {
+            if (fds[i].fd == -1 || !(fds[i].revents & POLLIN)) {
+                continue;
+            }
+            ssize_t bytes_received = fep_rx_recv(&rx[i], fds[i].fd);
+            uint64_t recv_tick = fep_tick();
+            const void *message;
+            if (bytes_received <= 0) {
+                log_message("INFO", "socket", "Client disconnected\n");
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                fep_gauge_add(FEP_G_OMS_CONNECTIONS, -1);
+                continue;
+            }
+            // whole orders only; a partial one stays buffered until the rest arrives
+            while ((message = fep_rx_next(&rx[i], sizeof(fkq_order))) != NULL) {
+                receive_order(message, recv_tick, &ack_templates[i], fds[i].fd);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Send orders journaled before startup. Everything after recover_end comes through the ring.
+void recover_orders(int recover_end) {
+    fkq_order order;
+
+    fep_repl_sending(*order_rc);
+    if (*order_rc < recover_end) {
+        fep_repl_wait(recover_end);
+    }
+    while (*order_rc < recover_end) {
+        if (pread(order_journal_fd, &order, sizeof(order), (off_t)*order_rc * sizeof(fkq_order)) != sizeof(order)) {
+            log_message("ERROR", "file", "order journal is shorter than wc %d\n", recover_end);
+            exit(EXIT_FAILURE);
+        }
+        if (send_all(krx_sock, &order, sizeof(order)) != 0) {
+            log_message("ERROR", "tcp", "send to KRX failed during recovery, rc = %d\n", *order_rc);
+            exit(EXIT_FAILURE);
+        }
+        (*order_rc)++;
+    }
+    log_message("INFO", "recovery", "order rc = %d\n", *order_rc);
+}
+
+// krx_sender: forward journaled orders to KRX in ring order
+void *sender_stage(void *arg) {
+    fep_stage *stage = arg;
+    static order_slot batch[SEND_BATCH];
+    static fkq_order out[SEND_BATCH];
+
+    fep_affinity_pin(stage->role);
+    connect_krx();
+    recover_orders(stage->recover_end);
+    while (1) {
+        int n = spsc_ring_pop_batch(&order_ring, batch, SEND_BATCH);
+        if (n == 0) {
+            unsigned int spins = 0;
+            while ((n = spsc_ring_pop_batch(&order_ring, batch, SEND_BATCH)) == 0) {
+                spsc_ring_idle(&spins);
+            }
+        }
+        uint64_t t_dequeued = fep_tick();
+
+        for (int k = 0; k < n; k++) {
+            out[k] = batch[k].order;
+        }
+        // sync replication: not to KRX before the standby has it
+        fep_repl_wait(*order_rc + n);
+        if (send_all(krx_sock, out, n * sizeof(fkq_order)) != 0) {
+            // R_count still points at the first unsent order; a restart resends from there
+            log_message("ERROR", "tcp", "send to KRX failed, rc = %d\n", *order_rc);
+            exit(EXIT_FAILURE);
+        }
+        uint64_t t_sent = fep_tick();
+
+        // the stages share one process, so no stamp ring is needed
+        for (int k = 0; k < n; k++) {
+            fep_stat_record(FEP_SEG_HANDOFF, batch[k].journaled_tick, t_dequeued);
+            fep_stat_record(FEP_SEG_SEND, t_dequeued, t_sent);
+            fep_stat_record(FEP_SEG_TICK_TO_TRADE, batch[k].recv_tick, t_sent);
+            fep_counter_add(FEP_M_ORDERS_SENT, 1);
+            if (fep_trace_sampled(batch[k].order.transaction_code)) {
+                fep_trace_put(FEP_TRACE_DEQUEUED, batch[k].order.transaction_code, t_dequeued, *order_rc + k);
+                fep_trace_put(FEP_TRACE_SENT, batch[k].order.transaction_code, t_sent, *order_rc + k);
+            }
+        }
+        *order_rc += n;
+    }
+    return NULL;
+}
+
+// One whole execution off a KRX connection
+void receive_execution(const void *message, uint64_t t_executed) {
+    kft_execution execution;
+    memcpy(&execution, message, sizeof(execution));
+    fep_counter_add(FEP_M_EXECS_RECEIVED, 1);
+
+    const char *invalid_code;
+    if (execution.hdr.tr_id != 11) {
+        fep_counter_add(FEP_M_EXECS_INVALID, 1);
+        log_message("INFO", "validation", "skip to process Invalid tr_id: %d\n", execution.hdr.tr_id);
+        return;
+    } else if ((invalid_code = fep_validate_execution(&execution)) != NULL) {
+        fep_counter_add(FEP_M_EXECS_INVALID, 1);
+        log_message("INFO", "validation", "invalid krx execution : %s.\n", invalid_code);
+        return;
+    }
+
+    if (write(exec_journal_fd, &execution, sizeof(kft_execution)) != sizeof(kft_execution)) {
+        log_message("ERROR", "file", "execution journal write failed\n");
+        exit(EXIT_FAILURE);
+    }
+    (*exec_wc)++;
+    uint64_t t_exec_journaled = fep_tick();
+    fep_stat_exec_journaled(*exec_wc - 1, t_executed, t_exec_journaled);
+    fep_counter_add(FEP_M_EXECS_JOURNALED, 1);
+    if (fep_trace_sampled(execution.transaction_code)) {
+        fep_trace_put(FEP_TRACE_EXECUTED, execution.transaction_code, t_executed, *exec_wc - 1);
+        fep_trace_put(FEP_TRACE_EXEC_JOURNALED, execution.transaction_code, t_exec_journaled, *exec_wc - 1);
+    }
+
+    unsigned int spins = 0;
+    while (!spsc_ring_push(&exec_ring, &execution)) {
+        spsc_ring_idle(&spins);  // the updator is behind the DB
+    }
+}
+
+// krx_listener: validate, journal and hand executions to the updator
+void *listener_stage(void *arg) {
+    fep_stage *stage = arg;
+    struct pollfd fds[MAX_CLIENTS];
+    static fep_rx rx[MAX_CLIENTS];
+
+    fep_affinity_pin(stage->role);
+    fds[0].fd = krx_server_fd;
+    fds[0].events = POLLIN;
+    for (int i = 1; i < MAX_CLIENTS; i++) {
+        fds[i].fd = -1;
+    }
+
+    while (1) {
+        int activity = poll(fds, MAX_CLIENTS, busy_poll ? 0 : -1);
+        if (activity < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_message("ERROR", "socket", "Poll error");
+            exit(EXIT_FAILURE);
+        } else if (activity == 0) {
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int client_fd = accept(krx_server_fd, NULL, NULL);
+            if (client_fd >= 0) {
+                int i = 1;
+                while (i < MAX_CLIENTS && fds[i].fd != -1) {
+                    i++;
+                }
+                if (i == MAX_CLIENTS) {
+                    log_message("ERROR", "socket", "too many KRX connections, connection refused\n");
+                    close(client_fd);
+                } else {
+                    fds[i].fd = client_fd;
+                    fds[i].events = POLLIN;
+                    fep_rx_reset(&rx[i]);
+                    fep_gauge_add(FEP_G_KRX_CONNECTIONS, 1);
+                    log_message("INFO", "socket", "New KRX connection\n");
+                }
+            }
+        }
+
+        for (int i = 1; i < MAX_CLIENTS; i++) {
+            if (fds[i].fd == -1 || !(fds[i].revents & POLLIN)) {
+                continue;
+            }
+            ssize_t bytes_received = fep_rx_recv(&rx[i], fds[i].fd);
+            uint64_t t_executed = fep_tick();
+            const void *message;
+            if (bytes_received <= 0) {
+                log_message("ERROR", "socket", "Client disconnected\n");
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                fep_gauge_add(FEP_G_KRX_CONNECTIONS, -1);
+                continue;
+            }
+            // whole executions only; a partial one stays buffered until the rest arrives
+            while ((message = fep_rx_next(&rx[i], sizeof(kft_execution))) != NULL) {
+                receive_execution(message, t_executed);
+            }
+        }
+    }
+    return NULL;
+}
+
+char status_of(const kft_execution *execution) {
+    if (execution->status_code == 0) {
+        return 'D';
+    } else if (execution->status_code == 1) {
+        return 'C';
+    } else if (execution->status_code == 99) {
+        return 'R';
+    }
+    return 0;
+}
+
+unsigned int hash_transaction_code(const char *transaction_code) {
+    unsigned int h = 2166136261u; // FNV-1a
+    for (int i = 0; i < 7 && transaction_code[i] != '\0'; i++) {
+        h ^= (unsigned char)transaction_code[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Fold executions into status updates, last write wins per transaction_code
+int coalesce_executions(const kft_execution *execs, int count, fep_status_update *updates) {
+    static int slots[COALESCE_SLOTS];   // index into updates[] + 1, 0 = empty
+    int used = 0;
+
+    memset(slots, 0, sizeof(slots));
+    for (int k = 0; k < count; k++) {
+        char status = status_of(&execs[k]);
+        if (status == 0) {
+            continue;
+        }
+        unsigned int slot = hash_transaction_code(execs[k].transaction_code) & (COALESCE_SLOTS - 1);
+        while (slots[slot] != 0 &&
+               strncmp(updates[slots[slot] - 1].transaction_code, execs[k].transaction_code, 6) != 0) {
+            slot = (slot + 1) & (COALESCE_SLOTS - 1);
+        }
+        if (slots[slot] == 0) {
+            slots[slot] = ++used;
+        }
+        fep_status_update *update = &updates[slots[slot] - 1];
+        memcpy(update->transaction_code, execs[k].transaction_code, sizeof(update->transaction_code) - 1);
+        update->transaction_code[sizeof(update->transaction_code) - 1] = '\0';
+        update->status = status;
+        strncpy(update->reject_code, execs[k].reject_code, 4);
+        update->reject_code[4] = '\0';
+    }
+    return used;
+}
+
+// An execution can only follow an order already journaled. While that order's
+// insert is still spilled, its UPDATE would match no row, so wait for catch-up.
+void wait_for_spilled_inserts() {
+    int journaled = __atomic_load_n(order_wc, __ATOMIC_ACQUIRE);
+    while (__atomic_load_n(&spill.spilling, __ATOMIC_ACQUIRE) && __atomic_load_n(&spill.next, __ATOMIC_ACQUIRE) < journaled) {
+        struct timespec wait = {0, 1000000};
+        nanosleep(&wait, NULL);
+    }
+}
+
+void apply_executions(const kft_execution *execs, int count) {
+    static fep_status_update updates[EXEC_BATCH_MAX];
+
+    int used = coalesce_executions(execs, count, updates);
+    uint64_t t_batch = fep_clock_ns();
+    if (used > 0) {
+        wait_for_spilled_inserts();
+        if (fep_store_update_status(store, updates, used) != 0) {
+            log_message("ERROR", "db", "giving up on %d executions\n", count);
+        }
+        uint64_t batch_ns = fep_clock_ns() - t_batch;
+        fep_counter_add(FEP_M_DB_BATCHES, 1);
+        fep_counter_add(FEP_M_DB_BATCH_NS, batch_ns);
+        fep_gauge_set(FEP_G_DB_BATCH_LAST_NS, batch_ns);
+    }
+    fep_counter_add(FEP_M_EXECS_PERSISTED, count);
+    uint64_t t_persisted = fep_tick();
+    fep_stat_exec_persisted(*exec_rc, *exec_rc + count, t_persisted);
+    for (int k = 0; k < used; k++) {
+        if (fep_trace_sampled(updates[k].transaction_code)) {
+            fep_trace_put(FEP_TRACE_PERSISTED, updates[k].transaction_code, t_persisted, *exec_rc + count - 1);
+        }
+    }
+    *exec_rc += count;
+}
+
+// db_updator: drain the ring in batches, one status transaction per batch
+void *updator_stage(void *arg) {
+    fep_stage *stage = arg;
+    static kft_execution batch[EXEC_BATCH_MAX];
+
+    fep_affinity_pin(stage->role);
+    while (1) {
+        unsigned int spins = 0;
+        int n;
+        while ((n = spsc_ring_pop_batch(&exec_ring, batch, EXEC_BATCH_MAX)) == 0) {
+            spsc_ring_idle(&spins);
+        }
+        apply_executions(batch, n);
+    }
+    return NULL;
+}
+
+// Apply executions journaled but not yet applied before the rings take over
+void recover_executions() {
+    static kft_execution execs[EXEC_BATCH_MAX];
+
+    while (*exec_rc < *exec_wc) {
+        int want = *exec_wc - *exec_rc < EXEC_BATCH_MAX ? *exec_wc - *exec_rc : EXEC_BATCH_MAX;
+        ssize_t got = pread(exec_journal_fd, execs, want * sizeof(kft_execution), (off_t)*exec_rc * sizeof(kft_execution));
+        if (got < (ssize_t)sizeof(kft_execution)) {
+            log_message("ERROR", "file", "execution journal is shorter than wc %d\n", *exec_wc);
+            exit(EXIT_FAILURE);
+        }
+        apply_executions(execs, got / sizeof(kft_execution));
+    }
+    log_message("INFO", "recovery", "exec rc = %d\n", *exec_rc);
+}
+
+// FEP_CPUS="r,s,l,u" places the stages that FEP_AFFINITY leaves out;
+// cpus beyond the machine wrap around
+void assign_cpus(fep_stage *stages, int count) {
+    const char *cpus = getenv("FEP_CPUS");
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    char list[128];
+
+    strncpy(list, cpus != NULL ? cpus : DEFAULT_CPUS, sizeof(list) - 1);
+    list[sizeof(list) - 1] = '\0';
+    char *save = NULL;
+    char *tok = strtok_r(list, ",", &save);
+    for (int i = 0; i < count; i++) {
+        int cpu = tok != NULL ? atoi(tok) : i + 1;
+        fep_affinity_default(stages[i].role, ncpu > 0 ? cpu % ncpu : 0);
+        if (tok != NULL) {
+            tok = strtok_r(NULL, ",", &save);
+        }
+    }
+}
+
+int main() {
+    fep_stage stages[] = {
+        {"reactor", reactor_stage, FEP_ROLE_REACTOR},
+        {"sender", sender_stage, FEP_ROLE_SENDER},
+        {"listener", listener_stage, FEP_ROLE_LISTENER},
+        {"updator", updator_stage, FEP_ROLE_UPDATOR},
+    };
+    int stage_count = sizeof(stages) / sizeof(stages[0]);
+
+    init_log();
+    if (fep_stat_open() != 0) {
+        log_message("ERROR", "stat", "latency stats disabled, cannot map %s\n", FEP_STAT_SHM_NAME);
+    }
+    if (fep_trace_open() != 0) {
+        log_message("ERROR", "trace", "order tracing disabled, cannot map %s\n", FEP_TRACE_SHM_NAME);
+    }
+    if (fep_metrics_open(FEP_P_INTEGRATED) != 0) {
+        log_message("ERROR", "metrics", "metrics disabled, cannot map %s\n", FEP_METRICS_SHM_NAME);
+    }
+    if (fep_repl_open() != 0) {
+        log_message("ERROR", "repl", "sync replication ignored, cannot map %s\n", FEP_REPL_SHM_NAME);
+    }
+    for (int g = 0; g < FEP_G_COUNT; g++) {
+        fep_gauge_set(g, 0);
+    }
+
+    // order and execution times are KST, as in oms_listener and krx_listener
+    setenv("TZ", "Asia/Seoul", 1);
+    tzset();
+    const char *busy_env = getenv("FEP_BUSY_POLL");
+    busy_poll = busy_env != NULL && atoi(busy_env) != 0;
+
+    store = fep_store_open("integrated", DB_POOL_MIN, DB_POOL_MAX);
+    if (store == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    order_wc = map_counter("/W_count");
+    order_rc = map_counter("/R_count");
+    exec_wc = map_counter("/KRX_W_count");
+    exec_rc = map_counter("/KRX_R_count");
+    order_journal_fd = open_journal("received_data.txt", sizeof(fkq_order));
+    exec_journal_fd = open_journal("krx_received_data.txt", sizeof(kft_execution));
+
+    assign_cpus(stages, stage_count);
+    if (spsc_ring_init(&order_ring, ORDER_RING_SIZE, sizeof(order_slot)) != 0 ||
+        spsc_ring_init(&exec_ring, EXEC_RING_SIZE, sizeof(kft_execution)) != 0) {
+        log_message("ERROR", "ring", "ring allocation failed\n");
+        return EXIT_FAILURE;
+    }
+    // each ring on its producer's node, then faulted in before the first order
+    fep_affinity_bind_memory(order_ring.data, ORDER_RING_SIZE * sizeof(order_slot), FEP_ROLE_REACTOR, "order ring");
+    fep_affinity_bind_memory(exec_ring.data, EXEC_RING_SIZE * sizeof(kft_execution), FEP_ROLE_LISTENER, "execution ring");
+    fep_mem_report("order ring", ORDER_RING_SIZE * sizeof(order_slot),
+                   fep_mem_prepare(order_ring.data, ORDER_RING_SIZE * sizeof(order_slot), order_ring.mem_flags));
+    fep_mem_report("execution ring", EXEC_RING_SIZE * sizeof(kft_execution),
+                   fep_mem_prepare(exec_ring.data, EXEC_RING_SIZE * sizeof(kft_execution), exec_ring.mem_flags));
+
+    oms_server_fd = open_server_socket(FEP_OMS_R_PORT);
+    krx_server_fd = open_server_socket(FEP_KRX_R_PORT);
+    recover_executions();
+    stages[1].recover_end = *order_wc;
+
+    for (int i = 0; i < stage_count; i++) {
+        if (pthread_create(&stages[i].thread, NULL, stages[i].run, &stages[i]) != 0) {
+            log_message("ERROR", "stage", "failed to start %s\n", stages[i].name);
+            return EXIT_FAILURE;
+        }
+    }
+    log_message("INFO", "stage", "integrated FEP running (busy poll %s)\n", busy_poll ? "on" : "off");
+
+    for (int i = 0; i < stage_count; i++) {
+        pthread_join(stages[i].thread, NULL);
+    }
+    fep_store_close(store);
+    return 0;
+}
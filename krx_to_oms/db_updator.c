@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,7 +11,13 @@
 #include <mqueue.h>
 #include <oms_fep_krx_struct.h>
 #include <envs.h>
-#include <mysql/mysql.h>
+#include <fep_affinity.h>
+#include <fep_memory.h>
+#include <fep_clock.h>
+#include <fep_store.h>
+#include <fep_stat.h>
+#include <fep_trace.h>
+#include <fep_metrics.h>
 
 // shared memory
 #include <sys/mman.h>
@@ -21,6 +28,8 @@
 #include <stdarg.h>
 #include <time.h>
 
+#include <pthread.h>
+
 typedef struct {
     int rc;
 } KRX_R_count;
@@ -29,8 +38,34 @@ typedef struct {
 
 #define LOG_FILE_PATH "/home/ubuntu/logs/db_updator.log"
 
+// batched status updates
+#define EXEC_BATCH_MIN 8        // batch size when the journal is nearly caught up
+#define EXEC_BATCH_MAX 512      // upper bound of executions per transaction
+#define DB_POOL_SIZE 1          // one writer keeps batches in journal order
+
+// coalescing: one status write per transaction_code per flush window
+#define COALESCE_SLOTS (EXEC_BATCH_MAX * 2)   // open addressing table, power of 2
+#define READ_CHUNK 256                        // journal records per fread
+#define FLUSH_WINDOW_MS 2                     // default; FEP_FLUSH_WINDOW_MS overrides, 0 disables
+#define INSERT_WAIT_LOG_MS 5000               // report a db_inserter this far behind
+#define RETRY_BACKOFF_MAX_MS 1000             // a batch the DB could not take is retried, backing off up to this
+#define DEAD_LETTER_FILE "db_dead_executions.txt"
 
 FILE *log_file = NULL;
+fep_store *store = NULL;
+
+pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;  // the pool thread logs too
+int *order_wc = NULL;   // /W_count, orders journaled by oms_listener
+int *insert_rc = NULL;  // /DB_R_count, orders inserted by db_inserter
+int batch_size = EXEC_BATCH_MIN;
+int flush_window_ms = FLUSH_WINDOW_MS;
+int dead_letter_fd = -1;
+
+// Latest execution per transaction_code in the current batch
+kft_execution coalesced[EXEC_BATCH_MAX];
+int coalesced_count = 0;
+int coalesce_slots[COALESCE_SLOTS];   // index into coalesced[] + 1, 0 = empty
+long folded_total = 0;
 
 // Initialize logging
 void init_log() {
@@ -44,13 +79,15 @@ void init_log() {
 
 // Log function with level and module
 void log_message(const char *level, const char *module, const char *format, ...) {
-    if (!log_file) return;
-
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    char time_buffer[20];
+    pthread_mutex_lock(&log_mutex);
+    if (!log_file) {
+        pthread_mutex_unlock(&log_mutex);
+        return;
+    }
 
-    strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", tm_info);
+    char time_buffer[FEP_CLOCK_LOG_TIME_LEN + 1];
+    fep_clock_log_time(time_buffer);
+    time_buffer[19] = '\0';     // YYYY-MM-DD HH:MM:SS
     fprintf(log_file, "[%s] [%s] [%s] ", time_buffer, level, module);
 
     va_list args;
@@ -58,6 +95,7 @@ void log_message(const char *level, const char *module, const char *format, ...)
     vfprintf(log_file, format, args);
     va_end(args);
     fflush(log_file);
+    pthread_mutex_unlock(&log_mutex);
 }
 
 void print_kft_execution(const kft_execution *execution) {
@@ -81,91 +119,308 @@ void close_log() {
     }
 }
 
-int main() {
-
-    init_log();
+char status_of(const kft_execution *execution) {
+    if (execution->status_code == 0) {
+        return 'D';
+    } else if (execution->status_code == 1) {
+        return 'C';
+    } else if (execution->status_code == 99) {
+        return 'R';
+    }
+    return 0;
+}
 
-    // mysql connection
-    MYSQL *conn;
-    MYSQL_RES *res;
-    MYSQL_ROW row;
-    
-    // MySQL 초기화
-    conn = mysql_init(NULL);
-    if (conn == NULL) {
-        log_message("ERROR", "db", "mysql_init() failed\n");
-        return EXIT_FAILURE;
+// Create or open a journal counter, 0 when newly created
+int *map_counter(const char *shared_mem_name) {
+    int is_initialized = 0;
+    int shm_fd = shm_open(shared_mem_name, O_CREAT | O_RDWR | O_EXCL, 0666);
+    if (shm_fd == -1) {
+        if (errno != EEXIST || (shm_fd = shm_open(shared_mem_name, O_RDWR, 0666)) == -1) {
+            log_message("ERROR", "shm", "shm_open %s failed\n", shared_mem_name);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        is_initialized = 1;
     }
-    // MySQL connection options
-    // mysql_options(conn, MYSQL_OPT_SSL_MODE, "DISABLED"); // Disable SSL if not needed
-    // mysql_options(conn, MYSQL_OPT_CONNECT_TIMEOUT, (const void *)5); // Set timeout
 
-    // 데이터베이스 연결
-    if (mysql_real_connect(conn, MYSQL_IP, MYSQL_USER, MYSQL_PW, MYSQL_DBNAME, 0, NULL, 0) == NULL) {
-        log_message("ERROR", "db", "mysql_real_connect() failed: %s\n", mysql_error(conn));
-        mysql_close(conn);
-        return EXIT_FAILURE;
+    if (ftruncate(shm_fd, sizeof(int)) == -1) {
+        log_message("ERROR", "shm", "ftruncate %s failed\n", shared_mem_name);
+        close(shm_fd);
+        exit(EXIT_FAILURE);
     }
+    int *counter = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (counter == MAP_FAILED) {
+        log_message("ERROR", "shm", "mmap %s failed\n", shared_mem_name);
+        exit(EXIT_FAILURE);
+    }
+    fep_mem_report(shared_mem_name, sizeof(int), fep_mem_prepare(counter, sizeof(int), 0));
+    if (is_initialized) {
+        *counter = 0;
+    }
+    log_message("DEBUG", "shm", "%s = %d\n", shared_mem_name, *counter);
+    return counter;
+}
 
+// An execution only exists for an order that was journaled already. Wait until
+// db_inserter has inserted everything journaled so far, or the UPDATE matches no row.
+void wait_for_inserts() {
+    int journaled = __atomic_load_n(order_wc, __ATOMIC_ACQUIRE);
+    int waited_ms = 0;
+    while (__atomic_load_n(insert_rc, __ATOMIC_ACQUIRE) < journaled) {
+        if (++waited_ms == INSERT_WAIT_LOG_MS) {
+            log_message("ERROR", "db", "waiting for db_inserter: %d of %d orders inserted\n",
+                        __atomic_load_n(insert_rc, __ATOMIC_ACQUIRE), journaled);
+        }
+        usleep(1000);
+    }
+}
 
-    mqd_t mq;
-    struct mq_attr attr;
+// Grow the batch while the journal backlog outpaces us, shrink it once we are caught up
+int next_batch_size(int backlog) {
+    if (backlog > batch_size && batch_size < EXEC_BATCH_MAX) {
+        batch_size *= 2;
+    } else if (backlog < batch_size / 4 && batch_size > EXEC_BATCH_MIN) {
+        batch_size /= 2;
+    }
+    return backlog < batch_size ? backlog : batch_size;
+}
 
+// Apply the batch atomically. Returns 0 once committed, FEP_STORE_RETRY or FEP_STORE_REJECTED.
+int apply_exec_batch(const kft_execution *execs, int count) {
+    static fep_status_update updates[EXEC_BATCH_MAX];
 
-    void read_exec_from_bin_file(FILE *file, int start, int end, KRX_R_count *r_count) {
+    for (int i = 0; i < count; i++) {
+        memcpy(updates[i].transaction_code, execs[i].transaction_code, sizeof(updates[i].transaction_code));
+        updates[i].transaction_code[sizeof(updates[i].transaction_code) - 1] = '\0';
+        updates[i].status = status_of(&execs[i]);
+        strncpy(updates[i].reject_code, execs[i].reject_code, 4);  // 4 bytes + null terminator
+        updates[i].reject_code[4] = '\0';
+    }
 
-        kft_execution execution;
-        memset(&execution, 0, sizeof(execution)); // Initialize the struct
+    // the MySQL store reconnects and retries on connection loss until the DB takes the batch
+    int result = fep_store_update_status(store, updates, count);
+    if (result != 0) {
+        log_message("ERROR", "db", "store rejected a batch of %d status updates\n", count);
+        return result;
+    }
+    log_message("INFO", "db", "batch of %d status updates committed\n", count);
+    return 0;
+}
 
-        while(end > r_count->rc){
-            if (fseek(file, sizeof(kft_execution) * r_count->rc, SEEK_SET) != 0) {
-            log_message("ERROR", "file", "Failed to seek to line");
-            fclose(file);
+// An execution whose update the DB refuses, kept for a load once the DB is fixed
+void divert_execution(const kft_execution *execution) {
+    if (dead_letter_fd == -1) {
+        const char *home_dir = getenv("HOME");
+        char filepath[256];
+        snprintf(filepath, sizeof(filepath), "%s/%s", home_dir != NULL ? home_dir : ".", DEAD_LETTER_FILE);
+        dead_letter_fd = open(filepath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (dead_letter_fd == -1) {
+            // skipping the execution would lose it without a trace
+            log_message("ERROR", "file", "cannot open %s\n", filepath);
             exit(EXIT_FAILURE);
+        }
+    }
+    if (write(dead_letter_fd, execution, sizeof(kft_execution)) != sizeof(kft_execution) || fdatasync(dead_letter_fd) != 0) {
+        log_message("ERROR", "file", "cannot write %s\n", DEAD_LETTER_FILE);
+        exit(EXIT_FAILURE);
+    }
+    fep_counter_add(FEP_M_EXECS_DIVERTED, 1);
+    log_message("ERROR", "db", "status update of %.6s refused by the DB, diverted to %s\n",
+                execution->transaction_code, DEAD_LETTER_FILE);
+}
+
+// Apply the coalesced executions of journal records [first, last]. A busy or locked
+// DB is waited out. A batch the DB refuses (constraint, type, schema) is applied in
+// halves until the refused updates are alone; their executions are appended to
+// $HOME/db_dead_executions.txt in the journal's format and counted in execs_diverted,
+// so /KRX_R_count can move on. Updates only set a status, so applying one twice is harmless.
+// Returns the number of updates diverted.
+int apply_execs(const kft_execution *execs, int count, int first, int last) {
+    for (int backoff_ms = 1; ; ) {
+        int result = apply_exec_batch(execs, count);
+        if (result == 0) {
+            return 0;
+        }
+        if (result == FEP_STORE_REJECTED) {
+            break;
+        }
+        log_message("ERROR", "db", "executions %d-%d retried in %d ms\n", first, last, backoff_ms);
+        usleep(backoff_ms * 1000);
+        backoff_ms = backoff_ms * 2 < RETRY_BACKOFF_MAX_MS ? backoff_ms * 2 : RETRY_BACKOFF_MAX_MS;
+    }
+
+    if (count == 1) {
+        divert_execution(&execs[0]);
+        return 1;
+    }
+    log_message("ERROR", "db", "%d status updates of executions %d-%d refused by the DB, applying them in halves\n",
+                count, first, last);
+    int half = count / 2;
+    return apply_execs(execs, half, first, last) + apply_execs(execs + half, count - half, first, last);
+}
+
+unsigned int hash_transaction_code(const char *transaction_code) {
+    unsigned int h = 2166136261u; // FNV-1a
+    for (int i = 0; i < 7 && transaction_code[i] != '\0'; i++) {
+        h ^= (unsigned char)transaction_code[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void coalesce_reset() {
+    memset(coalesce_slots, 0, sizeof(coalesce_slots));
+    coalesced_count = 0;
+}
+
+// Fold an execution into the batch, last write wins per transaction_code.
+// Returns 0 if it would need a new entry while the batch already holds `limit` entries.
+int coalesce_execution(const kft_execution *execution, int limit) {
+    unsigned int slot = hash_transaction_code(execution->transaction_code) & (COALESCE_SLOTS - 1);
+
+    while (coalesce_slots[slot] != 0) {
+        kft_execution *prev = &coalesced[coalesce_slots[slot] - 1];
+        if (strncmp(prev->transaction_code, execution->transaction_code, sizeof(prev->transaction_code)) == 0) {
+            log_message("DEBUG", "db", "%s: %c folded into %c\n", execution->transaction_code,
+                        status_of(prev), status_of(execution));
+            *prev = *execution;
+            folded_total++;
+            return 1;
+        }
+        slot = (slot + 1) & (COALESCE_SLOTS - 1);
+    }
+
+    if (coalesced_count >= limit) {
+        return 0;
+    }
+    coalesced[coalesced_count] = *execution;
+    coalesce_slots[slot] = ++coalesced_count;
+    return 1;
+}
+
+void read_exec_from_bin_file(FILE *file, int end, KRX_R_count *r_count) {
+    static kft_execution chunk[READ_CHUNK];
+
+    while (end > r_count->rc) {
+        int limit = next_batch_size(end - r_count->rc);
+        int pos = r_count->rc;
+        int full = 0;
+
+        // fold journal records until the batch holds `limit` distinct orders.
+        // The whole run [rc, pos) commits together, so the final state per order is
+        // exactly what applying the records one by one would leave behind.
+        coalesce_reset();
+        while (pos < end && !full) {
+            int want = end - pos < READ_CHUNK ? end - pos : READ_CHUNK;
+            if (fseek(file, sizeof(kft_execution) * pos, SEEK_SET) != 0) {
+                log_message("ERROR", "file", "Failed to seek to line");
+                fclose(file);
+                exit(EXIT_FAILURE);
             }
-            fread(&execution, sizeof(kft_execution), 1, file);
-            print_kft_execution(&execution);
-            
-            char query[512] = {0};
-            char status;
-            char truncated_reject_code[5];  // 4 bytes + 1 for null terminator
-            strncpy(truncated_reject_code, execution.reject_code, 4);
-            truncated_reject_code[4] = '\0';  // Ensure null termination
-            
-            if (execution.status_code == 0) {
-                // db update
-                // Create query string with transaction_code safely    
-                // snprintf(query, sizeof(query), "UPDATE tx_history SET status = 'D' WHERE transaction_code = '%s'", execution.transaction_code);
-                snprintf(query, sizeof(query),
-                "UPDATE tx_history SET status = 'D', reject_code = '%s' WHERE transaction_code = '%s'",
-                truncated_reject_code, execution.transaction_code);
-                status = 'D';
-            } else if (execution.status_code == 1){
-                // snprintf(query, sizeof(query), "UPDATE tx_history SET status = 'C' WHERE transaction_code = '%s'", execution.transaction_code);
-                snprintf(query, sizeof(query),
-                "UPDATE tx_history SET status = 'C', reject_code = '%s' WHERE transaction_code = '%s'",
-                truncated_reject_code, execution.transaction_code);
-                status = 'C';
-            } else if (execution.status_code == 99){
-                // snprintf(query, sizeof(query), "UPDATE tx_history SET status = 'R' WHERE transaction_code = '%s'", execution.transaction_code);
-                snprintf(query, sizeof(query),
-                "UPDATE tx_history SET status = 'R', reject_code = '%s' WHERE transaction_code = '%s'",
-                truncated_reject_code, execution.transaction_code);
-                status = 'R';
+            int got = fread(chunk, sizeof(kft_execution), want, file);
+            if (got <= 0) {
+                log_message("ERROR", "file", "journal is shorter than wc %d\n", end);
+                end = pos;
+                break;
             }
 
-            // Execute the update query
-            if (mysql_query(conn, query)) {
-                fprintf(stderr, "UPDATE query failed: %s\n", mysql_error(conn));
-                mysql_close(conn);
-                // return EXIT_FAILURE;
+            for (int k = 0; k < got; k++) {
+                if (status_of(&chunk[k]) == 0) {
+                    log_message("ERROR", "db", "unknown status code %d for %s, skipped\n",
+                                chunk[k].status_code, chunk[k].transaction_code);
+                } else if (!coalesce_execution(&chunk[k], limit)) {
+                    full = 1;
+                    break;
+                }
+                print_kft_execution(&chunk[k]);
+                pos++;
             }
-            log_message("INFO", "db","update status to %c executed successfully!\n", status);
+        }
 
-            r_count->rc++;
-            log_message("INFO", "shm", "current exec rc = %d\n", r_count->rc);
-        }   
+        int diverted = 0;
+        if (coalesced_count > 0) {
+            wait_for_inserts();
+            uint64_t t_batch = fep_clock_ns();
+            // rc stays where it is until the store took or diverted every update
+            diverted = apply_execs(coalesced, coalesced_count, r_count->rc, pos - 1);
+            uint64_t batch_ns = fep_clock_ns() - t_batch;
+            fep_counter_add(FEP_M_DB_BATCHES, 1);
+            fep_counter_add(FEP_M_DB_BATCH_NS, batch_ns);
+            fep_gauge_set(FEP_G_DB_BATCH_LAST_NS, batch_ns);
+        }
+        uint64_t t_persisted = fep_tick();
+        fep_counter_add(FEP_M_EXECS_PERSISTED, pos - r_count->rc - diverted);
+        fep_stat_exec_persisted(r_count->rc, pos, t_persisted);
+        // one event per order: folded executions were committed by the same write
+        for (int k = 0; k < coalesced_count; k++) {
+            if (fep_trace_sampled(coalesced[k].transaction_code)) {
+                fep_trace_put(FEP_TRACE_PERSISTED, coalesced[k].transaction_code, t_persisted, pos - 1);
+            }
+        }
+        log_message("INFO", "db", "%d executions written as %d updates (%ld folded in total)\n",
+                    pos - r_count->rc, coalesced_count, folded_total);
+        r_count->rc = pos;
+        log_message("INFO", "shm", "current exec rc = %d (backlog %d)\n", r_count->rc, end - r_count->rc);
     }
+}
+
+// Keep collecting wc wakeups for up to flush_window_ms, so bursts of executions
+// for the same order fold into one write. Returns the highest wc seen.
+int extend_flush_window(mqd_t mq, struct mq_attr *attr, int end, KRX_R_count *r_count) {
+    struct timespec deadline;
+    int received_wc;
+
+    if (flush_window_ms <= 0) {
+        return end;
+    }
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += flush_window_ms * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+
+    while (end - r_count->rc < EXEC_BATCH_MAX &&
+           mq_timedreceive(mq, (char *)&received_wc, attr->mq_msgsize, NULL, &deadline) != -1) {
+        if (received_wc > end) {
+            end = received_wc;
+        }
+    }
+    return end;
+}
+
+int main() {
+
+    // log times are KST, also when formatted locally without fep_clockd
+    setenv("TZ", "Asia/Seoul", 1);
+    tzset();
+    init_log();
+    fep_affinity_pin(FEP_ROLE_UPDATOR);
+    if (fep_stat_open() != 0) {
+        log_message("ERROR", "stat", "latency stats disabled, cannot map %s\n", FEP_STAT_SHM_NAME);
+    }
+    if (fep_trace_open() != 0) {
+        log_message("ERROR", "trace", "order tracing disabled, cannot map %s\n", FEP_TRACE_SHM_NAME);
+    }
+    if (fep_metrics_open(FEP_P_DB_UPDATOR) != 0) {
+        log_message("ERROR", "metrics", "metrics disabled, cannot map %s\n", FEP_METRICS_SHM_NAME);
+    }
+
+    const char *window_env = getenv("FEP_FLUSH_WINDOW_MS");
+    if (window_env != NULL) {
+        flush_window_ms = atoi(window_env);
+    }
+
+    // MySQL 초기화
+    store = fep_store_open("update", DB_POOL_SIZE, DB_POOL_SIZE);
+    if (store == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    mqd_t mq;
+    struct mq_attr attr;
+
+    order_wc = map_counter("/W_count");
+    insert_rc = map_counter("/DB_R_count");
 
     // mmap memory code
     const char *shared_mem_name = "/KRX_R_count";
@@ -210,6 +465,7 @@ int main() {
         shm_unlink(shared_mem_name);
         exit(EXIT_FAILURE);
     }
+    fep_mem_report(shared_mem_name, shared_mem_size, fep_mem_prepare(r_count, shared_mem_size, 0));
 
     // Initialize shared memory if it is newly created
     if (is_initialized) {
@@ -234,6 +490,9 @@ int main() {
             log_message("ERROR", "file", "Error opening file");
             return;
         }
+    if (fep_journal_check(fileno(file), filepath, sizeof(kft_execution)) != 0) {
+        exit(EXIT_FAILURE);
+    }
     log_message("INFO", "file", "file is opened\n");
 
     // Open the message queue
@@ -244,6 +503,11 @@ int main() {
     }
     log_message("DEBUG", "mq", "message queue opened\n");
 
+    if (mq_getattr(mq, &attr) == -1) {
+        log_message("ERROR", "mq", "mq_getattr error");
+        exit(1);
+    }
+
     int received_wc; 
 
     while(1){
@@ -257,7 +521,8 @@ int main() {
         // Convert the byte array back to a long
         log_message("DEBUG", "mq", "Received execution wc: %d\n", received_wc);
         if(received_wc > r_count->rc){
-            read_exec_from_bin_file(file, r_count->rc, received_wc, r_count);
+            received_wc = extend_flush_window(mq, &attr, received_wc, r_count);
+            read_exec_from_bin_file(file, received_wc, r_count);
         }
     }
     
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,6 +11,14 @@
 #include <mqueue.h>
 #include <oms_fep_krx_struct.h>
 #include <envs.h>
+#include <fep_affinity.h>
+#include <fep_memory.h>
+#include <fep_clock.h>
+#include <fep_validate.h>
+#include <fep_codec.h>
+#include <fep_stat.h>
+#include <fep_trace.h>
+#include <fep_metrics.h>
 
 // shared memory
 #include <sys/mman.h>
@@ -20,6 +29,8 @@
 #include <stdarg.h>
 #include <time.h>
 
+#include <netinet/tcp.h>
+
 typedef struct {
     int wc; // Write counter
 } KRX_W_count;
@@ -28,11 +39,75 @@ typedef struct {
 
 // socket
 #define MAX_CLIENTS 20
+
+// execution report fan-out to OMS subscribers
+#ifndef FEP_OMS_EXEC_PORT
+#define FEP_OMS_EXEC_PORT (FEP_KRX_R_PORT + 1)
+#endif
+#define MAX_SUBSCRIBERS 20
+#define SUB_LISTEN_SLOT MAX_CLIENTS                       // fds[] index of the subscriber listen socket
+#define SUB_SLOT(k) (MAX_CLIENTS + 1 + (k))               // fds[] index of subscriber k
+#define POLL_COUNT (MAX_CLIENTS + 1 + MAX_SUBSCRIBERS)
+#define REPLAY_BATCH 64                                   // reports replayed per POLLOUT wakeup
+#define ORDER_INDEX_SIZE (1 << 20)                        // power of 2, larger than orders per trading day
+
+// execution stream sequencing
+#define SEQ_WINDOW 65536                                  // seqs tracked for duplicates per session, power of 2
+#define MAX_SESSIONS MAX_CLIENTS
+#define RESEND_TIMEOUT_MS 500                             // a requested gap still open after this is requested again
 #define LOG_FILE_PATH "/home/ubuntu/logs/krx_listener.log"
-#define ORDER_TIME_FORMAT "%Y%m%d%H%M%S"
 
 FILE *log_file = NULL;
 
+typedef enum {
+    SUB_WAITING,    // connected, ofq_subscribe not received yet
+    SUB_REPLAYING,  // catching up from the execution journal
+    SUB_LIVE        // receives reports as executions arrive
+} subscriber_state;
+
+typedef struct {
+    int fd;
+    subscriber_state state;
+    char user_id[21];        // empty: every execution of the session
+    int next_seq;            // journal index of the next execution to deliver
+    char pending[sizeof(fot_execution_report)]; // unsent tail of a partially written report
+    int pending_len;
+    int pending_off;
+} exec_subscriber;
+
+typedef struct {
+    char transaction_code[7];
+    char user_id[21];
+} order_index_entry;
+
+// One per KRX execution session, which outlives its connections: the exchange goes on
+// numbering across a reconnect. KRX reports from one address per session.
+typedef struct {
+    in_addr_t peer;
+    int fd;             // current connection, -1 while KRX is reconnecting
+    int reconnected;    // no sequenced execution on the current connection yet
+    int next_seq;       // every seq below this one has been received
+    int high_seq;       // highest seq received so far
+    int requested_seq;  // highest seq already covered by a resend request
+    long progress_ms;   // when next_seq last moved or the open gap was last requested
+    unsigned long long window[SEQ_WINDOW / 64]; // received bits for [next_seq, next_seq + SEQ_WINDOW)
+    long duplicates;
+    long gaps;
+} exec_session;
+
+exec_subscriber subscribers[MAX_SUBSCRIBERS];
+exec_session sessions[MAX_SESSIONS];
+int session_count = 0;
+exec_session *connection_session[MAX_CLIENTS];  // indexed like fds[]
+
+// transaction_code -> user_id, built by tailing the order journal written by oms_listener
+order_index_entry order_index[ORDER_INDEX_SIZE];
+char order_journal_path[256];
+int order_journal_fd = -1;
+long order_journal_pos = 0;  // order records indexed so far
+
+int exec_journal_fd = -1;    // read side of krx_received_data.txt, used for replay
+
 
 // Initialize logging
 void init_log() {
@@ -48,11 +123,9 @@ void init_log() {
 void log_message(const char *level, const char *module, const char *format, ...) {
     if (!log_file) return;
 
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    char time_buffer[20];
-
-    strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", tm_info);
+    char time_buffer[FEP_CLOCK_LOG_TIME_LEN + 1];
+    fep_clock_log_time(time_buffer);
+    time_buffer[19] = '\0';     // YYYY-MM-DD HH:MM:SS
     fprintf(log_file, "[%s] [%s] [%s] ", time_buffer, level, module);
 
     va_list args;
@@ -89,42 +162,436 @@ void save_order_to_file_bin(kft_execution *execution, FILE *file) {
         fflush(file);
 }
 
-int is_order_time_future(const char *order_time) {
+unsigned int hash_transaction_code(const char *transaction_code) {
+    unsigned int h = 2166136261u; // FNV-1a
+    for (int i = 0; i < 7 && transaction_code[i] != '\0'; i++) {
+        h ^= (unsigned char)transaction_code[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void index_order(const fkq_order *order) {
+    unsigned int slot = hash_transaction_code(order->transaction_code) & (ORDER_INDEX_SIZE - 1);
+
+    for (int probe = 0; probe < ORDER_INDEX_SIZE; probe++) {
+        order_index_entry *entry = &order_index[slot];
+        if (entry->transaction_code[0] == '\0' ||
+            strncmp(entry->transaction_code, order->transaction_code, sizeof(entry->transaction_code)) == 0) {
+            memcpy(entry->transaction_code, order->transaction_code, sizeof(entry->transaction_code));
+            entry->transaction_code[sizeof(entry->transaction_code) - 1] = '\0';
+            memcpy(entry->user_id, order->user_id, sizeof(entry->user_id));
+            entry->user_id[sizeof(entry->user_id) - 1] = '\0';
+            return;
+        }
+        slot = (slot + 1) & (ORDER_INDEX_SIZE - 1);
+    }
+    log_message("ERROR", "report", "order index is full, %s is not indexed\n", order->transaction_code);
+}
+
+// Index the orders appended to received_data.txt since the last call
+void tail_order_journal() {
+    fkq_order orders[256];
+
+    if (order_journal_fd == -1) {
+        order_journal_fd = open(order_journal_path, O_RDONLY);
+        if (order_journal_fd == -1) {
+            return; // oms_listener has not created the journal yet
+        }
+    }
+
+    while (1) {
+        ssize_t bytes_read = pread(order_journal_fd, orders, sizeof(orders), order_journal_pos * sizeof(fkq_order));
+        int count = bytes_read > 0 ? bytes_read / sizeof(fkq_order) : 0;
+        for (int i = 0; i < count; i++) {
+            index_order(&orders[i]);
+        }
+        order_journal_pos += count;
+        if (count < (int)(sizeof(orders) / sizeof(fkq_order))) {
+            break;
+        }
+    }
+}
+
+const char *lookup_user_id(const char *transaction_code, int tail_on_miss) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        unsigned int slot = hash_transaction_code(transaction_code) & (ORDER_INDEX_SIZE - 1);
+        for (int probe = 0; probe < ORDER_INDEX_SIZE; probe++) {
+            order_index_entry *entry = &order_index[slot];
+            if (entry->transaction_code[0] == '\0') {
+                break;
+            }
+            if (strncmp(entry->transaction_code, transaction_code, sizeof(entry->transaction_code) - 1) == 0) {
+                return entry->user_id;
+            }
+            slot = (slot + 1) & (ORDER_INDEX_SIZE - 1);
+        }
+        if (!tail_on_miss) {
+            break;
+        }
+        tail_order_journal(); // the order may have been journaled after our last look
+    }
+    return "";
+}
+
+void build_execution_report(fot_execution_report *report, const kft_execution *execution, int seq, const char *user_id) {
+    memset(report, 0, sizeof(fot_execution_report));
+    report->hdr.tr_id = 13;
+    report->hdr.length = sizeof(fot_execution_report);
+    report->seq = seq;
+    memcpy(report->transaction_code, execution->transaction_code, sizeof(report->transaction_code) - 1);
+    strncpy(report->user_id, user_id, sizeof(report->user_id) - 1);
+    report->status_code = execution->status_code;
+    memcpy(report->time, execution->time, sizeof(report->time) - 1);
+    report->executed_price = execution->executed_price;
+    memcpy(report->original_order, execution->original_order, sizeof(report->original_order) - 1);
+    memcpy(report->reject_code, execution->reject_code, sizeof(report->reject_code) - 1);
+}
 
-    struct tm order_tm = {0};
-    time_t order_epoch, current_time;
+int subscriber_wants(const exec_subscriber *sub, const char *user_id) {
+    return sub->user_id[0] == '\0' || strcmp(sub->user_id, user_id) == 0;
+}
+
+void close_subscriber(exec_subscriber *sub, struct pollfd *pfd) {
+    log_message("INFO", "report", "subscriber %s disconnected (next seq %d)\n",
+                sub->user_id[0] ? sub->user_id : "*", sub->next_seq);
+    close(sub->fd);
+    sub->fd = -1;
+    pfd->fd = -1;
+    fep_gauge_add(FEP_G_SUBSCRIBERS, -1);
+}
+
+// Returns 1 when the subscriber is free to take the next report, 0 while bytes are still pending, -1 on error
+int flush_subscriber(exec_subscriber *sub) {
+    while (sub->pending_off < sub->pending_len) {
+        ssize_t sent = send(sub->fd, sub->pending + sub->pending_off, sub->pending_len - sub->pending_off, MSG_NOSIGNAL);
+        if (sent < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        sub->pending_off += sent;
+    }
+    sub->pending_len = sub->pending_off = 0;
+    return 1;
+}
 
-    // Convert order_time string to struct tm
-    if (strptime(order_time, ORDER_TIME_FORMAT, &order_tm) == NULL) {
-        fprintf(stderr, "Error parsing order_time: %s\n", order_time);
-        return -1; // Error case
+// Returns 1 when the report is accepted (possibly with a pending tail), 0 when the socket is full, -1 on error
+int send_report(exec_subscriber *sub, const fot_execution_report *report) {
+    if (sub->pending_len > 0) {
+        return 0;
+    }
+    ssize_t sent = send(sub->fd, report, sizeof(fot_execution_report), MSG_NOSIGNAL);
+    if (sent < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
     }
+    if (sent < (ssize_t)sizeof(fot_execution_report)) {
+        memcpy(sub->pending, (const char *)report + sent, sizeof(fot_execution_report) - sent);
+        sub->pending_len = sizeof(fot_execution_report) - sent;
+        sub->pending_off = 0;
+    }
+    return 1;
+}
 
-    // Convert struct tm to epoch time
-    order_epoch = mktime(&order_tm);
-    if (order_epoch == -1) {
-        fprintf(stderr, "Error converting order_time to epoch\n");
-        return -1;
+// Replay journaled executions [next_seq, journal_count) to a subscriber that is catching up.
+// The execution journal is the replay buffer, so a slow subscriber never holds memory here.
+void replay_subscriber(exec_subscriber *sub, struct pollfd *pfd, int journal_count) {
+    int rc = flush_subscriber(sub);
+    if (rc <= 0) {
+        if (rc < 0) {
+            close_subscriber(sub, pfd);
+        }
+        return;
     }
 
-    // Get the current epoch time
-    current_time = time(NULL);
-    if (current_time == -1) {
-        fprintf(stderr, "Error getting current time\n");
-        return -1;
+    for (int n = 0; n < REPLAY_BATCH && sub->next_seq < journal_count; n++) {
+        kft_execution execution;
+        if (pread(exec_journal_fd, &execution, sizeof(kft_execution), (off_t)sub->next_seq * sizeof(kft_execution)) != sizeof(kft_execution)) {
+            log_message("ERROR", "report", "failed to read execution %d from journal\n", sub->next_seq);
+            close_subscriber(sub, pfd);
+            return;
+        }
+
+        const char *user_id = lookup_user_id(execution.transaction_code, 1);
+        if (subscriber_wants(sub, user_id)) {
+            fot_execution_report report;
+            build_execution_report(&report, &execution, sub->next_seq + 1, user_id);
+            rc = send_report(sub, &report);
+            if (rc < 0) {
+                close_subscriber(sub, pfd);
+                return;
+            } else if (rc == 0) {
+                return; // socket full, continue on the next POLLOUT
+            }
+        }
+        sub->next_seq++;
     }
 
-    // Check if current time is more than 2 second past order time
-    if (order_epoch > current_time + 2) {
-        return 1; // order time is future => error
+    if (sub->next_seq >= journal_count && sub->pending_len == 0) {
+        sub->state = SUB_LIVE;
+        pfd->events = POLLIN;
+        log_message("INFO", "report", "subscriber %s is live at seq %d\n",
+                    sub->user_id[0] ? sub->user_id : "*", sub->next_seq);
     } else {
-        return 0; // within range
+        pfd->events = POLLIN | POLLOUT;
+    }
+}
+
+// Push a freshly journaled execution (journal position seq) to every live subscriber it routes to
+void publish_execution(const kft_execution *execution, int seq, struct pollfd *fds) {
+    const char *user_id = lookup_user_id(execution->transaction_code, 1);
+    fot_execution_report report;
+    int built = 0;
+
+    for (int k = 0; k < MAX_SUBSCRIBERS; k++) {
+        exec_subscriber *sub = &subscribers[k];
+        if (sub->fd == -1 || sub->state != SUB_LIVE || !subscriber_wants(sub, user_id)) {
+            continue;
+        }
+        if (!built) {
+            build_execution_report(&report, execution, seq, user_id);
+            built = 1;
+        }
+
+        int rc = send_report(sub, &report);
+        if (rc < 0) {
+            close_subscriber(sub, &fds[SUB_SLOT(k)]);
+        } else if (rc == 0) {
+            // socket is backed up: fall back to replaying from the journal
+            sub->state = SUB_REPLAYING;
+            sub->next_seq = seq - 1;
+            fds[SUB_SLOT(k)].events = POLLIN | POLLOUT;
+        } else {
+            sub->next_seq = seq;
+            if (sub->pending_len > 0) {
+                fds[SUB_SLOT(k)].events = POLLIN | POLLOUT;
+            }
+        }
     }
 }
 
+void handle_subscribe(exec_subscriber *sub, struct pollfd *pfd, int journal_count) {
+    ofq_subscribe request;
+    ssize_t bytes_received = recv(sub->fd, &request, sizeof(request), 0);
+    if (bytes_received <= 0) {
+        close_subscriber(sub, pfd);
+        return;
+    }
+    if (sub->state != SUB_WAITING) {
+        return; // subscribers only talk once
+    }
+    if (bytes_received != sizeof(ofq_subscribe) || request.hdr.tr_id != 12) {
+        log_message("ERROR", "report", "invalid subscribe request (tr_id %d, %ld bytes)\n", request.hdr.tr_id, bytes_received);
+        close_subscriber(sub, pfd);
+        return;
+    }
+
+    memcpy(sub->user_id, request.user_id, sizeof(sub->user_id));
+    sub->user_id[sizeof(sub->user_id) - 1] = '\0';
+    sub->next_seq = request.last_seq < 0 ? 0 : request.last_seq;
+    if (sub->next_seq > journal_count) {
+        sub->next_seq = journal_count;
+    }
+    sub->state = SUB_REPLAYING;
+    pfd->events = POLLIN | POLLOUT;
+    log_message("INFO", "report", "subscriber %s replaying from seq %d (journal at %d)\n",
+                sub->user_id[0] ? sub->user_id : "*", sub->next_seq, journal_count);
+}
+
+long monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+void reset_session(exec_session *session, in_addr_t peer) {
+    memset(session, 0, sizeof(exec_session));
+    session->peer = peer;
+    session->fd = -1;
+    session->next_seq = 1;
+}
+
+// The session a new KRX connection continues; a session is only started over when
+// the table is full and its slot is taken by a new peer.
+exec_session *attach_session(in_addr_t peer, int fd) {
+    exec_session *session = NULL;
+
+    for (int k = 0; k < session_count; k++) {
+        if (sessions[k].peer == peer) {
+            session = &sessions[k];
+            break;
+        }
+    }
+    if (session == NULL && session_count < MAX_SESSIONS) {
+        session = &sessions[session_count++];
+        reset_session(session, peer);
+    }
+    for (int k = 0; session == NULL && k < MAX_SESSIONS; k++) {
+        if (sessions[k].fd == -1) {
+            log_message("ERROR", "seq", "session table full, sequence state of a disconnected session dropped\n");
+            session = &sessions[k];
+            reset_session(session, peer);
+        }
+    }
+    if (session != NULL) {
+        session->fd = fd;
+        session->reconnected = 1;
+        session->progress_ms = monotonic_ms();
+        log_message("INFO", "seq", "KRX session continues at seq %d (high %d)\n", session->next_seq, session->high_seq);
+    }
+    return session;
+}
+
+int seq_is_received(const exec_session *session, int seq) {
+    unsigned int bit = (unsigned int)seq & (SEQ_WINDOW - 1);
+    return (session->window[bit / 64] >> (bit % 64)) & 1;
+}
+
+void seq_set_received(exec_session *session, int seq, int received) {
+    unsigned int bit = (unsigned int)seq & (SEQ_WINDOW - 1);
+    if (received) {
+        session->window[bit / 64] |= 1ULL << (bit % 64);
+    } else {
+        session->window[bit / 64] &= ~(1ULL << (bit % 64));
+    }
+}
+
+void send_resend_request(int sock, int begin_seq, int end_seq) {
+    fkq_resend_request request;
+    memset(&request, 0, sizeof(request));
+    request.hdr.tr_id = 14;
+    request.hdr.length = sizeof(fkq_resend_request);
+    request.begin_seq = begin_seq;
+    request.end_seq = end_seq;
+
+    if (send(sock, &request, sizeof(request), MSG_NOSIGNAL) != sizeof(request)) {
+        log_message("ERROR", "seq", "failed to send resend request %d-%d\n", begin_seq, end_seq);
+        return;
+    }
+    fep_counter_add(FEP_M_RESEND_REQUESTS, 1);
+    log_message("INFO", "seq", "resend requested %d-%d\n", begin_seq, end_seq);
+}
+
+// Returns 1 when seq is new and should be processed, 0 when it is a duplicate.
+// Gaps are requested again from the exchange on the same session socket.
+int check_sequence(exec_session *session, int seq, int sock) {
+    if (seq <= 0) {
+        return 1; // exchange did not sequence this message
+    }
+    if (session->reconnected) {
+        // seq 1 first thing on a new connection: the exchange started a new session
+        if (seq == 1 && session->next_seq > 1) {
+            log_message("INFO", "seq", "KRX restarted its session at seq 1 (was at %d)\n", session->next_seq);
+            reset_session(session, session->peer);
+            session->fd = sock;
+        }
+        session->reconnected = 0;
+    }
+    if (seq < session->next_seq || (seq - session->next_seq < SEQ_WINDOW && seq_is_received(session, seq))) {
+        session->duplicates++;
+        log_message("INFO", "seq", "duplicate execution seq %d dropped (%ld so far)\n", seq, session->duplicates);
+        return 0;
+    }
+
+    if (seq - session->next_seq >= SEQ_WINDOW) {
+        // too far ahead to track: give up on the oldest missing seqs
+        log_message("ERROR", "seq", "seq %d is beyond the window at %d, %d seqs no longer tracked\n",
+                    seq, session->next_seq, seq - SEQ_WINDOW + 1 - session->next_seq);
+        if (seq - session->next_seq >= 2 * SEQ_WINDOW) {
+            memset(session->window, 0, sizeof(session->window));
+            session->next_seq = seq - SEQ_WINDOW + 1;
+        }
+        while (seq - session->next_seq >= SEQ_WINDOW) {
+            seq_set_received(session, session->next_seq, 0);
+            session->next_seq++;
+        }
+    }
+
+    seq_set_received(session, seq, 1);
+
+    if (seq > session->high_seq) {
+        int gap_begin = session->high_seq + 1;
+        if (gap_begin < session->requested_seq + 1) {
+            gap_begin = session->requested_seq + 1;
+        }
+        if (seq > gap_begin) {
+            session->gaps++;
+            log_message("ERROR", "seq", "gap detected: expected %d, got %d\n", session->high_seq + 1, seq);
+            send_resend_request(sock, gap_begin, seq - 1);
+            session->requested_seq = seq - 1;
+            session->progress_ms = monotonic_ms();
+        }
+        session->high_seq = seq;
+    }
+
+    if (session->next_seq <= session->high_seq && seq_is_received(session, session->next_seq)) {
+        session->progress_ms = monotonic_ms();
+    }
+    while (session->next_seq <= session->high_seq && seq_is_received(session, session->next_seq)) {
+        seq_set_received(session, session->next_seq, 0);
+        session->next_seq++;
+    }
+    return 1;
+}
+
+// A resend request or its reply can be lost too: request a gap again while next_seq
+// stands still. Returns 1 while some session still waits for a resend.
+int check_resend_timeouts() {
+    long now = monotonic_ms();
+    int waiting = 0;
+
+    for (int k = 0; k < session_count; k++) {
+        exec_session *session = &sessions[k];
+        if (session->next_seq > session->requested_seq) {
+            continue;
+        }
+        waiting = 1;
+        if (session->fd != -1 && now - session->progress_ms >= RESEND_TIMEOUT_MS) {
+            log_message("ERROR", "seq", "seq %d still missing after %ld ms\n", session->next_seq, now - session->progress_ms);
+            send_resend_request(session->fd, session->next_seq, session->requested_seq);
+            session->progress_ms = now;
+        }
+    }
+    return waiting;
+}
+
+int open_subscriber_socket() {
+    struct sockaddr_in address;
+    int sub_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sub_fd < 0) {
+        log_message("ERROR", "socket", "Subscriber socket failed");
+        exit(EXIT_FAILURE);
+    }
+
+    int opt = 1;
+    setsockopt(sub_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(FEP_OMS_EXEC_PORT);
+
+    if (bind(sub_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(sub_fd, MAX_SUBSCRIBERS) < 0) {
+        log_message("ERROR", "socket", "Subscriber bind/listen failed on port %d\n", FEP_OMS_EXEC_PORT);
+        close(sub_fd);
+        exit(EXIT_FAILURE);
+    }
+    log_message("DEBUG", "socket", "Execution reports served on port %d\n", FEP_OMS_EXEC_PORT);
+    return sub_fd;
+}
+
 int main() {
 
     init_log();
+    fep_affinity_pin(FEP_ROLE_LISTENER);
+    if (fep_stat_open() != 0) {
+        log_message("ERROR", "stat", "latency stats disabled, cannot map %s\n", FEP_STAT_SHM_NAME);
+    }
+    if (fep_trace_open() != 0) {
+        log_message("ERROR", "trace", "order tracing disabled, cannot map %s\n", FEP_TRACE_SHM_NAME);
+    }
+    if (fep_metrics_open(FEP_P_KRX_LISTENER) != 0) {
+        log_message("ERROR", "metrics", "metrics disabled, cannot map %s\n", FEP_METRICS_SHM_NAME);
+    }
+    fep_gauge_set(FEP_G_KRX_CONNECTIONS, 0);
+    fep_gauge_set(FEP_G_SUBSCRIBERS, 0);
     
     // set timezone as KST
     setenv("TZ", "Asia/Seoul", 1);
@@ -177,6 +644,7 @@ int main() {
         shm_unlink(shared_mem_name);
         exit(EXIT_FAILURE);
     }
+    fep_mem_report(shared_mem_name, shared_mem_size, fep_mem_prepare(w_count, shared_mem_size, 0));
 
     // Initialize shared memory if it is newly created
     if (is_initialized) {
@@ -227,16 +695,24 @@ int main() {
     int client_sockets[MAX_CLIENTS] = {0}; // Track client sockets
     log_message("DEBUG", "socket", "Server listening on port %d\n", FEP_KRX_R_PORT);
     // Poll array to monitor multiple file descriptors
-    struct pollfd fds[MAX_CLIENTS];
+    struct pollfd fds[POLL_COUNT];
+    static fep_rx rx[MAX_CLIENTS];
 
     // Initialize poll array
     fds[0].fd = server_fd;  // Monitor the server socket for new connections
     fds[0].events = POLLIN; // Monitor for incoming data
 
-    for (int i = 1; i < MAX_CLIENTS; i++) {
+    for (int i = 1; i < POLL_COUNT; i++) {
         fds[i].fd = -1; // Initialize all other file descriptors
     }
 
+    // OMS subscribers for execution reports
+    fds[SUB_LISTEN_SLOT].fd = open_subscriber_socket();
+    fds[SUB_LISTEN_SLOT].events = POLLIN;
+    for (int k = 0; k < MAX_SUBSCRIBERS; k++) {
+        subscribers[k].fd = -1;
+    }
+
     // set file dir structure
     const char *home_dir = getenv("HOME");
     char filepath[256];
@@ -252,6 +728,23 @@ int main() {
         log_message("ERROR", "file", "Error opening file");
         return;
     }
+    if (fep_journal_check(fileno(file), filepath, sizeof(kft_execution)) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    fep_journal_reserve(fileno(file), filepath);
+    exec_journal_fd = open(filepath, O_RDONLY);
+    if (exec_journal_fd == -1) {
+        log_message("ERROR", "file", "Error opening execution journal for replay");
+        return;
+    }
+
+    if (home_dir != NULL) {
+        snprintf(order_journal_path, sizeof(order_journal_path), "%s/received_data.txt", home_dir);
+    } else {
+        strncpy(order_journal_path, "./received_data.txt", sizeof(order_journal_path));
+    }
+    tail_order_journal();
+    log_message("DEBUG", "report", "order index loaded. %ld orders\n", order_journal_pos);
 
     // Open the message queue
     mq = mq_open(QUEUE_NAME, O_CREAT | O_WRONLY, 0644, NULL, &attr);
@@ -260,9 +753,10 @@ int main() {
         exit(1);
     }
 
+    int resend_waiting = 0;
     while (1) {
-        // Wait for an event
-        activity = poll(fds, MAX_CLIENTS, -1); // Infinite timeout
+        // Wait for an event; wake up for resend timeouts while a gap is open
+        activity = poll(fds, POLL_COUNT, resend_waiting ? RESEND_TIMEOUT_MS / 5 : -1);
 
         if (activity < 0) {
             perror("Poll error");
@@ -288,6 +782,9 @@ int main() {
                     fds[i].fd = client_fd;
                     fds[i].events = POLLIN; // Monitor for incoming data
                     // client_sockets[i] = new_socket;
+                    connection_session[i] = attach_session(client_addr.sin_addr.s_addr, client_fd);
+                    fep_rx_reset(&rx[i]);
+                    fep_gauge_add(FEP_G_KRX_CONNECTIONS, 1);
                     break;
                 }
             }
@@ -296,30 +793,36 @@ int main() {
         // Check all client sockets for activity
         for (int i = 1; i < MAX_CLIENTS; i++) {
             if (fds[i].fd != -1 && (fds[i].revents & POLLIN)) {
-                kft_execution execution;
-                ssize_t bytes_received = recv(fds[i].fd, &execution, sizeof(execution), 0);
+                ssize_t bytes_received = fep_rx_recv(&rx[i], fds[i].fd);
+                uint64_t t_executed = fep_tick();
+                const void *message;
                 if (bytes_received <= 0) {
                     // Connection closed or error
                     log_message("ERROR", "socket","Client disconnected\n");
+                    if (connection_session[i] != NULL && connection_session[i]->fd == fds[i].fd) {
+                        connection_session[i]->fd = -1;     // the sequence state waits for the reconnect
+                    }
                     close(fds[i].fd);
                     fds[i].fd = -1;
-                // } else if (bytes_received == sizeof(received_order.hdr.length)) {
-                } else if (bytes_received == sizeof(kft_execution)) {
+                    fep_gauge_add(FEP_G_KRX_CONNECTIONS, -1);
+                    continue;
+                }
+                // whole executions only; a partial one stays buffered until the rest arrives
+                while ((message = fep_rx_next(&rx[i], sizeof(kft_execution))) != NULL) {
+                    kft_execution execution;
+                    const char *invalid_code;
+                    memcpy(&execution, message, sizeof(execution));
+                    fep_counter_add(FEP_M_EXECS_RECEIVED, 1);
                     // validation
                     if (execution.hdr.tr_id !=11 ) { 
+                        fep_counter_add(FEP_M_EXECS_INVALID, 1);
                         log_message("INFO", "validation", "skip to process Invalid tr_id: %d\n", execution.hdr.tr_id);
                         continue; 
-                    } else if (!((execution.status_code == 0) || (execution.status_code == 1) || (execution.status_code == 99))) { 
-                        log_message("INFO", "validation", "invalid krx execution status code : %s.\n", "E301");
-                        continue; 
-                    } else if (is_order_time_future(execution.time)) { 
-                        log_message("INFO", "validation", "invalid krx execution time : %s.\n", "E302");
-                        continue; 
-                    } else if (execution.executed_price < 0){
-                        log_message("INFO", "validation", "invalid krx execution executed price : %s.\n", "E303");
-                        continue; // Skip processing
-                    } else if (!((strncmp(execution.reject_code, "0000", 4) == 0) || (execution.reject_code[0] == 'E'))){
-                        log_message("INFO", "validation", "invalid krx execution reject code : %s.\n", "E304");
+                    } else if (connection_session[i] != NULL && !check_sequence(connection_session[i], execution.seq_no, fds[i].fd)) {
+                        continue; // already journaled
+                    } else if ((invalid_code = fep_validate_execution(&execution)) != NULL) {
+                        fep_counter_add(FEP_M_EXECS_INVALID, 1);
+                        log_message("INFO", "validation", "invalid krx execution : %s.\n", invalid_code);
                         continue; // Skip processing
                     }
      
@@ -329,6 +832,13 @@ int main() {
                     save_order_to_file_bin(&execution, file);
                     log_message("INFO", "FILE", "execution is written to a file");
                     w_count->wc++;
+                    uint64_t t_exec_journaled = fep_tick();
+                    fep_stat_exec_journaled(w_count->wc - 1, t_executed, t_exec_journaled);
+                    fep_counter_add(FEP_M_EXECS_JOURNALED, 1);
+                    if (fep_trace_sampled(execution.transaction_code)) {
+                        fep_trace_put(FEP_TRACE_EXECUTED, execution.transaction_code, t_executed, w_count->wc - 1);
+                        fep_trace_put(FEP_TRACE_EXEC_JOURNALED, execution.transaction_code, t_exec_journaled, w_count->wc - 1);
+                    }
                     log_message("INFO", "shm", "krx_wc increased. wc = %d\n", w_count->wc);
 
                     //send wc
@@ -337,15 +847,62 @@ int main() {
                         exit(1);
                     }           
                     log_message("DEBUG", "mq", "krx_w_cnt sent: %d", w_count->wc);
-                        
 
+                    publish_execution(&execution, w_count->wc, fds);
+                }
+            }
+        }
+
+        // New execution report subscriber
+        if (fds[SUB_LISTEN_SLOT].revents & POLLIN) {
+            int sub_fd = accept(fds[SUB_LISTEN_SLOT].fd, NULL, NULL);
+            if (sub_fd >= 0) {
+                int k = 0;
+                while (k < MAX_SUBSCRIBERS && subscribers[k].fd != -1) {
+                    k++;
+                }
+                if (k == MAX_SUBSCRIBERS) {
+                    log_message("ERROR", "report", "too many subscribers, connection refused\n");
+                    close(sub_fd);
                 } else {
-                    
-                    log_message("ERROR", "socket", "Incomplete data received. Expected %lu bytes, got %ld bytes.\n", sizeof(kft_execution), bytes_received);
+                    int nodelay = 1;
+                    setsockopt(sub_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+                    fcntl(sub_fd, F_SETFL, fcntl(sub_fd, F_GETFL, 0) | O_NONBLOCK);
+                    memset(&subscribers[k], 0, sizeof(exec_subscriber));
+                    subscribers[k].fd = sub_fd;
+                    subscribers[k].state = SUB_WAITING;
+                    fds[SUB_SLOT(k)].fd = sub_fd;
+                    fds[SUB_SLOT(k)].events = POLLIN;
+                    fep_gauge_add(FEP_G_SUBSCRIBERS, 1);
+                    log_message("INFO", "report", "New subscriber connection\n");
+                }
+            }
+        }
 
-                }      
+        for (int k = 0; k < MAX_SUBSCRIBERS; k++) {
+            struct pollfd *pfd = &fds[SUB_SLOT(k)];
+            exec_subscriber *sub = &subscribers[k];
+            if (sub->fd == -1) {
+                continue;
+            }
+            if (pfd->revents & (POLLIN | POLLERR | POLLHUP)) {
+                handle_subscribe(sub, pfd, w_count->wc);
+            }
+            if (sub->fd != -1 && (pfd->revents & POLLOUT)) {
+                if (sub->state == SUB_REPLAYING) {
+                    replay_subscriber(sub, pfd, w_count->wc);
+                } else {
+                    int rc = flush_subscriber(sub);
+                    if (rc < 0) {
+                        close_subscriber(sub, pfd);
+                    } else if (rc > 0) {
+                        pfd->events = POLLIN;
+                    }
+                }
             }
         }
+
+        resend_waiting = check_resend_timeouts();
     }
 
     close(server_fd);
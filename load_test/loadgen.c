@@ -0,0 +1,395 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <envs.h>
+#include <oms_fep_krx_struct.h>
+#include <fep_hist.h>
+#include "lt_conn.h"
+
+// Open-loop order generator for oms_listener / fep_integrated.
+//
+// Every thread owns a share of the connections and an epoll set, and sends on a
+// fixed schedule (rate / threads orders per second) without waiting for acks.
+// Up to -w orders may be in flight per connection. Latency is measured from the
+// time an order was *scheduled*, so when the FEP stalls, the orders the schedule
+// wanted to send meanwhile count their waiting time (coordinated omission
+// correction). The uncorrected figures, measured from the actual send, are shown
+// next to them.
+//
+// usage: loadgen [-a host] [-p port] [-r rate] [-d seconds] [-c connections] [-t threads]
+//                [-w window] [-j reject%] [-x cancel%] [-s seed] [-o hgrm_file]
+//   -r  orders per second over all threads, 0 = as fast as the windows allow (default 10000)
+//   -d  test duration, default 10
+//   -c  connections, default 16 (oms_listener serves at most MAX_CLIENTS - 1 = 19)
+//   -t  threads, default 4
+//   -w  orders in flight per connection, default 64, at most 256
+//   -j  share of orders made invalid on purpose (quantity 0, E103), default 0
+//   -x  share of orders that cancel this thread's previous order ('C'), default 0
+//   -o  write the corrected latency distribution in HdrHistogram percentile format
+//
+// build: gcc -O2 -Iinclude load_test/loadgen.c -o loadgen -lpthread
+
+#define MAX_THREADS 64
+#define MAX_CONNECTIONS 1024
+#define EPOLL_BATCH 64
+#define DRAIN_NS 5000000000ULL          // wait this long for the last acks
+#define SPIN_NS 1000000ULL              // closer than this to the next send: poll without sleeping
+
+#define DEFAULT_RATE 10000
+#define DEFAULT_SECONDS 10
+#define DEFAULT_CONNECTIONS 16
+#define DEFAULT_THREADS 4
+#define DEFAULT_WINDOW 64
+
+typedef struct {
+    int id;
+    pthread_t thread;
+    int epoll_fd;
+    lt_conn *conns;
+    int conn_count;
+    int next_conn;
+    lt_conn **dirty;
+    int dirty_count;
+    uint64_t interval_ns;   // 0 = flat out
+    unsigned int seed;
+    char order_time[15];
+    time_t order_time_sec;
+    char last_transaction[7];   // what the next cancel refers to
+    fep_hist corrected;
+    fep_hist uncorrected;
+    uint64_t sent, acked, rejected, lost;
+} lg_thread;
+
+typedef struct {
+    const char *host;
+    int port;
+    double rate;
+    int seconds;
+    int connections;
+    int threads;
+    int window;
+    int reject_percent;
+    int cancel_percent;
+    unsigned int seed;
+    const char *hgrm_path;
+} lg_config;
+
+static lg_config config = {FEP_IP, FEP_OMS_R_PORT, DEFAULT_RATE, DEFAULT_SECONDS, DEFAULT_CONNECTIONS,
+                           DEFAULT_THREADS, DEFAULT_WINDOW, 0, 0, 0, NULL};
+static lg_thread threads[MAX_THREADS];
+static uint64_t start_ns, end_ns;
+static unsigned int next_transaction;     // shared, atomic
+
+static const char *stock_codes[] = {"005930", "000660", "035420", "005380", "051910", "006400", "035720", "068270"};
+static const char *stock_names[] = {"삼성전자", "SK하이닉스", "NAVER", "현대차", "LG화학", "삼성SDI", "카카오", "셀트리온"};
+#define STOCK_COUNT (int)(sizeof(stock_codes) / sizeof(stock_codes[0]))
+
+static void refresh_order_time(lg_thread *t) {
+    time_t now = time(NULL);
+    if (now != t->order_time_sec) {
+        strftime(t->order_time, sizeof(t->order_time), "%Y%m%d%H%M%S", localtime(&now));
+        t->order_time_sec = now;
+    }
+}
+
+static void build_order(lg_thread *t, fkq_order *order) {
+    int stock = rand_r(&t->seed) % STOCK_COUNT;
+    unsigned int tx = __atomic_fetch_add(&next_transaction, 1, __ATOMIC_RELAXED) % 1000000;
+
+    memset(order, 0, sizeof(fkq_order));
+    order->hdr.tr_id = FEP_TR_fkq_order;
+    order->hdr.length = sizeof(fkq_order);
+    memcpy(order->stock_code, stock_codes[stock], 6);
+    strncpy(order->stock_name, stock_names[stock], sizeof(order->stock_name) - 1);
+    snprintf(order->transaction_code, sizeof(order->transaction_code), "%06u", tx);
+    snprintf(order->user_id, sizeof(order->user_id), "user%05d", rand_r(&t->seed) % 100000);
+    order->order_type = (rand_r(&t->seed) & 1) ? 'B' : 'S';
+    order->quantity = 1 + rand_r(&t->seed) % 1000;
+    order->price = 1000 + rand_r(&t->seed) % 100000;
+    memcpy(order->order_time, t->order_time, sizeof(order->order_time));
+    memcpy(order->original_order, "NA", 3);
+    if (config.cancel_percent > 0 && t->last_transaction[0] != '\0'
+            && rand_r(&t->seed) % 100 < (unsigned int)config.cancel_percent) {
+        order->order_type = 'C';
+        memcpy(order->original_order, t->last_transaction, sizeof(order->original_order));
+    }
+    if (config.reject_percent > 0 && rand_r(&t->seed) % 100 < (unsigned int)config.reject_percent) {
+        order->quantity = 0;
+    }
+    memcpy(t->last_transaction, order->transaction_code, sizeof(t->last_transaction));
+}
+
+static void close_conn(lg_thread *t, lt_conn *c, const char *why) {
+    if (c->fd == -1) {
+        return;
+    }
+    unsigned int unanswered = lt_close(c);
+    fprintf(stderr, "thread %d: connection closed (%s), %u orders unanswered\n", t->id, why, unanswered);
+    t->lost += unanswered;
+}
+
+static void record_ack(void *ctx, const lt_inflight *o, const fot_order_is_submitted *ack, uint64_t now) {
+    lg_thread *t = ctx;
+    fep_hist_record(&t->corrected, now - o->intended_ns);
+    fep_hist_record(&t->uncorrected, now - o->sent_ns);
+    if (ack->hdr.tr_id != FEP_TR_fot_order_is_submitted || strncmp(ack->reject_code, "0000", 4) != 0) {
+        __atomic_store_n(&t->rejected, t->rejected + 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&t->acked, t->acked + 1, __ATOMIC_RELAXED);
+}
+
+// Next connection with room in its window, round robin. NULL when all are full.
+static lt_conn *pick_conn(lg_thread *t) {
+    for (int k = 0; k < t->conn_count; k++) {
+        lt_conn *c = &t->conns[t->next_conn];
+        t->next_conn = (t->next_conn + 1) % t->conn_count;
+        if (c->fd != -1 && lt_in_flight(c) < (unsigned int)config.window) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+static void queue_order(lg_thread *t, lt_conn *c, uint64_t intended, uint64_t now) {
+    build_order(t, lt_queue(c, 0, intended, now));
+    if (!c->dirty) {
+        c->dirty = 1;
+        t->dirty[t->dirty_count++] = c;
+    }
+    __atomic_store_n(&t->sent, t->sent + 1, __ATOMIC_RELAXED);
+}
+
+static unsigned int in_flight(const lg_thread *t) {
+    unsigned int total = 0;
+    for (int k = 0; k < t->conn_count; k++) {
+        total += lt_in_flight(&t->conns[k]);
+    }
+    return total;
+}
+
+static void *run_thread(void *arg) {
+    lg_thread *t = arg;
+    struct epoll_event events[EPOLL_BATCH];
+    uint64_t next_send = start_ns;
+
+    while (1) {
+        uint64_t now = lt_now_ns();
+        if (now >= end_ns) {
+            if (in_flight(t) == 0 || now >= end_ns + DRAIN_NS) {
+                break;
+            }
+        } else {
+            refresh_order_time(t);
+            // everything the schedule owes up to now; a stalled FEP leaves next_send behind
+            while (t->interval_ns == 0 || next_send <= now) {
+                lt_conn *c = pick_conn(t);
+                if (c == NULL) {
+                    break;  // every window is full, wait for acks
+                }
+                queue_order(t, c, t->interval_ns ? next_send : now, now);
+                next_send += t->interval_ns;
+            }
+            for (int k = 0; k < t->dirty_count; k++) {
+                lt_conn *c = t->dirty[k];
+                c->dirty = 0;
+                if (c->fd != -1 && lt_flush(c) < 0) {
+                    close_conn(t, c, strerror(errno));
+                }
+            }
+            t->dirty_count = 0;
+        }
+
+        int timeout = 1;
+        if (now < end_ns && t->interval_ns != 0 && next_send > now) {
+            timeout = next_send - now < SPIN_NS ? 0 : (int)((next_send - now) / 1000000);
+        } else if (now < end_ns && t->interval_ns != 0) {
+            timeout = 0;
+        }
+        int n = epoll_wait(t->epoll_fd, events, EPOLL_BATCH, timeout);
+        for (int k = 0; k < n; k++) {
+            lt_conn *c = events[k].data.ptr;
+            if (c->fd == -1) {
+                continue;
+            }
+            const char *why;
+            if ((events[k].events & EPOLLIN) && (why = lt_read_acks(c, record_ack, t)) != NULL) {
+                close_conn(t, c, why);
+            }
+            if (c->fd != -1 && (events[k].events & EPOLLOUT) && lt_flush(c) < 0) {
+                close_conn(t, c, strerror(errno));
+            }
+            if (c->fd != -1 && (events[k].events & (EPOLLERR | EPOLLHUP))) {
+                close_conn(t, c, "socket error");
+            }
+        }
+    }
+
+    for (int k = 0; k < t->conn_count; k++) {
+        t->lost += lt_close(&t->conns[k]);
+    }
+    return NULL;
+}
+
+static void print_percentiles(const char *name, const fep_hist *h) {
+    static const double percentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+    printf("  %-12s", name);
+    for (int k = 0; k < (int)(sizeof(percentiles) / sizeof(percentiles[0])); k++) {
+        printf(" %10.1f", fep_hist_percentile(h, percentiles[k]) / 1000.0);
+    }
+    printf(" %10.1f %10.1f\n", h->max / 1000.0, fep_hist_mean(h) / 1000.0);
+}
+
+// HdrHistogram percentile distribution, values in microseconds
+static int write_hgrm(const char *path, const fep_hist *h) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    fprintf(file, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    uint64_t seen = 0;
+    for (int i = 0; i < FEP_HIST_BUCKETS; i++) {
+        if (h->buckets[i] == 0) {
+            continue;
+        }
+        seen += h->buckets[i];
+        double fraction = (double)seen / h->count;
+        uint64_t value = fep_hist_value_at(i);
+        if (value > h->max) {
+            value = h->max;
+        }
+        if (fraction < 1.0) {
+            fprintf(file, "%12.3f %14.12f %10lu %14.2f\n", value / 1000.0, fraction, (unsigned long)seen, 1.0 / (1.0 - fraction));
+        } else {
+            fprintf(file, "%12.3f %14.12f %10lu\n", value / 1000.0, fraction, (unsigned long)seen);
+        }
+    }
+    fprintf(file, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", fep_hist_mean(h) / 1000.0, 0.0);
+    fprintf(file, "#[Max     = %12.3f, Total count    = %12lu]\n", h->max / 1000.0, (unsigned long)h->count);
+    fprintf(file, "#[Buckets = %12d, SubBuckets     = %12d]\n", FEP_HIST_MAX_BITS - FEP_HIST_SUB_BITS + 1, 2 * FEP_HIST_HALF);
+    fclose(file);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-a host] [-p port] [-r rate] [-d seconds] [-c connections] [-t threads]"
+                    " [-w window] [-j reject%%] [-x cancel%%] [-s seed] [-o hgrm_file]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    config.seed = (unsigned int)time(NULL);
+    while ((opt = getopt(argc, argv, "a:p:r:d:c:t:w:j:x:s:o:")) != -1) {
+        switch (opt) {
+        case 'a': config.host = optarg; break;
+        case 'p': config.port = atoi(optarg); break;
+        case 'r': config.rate = atof(optarg); break;
+        case 'd': config.seconds = atoi(optarg); break;
+        case 'c': config.connections = atoi(optarg); break;
+        case 't': config.threads = atoi(optarg); break;
+        case 'w': config.window = atoi(optarg); break;
+        case 'j': config.reject_percent = atoi(optarg); break;
+        case 'x': config.cancel_percent = atoi(optarg); break;
+        case 's': config.seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'o': config.hgrm_path = optarg; break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (config.threads < 1 || config.threads > MAX_THREADS || config.connections < config.threads
+            || config.connections > MAX_CONNECTIONS || config.window < 1 || config.window > LT_MAX_WINDOW
+            || config.seconds < 1 || config.rate < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // order_time is validated against KST by the FEP
+    setenv("TZ", "Asia/Seoul", 1);
+    tzset();
+    srand(config.seed);
+    next_transaction = (unsigned int)rand() % 1000000;
+
+    for (int i = 0; i < config.threads; i++) {
+        lg_thread *t = &threads[i];
+        t->id = i;
+        t->conn_count = config.connections / config.threads + (i < config.connections % config.threads);
+        t->conns = calloc(t->conn_count, sizeof(lt_conn));
+        t->dirty = calloc(t->conn_count, sizeof(lt_conn *));
+        t->interval_ns = config.rate > 0 ? (uint64_t)(1e9 * config.threads / config.rate) : 0;
+        t->seed = config.seed + i;
+        t->epoll_fd = epoll_create1(0);
+        if (t->conns == NULL || t->dirty == NULL || t->epoll_fd < 0) {
+            perror("thread setup");
+            return EXIT_FAILURE;
+        }
+        for (int k = 0; k < t->conn_count; k++) {
+            if (lt_open(&t->conns[k], t->epoll_fd, config.host, config.port) != 0) {
+                fprintf(stderr, "cannot connect to %s:%d: %s\n", config.host, config.port, strerror(errno));
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    printf("%d connections on %d threads to %s:%d, %s for %d s, window %d\n",
+           config.connections, config.threads, config.host, config.port,
+           config.rate > 0 ? "open loop" : "flat out", config.seconds, config.window);
+    if (config.rate > 0) {
+        printf("target %.0f orders/s\n", config.rate);
+    }
+
+    start_ns = lt_now_ns();
+    end_ns = start_ns + (uint64_t)config.seconds * 1000000000ULL;
+    for (int i = 0; i < config.threads; i++) {
+        pthread_create(&threads[i].thread, NULL, run_thread, &threads[i]);
+    }
+
+    // progress once a second
+    uint64_t last_sent = 0, last_acked = 0;
+    for (int s = 1; s <= config.seconds; s++) {
+        struct timespec wait = {1, 0};
+        nanosleep(&wait, NULL);
+        uint64_t sent = 0, acked = 0, rejected = 0;
+        for (int i = 0; i < config.threads; i++) {
+            sent += __atomic_load_n(&threads[i].sent, __ATOMIC_RELAXED);
+            acked += __atomic_load_n(&threads[i].acked, __ATOMIC_RELAXED);
+            rejected += __atomic_load_n(&threads[i].rejected, __ATOMIC_RELAXED);
+        }
+        printf("%4d s  sent %8lu/s  acked %8lu/s  in flight %6lu  rejected %lu\n", s,
+               (unsigned long)(sent - last_sent), (unsigned long)(acked - last_acked),
+               (unsigned long)(sent - acked), (unsigned long)rejected);
+        fflush(stdout);
+        last_sent = sent;
+        last_acked = acked;
+    }
+
+    static fep_hist corrected, uncorrected;
+    uint64_t sent = 0, acked = 0, rejected = 0, lost = 0;
+    for (int i = 0; i < config.threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        fep_hist_merge(&corrected, &threads[i].corrected);
+        fep_hist_merge(&uncorrected, &threads[i].uncorrected);
+        sent += threads[i].sent;
+        acked += threads[i].acked;
+        rejected += threads[i].rejected;
+        lost += threads[i].lost;
+    }
+
+    printf("\nsent %lu, acked %lu (%.0f/s), rejected %lu, unanswered %lu\n", (unsigned long)sent,
+           (unsigned long)acked, acked / (double)config.seconds, (unsigned long)rejected, (unsigned long)lost);
+    printf("  %-12s %10s %10s %10s %10s %10s %10s %10s\n", "ack latency", "p50(us)", "p90(us)", "p99(us)",
+           "p99.9(us)", "p99.99(us)", "max(us)", "mean(us)");
+    print_percentiles("corrected", &corrected);
+    print_percentiles("uncorrected", &uncorrected);
+
+    if (config.hgrm_path != NULL && write_hgrm(config.hgrm_path, &corrected) == 0) {
+        printf("distribution written to %s\n", config.hgrm_path);
+    }
+    return lost == 0 ? 0 : EXIT_FAILURE;
+}
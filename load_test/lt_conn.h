@@ -0,0 +1,170 @@
+#ifndef LT_CONN_H
+#define LT_CONN_H
+
+// Pipelined order connection of the load tools (loadgen, replay).
+//
+// A non-blocking TCP connection to oms_listener / fep_integrated, registered in the
+// caller's epoll set with the connection as data.ptr. Orders are queued into tx and
+// flushed without waiting for acks, at most LT_MAX_WINDOW in flight. The FEP acks
+// the orders of a connection in order, so the in-flight fifo tells which order an
+// ack answers.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <oms_fep_krx_struct.h>
+
+#define LT_MAX_WINDOW 256
+
+typedef struct {
+    uint32_t order;         // caller's, e.g. replay's journal index
+    uint64_t intended_ns;   // when the schedule wanted the order sent
+    uint64_t sent_ns;       // when it was handed to the socket
+} lt_inflight;
+
+typedef struct {
+    int fd;
+    int epoll_fd;
+    lt_inflight fifo[LT_MAX_WINDOW];
+    unsigned int head, tail;
+    char tx[LT_MAX_WINDOW * sizeof(fkq_order)];    // unsent orders are always in flight
+    size_t tx_len, tx_off;
+    _Alignas(fot_order_is_submitted) char rx[64 * sizeof(fot_order_is_submitted)];
+    size_t rx_len;
+    int dirty;              // caller's: has unsent bytes and is on a list to flush
+    int want_out;           // registered for EPOLLOUT
+} lt_conn;
+
+// One ack and the order it answers
+typedef void (*lt_ack_fn)(void *ctx, const lt_inflight *o, const fot_order_is_submitted *ack, uint64_t now);
+
+static inline uint64_t lt_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Connect and add to epoll_fd for EPOLLIN. 0 on success, -1 with errno set.
+static inline int lt_open(lt_conn *c, int epoll_fd, const char *host, int port) {
+    struct sockaddr_in addr;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    memset(c, 0, sizeof(lt_conn));
+    c->fd = fd;
+    c->epoll_fd = epoll_fd;
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    return 0;
+}
+
+static inline void lt_set_want_out(lt_conn *c, int want) {
+    if (c->want_out != want) {
+        struct epoll_event ev = {.events = EPOLLIN | (want ? EPOLLOUT : 0), .data.ptr = c};
+        epoll_ctl(c->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->want_out = want;
+    }
+}
+
+// Close and forget what was in flight. Returns the orders left unanswered.
+static inline unsigned int lt_close(lt_conn *c) {
+    unsigned int unanswered = c->tail - c->head;
+    if (c->fd == -1) {
+        return 0;
+    }
+    epoll_ctl(c->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    c->head = c->tail = 0;
+    c->tx_len = c->tx_off = 0;
+    c->rx_len = 0;
+    return unanswered;
+}
+
+static inline unsigned int lt_in_flight(const lt_conn *c) {
+    return c->tail - c->head;
+}
+
+// Room for one more order, which the caller fills in. The window must not be full.
+static inline fkq_order *lt_queue(lt_conn *c, uint32_t order, uint64_t intended, uint64_t now) {
+    lt_inflight *o = &c->fifo[c->tail++ % LT_MAX_WINDOW];
+    o->order = order;
+    o->intended_ns = intended;
+    o->sent_ns = now;
+    fkq_order *slot = (fkq_order *)(c->tx + c->tx_len);
+    c->tx_len += sizeof(fkq_order);
+    return slot;
+}
+
+// 0 when everything buffered went out, 1 if the socket is full, -1 on error
+static inline int lt_flush(lt_conn *c) {
+    while (c->tx_off < c->tx_len) {
+        ssize_t n = send(c->fd, c->tx + c->tx_off, c->tx_len - c->tx_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // move the unsent tail to the front: acks reopen the window, and
+                // tx only has room for a window of orders
+                memmove(c->tx, c->tx + c->tx_off, c->tx_len - c->tx_off);
+                c->tx_len -= c->tx_off;
+                c->tx_off = 0;
+                lt_set_want_out(c, 1);
+                return 1;
+            }
+            return -1;
+        }
+        c->tx_off += n;
+    }
+    c->tx_len = c->tx_off = 0;
+    lt_set_want_out(c, 0);
+    return 0;
+}
+
+// Read what arrived and hand every whole ack to on_ack. NULL while the connection is
+// fine, otherwise why it has to be closed.
+static inline const char *lt_read_acks(lt_conn *c, lt_ack_fn on_ack, void *ctx) {
+    while (1) {
+        ssize_t n = recv(c->fd, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len, 0);
+        if (n == 0) {
+            return "closed by peer";
+        } else if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? NULL : strerror(errno);
+        }
+        c->rx_len += n;
+
+        uint64_t now = lt_now_ns();
+        size_t off = 0;
+        for (; c->rx_len - off >= sizeof(fot_order_is_submitted); off += sizeof(fot_order_is_submitted)) {
+            if (c->head == c->tail) {
+                return "ack without an order in flight";
+            }
+            on_ack(ctx, &c->fifo[c->head++ % LT_MAX_WINDOW], (const fot_order_is_submitted *)(c->rx + off), now);
+        }
+        memmove(c->rx, c->rx + off, c->rx_len - off);
+        c->rx_len -= off;
+    }
+}
+
+#endif //LT_CONN_H
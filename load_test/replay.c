@@ -0,0 +1,567 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <envs.h>
+#include <oms_fep_krx_struct.h>
+#include <fep_hist.h>
+#include "lt_conn.h"
+
+// Replays a captured order journal (received_data.txt, raw fkq_order records)
+// into oms_listener / fep_integrated, then compares what came back.
+//
+// Timing: the journal only has order_time, to the second. Orders keep the gaps
+// between their seconds, and the orders of one second are spread evenly over it.
+// -x 10 replays ten times faster, -x 0 as fast as the windows allow; -g caps idle
+// gaps such as the night between two sessions. order_time is rewritten to the
+// current KST time when an order is sent, so the FEP's time check passes.
+// Orders go round robin over the connections, at most -w in flight on each.
+//
+// Comparison:
+//   acks        every journaled order was accepted, so anything but "0000" is a
+//               difference. With -A, each ack is compared with the one a previous
+//               replay saved with -o, in journal order.
+//   executions  with -e original and -E replayed execution journal
+//               (krx_received_data.txt), per transaction_code: execution count and
+//               final status, code and price. -W waits until the replayed journal
+//               stopped growing for that many seconds first.
+// Run the replay against an empty store and journals, and the mock exchange
+// deterministic (e.g. simple_receiver -m 100 -s 1), or execution diffs are expected.
+// -D only compares (-e/-E), without sending anything.
+//
+// usage: replay [-a host] [-p port] [-c connections] [-w window] [-x speed] [-g max_gap_s]
+//               [-n orders] [-o acks_out] [-A acks_before] [-e exec_journal -E exec_journal_replayed]
+//               [-W settle_s] [-D] journal
+//
+// build: gcc -O2 -Iinclude load_test/replay.c -o replay
+
+#define MAX_CONNECTIONS 64
+#define DEFAULT_CONNECTIONS 4
+#define DEFAULT_WINDOW 64
+#define EPOLL_BATCH 64
+#define DRAIN_NS 5000000000ULL      // wait this long for the last acks
+#define SPIN_NS 200000ULL           // closer than this to a send, poll instead of sleeping
+#define DIFF_SHOWN 10               // differences listed per kind
+
+typedef struct {
+    const char *host;
+    int port;
+    int connections;
+    int window;
+    double speed;           // 0 = as fast as possible
+    double max_gap;         // seconds, 0 = keep every gap
+    long limit;
+    const char *acks_out;
+    const char *acks_before;
+    const char *exec_original;
+    const char *exec_replayed;
+    int settle;
+    int diff_only;
+} rp_config;
+
+static rp_config config = {FEP_IP, FEP_OMS_R_PORT, DEFAULT_CONNECTIONS, DEFAULT_WINDOW, 1.0, 0, 0,
+                           NULL, NULL, NULL, NULL, 0, 0};
+
+static const fkq_order *orders;
+static long order_count;
+static uint64_t *offsets;                   // ns after the first order, already divided by speed
+static fot_order_is_submitted *acks;        // by journal index
+static unsigned char *acked;
+
+static lt_conn conns[MAX_CONNECTIONS];
+static int epoll_fd;
+static int next_conn = 0;
+static char now_time[15];
+static time_t now_time_sec = 0;
+static fep_hist corrected, uncorrected;
+static uint64_t sent = 0, answered = 0, lost = 0, misrouted = 0;
+
+static const void *map_file(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    *size = st.st_size;
+    if (st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    const void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    return data;
+}
+
+// order_time as seconds; only differences matter, so the time zone does not
+static int order_second(const char *order_time, time_t *second) {
+    char text[15];
+    struct tm tm = {0};
+    memcpy(text, order_time, sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    if (strptime(text, "%Y%m%d%H%M%S", &tm) == NULL) {
+        return -1;
+    }
+    *second = timegm(&tm);
+    return 0;
+}
+
+// Send offsets from the original order times, see the timing notes at the top
+static void plan_schedule() {
+    offsets = calloc(order_count, sizeof(uint64_t));
+    if (offsets == NULL) {
+        perror("schedule");
+        exit(EXIT_FAILURE);
+    }
+    if (config.speed == 0) {
+        return;
+    }
+    time_t previous = 0;
+    double elapsed = 0;     // original seconds from the first order, idle gaps capped
+    long i = 0;
+    while (i < order_count) {
+        time_t second;
+        if (order_second(orders[i].order_time, &second) != 0 || (i > 0 && second < previous)) {
+            second = previous;  // unparsable or out of order: keep it with the previous second
+        }
+        if (i > 0) {
+            double gap = (double)(second - previous);
+            elapsed += config.max_gap > 0 && gap > config.max_gap ? config.max_gap : gap;
+        }
+        long first = i, end = i + 1;
+        for (time_t s; end < order_count && order_second(orders[end].order_time, &s) == 0 && s == second; end++) {
+        }
+        for (long k = first; k < end; k++) {
+            double at = elapsed + (double)(k - first) / (end - first);
+            offsets[k] = (uint64_t)(at / config.speed * 1e9);
+        }
+        previous = second;
+        i = end;
+    }
+}
+
+static const char *current_time() {
+    time_t now = time(NULL);
+    if (now != now_time_sec) {
+        strftime(now_time, sizeof(now_time), "%Y%m%d%H%M%S", localtime(&now));
+        now_time_sec = now;
+    }
+    return now_time;
+}
+
+static void close_conn(lt_conn *c, const char *why) {
+    if (c->fd == -1) {
+        return;
+    }
+    unsigned int unanswered = lt_close(c);
+    fprintf(stderr, "connection closed (%s), %u orders unanswered\n", why, unanswered);
+    lost += unanswered;
+}
+
+static void flush_conn(lt_conn *c) {
+    if (lt_flush(c) < 0) {
+        close_conn(c, strerror(errno));
+    }
+}
+
+// o->order is the journal index
+static void record_ack(void *ctx, const lt_inflight *o, const fot_order_is_submitted *ack, uint64_t now) {
+    (void)ctx;
+    fep_hist_record(&corrected, now - o->intended_ns);
+    fep_hist_record(&uncorrected, now - o->sent_ns);
+    if (strncmp(ack->transaction_code, orders[o->order].transaction_code, sizeof(ack->transaction_code) - 1) != 0) {
+        misrouted++;
+    }
+    acks[o->order] = *ack;
+    acked[o->order] = 1;
+    answered++;
+}
+
+static void read_acks(lt_conn *c) {
+    const char *why = lt_read_acks(c, record_ack, NULL);
+    if (why != NULL) {
+        close_conn(c, why);
+    }
+}
+
+// Next connection with room in its window, round robin. NULL when all are full.
+static lt_conn *pick_conn() {
+    for (int k = 0; k < config.connections; k++) {
+        lt_conn *c = &conns[next_conn];
+        next_conn = (next_conn + 1) % config.connections;
+        if (c->fd != -1 && lt_in_flight(c) < (unsigned int)config.window) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+static void queue_order(lt_conn *c, long index, uint64_t intended, uint64_t now) {
+    fkq_order *order = lt_queue(c, (uint32_t)index, intended, now);
+    *order = orders[index];
+    memcpy(order->order_time, current_time(), sizeof(order->order_time));
+    sent++;
+}
+
+static uint64_t in_flight() {
+    uint64_t total = 0;
+    for (int k = 0; k < config.connections; k++) {
+        total += lt_in_flight(&conns[k]);
+    }
+    return total;
+}
+
+static void print_percentiles(const char *name, const fep_hist *h) {
+    static const double percentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+    printf("  %-12s", name);
+    for (int k = 0; k < (int)(sizeof(percentiles) / sizeof(percentiles[0])); k++) {
+        printf(" %10.1f", fep_hist_percentile(h, percentiles[k]) / 1000.0);
+    }
+    printf(" %10.1f %10.1f\n", h->max / 1000.0, fep_hist_mean(h) / 1000.0);
+}
+
+static void replay() {
+    for (int k = 0; k < config.connections; k++) {
+        if (lt_open(&conns[k], epoll_fd, config.host, config.port) != 0) {
+            fprintf(stderr, "cannot connect to %s:%d: %s\n", config.host, config.port, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("replaying %ld orders over %d connections to %s:%d, ", order_count, config.connections,
+           config.host, config.port);
+    if (config.speed > 0) {
+        printf("x%g speed, %.1f s\n", config.speed, order_count ? offsets[order_count - 1] / 1e9 : 0.0);
+    } else {
+        printf("as fast as possible, window %d\n", config.window);
+    }
+    fflush(stdout);
+
+    struct epoll_event events[EPOLL_BATCH];
+    uint64_t start = lt_now_ns(), done_at = 0, next_report = start + 1000000000ULL;
+    uint64_t last_sent = 0, last_answered = 0, worst_behind = 0;
+    long next = 0;
+    while (1) {
+        uint64_t now = lt_now_ns();
+        if (next == order_count) {
+            if (done_at == 0) {
+                done_at = now;
+            }
+            if (in_flight() == 0 || now >= done_at + DRAIN_NS) {
+                break;
+            }
+        }
+        // everything the schedule owes up to now; a stalled FEP leaves the schedule behind
+        while (next < order_count && start + offsets[next] <= now) {
+            lt_conn *c = pick_conn();
+            if (c == NULL) {
+                break;  // every window is full, wait for acks
+            }
+            uint64_t intended = config.speed > 0 ? start + offsets[next] : now;
+            if (now - intended > worst_behind) {
+                worst_behind = now - intended;
+            }
+            queue_order(c, next++, intended, now);
+        }
+        for (int k = 0; k < config.connections; k++) {
+            if (conns[k].fd != -1 && conns[k].tx_len > conns[k].tx_off && !conns[k].want_out) {
+                flush_conn(&conns[k]);
+            }
+        }
+
+        int timeout = 1;
+        if (next < order_count && start + offsets[next] > now) {
+            uint64_t wait = start + offsets[next] - now;
+            timeout = wait < SPIN_NS ? 0 : (int)(wait / 1000000 < 100 ? wait / 1000000 : 100);
+        } else if (next < order_count && pick_conn() != NULL) {
+            timeout = 0;
+        }
+        int n = epoll_wait(epoll_fd, events, EPOLL_BATCH, timeout);
+        for (int k = 0; k < n; k++) {
+            lt_conn *c = events[k].data.ptr;
+            if (c->fd != -1 && (events[k].events & EPOLLIN)) {
+                read_acks(c);
+            }
+            if (c->fd != -1 && (events[k].events & EPOLLOUT)) {
+                flush_conn(c);
+            }
+            if (c->fd != -1 && (events[k].events & (EPOLLERR | EPOLLHUP))) {
+                close_conn(c, "socket error");
+            }
+        }
+
+        if (now >= next_report) {
+            printf("%6.0f s  sent %8lu/s  acked %8lu/s  in flight %6lu  %ld of %ld\n", (now - start) / 1e9,
+                   (unsigned long)(sent - last_sent), (unsigned long)(answered - last_answered),
+                   (unsigned long)in_flight(), next, order_count);
+            fflush(stdout);
+            last_sent = sent;
+            last_answered = answered;
+            next_report += 1000000000ULL;
+        }
+    }
+    for (int k = 0; k < config.connections; k++) {
+        lost += lt_close(&conns[k]);
+    }
+
+    double seconds = ((done_at ? done_at : lt_now_ns()) - start) / 1e9;
+    printf("\nsent %lu in %.1f s (%.0f/s), acked %lu, unanswered %lu, schedule slipped up to %.1f ms\n",
+           (unsigned long)sent, seconds, seconds > 0 ? sent / seconds : 0.0, (unsigned long)answered,
+           (unsigned long)lost, worst_behind / 1e6);
+    printf("  %-12s %10s %10s %10s %10s %10s %10s %10s\n", "ack latency", "p50(us)", "p90(us)", "p99(us)",
+           "p99.9(us)", "p99.99(us)", "max(us)", "mean(us)");
+    print_percentiles("corrected", &corrected);
+    print_percentiles("uncorrected", &uncorrected);
+}
+
+// ---- comparison ----
+
+static int diff_acks() {
+    const fot_order_is_submitted *before = NULL;
+    long before_count = 0;
+    if (config.acks_before != NULL) {
+        size_t size;
+        before = map_file(config.acks_before, &size);
+        before_count = size / sizeof(fot_order_is_submitted);
+    }
+
+    long rejected = 0, changed = 0, missing = 0;
+    int shown = 0;
+    printf("\nacks against %s\n", before ? config.acks_before : "the journal (all accepted)");
+    for (long i = 0; i < order_count; i++) {
+        if (!acked[i]) {
+            missing++;
+            continue;
+        }
+        char expected[5] = "0000";
+        if (before != NULL && i < before_count) {
+            memcpy(expected, before[i].reject_code, 4);
+        }
+        if (strncmp(acks[i].reject_code, expected, 4) != 0) {
+            if (before == NULL) {
+                rejected++;
+            } else {
+                changed++;
+            }
+            if (shown++ < DIFF_SHOWN) {
+                printf("  %.6s  expected %.4s  got %.4s\n", orders[i].transaction_code, expected, acks[i].reject_code);
+            }
+        }
+    }
+    if (before != NULL && before_count != order_count) {
+        printf("  %ld acks before, %ld orders now\n", before_count, order_count);
+    }
+    printf("  %ld different (%ld rejected, %ld changed), %ld unanswered, %lu for another order\n",
+           rejected + changed, rejected, changed, missing, (unsigned long)misrouted);
+    return rejected + changed + missing + misrouted != 0;
+}
+
+typedef struct {
+    char transaction_code[7];
+    int count;
+    int status_code;        // of the last execution
+    int executed_price;
+    char reject_code[7];
+} exec_summary;
+
+static int compare_summary(const void *a, const void *b) {
+    return strncmp(((const exec_summary *)a)->transaction_code, ((const exec_summary *)b)->transaction_code, 6);
+}
+
+// One entry per transaction_code, in code order; journal order decides "last"
+static exec_summary *summarize(const char *path, long *count, long *records) {
+    size_t size;
+    const kft_execution *execs = map_file(path, &size);
+    if (size % sizeof(kft_execution) != 0) {
+        // another record layout (kft_execution was 56 bytes before seq_no) or a torn tail
+        fprintf(stderr, "%s: %zu bytes is not a whole number of %zu-byte executions\n", path, size, sizeof(kft_execution));
+        exit(EXIT_FAILURE);
+    }
+    *records = size / sizeof(kft_execution);
+    exec_summary *all = calloc(*records + 1, sizeof(exec_summary));
+    if (all == NULL) {
+        perror("summary");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < *records; i++) {
+        exec_summary *s = &all[i];
+        memcpy(s->transaction_code, execs[i].transaction_code, 6);
+        s->count = (int)i;      // journal position until folded
+        s->status_code = execs[i].status_code;
+        s->executed_price = execs[i].executed_price;
+        memcpy(s->reject_code, execs[i].reject_code, 4);
+    }
+    // stable by code: sort, then keep the last record of each code and count them
+    qsort(all, *records, sizeof(exec_summary), compare_summary);
+    long n = 0;
+    for (long i = 0; i < *records;) {
+        long end = i, last = i;
+        while (end < *records && compare_summary(&all[end], &all[i]) == 0) {
+            if (all[end].count > all[last].count) {
+                last = end;
+            }
+            end++;
+        }
+        all[n] = all[last];
+        all[n].count = (int)(end - i);
+        n++;
+        i = end;
+    }
+    *count = n;
+    return all;
+}
+
+static int diff_executions() {
+    long original_count, replayed_count, original_records, replayed_records;
+    exec_summary *original = summarize(config.exec_original, &original_count, &original_records);
+    exec_summary *replayed = summarize(config.exec_replayed, &replayed_count, &replayed_records);
+
+    long only_original = 0, only_replayed = 0, final_differs = 0, count_differs = 0;
+    int shown = 0;
+    printf("\nexecutions: %ld records for %ld orders before, %ld records for %ld orders now\n",
+           original_records, original_count, replayed_records, replayed_count);
+    long i = 0, k = 0;
+    while (i < original_count || k < replayed_count) {
+        int order = i == original_count ? 1 : k == replayed_count ? -1 : compare_summary(&original[i], &replayed[k]);
+        if (order < 0) {
+            only_original++;
+            if (shown++ < DIFF_SHOWN) {
+                printf("  %.6s  only before (status %d)\n", original[i].transaction_code, original[i].status_code);
+            }
+            i++;
+        } else if (order > 0) {
+            only_replayed++;
+            if (shown++ < DIFF_SHOWN) {
+                printf("  %.6s  only now (status %d)\n", replayed[k].transaction_code, replayed[k].status_code);
+            }
+            k++;
+        } else {
+            const exec_summary *a = &original[i++], *b = &replayed[k++];
+            if (a->status_code != b->status_code || a->executed_price != b->executed_price
+                    || strncmp(a->reject_code, b->reject_code, 4) != 0) {
+                final_differs++;
+                if (shown++ < DIFF_SHOWN) {
+                    printf("  %.6s  final status %d %d %.4s -> %d %d %.4s\n", a->transaction_code,
+                           a->status_code, a->executed_price, a->reject_code,
+                           b->status_code, b->executed_price, b->reject_code);
+                }
+            } else if (a->count != b->count) {
+                count_differs++;
+                if (shown++ < DIFF_SHOWN) {
+                    printf("  %.6s  %d executions -> %d\n", a->transaction_code, a->count, b->count);
+                }
+            }
+        }
+    }
+    printf("  %ld only before, %ld only now, %ld final state differs, %ld execution count differs\n",
+           only_original, only_replayed, final_differs, count_differs);
+    free(original);
+    free(replayed);
+    return only_original + only_replayed + final_differs + count_differs != 0;
+}
+
+// Wait until the replayed execution journal stopped growing for `settle` seconds
+static void settle_executions() {
+    struct stat st;
+    off_t last_size = -1;
+    int quiet = 0;
+    while (quiet < config.settle) {
+        sleep(1);
+        off_t size = stat(config.exec_replayed, &st) == 0 ? st.st_size : 0;
+        quiet = size == last_size ? quiet + 1 : 0;
+        last_size = size;
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-a host] [-p port] [-c connections] [-w window] [-x speed] [-g max_gap_s]"
+                    " [-n orders] [-o acks_out] [-A acks_before] [-e exec_journal -E exec_journal_replayed]"
+                    " [-W settle_s] [-D] journal\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:c:w:x:g:n:o:A:e:E:W:D")) != -1) {
+        switch (opt) {
+        case 'a': config.host = optarg; break;
+        case 'p': config.port = atoi(optarg); break;
+        case 'c': config.connections = atoi(optarg); break;
+        case 'w': config.window = atoi(optarg); break;
+        case 'x': config.speed = atof(optarg); break;
+        case 'g': config.max_gap = atof(optarg); break;
+        case 'n': config.limit = atol(optarg); break;
+        case 'o': config.acks_out = optarg; break;
+        case 'A': config.acks_before = optarg; break;
+        case 'e': config.exec_original = optarg; break;
+        case 'E': config.exec_replayed = optarg; break;
+        case 'W': config.settle = atoi(optarg); break;
+        case 'D': config.diff_only = 1; break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (config.connections < 1 || config.connections > MAX_CONNECTIONS || config.window < 1
+            || config.window > LT_MAX_WINDOW || config.speed < 0 || (config.exec_original == NULL) != (config.exec_replayed == NULL)
+            || (!config.diff_only && optind != argc - 1) || (config.diff_only && config.exec_original == NULL)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int differences = 0;
+    if (!config.diff_only) {
+        size_t size;
+        orders = map_file(argv[optind], &size);
+        order_count = size / sizeof(fkq_order);
+        if (size % sizeof(fkq_order) != 0) {
+            fprintf(stderr, "%s: %zu trailing bytes ignored\n", argv[optind], size % sizeof(fkq_order));
+        }
+        if (config.limit > 0 && config.limit < order_count) {
+            order_count = config.limit;
+        }
+        acks = calloc(order_count + 1, sizeof(fot_order_is_submitted));
+        acked = calloc(order_count + 1, 1);
+        epoll_fd = epoll_create1(0);
+        if (acks == NULL || acked == NULL || epoll_fd < 0) {
+            perror("setup");
+            return EXIT_FAILURE;
+        }
+
+        // order_time is validated against KST by the FEP
+        setenv("TZ", "Asia/Seoul", 1);
+        tzset();
+        plan_schedule();
+        replay();
+
+        if (config.acks_out != NULL) {
+            FILE *file = fopen(config.acks_out, "wb");
+            if (file == NULL || fwrite(acks, sizeof(fot_order_is_submitted), order_count, file) != (size_t)order_count) {
+                perror(config.acks_out);
+            } else {
+                printf("acks saved to %s\n", config.acks_out);
+            }
+            if (file != NULL) {
+                fclose(file);
+            }
+        }
+        differences |= diff_acks();
+    }
+
+    if (config.exec_original != NULL) {
+        if (config.settle > 0) {
+            settle_executions();
+        }
+        differences |= diff_executions();
+    }
+    return lost != 0 ? EXIT_FAILURE : differences ? 2 : 0;
+}
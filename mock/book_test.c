@@ -0,0 +1,126 @@
+// Order book checks for the KRX mock (simple_receiver.c), built from the same source
+// with its main renamed. Executions stay in exec_tx: nothing is connected or flushed.
+//
+// usage: book_test     exit status 0 when every check passed
+
+#define main simple_receiver_main
+#include "simple_receiver.c"
+#undef main
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+static void book_reset() {
+    for (int i = 0; i < MAX_RESTING; i++) {
+        resting[i].live = 0;
+        resting[i].next_free = i + 1 < MAX_RESTING ? i + 1 : -1;
+    }
+    free_resting = 0;
+    resting_count = 0;
+    memset(order_index, -1, sizeof(int) * ORDER_INDEX_SIZE);
+    order_index_used = 0;
+    for (int b = 0; b < MAX_BOOKS; b++) {
+        books[b].used = 0;
+        books[b].counts[0] = books[b].counts[1] = 0;
+    }
+    exec_tx_len = exec_tx_off = 0;
+}
+
+static void submit(const char *transaction_code, char order_type, int quantity, int price, const char *original_order) {
+    fkq_order order;
+    memset(&order, 0, sizeof(order));
+    order.hdr.tr_id = FEP_TR_fkq_order;
+    order.hdr.length = sizeof(fkq_order);
+    fep_copy_str(order.stock_code, sizeof(order.stock_code), "005930");
+    fep_copy_str(order.transaction_code, sizeof(order.transaction_code), transaction_code);
+    order.order_type = order_type;
+    order.quantity = quantity;
+    order.price = price;
+    fep_copy_str(order.original_order, sizeof(order.original_order), original_order);
+    if (order_type == 'C') {
+        cancel_order(&order);
+    } else {
+        match_order(&order);
+    }
+}
+
+static int executions() {
+    return (int)((exec_tx_len - exec_tx_off) / sizeof(kft_execution));
+}
+
+static const kft_execution *execution(int k) {
+    return (const kft_execution *)(exec_tx + exec_tx_off) + k;
+}
+
+// A cancelled best order is dropped when the book is next matched: its slot, not the
+// new best's, goes back on the free list, and the fill is for the live order.
+static void test_cancel_then_match() {
+    book_reset();
+    submit("A00001", 'B', 10, 100, "NA");
+    submit("B00002", 'B', 10, 99, "NA");
+    int a = *index_slot("A00001", 0), b = *index_slot("B00002", 0);
+    submit("C00003", 'C', 0, 0, "A00001");
+    exec_tx_len = exec_tx_off = 0;
+
+    order_book *book = find_book("005930");
+    book_entry *best = best_entry(book, 0);
+    CHECK(best != NULL && best->order == b, "best bid is B after A was cancelled");
+    CHECK(free_resting == a, "A's slot %d is free, free list starts at %d", a, free_resting);
+    CHECK(resting[b].live && book->counts[0] == 1, "B still rests alone");
+
+    submit("E00005", 'B', 10, 98, "NA");
+    CHECK(*index_slot("E00005", 0) == a, "E rests in A's old slot");
+    CHECK(resting[b].live && strncmp(resting[b].transaction_code, "B00002", 6) == 0, "B untouched by E");
+
+    submit("D00004", 'S', 10, 99, "NA");
+    CHECK(executions() == 2, "one trade, %d executions", executions());
+    if (executions() == 2) {
+        CHECK(strncmp(execution(0)->transaction_code, "D00004", 6) == 0 && execution(0)->executed_price == 99,
+              "incoming sell filled at 99");
+        CHECK(strncmp(execution(1)->transaction_code, "B00002", 6) == 0 && execution(1)->executed_price == 99,
+              "resting fill is B at 99, not %.6s at %d", execution(1)->transaction_code, execution(1)->executed_price);
+    }
+    CHECK(resting_count == 1, "only E rests, %d resting", resting_count);
+}
+
+// Filled and cancelled orders give their slots back, so a long run does not report E904
+static void test_slots_are_reused() {
+    book_reset();
+    for (int i = 0; i < 3 * MAX_RESTING; i++) {
+        char code[7];
+        snprintf(code, sizeof(code), "%06d", i % 1000000);
+        submit(code, 'B', 1, 100, "NA");
+        if (i % 2 == 0) {
+            submit("X00000", 'S', 1, 100, "NA");
+        } else {
+            submit("Y00000", 'C', 0, 0, code);
+        }
+        exec_tx_len = exec_tx_off = 0;
+    }
+    CHECK(stats.rejects == 0, "%lu rejects", (unsigned long)stats.rejects);
+}
+
+int main() {
+    maker_percent = 0;      // the unfilled rest always rests
+    quiet = 1;
+    resting = malloc(sizeof(resting_order) * MAX_RESTING);
+    order_index = malloc(sizeof(int) * ORDER_INDEX_SIZE);
+    if (resting == NULL || order_index == NULL) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    test_cancel_then_match();
+    test_slots_are_reused();
+
+    printf("%s\n", failures == 0 ? "book_test: ok" : "book_test: FAILED");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,240 +1,1003 @@
-    #include <stdio.h>
-    #include <stdlib.h>
-    #include <string.h>
-    #include <arpa/inet.h>
-    #include <unistd.h>
-    #include <envs.h>
-
-    // Define `hdr` structure
-    typedef struct {
-        int tr_id;
-        int length;
-    } hdr;
-
-    // Define `fkq_order` structure
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <envs.h>
+#include <oms_fep_krx_struct.h>
+#include <fep_codec.h>
+
+// Mock KRX exchange.
+//
+// Accepts any number of order sessions on KRX_PORT and reports executions on one
+// connection to the FEP (FEP_IP:FEP_KRX_R_PORT), as KRX does. Every stock code has
+// a price-time priority book; an incoming order trades against the best resting
+// orders first. What is left then either rests in the book or, with the simulated
+// market maker (-m), is filled against outside liquidity in up to -p parts.
+//   B / S   limit order at price, price 0 = market order (the unfilled rest is cancelled)
+//   C       cancels original_order: status 1 for the cancel and for the cancelled order
+// kft_execution has no quantity, so every fill of an order is one status 0 execution.
+// Rejected orders get status 99 with one of the KRX_E* codes below.
+//
+// The book is checked by mock/book_test.c.
+//
+// One thread, non-blocking sockets and batched writes, so it outruns the FEP.
+// While the FEP reads executions slower than they are produced, order sessions are
+// no longer read (backpressure), which bounds the unsent and delayed executions.
+//
+// usage: simple_receiver [-m maker%] [-p parts] [-r reject%] [-L latency] [-A latency]
+//                        [-a] [-g drop_every_n] [-d duplicate_every_n] [-s seed] [-q]
+//   -m  chance that the unfilled rest of a limit order is filled by the market maker, default 100
+//   -p  the market maker fills in 1..parts executions, default 1
+//   -r  share of orders rejected at random (E901), default 0
+//   -L  execution latency: 0 | fixed:us | uniform:lo_us:hi_us | exp:mean_us | normal:mean_us:sd_us
+//   -A  order ack latency, same forms (acks are only sent with -a)
+//   -a  acknowledge every order with kft_order (tr 15) on its session
+//   -g  hold back every Nth execution (sequence gap), answered by resend requests
+//   -d  send every Nth execution twice
+//   -q  no per second statistics
+
+#define KRX_E_RANDOM   "E901"   // rejected at random (-r)
+#define KRX_E_INVALID  "E902"   // bad order type, quantity or price
+#define KRX_E_NO_ORDER "E903"   // cancel of an order that is not in the book
+#define KRX_E_FULL     "E904"   // the book has no room for another resting order
+
+#define MAX_SESSIONS 64
+#define MAX_BOOKS 4096                          // distinct stock codes, power of 2
+#define MAX_RESTING (1 << 20)                   // resting orders over all books
+#define ORDER_INDEX_SIZE (1 << 22)              // transaction_code -> resting order, power of 2
+#define SESSION_RX_SIZE (sizeof(fkq_order) * 512)
+#define SESSION_TX_SIZE (sizeof(kft_order) * 4096)
+#define EXEC_HIGH_WATER 65536                  // unsent + delayed executions that pause order reads
+#define EPOLL_BATCH 64
+
+// Sent executions kept for resend requests, indexed by seq_no
+#define HISTORY_SIZE 65536
+
+// epoll tags for the fixed descriptors; sessions are tagged with their index
+#define TAG_LISTEN -1
+#define TAG_EXEC -2
+#define TAG_TIMER -3
+
 typedef struct {
-    hdr hdr;           // 4 bytes
-    char stock_code[7];     // 7 bytes
-    char padding1;          // 1 byte (패딩)
-    char stock_name[51];    // 51 bytes
-    char padding2;          // 1 byte (패딩)
-    char transaction_code[7]; // 7 bytes
-    char padding3;          // 1 byte (패딩)
-    char user_id[21];       // 21 bytes
-    char padding4[3];       // 3 bytes (패딩, 4의 배수 정렬)
-    char order_type;        // 1 byte
-    char padding5[3];       // 3 bytes (패딩)
-    int quantity;           // 4 bytes
-    char order_time[15];    // 15 bytes
-    char padding6;          // 1 byte (패딩)
-    int price;              // 4 bytes
-    char original_order[7]; // 7 bytes
-    char padding7;          // 1 byte (패딩)
-} fkq_order;  // **총 136 bytes (패딩 포함)**
-
-    // Define `kft_execution` structure
+    char transaction_code[7];
+    char side;              // 'B' / 'S'
+    int price;
+    int remaining;
+    int live;               // 0 once filled or cancelled, its heap entry is then skipped
+    int next_free;
+} resting_order;
+
 typedef struct {
-    hdr hdr;
-    char transaction_code[7]; // 거래코드
-    char padding1;          // 1 byte (패딩)
-    int status_code;          // 상태 코드 (0: 체결, 1: 취소, 99: 오류)
-    char time[15];            // 응답시간 (YYYYMMDDHHMMSS)
-    char padding2;          // 1 byte (패딩)
-    int executed_price;       // 체결 가격
-    char original_order[7];   // 원주문번호
-    char padding3;          // 1 byte (패딩)
-    char reject_code[7];      // 거부사유코드 (문자열)
-    char padding4;          // 1 byte (패딩)
-} kft_execution;
+    int price;
+    uint64_t time_seq;      // arrival order, the time in price-time priority
+    int order;              // index into resting[]
+} book_entry;
 
 typedef struct {
-    hdr hdr;
-    char transaction_code[7]; // 거래코드
-    char padding1;          // 1 byte (패딩)
-    char user_id[21];         // 유저 ID
-    char padding2[3];          // 1 byte (패딩) 
-    char time[15];            // 응답시간 (YYYYMMDDHHMMSS)
-    char padding3;          // 1 byte (패딩)
-    char reject_code[7];      // 거부사유코드 (문자열)
-    char padding4;          // 1 byte (패딩)
-} fot_order_is_submitted;
-
-    // Function to send `kft_execution` structure to the specified IP and port
-    void send_kft_execution(const kft_execution *exec, int sock) {
-
-        // Send the `kft_execution` structure
-        ssize_t sent_bytes = send(sock, exec, sizeof(kft_execution), 0);
-        if (sent_bytes < 0) {
-            perror("Send failed");
-        } else if (sent_bytes < sizeof(kft_execution)) {
-            fprintf(stderr, "Partial data sent. Expected %lu bytes, sent %ld bytes.\n",
-                    sizeof(kft_execution), sent_bytes);
-        } else {
-            printf("krx says transaction is executed\n");
-        }
+    char stock_code[7];
+    int used;
+    book_entry *heaps[2];   // [0] bids, best = highest price; [1] asks, best = lowest price
+    int counts[2];
+    int caps[2];
+} order_book;
+
+typedef struct {
+    int fd;
+    unsigned int generation;    // delayed acks for a closed session are dropped
+    char rx[SESSION_RX_SIZE];
+    size_t rx_len;
+    char tx[SESSION_TX_SIZE];
+    size_t tx_len, tx_off;
+} order_session;
+
+typedef enum { LAT_NONE, LAT_FIXED, LAT_UNIFORM, LAT_EXP, LAT_NORMAL } latency_kind;
+
+typedef struct {
+    latency_kind kind;
+    double a, b;            // microseconds
+} latency_dist;
+
+typedef struct {
+    uint64_t due_ns;
+    uint64_t order;         // tie breaker, keeps equal due times in submit order
+    int session;            // -1: execution to the FEP
+    unsigned int generation;
+    union {
+        kft_execution execution;
+        kft_order ack;
+    } msg;
+} delayed_msg;
+
+// configuration
+static int maker_percent = 100;
+static int maker_parts = 1;
+static int reject_percent = 0;
+static int send_acks = 0;
+static int quiet = 0;
+static latency_dist exec_latency = {LAT_NONE, 0, 0};
+static latency_dist ack_latency = {LAT_NONE, 0, 0};
+
+// gap injection (-g N: hold back every Nth execution, -d N: send every Nth twice)
+static int drop_every = 0;
+static int dup_every = 0;
+static long dropped = 0, duplicated = 0, resent = 0;
+static uint64_t resend_started;
+
+static kft_execution history[HISTORY_SIZE];
+static int exec_seq = 0;
+
+static order_book books[MAX_BOOKS];
+static resting_order *resting;
+static int *order_index;
+static int order_index_used = 0;
+static int free_resting = -1;
+static int resting_count = 0;
+static uint64_t time_seq = 0;
+
+static order_session sessions[MAX_SESSIONS];
+static unsigned int session_generation = 0;
+static int epoll_fd, exec_fd, timer_fd;
+static int sessions_paused = 0;
+
+static char *exec_tx = NULL;
+static size_t exec_tx_len = 0, exec_tx_off = 0, exec_tx_cap = 0;
+static char exec_rx[sizeof(fkq_resend_request) * 64];
+static size_t exec_rx_len = 0;
+
+static delayed_msg *delayed;
+static int delayed_count = 0, delayed_cap = 0;
+static uint64_t delayed_order = 0;
+
+static uint64_t rng_state;
+static char now_time[15];
+static time_t now_time_sec = 0;
 
-        // Close the socket
-        // close(sock);
+static struct {
+    uint64_t orders, executions, fills, trades, cancels, rejects, acks, acks_dropped;
+} stats, last_stats;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t next_random() {
+    rng_state ^= rng_state << 13;    // xorshift64
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double random_unit() {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int random_percent(int percent) {
+    return percent > 0 && (int)(next_random() % 100) < percent;
+}
+
+static int parse_latency(const char *spec, latency_dist *dist) {
+    memset(dist, 0, sizeof(*dist));
+    if (strcmp(spec, "0") == 0) {
+        return 0;
+    } else if (sscanf(spec, "fixed:%lf", &dist->a) == 1) {
+        dist->kind = LAT_FIXED;
+    } else if (sscanf(spec, "uniform:%lf:%lf", &dist->a, &dist->b) == 2 && dist->b >= dist->a) {
+        dist->kind = LAT_UNIFORM;
+    } else if (sscanf(spec, "exp:%lf", &dist->a) == 1) {
+        dist->kind = LAT_EXP;
+    } else if (sscanf(spec, "normal:%lf:%lf", &dist->a, &dist->b) == 2) {
+        dist->kind = LAT_NORMAL;
+    } else {
+        return -1;
     }
+    return dist->a >= 0 ? 0 : -1;
+}
 
-    int main() {
-        // socket for local port incoming
+static uint64_t sample_latency_ns(const latency_dist *dist) {
+    double us = 0;
+    switch (dist->kind) {
+    case LAT_NONE:    return 0;
+    case LAT_FIXED:   us = dist->a; break;
+    case LAT_UNIFORM: us = dist->a + (dist->b - dist->a) * random_unit(); break;
+    case LAT_EXP:     us = -dist->a * log(1.0 - random_unit()); break;
+    case LAT_NORMAL:  // Box-Muller
+        us = dist->a + dist->b * sqrt(-2.0 * log(1.0 - random_unit())) * cos(2 * M_PI * random_unit());
+        break;
+    }
+    return us > 0 ? (uint64_t)(us * 1000.0) : 0;
+}
+
+// Current KST time, the FEP rejects execution times in the future
+static const char *current_time() {
+    time_t now = time(NULL);
+    if (now != now_time_sec) {
+        strftime(now_time, sizeof(now_time), "%Y%m%d%H%M%S", localtime(&now));
+        now_time_sec = now;
+    }
+    return now_time;
+}
 
-        int server_fd, client_fd;
-        struct sockaddr_in server_addr, client_addr;
-        socklen_t addr_len = sizeof(client_addr);
+// ---- delayed messages: min-heap on (due_ns, order), drained by timer_fd ----
+
+static int delayed_before(const delayed_msg *x, const delayed_msg *y) {
+    return x->due_ns < y->due_ns || (x->due_ns == y->due_ns && x->order < y->order);
+}
+
+static void arm_timer() {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (delayed_count > 0) {
+        uint64_t due = delayed[0].due_ns ? delayed[0].due_ns : 1;
+        spec.it_value.tv_sec = due / 1000000000ULL;
+        spec.it_value.tv_nsec = due % 1000000000ULL;
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
 
-        // Create socket
-        if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-            perror("Socket creation failed");
+static void delay_push(const delayed_msg *msg) {
+    if (delayed_count == delayed_cap) {
+        delayed_cap = delayed_cap ? delayed_cap * 2 : 4096;
+        delayed = realloc(delayed, sizeof(delayed_msg) * delayed_cap);
+        if (delayed == NULL) {
+            perror("delayed queue");
             exit(EXIT_FAILURE);
         }
-    // 포트 재사용 옵션 추가
-    int opt = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        printf( "setsockopt failed");
-        exit(EXIT_FAILURE);
     }
+    int i = delayed_count++;
+    delayed[i] = *msg;
+    delayed[i].order = delayed_order++;
+    while (i > 0 && delayed_before(&delayed[i], &delayed[(i - 1) / 2])) {
+        delayed_msg tmp = delayed[i];
+        delayed[i] = delayed[(i - 1) / 2];
+        delayed[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+    if (i == 0) {
+        arm_timer();
+    }
+}
 
+static void delay_pop(delayed_msg *out) {
+    *out = delayed[0];
+    delayed[0] = delayed[--delayed_count];
+    int i = 0;
+    while (1) {
+        int best = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < delayed_count && delayed_before(&delayed[l], &delayed[best])) {
+            best = l;
+        }
+        if (r < delayed_count && delayed_before(&delayed[r], &delayed[best])) {
+            best = r;
+        }
+        if (best == i) {
+            break;
+        }
+        delayed_msg tmp = delayed[i];
+        delayed[i] = delayed[best];
+        delayed[best] = tmp;
+        i = best;
+    }
+}
 
-        // Set server address
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_addr.s_addr = INADDR_ANY;
-        server_addr.sin_port = htons(FEP_OMS_R_PORT); 
+// ---- execution connection to the FEP ----
 
-        // Bind socket
-        if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-            perror("Bind failed");
-            close(server_fd);
+static void update_session_reads();
+
+static void flush_exec() {
+    while (exec_tx_off < exec_tx_len) {
+        ssize_t n = send(exec_fd, exec_tx + exec_tx_off, exec_tx_len - exec_tx_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            perror("FEP execution connection");
             exit(EXIT_FAILURE);
         }
+        exec_tx_off += n;
+    }
+    if (exec_tx_off == exec_tx_len) {
+        exec_tx_off = exec_tx_len = 0;
+    }
+    struct epoll_event ev = {.events = EPOLLIN | (exec_tx_len ? EPOLLOUT : 0), .data.u64 = (uint64_t)(int64_t)TAG_EXEC};
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, exec_fd, &ev);
+    update_session_reads();
+}
 
-        // Listen for connections
-        if (listen(server_fd, 1) < 0) {
-            perror("Listen failed");
-            close(server_fd);
+// Queue an execution for the FEP. The buffer grows rather than drops: one order
+// sweeping a book or a resend can add many executions after reads were paused.
+static void send_kft_execution(const kft_execution *exec) {
+    if (exec_tx_len + sizeof(kft_execution) > exec_tx_cap && exec_tx_off > 0) {
+        memmove(exec_tx, exec_tx + exec_tx_off, exec_tx_len - exec_tx_off);
+        exec_tx_len -= exec_tx_off;
+        exec_tx_off = 0;
+    }
+    if (exec_tx_len + sizeof(kft_execution) > exec_tx_cap) {
+        exec_tx_cap = exec_tx_cap ? exec_tx_cap * 2 : sizeof(kft_execution) * EXEC_HIGH_WATER;
+        exec_tx = realloc(exec_tx, exec_tx_cap);
+        if (exec_tx == NULL) {
+            perror("execution buffer");
             exit(EXIT_FAILURE);
         }
+    }
+    memcpy(exec_tx + exec_tx_len, exec, sizeof(kft_execution));
+    exec_tx_len += sizeof(kft_execution);
+    stats.executions++;
+}
 
-        // socket for sending response
-        int sock;
-        struct sockaddr_in fep_server_addr;
+static void next_execution(kft_execution *exec) {
+    exec->seq_no = ++exec_seq;
+    history[exec->seq_no % HISTORY_SIZE] = *exec;
 
-        // Create socket
-        if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-            perror("Socket creation failed");
-            exit(EXIT_FAILURE);
+    if (drop_every > 0 && exec->seq_no % drop_every == 0) {
+        dropped++;
+        if (!quiet) {
+            printf("gap injected: seq %d held back\n", exec->seq_no);
         }
+        return;
+    }
+    send_kft_execution(exec);
+    if (dup_every > 0 && exec->seq_no % dup_every == 0) {
+        duplicated++;
+        send_kft_execution(exec);
+    }
+}
+
+static void handle_resend_request(const fkq_resend_request *request) {
+    if (request->hdr.tr_id != FEP_TR_fkq_resend_request) {
+        fprintf(stderr, "Unknown message from FEP (tr_id %d)\n", request->hdr.tr_id);
+        return;
+    }
+    if (request->begin_seq < exec_seq - HISTORY_SIZE + 1 || request->end_seq > exec_seq) {
+        fprintf(stderr, "Resend %d-%d is out of history range\n", request->begin_seq, request->end_seq);
+        return;
+    }
+    if (resent == 0) {
+        resend_started = now_ns();
+    }
+    for (int seq = request->begin_seq; seq <= request->end_seq; seq++) {
+        send_kft_execution(&history[seq % HISTORY_SIZE]);
+        resent++;
+    }
+    double elapsed = (now_ns() - resend_started) / 1e9;
+    printf("resent %d-%d. dropped=%ld duplicated=%ld resent=%ld (%.0f msg/s)\n",
+           request->begin_seq, request->end_seq, dropped, duplicated, resent,
+           elapsed > 0 ? resent / elapsed : 0.0);
+}
 
-        // Set server address
-        fep_server_addr.sin_family = AF_INET;
-        fep_server_addr.sin_port = htons(FEP_KRX_R_PORT);
-        if (inet_pton(AF_INET, FEP_IP, &fep_server_addr.sin_addr) <= 0) {
-            perror("Invalid IP address or format");
-            close(sock);
+static void read_exec_connection() {
+    while (1) {
+        ssize_t n = recv(exec_fd, exec_rx + exec_rx_len, sizeof(exec_rx) - exec_rx_len, 0);
+        if (n == 0) {
+            printf("FEP closed the execution connection.\n");
             exit(EXIT_FAILURE);
+        } else if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            perror("FEP execution connection");
+            exit(EXIT_FAILURE);
+        }
+        exec_rx_len += n;
+        size_t off = 0;
+        for (; exec_rx_len - off >= sizeof(fkq_resend_request); off += sizeof(fkq_resend_request)) {
+            fkq_resend_request request;
+            memcpy(&request, exec_rx + off, sizeof(request));
+            handle_resend_request(&request);
         }
+        memmove(exec_rx, exec_rx + off, exec_rx_len - off);
+        exec_rx_len -= off;
+    }
+    flush_exec();
+}
 
-        // Connect to the server
-        if (connect(sock, (struct sockaddr *)&fep_server_addr, sizeof(fep_server_addr)) < 0) {
-            perror("Connection to server failed");
-            close(sock);
-            exit(EXIT_FAILURE);
+// Build an execution and send it now or after the configured latency
+static void emit_execution(const char *transaction_code, int status_code, int price,
+                           const char *original_order, const char *reject_code) {
+    delayed_msg msg;
+    kft_execution *exec = &msg.msg.execution;
+
+    memset(exec, 0, sizeof(kft_execution));
+    exec->hdr.tr_id = FEP_TR_kft_execution;
+    exec->hdr.length = sizeof(kft_execution);
+    fep_copy_str(exec->transaction_code, sizeof(exec->transaction_code), transaction_code);
+    exec->status_code = status_code;
+    memcpy(exec->time, current_time(), sizeof(exec->time));
+    exec->executed_price = price;
+    fep_copy_str(exec->original_order, sizeof(exec->original_order), original_order);
+    fep_copy_str(exec->reject_code, sizeof(exec->reject_code), reject_code);
+
+    uint64_t delay = sample_latency_ns(&exec_latency);
+    if (delay == 0 && delayed_count == 0) {
+        next_execution(exec);
+        return;
+    }
+    msg.due_ns = now_ns() + delay;
+    msg.session = -1;
+    delay_push(&msg);
+}
+
+// ---- order sessions ----
+
+static void flush_session(order_session *s) {
+    while (s->tx_off < s->tx_len) {
+        ssize_t n = send(s->fd, s->tx + s->tx_off, s->tx_len - s->tx_off, MSG_NOSIGNAL);
+        if (n <= 0) {
+            break;  // acks are informational, whatever does not fit is dropped later
+        }
+        s->tx_off += n;
+    }
+    if (s->tx_off == s->tx_len) {
+        s->tx_off = s->tx_len = 0;
+    }
+}
+
+static void send_ack(int index, const kft_order *ack) {
+    order_session *s = &sessions[index];
+    if (s->tx_len + sizeof(kft_order) > SESSION_TX_SIZE && s->tx_off > 0) {
+        memmove(s->tx, s->tx + s->tx_off, s->tx_len - s->tx_off);
+        s->tx_len -= s->tx_off;
+        s->tx_off = 0;
+    }
+    if (s->tx_len + sizeof(kft_order) > SESSION_TX_SIZE) {
+        stats.acks_dropped++;   // the session does not read its acks
+        return;
+    }
+    memcpy(s->tx + s->tx_len, ack, sizeof(kft_order));
+    s->tx_len += sizeof(kft_order);
+    stats.acks++;
+}
+
+static void emit_ack(int index, const fkq_order *order, const char *reject_code) {
+    delayed_msg msg;
+    fep_build_kft_order(&msg.msg.ack, order, reject_code);
+    memcpy(msg.msg.ack.time, current_time(), sizeof(msg.msg.ack.time));
+
+    uint64_t delay = sample_latency_ns(&ack_latency);
+    if (delay == 0) {
+        send_ack(index, &msg.msg.ack);
+        return;
+    }
+    msg.due_ns = now_ns() + delay;
+    msg.session = index;
+    msg.generation = sessions[index].generation;
+    delay_push(&msg);
+}
+
+// Stop reading orders while the FEP is behind on executions
+static void update_session_reads() {
+    int pause = (exec_tx_len - exec_tx_off) / sizeof(kft_execution) + delayed_count > EXEC_HIGH_WATER;
+    if (pause == sessions_paused) {
+        return;
+    }
+    sessions_paused = pause;
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        if (sessions[i].fd != -1) {
+            struct epoll_event ev = {.events = pause ? 0 : EPOLLIN, .data.u64 = (uint64_t)i};
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, sessions[i].fd, &ev);
         }
+    }
+}
 
-        while (1) {
-            printf("Waiting for connections...\n");
+static void close_session(int index) {
+    order_session *s = &sessions[index];
+    printf("order session %d disconnected.\n", index);
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    s->fd = -1;
+}
 
-            // Accept a connection
-            if ((client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &addr_len)) < 0) {
-                perror("Accept failed");
-                close(server_fd);
-                exit(EXIT_FAILURE);
-            }
+// ---- books ----
+
+static unsigned int hash_code(const char *code) {
+    unsigned int h = 2166136261u; // FNV-1a
+    for (int i = 0; i < 6 && code[i] != '\0'; i++) {
+        h ^= (unsigned char)code[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static order_book *find_book(const char *stock_code) {
+    unsigned int slot = hash_code(stock_code) & (MAX_BOOKS - 1);
+    for (int probe = 0; probe < MAX_BOOKS; probe++) {
+        order_book *book = &books[slot];
+        if (!book->used) {
+            book->used = 1;
+            fep_copy_str(book->stock_code, sizeof(book->stock_code), stock_code);
+            return book;
+        }
+        if (strncmp(book->stock_code, stock_code, sizeof(book->stock_code)) == 0) {
+            return book;
+        }
+        slot = (slot + 1) & (MAX_BOOKS - 1);
+    }
+    return NULL;
+}
+
+// side 0 = bids (higher price first), 1 = asks (lower price first); earlier arrival breaks ties
+static int entry_before(int side, const book_entry *x, const book_entry *y) {
+    if (x->price != y->price) {
+        return side == 0 ? x->price > y->price : x->price < y->price;
+    }
+    return x->time_seq < y->time_seq;
+}
+
+static int heap_push(order_book *book, int side, const book_entry *entry) {
+    if (book->counts[side] == book->caps[side]) {
+        int cap = book->caps[side] ? book->caps[side] * 2 : 256;
+        book_entry *grown = realloc(book->heaps[side], sizeof(book_entry) * cap);
+        if (grown == NULL) {
+            return -1;
+        }
+        book->heaps[side] = grown;
+        book->caps[side] = cap;
+    }
+    book_entry *h = book->heaps[side];
+    int i = book->counts[side]++;
+    h[i] = *entry;
+    while (i > 0 && entry_before(side, &h[i], &h[(i - 1) / 2])) {
+        book_entry tmp = h[i];
+        h[i] = h[(i - 1) / 2];
+        h[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+    return 0;
+}
+
+static void heap_pop(order_book *book, int side) {
+    book_entry *h = book->heaps[side];
+    int count = --book->counts[side];
+    h[0] = h[count];
+    int i = 0;
+    while (1) {
+        int best = i, l = 2 * i + 1, r = 2 * i + 2;
+        if (l < count && entry_before(side, &h[l], &h[best])) {
+            best = l;
+        }
+        if (r < count && entry_before(side, &h[r], &h[best])) {
+            best = r;
+        }
+        if (best == i) {
+            break;
+        }
+        book_entry tmp = h[i];
+        h[i] = h[best];
+        h[best] = tmp;
+        i = best;
+    }
+}
+
+// Best live resting order on a side, dropping filled and cancelled ones on the way
+static book_entry *best_entry(order_book *book, int side) {
+    while (book->counts[side] > 0) {
+        book_entry *top = &book->heaps[side][0];
+        if (resting[top->order].live && resting[top->order].remaining > 0) {
+            return top;
+        }
+        // heap_pop moves another entry into top
+        int dead = top->order;
+        heap_pop(book, side);
+        resting[dead].next_free = free_resting;
+        free_resting = dead;
+    }
+    return NULL;
+}
+
+// order_index maps transaction_code to a resting order. Slots whose order has
+// left the book are reused on insert; the table is rebuilt when it gets crowded.
+static int *index_slot(const char *transaction_code, int for_insert) {
+    unsigned int slot = hash_code(transaction_code) & (ORDER_INDEX_SIZE - 1);
+    int *reusable = NULL;
+    while (order_index[slot] != -1) {
+        resting_order *o = &resting[order_index[slot]];
+        int current = o->live && strncmp(o->transaction_code, transaction_code, sizeof(o->transaction_code)) == 0;
+        if (current) {
+            return &order_index[slot];
+        }
+        if (for_insert && reusable == NULL && !o->live) {
+            reusable = &order_index[slot];
+        }
+        slot = (slot + 1) & (ORDER_INDEX_SIZE - 1);
+    }
+    return for_insert ? (reusable != NULL ? reusable : &order_index[slot]) : NULL;
+}
 
-            printf("Client connected!\n");
-
-            while(1){
-                // Receive data
-                fkq_order received_order;
-                ssize_t bytes_received = recv(client_fd, &received_order, sizeof(received_order), 0);
-                if (bytes_received < 0) {
-                    perror("Receive failed");
-                    close(client_fd);
-                    close(server_fd);
-                    // exit(EXIT_FAILURE);
-                    break;
-                } else if (bytes_received == 0) {
-                    // Client disconnected
-                    printf("Client disconnected.\n");
-                    close(client_fd);
-                    break; // Exit inner loop on disconnection
+static void rebuild_index() {
+    memset(order_index, -1, sizeof(int) * ORDER_INDEX_SIZE);
+    order_index_used = 0;
+    for (int b = 0; b < MAX_BOOKS; b++) {
+        for (int side = 0; side < 2; side++) {
+            for (int k = 0; books[b].used && k < books[b].counts[side]; k++) {
+                int order = books[b].heaps[side][k].order;
+                if (resting[order].live) {
+                    *index_slot(resting[order].transaction_code, 1) = order;
+                    order_index_used++;
                 }
-          
-                printf("krx get order\n");
-                // Print received data
-                printf("%d,%d,%s,%s,%s,%s,%c,%d,%s,%d,%s\n",
-                    received_order.hdr.tr_id,
-                    received_order.hdr.length,
-                    received_order.stock_code,
-                    received_order.stock_name,
-                    received_order.transaction_code,
-                    received_order.user_id,
-                    received_order.order_type,
-                    received_order.quantity,
-                    received_order.order_time,
-                    received_order.price,
-                    received_order.original_order);
-
-                // Prepare `fot_order_is_submitted` structure
-                fot_order_is_submitted submit_result;            
-                memset(&submit_result, 0, sizeof(fot_order_is_submitted)); // Initialize the struct
-                submit_result.hdr.tr_id = 10;
-                submit_result.hdr.length = sizeof(fot_order_is_submitted);
-            
-                strncpy(submit_result.transaction_code, received_order.transaction_code, sizeof(submit_result.transaction_code) - 1);
-                submit_result.transaction_code[sizeof(submit_result.transaction_code) - 1] = '\0'; // Null-terminate
-                
-                strncpy(submit_result.user_id, received_order.user_id, sizeof(submit_result.user_id));
-                submit_result.user_id[sizeof(submit_result.user_id) - 1] = '\0'; // Null-terminate
-            
-                strncpy(submit_result.time, "20250123134500", sizeof(submit_result.time) - 1);
-                submit_result.time[sizeof(submit_result.time) - 1] = '\0'; // Null-terminate
-
-                strncpy(submit_result.reject_code, "0000", sizeof(submit_result.reject_code) - 1); // No error
-                submit_result.reject_code[sizeof(submit_result.reject_code) - 1] = '\0'; // Null-terminate
-
-                // send order_submitted response
-
-                ssize_t bytes_sent = send(client_fd, &submit_result, sizeof(fot_order_is_submitted), 0);
-                    if (bytes_sent < 0) {
-                        perror("Failed to send response");
-                    } else if (bytes_sent < sizeof(submit_result)) {
-                        fprintf(stderr, "Partial response sent. Expected %lu bytes, sent %ld bytes.\n",
-                                sizeof(submit_result), bytes_sent);
-                    } else {
-                        printf("Response sent successfully to client. Sent %ld bytes.\n", bytes_sent);
-                    }
-
-                // Prepare `kft_execution` structure
-                kft_execution exec_response = {
-                    .hdr = {11, sizeof(kft_execution)},
-                    .status_code = 0, // Success
-                };
-                strncpy(exec_response.transaction_code, received_order.transaction_code, sizeof(exec_response.transaction_code) - 1);
-                strncpy(exec_response.time, "20250123134500", sizeof(exec_response.time) - 1);
-                exec_response.executed_price = received_order.price; // Example
-                strncpy(exec_response.original_order, received_order.original_order, sizeof(exec_response.original_order) - 1);
-                strncpy(exec_response.reject_code, "E777", sizeof(exec_response.reject_code) - 1); // No error
-                // Send `kft_execution` to the remote server
-                send_kft_execution(&exec_response, sock);
-                
             }
         }
+    }
+}
 
-        // Close sockets
-        close(client_fd);
-        close(server_fd);
-        return 0;
+static int rest_order(order_book *book, const fkq_order *order, int side, int remaining) {
+    if (free_resting == -1 || order_index_used >= ORDER_INDEX_SIZE / 2) {
+        rebuild_index();
+        if (free_resting == -1) {
+            return -1;
+        }
+    }
+    int index = free_resting;
+    resting_order *o = &resting[index];
+    free_resting = o->next_free;
+
+    FEP_COPY_FIELD(o->transaction_code, order->transaction_code);
+    o->side = order->order_type;
+    o->price = order->price;
+    o->remaining = remaining;
+    o->live = 1;
+    book_entry entry = {order->price, time_seq++, index};
+    if (heap_push(book, side, &entry) != 0) {
+        o->live = 0;
+        o->next_free = free_resting;
+        free_resting = index;
+        return -1;
+    }
+    int *slot = index_slot(o->transaction_code, 1);
+    if (*slot == -1) {
+        order_index_used++;
+    }
+    *slot = index;
+    resting_count++;
+    return 0;
+}
+
+static void match_order(const fkq_order *order) {
+    int side = order->order_type == 'B' ? 0 : 1;
+    int contra = 1 - side;
+    int remaining = order->quantity;
+    order_book *book = find_book(order->stock_code);
+    if (book == NULL) {
+        stats.rejects++;
+        emit_execution(order->transaction_code, 99, 0, order->original_order, KRX_E_FULL);
+        return;
     }
 
+    book_entry *best;
+    while (remaining > 0 && (best = best_entry(book, contra)) != NULL) {
+        if (order->price != 0 && (side == 0 ? best->price > order->price : best->price < order->price)) {
+            break;
+        }
+        resting_order *o = &resting[best->order];
+        int quantity = remaining < o->remaining ? remaining : o->remaining;
+        remaining -= quantity;
+        o->remaining -= quantity;
+        stats.trades++;
+        stats.fills += 2;
+        emit_execution(order->transaction_code, 0, best->price, order->original_order, "0000");
+        emit_execution(o->transaction_code, 0, best->price, "NA", "0000");
+        if (o->remaining == 0) {
+            o->live = 0;
+            resting_count--;
+        }
+    }
+    if (remaining == 0) {
+        return;
+    }
+
+    if (order->price == 0) {
+        // market order: the rest is cancelled
+        stats.cancels++;
+        emit_execution(order->transaction_code, 1, 0, order->original_order, "0000");
+    } else if (random_percent(maker_percent)) {
+        int parts = maker_parts > 1 ? 1 + (int)(next_random() % maker_parts) : 1;
+        if (parts > remaining) {
+            parts = remaining;
+        }
+        for (int k = 0; k < parts; k++) {
+            stats.fills++;
+            emit_execution(order->transaction_code, 0, order->price, order->original_order, "0000");
+        }
+    } else if (rest_order(book, order, side, remaining) != 0) {
+        stats.rejects++;
+        emit_execution(order->transaction_code, 99, 0, order->original_order, KRX_E_FULL);
+    }
+}
+
+static void cancel_order(const fkq_order *order) {
+    int *slot = index_slot(order->original_order, 0);
+    if (slot == NULL) {
+        stats.rejects++;
+        emit_execution(order->transaction_code, 99, 0, order->original_order, KRX_E_NO_ORDER);
+        return;
+    }
+    resting_order *o = &resting[*slot];
+    o->live = 0;
+    resting_count--;
+    stats.cancels++;
+    emit_execution(order->transaction_code, 1, 0, order->original_order, "0000");
+    emit_execution(o->transaction_code, 1, o->price, order->transaction_code, "0000");
+}
+
+// Returns the reject code for the order, NULL when accepted
+static const char *check_order(const fkq_order *order) {
+    if (order->hdr.tr_id != FEP_TR_fkq_order) {
+        return KRX_E_INVALID;
+    } else if (order->order_type == 'C') {
+        return NULL;
+    } else if ((order->order_type != 'B' && order->order_type != 'S') || order->quantity <= 0 || order->price < 0) {
+        return KRX_E_INVALID;
+    } else if (random_percent(reject_percent)) {
+        return KRX_E_RANDOM;
+    }
+    return NULL;
+}
+
+static void handle_order(int index, const fkq_order *order) {
+    stats.orders++;
+    const char *reject = check_order(order);
+    if (send_acks) {
+        emit_ack(index, order, reject != NULL ? reject : "0000");
+    }
+    if (reject != NULL) {
+        stats.rejects++;
+        emit_execution(order->transaction_code, 99, 0, order->original_order, reject);
+    } else if (order->order_type == 'C') {
+        cancel_order(order);
+    } else {
+        match_order(order);
+    }
+}
+
+static void read_session(int index) {
+    order_session *s = &sessions[index];
+    while (1) {
+        ssize_t n = recv(s->fd, s->rx + s->rx_len, sizeof(s->rx) - s->rx_len, 0);
+        if (n == 0) {
+            close_session(index);
+            return;
+        } else if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                close_session(index);
+            }
+            return;
+        }
+        s->rx_len += n;
+        size_t off = 0;
+        for (; s->rx_len - off >= sizeof(fkq_order); off += sizeof(fkq_order)) {
+            fkq_order order;
+            memcpy(&order, s->rx + off, sizeof(order));
+            handle_order(index, &order);
+        }
+        memmove(s->rx, s->rx + off, s->rx_len - off);
+        s->rx_len -= off;
+        if (s->tx_len) {
+            flush_session(s);
+        }
+        if (exec_tx_len) {
+            flush_exec();
+        } else {
+            update_session_reads();
+        }
+        if (sessions_paused) {
+            return;
+        }
+    }
+}
+
+static void accept_session(int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    int i = 0;
+    while (i < MAX_SESSIONS && sessions[i].fd != -1) {
+        i++;
+    }
+    if (i == MAX_SESSIONS) {
+        fprintf(stderr, "too many order sessions, connection refused\n");
+        close(fd);
+        return;
+    }
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    order_session *s = &sessions[i];
+    s->fd = fd;
+    s->generation = ++session_generation;
+    s->rx_len = s->tx_len = s->tx_off = 0;
+    struct epoll_event ev = {.events = sessions_paused ? 0 : EPOLLIN, .data.u64 = (uint64_t)i};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    printf("order session %d connected.\n", i);
+}
+
+static void release_due() {
+    uint64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        perror("timerfd");
+    }
+    uint64_t now = now_ns();
+    while (delayed_count > 0 && delayed[0].due_ns <= now) {
+        delayed_msg msg;
+        delay_pop(&msg);
+        if (msg.session == -1) {
+            next_execution(&msg.msg.execution);
+        } else if (sessions[msg.session].fd != -1 && sessions[msg.session].generation == msg.generation) {
+            send_ack(msg.session, &msg.msg.ack);
+            flush_session(&sessions[msg.session]);
+        }
+    }
+    arm_timer();
+    flush_exec();
+}
+
+static void print_stats(double seconds) {
+    printf("orders %8.0f/s  executions %8.0f/s  trades %8.0f/s  cancels %lu  rejects %lu  resting %d"
+           "  acks dropped %lu  delayed %d  unsent %zu B%s\n",
+           (stats.orders - last_stats.orders) / seconds, (stats.executions - last_stats.executions) / seconds,
+           (stats.trades - last_stats.trades) / seconds, (unsigned long)stats.cancels, (unsigned long)stats.rejects,
+           resting_count, (unsigned long)stats.acks_dropped, delayed_count, exec_tx_len - exec_tx_off,
+           sessions_paused ? "  (paused)" : "");
+    fflush(stdout);
+    last_stats = stats;
+}
+
+static int open_listen_socket() {
+    struct sockaddr_in server_addr;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    // 포트 재사용 옵션 추가
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt failed");
+        exit(EXIT_FAILURE);
+    }
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(KRX_PORT);
+    if (bind(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0 || listen(fd, MAX_SESSIONS) < 0) {
+        perror("Bind failed");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+static int connect_fep() {
+    struct sockaddr_in fep_server_addr;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    memset(&fep_server_addr, 0, sizeof(fep_server_addr));
+    fep_server_addr.sin_family = AF_INET;
+    fep_server_addr.sin_port = htons(FEP_KRX_R_PORT);
+    if (inet_pton(AF_INET, FEP_IP, &fep_server_addr.sin_addr) <= 0) {
+        perror("Invalid IP address or format");
+        exit(EXIT_FAILURE);
+    }
+    if (connect(fd, (struct sockaddr *)&fep_server_addr, sizeof(fep_server_addr)) < 0) {
+        perror("Connection to server failed");
+        exit(EXIT_FAILURE);
+    }
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-m maker%%] [-p parts] [-r reject%%] [-L latency] [-A latency] [-a]"
+                    " [-g drop_every_n] [-d duplicate_every_n] [-s seed] [-q]\n"
+                    "  latency: 0 | fixed:us | uniform:lo_us:hi_us | exp:mean_us | normal:mean_us:sd_us\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    int opt_c;
+    rng_state = (uint64_t)time(NULL) * 2654435761u | 1;
+    while ((opt_c = getopt(argc, argv, "m:p:r:L:A:ag:d:s:q")) != -1) {
+        switch (opt_c) {
+        case 'm': maker_percent = atoi(optarg); break;
+        case 'p': maker_parts = atoi(optarg); break;
+        case 'r': reject_percent = atoi(optarg); break;
+        case 'L': if (parse_latency(optarg, &exec_latency) != 0) usage(argv[0]); break;
+        case 'A': if (parse_latency(optarg, &ack_latency) != 0) usage(argv[0]); break;
+        case 'a': send_acks = 1; break;
+        case 'g': drop_every = atoi(optarg); break;
+        case 'd': dup_every = atoi(optarg); break;
+        case 's': rng_state = strtoull(optarg, NULL, 10) * 2654435761u | 1; break;
+        case 'q': quiet = 1; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (maker_parts < 1) {
+        maker_parts = 1;
+    }
+
+    // execution times are KST, as the FEP validates them
+    setenv("TZ", "Asia/Seoul", 1);
+    tzset();
+
+    resting = malloc(sizeof(resting_order) * MAX_RESTING);
+    order_index = malloc(sizeof(int) * ORDER_INDEX_SIZE);
+    if (resting == NULL || order_index == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < MAX_RESTING; i++) {
+        resting[i].live = 0;
+        resting[i].next_free = i + 1 < MAX_RESTING ? i + 1 : -1;
+    }
+    free_resting = 0;
+    memset(order_index, -1, sizeof(int) * ORDER_INDEX_SIZE);
+    for (int i = 0; i < MAX_SESSIONS; i++) {
+        sessions[i].fd = -1;
+    }
+
+    int listen_fd = open_listen_socket();
+    exec_fd = connect_fep();
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    epoll_fd = epoll_create1(0);
+    if (timer_fd < 0 || epoll_fd < 0) {
+        perror("epoll");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.u64 = (uint64_t)(int64_t)TAG_LISTEN};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.u64 = (uint64_t)(int64_t)TAG_EXEC;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, exec_fd, &ev);
+    ev.data.u64 = (uint64_t)(int64_t)TAG_TIMER;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+    printf("KRX mock on port %d, executions to %s:%d\n", KRX_PORT, FEP_IP, FEP_KRX_R_PORT);
+
+    uint64_t last_report = now_ns();
+    struct epoll_event events[EPOLL_BATCH];
+    while (1) {
+        int n = epoll_wait(epoll_fd, events, EPOLL_BATCH, 1000);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        for (int k = 0; k < n; k++) {
+            int tag = (int)(int64_t)events[k].data.u64;
+            if (tag == TAG_LISTEN) {
+                accept_session(listen_fd);
+            } else if (tag == TAG_EXEC) {
+                if (events[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    read_exec_connection();
+                }
+                if (events[k].events & EPOLLOUT) {
+                    flush_exec();
+                }
+            } else if (tag == TAG_TIMER) {
+                release_due();
+            } else if (sessions[tag].fd != -1) {
+                read_session(tag);
+            }
+        }
+
+        uint64_t now = now_ns();
+        if (!quiet && now - last_report >= 1000000000ULL) {
+            print_stats((now - last_report) / 1e9);
+            last_report = now;
+        }
+    }
+    return 0;
+}
@@ -4,33 +4,7 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <envs.h>
-
-// Define the structures
-typedef struct {
-    int tr_id;
-    int length;
-} hdr;
-
-typedef struct {
-    hdr hdr;
-    char stock_code[7];       // 종목코드
-    char stock_name[51];      // 종목명 
-    char transaction_code[7]; // 거래코드 
-    char user_id[21];         // 유저 ID 
-    char order_type;          // 매수(B) / 매도(S) (1바이트)
-    int quantity;             // 수량 (정수형)
-    char order_time[15];      // 주문시간 (YYYYMMDDHHMMSS)
-    int price;                // 호가 (정수형)
-    char original_order[7];   // 원주문번호 (문자열)
-} fkq_order;
-
-typedef struct {
-    hdr hdr;
-    char transaction_code[7]; // 거래코드 
-    char user_id[21];         // 유저 ID 
-    char time[15];            // 응답시간 (YYYYMMDDHHMMSS)
-    char reject_code[7];      // 거부사유코드 (문자열)
-} fot_order_is_submitted;
+#include <oms_fep_krx_struct.h>
 
 // Function to print the received structure
 void print_fot_order_is_submitted(const fot_order_is_submitted *submit_result) {
@@ -75,6 +49,7 @@ int main() {
     header.tr_id = 9;
 
     fkq_order order;
+    memset(&order, 0, sizeof(order)); // padding goes out on the wire too
     order.hdr = header;
     strncpy(order.stock_code, "stock1", sizeof(order.stock_code));
     order.stock_code[sizeof(order.stock_code) - 1] = '\0'; // Null-terminate
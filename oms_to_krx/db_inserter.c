@@ -0,0 +1,302 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h> // For open()
+#include <errno.h>
+#include <oms_fep_krx_struct.h>
+#include <envs.h>
+#include <fep_affinity.h>
+#include <fep_memory.h>
+#include <fep_clock.h>
+#include <fep_store.h>
+#include <fep_codec.h>
+#include <fep_stat.h>
+#include <fep_metrics.h>
+
+// shared memory
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+//log
+#include <stdarg.h>
+#include <time.h>
+
+#include <pthread.h>
+
+// tx_history INSERT writer. Tails the order journal (received_data.txt) like
+// krx_sender does, with its own checkpoint /DB_R_count, so oms_listener only
+// appends to the journal and never talks to the DB.
+//
+// /DB_R_count moves only after a whole batch is committed. The statements of a batch
+// run in parallel, so after a crash or a failed batch any of them may already be
+// in tx_history: the first batch after startup and the retries of a failed one
+// skip the orders whose rows are there.
+// A batch that failed on a busy or locked DB is retried until it goes through. One
+// the DB refuses (constraint, type, schema) is loaded in halves down to the orders
+// it refuses one by one. Those are appended to $HOME/db_dead_orders.txt, in the
+// journal's format, and counted in orders_diverted; /DB_R_count moves past them.
+// Once the DB is fixed, eod_loader -o db_dead_orders.txt loads them.
+// db_updator waits for /DB_R_count before updating, so no UPDATE overtakes its INSERT.
+
+typedef struct {
+    int rc;
+} DB_R_count;
+
+typedef struct {
+    int wc;
+} W_count;
+
+#define LOG_FILE_PATH "/home/ubuntu/logs/db_inserter.log"
+
+#define DB_POOL_MIN 1               // a batch's statements run in parallel on up to
+#define DB_POOL_MAX 8               // DB_POOL_MAX connections, as many as the load needs
+#define INSERT_BATCH_MAX 4096       // journal records per committed batch
+#define IDLE_SLEEP_US 1000          // journal poll interval while caught up
+#define RETRY_BACKOFF_MAX_MS 1000   // a batch the DB could not take is retried, backing off up to this
+#define DEAD_LETTER_FILE "db_dead_orders.txt"
+
+FILE *log_file = NULL;
+fep_store *store = NULL;
+int recheck_end = 0;                // journal index up to which rows may already exist
+int dead_letter_fd = -1;
+
+pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;  // the pool thread logs too
+
+// Initialize logging
+void init_log() {
+    mkdir("/home/ubuntu/logs", 0777);
+    log_file = fopen(LOG_FILE_PATH, "a");
+    if (!log_file) {
+        perror("Failed to open log file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Log function with level and module
+void log_message(const char *level, const char *module, const char *format, ...) {
+    pthread_mutex_lock(&log_mutex);
+    if (!log_file) {
+        pthread_mutex_unlock(&log_mutex);
+        return;
+    }
+
+    char time_buffer[FEP_CLOCK_LOG_TIME_LEN + 1];
+    fep_clock_log_time(time_buffer);
+    time_buffer[19] = '\0';     // YYYY-MM-DD HH:MM:SS
+    fprintf(log_file, "[%s] [%s] [%s] ", time_buffer, level, module);
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(log_file, format, args);
+    va_end(args);
+    fflush(log_file);
+    pthread_mutex_unlock(&log_mutex);
+}
+
+// Create or open a journal counter, 0 when newly created
+void *map_counter(const char *shared_mem_name, size_t size) {
+    int is_initialized = 0;
+    int shm_fd = shm_open(shared_mem_name, O_CREAT | O_RDWR | O_EXCL, 0666);
+    if (shm_fd == -1) {
+        if (errno != EEXIST || (shm_fd = shm_open(shared_mem_name, O_RDWR, 0666)) == -1) {
+            log_message("ERROR", "shm", "shm_open %s failed\n", shared_mem_name);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        is_initialized = 1;
+    }
+
+    if (ftruncate(shm_fd, size) == -1) {
+        log_message("ERROR", "shm", "ftruncate %s failed\n", shared_mem_name);
+        close(shm_fd);
+        exit(EXIT_FAILURE);
+    }
+    void *counter = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (counter == MAP_FAILED) {
+        log_message("ERROR", "shm", "mmap %s failed\n", shared_mem_name);
+        exit(EXIT_FAILURE);
+    }
+    fep_mem_report(shared_mem_name, size, fep_mem_prepare(counter, size, 0));
+    if (is_initialized) {
+        memset(counter, 0, size);
+    }
+    log_message("DEBUG", "shm", "%s = %d\n", shared_mem_name, *(int *)counter);
+    return counter;
+}
+
+void order_to_row(const fkq_order *order, fep_order_row *row) {
+    memset(row, 0, sizeof(fep_order_row));
+    FEP_COPY_FIELD(row->stock_code, order->stock_code);
+    FEP_COPY_FIELD(row->stock_name, order->stock_name);
+    FEP_COPY_FIELD(row->transaction_code, order->transaction_code);
+    FEP_COPY_FIELD(row->user_id, order->user_id);
+    row->order_type = order->order_type;
+    row->quantity = order->quantity;
+    row->price = order->price;
+    FEP_COPY_FIELD(row->order_time, order->order_time);
+    FEP_COPY_FIELD(row->original_order, order->original_order);
+    row->status = 'W';
+}
+
+// Rows for the orders, leaving out those already in tx_history: after a crash or a
+// failed load the checkpoint did not move past a partly committed batch.
+int build_rows(const fkq_order *orders, fep_order_row *rows, int first, int count) {
+    fep_order_row existing;
+    int kept = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (first + i < recheck_end && fep_store_lookup(store, orders[i].transaction_code, &existing) == 1) {
+            continue;
+        }
+        order_to_row(&orders[i], &rows[kept++]);
+    }
+    if (kept < count) {
+        log_message("INFO", "db", "%d orders from %d on were already inserted\n", count - kept, first);
+    }
+    return kept;
+}
+
+// An order the DB refuses, kept for a load once the DB is fixed
+void divert_order(const fkq_order *order, int index) {
+    if (dead_letter_fd == -1) {
+        const char *home_dir = getenv("HOME");
+        char filepath[256];
+        snprintf(filepath, sizeof(filepath), "%s/%s", home_dir != NULL ? home_dir : ".", DEAD_LETTER_FILE);
+        dead_letter_fd = open(filepath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (dead_letter_fd == -1) {
+            // skipping the order would lose it without a trace
+            log_message("ERROR", "file", "cannot open %s, order %d stays in the journal\n", filepath, index);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (write(dead_letter_fd, order, sizeof(fkq_order)) != sizeof(fkq_order) || fdatasync(dead_letter_fd) != 0) {
+        log_message("ERROR", "file", "cannot write %s, order %d stays in the journal\n", DEAD_LETTER_FILE, index);
+        exit(EXIT_FAILURE);
+    }
+    fep_counter_add(FEP_M_ORDERS_DIVERTED, 1);
+    log_message("ERROR", "db", "order %d (%.6s) refused by the DB, diverted to %s\n",
+                index, order->transaction_code, DEAD_LETTER_FILE);
+}
+
+// Insert the orders [first, first + count) that are not in tx_history yet. A busy or
+// locked DB is waited out; a refused batch is split until the refused orders are
+// alone and diverted. Returns the rows that were missing, *diverted counts the rest.
+int load_orders(const fkq_order *orders, int first, int count, int *diverted) {
+    static fep_order_row rows[INSERT_BATCH_MAX];
+    int missing = -1;
+    int result;
+
+    for (int backoff_ms = 1; ; ) {
+        int kept = build_rows(orders, rows, first, count);
+        if (missing < 0) {
+            missing = kept;
+        }
+        if (kept == 0) {
+            return missing;
+        }
+
+        uint64_t t_batch = fep_clock_ns();
+        result = fep_store_load_rows(store, rows, kept);
+        uint64_t batch_ns = fep_clock_ns() - t_batch;
+        fep_counter_add(FEP_M_INSERT_BATCHES, 1);
+        fep_counter_add(FEP_M_INSERT_BATCH_NS, batch_ns);
+        if (result == 0) {
+            return missing;
+        }
+        // part of the batch may be committed; the next attempt looks its orders up
+        if (recheck_end < first + count) {
+            recheck_end = first + count;
+        }
+        if (result == FEP_STORE_REJECTED) {
+            break;
+        }
+        log_message("ERROR", "db", "orders %d-%d retried in %d ms\n", first, first + count - 1, backoff_ms);
+        usleep(backoff_ms * 1000);
+        backoff_ms = backoff_ms * 2 < RETRY_BACKOFF_MAX_MS ? backoff_ms * 2 : RETRY_BACKOFF_MAX_MS;
+    }
+
+    if (count == 1) {
+        divert_order(&orders[0], first);
+        (*diverted)++;
+        return missing;
+    }
+    log_message("ERROR", "db", "orders %d-%d refused by the DB, loading them in halves\n", first, first + count - 1);
+    int half = count / 2;
+    load_orders(orders, first, half, diverted);
+    load_orders(orders + half, first + half, count - half, diverted);
+    return missing;
+}
+
+void insert_orders(int journal_fd, int end, DB_R_count *r_count) {
+    static fkq_order orders[INSERT_BATCH_MAX];
+
+    while (end > r_count->rc) {
+        int want = end - r_count->rc < INSERT_BATCH_MAX ? end - r_count->rc : INSERT_BATCH_MAX;
+        ssize_t bytes_read = pread(journal_fd, orders, sizeof(fkq_order) * want, (off_t)r_count->rc * sizeof(fkq_order));
+        int got = bytes_read > 0 ? bytes_read / sizeof(fkq_order) : 0;
+        if (got == 0) {
+            log_message("ERROR", "file", "order journal is shorter than wc %d\n", end);
+            return;
+        }
+        // the MySQL store reconnects and retries on connection loss until the DB takes the batch
+        int diverted = 0;
+        int missing = load_orders(orders, r_count->rc, got, &diverted);
+        fep_counter_add(FEP_M_ORDERS_PERSISTED, missing - diverted);
+
+        r_count->rc += got;
+        log_message("INFO", "db", "%d orders inserted, rc = %d (backlog %d)\n", got, r_count->rc, end - r_count->rc);
+    }
+}
+
+int main() {
+
+    // log times are KST, also when formatted locally without fep_clockd
+    setenv("TZ", "Asia/Seoul", 1);
+    tzset();
+    init_log();
+    fep_affinity_pin(FEP_ROLE_INSERTER);
+    if (fep_metrics_open(FEP_P_DB_INSERTER) != 0) {
+        log_message("ERROR", "metrics", "metrics disabled, cannot map %s\n", FEP_METRICS_SHM_NAME);
+    }
+
+    store = fep_store_open("insert", DB_POOL_MIN, DB_POOL_MAX);
+    if (store == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    W_count *w_count = map_counter("/W_count", sizeof(W_count));
+    DB_R_count *r_count = map_counter("/DB_R_count", sizeof(DB_R_count));
+
+    // set file dir structure
+    const char *home_dir = getenv("HOME");
+    char filepath[256];
+    if (home_dir != NULL) {
+        snprintf(filepath, sizeof(filepath), "%s/received_data.txt", home_dir);
+    } else {
+        // Fallback to current directory if $HOME is not set
+        strncpy(filepath, "./received_data.txt", sizeof(filepath));
+    }
+    // created here as well, so either side may start first
+    int journal_fd = open(filepath, O_RDONLY | O_CREAT, 0644);
+    if (journal_fd == -1) {
+        log_message("ERROR", "file", "Error opening %s\n", filepath);
+        return EXIT_FAILURE;
+    }
+    log_message("INFO", "file", "order journal is opened, resuming at %d\n", r_count->rc);
+
+    recheck_end = r_count->rc + INSERT_BATCH_MAX;
+    while (1) {
+        int end = __atomic_load_n(&w_count->wc, __ATOMIC_ACQUIRE);
+        if (end > r_count->rc) {
+            insert_orders(journal_fd, end, r_count);
+        } else {
+            usleep(IDLE_SLEEP_US);
+        }
+    }
+
+    return 0;
+}
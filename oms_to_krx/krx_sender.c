@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,6 +11,13 @@
 #include <mqueue.h>
 #include <oms_fep_krx_struct.h>
 #include <envs.h>
+#include <fep_affinity.h>
+#include <fep_memory.h>
+#include <fep_clock.h>
+#include <fep_repl.h>
+#include <fep_stat.h>
+#include <fep_trace.h>
+#include <fep_metrics.h>
 
 // shared memory
 #include <sys/mman.h>
@@ -49,17 +57,9 @@ void init_log() {
 void log_message(const char *level, const char *module, const char *format, ...) {
     if (!log_file) return;
 
-    struct timeval tv;
-    gettimeofday(&tv, NULL);  // Get current time with microseconds
-
-    struct tm *tm_info = localtime(&tv.tv_sec);
-    char time_buffer[25];
-
-    // Format: YYYY-MM-DD HH:MM:SS.mmm
-    snprintf(time_buffer, sizeof(time_buffer), "%04d-%02d-%02d %02d:%02d:%02d.%03ld",
-             tm_info->tm_year + 1900, tm_info->tm_mon + 1, tm_info->tm_mday,
-             tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec,
-             tv.tv_usec / 1000);  // Convert microseconds to milliseconds
+    // YYYY-MM-DD HH:MM:SS.mmm, copied from the shared clock page
+    char time_buffer[FEP_CLOCK_LOG_TIME_LEN + 1];
+    fep_clock_log_time(time_buffer);
 
     fprintf(log_file, "[%s] [%s] [%s] ", time_buffer, level, module);
 
@@ -81,7 +81,23 @@ void close_log() {
 
 int main() {
 
+    // log times are KST, also when formatted locally without fep_clockd
+    setenv("TZ", "Asia/Seoul", 1);
+    tzset();
     init_log(); 
+    fep_affinity_pin(FEP_ROLE_SENDER);
+    if (fep_stat_open() != 0) {
+        log_message("ERROR", "stat", "latency stats disabled, cannot map %s\n", FEP_STAT_SHM_NAME);
+    }
+    if (fep_trace_open() != 0) {
+        log_message("ERROR", "trace", "order tracing disabled, cannot map %s\n", FEP_TRACE_SHM_NAME);
+    }
+    if (fep_metrics_open(FEP_P_KRX_SENDER) != 0) {
+        log_message("ERROR", "metrics", "metrics disabled, cannot map %s\n", FEP_METRICS_SHM_NAME);
+    }
+    if (fep_repl_open() != 0) {
+        log_message("ERROR", "repl", "sync replication ignored, cannot map %s\n", FEP_REPL_SHM_NAME);
+    }
 
     mqd_t mq, submit_mq;
     struct mq_attr attr;
@@ -111,8 +127,16 @@ int main() {
             exit(EXIT_FAILURE);
             }
             fread(&order, sizeof(fkq_order), 1, file);
+            uint64_t t_dequeued = fep_tick();
 
             send_order_to_krx(&order, sock);
+            uint64_t t_sent = fep_tick();
+            fep_stat_order_sent(r_count->rc, t_dequeued, t_sent);
+            fep_counter_add(FEP_M_ORDERS_SENT, 1);
+            if (fep_trace_sampled(order.transaction_code)) {
+                fep_trace_put(FEP_TRACE_DEQUEUED, order.transaction_code, t_dequeued, r_count->rc);
+                fep_trace_put(FEP_TRACE_SENT, order.transaction_code, t_sent, r_count->rc);
+            }
             r_count->rc++;
             log_message("INFO", "shm", "current value rc = %d\n", r_count->rc);
             
@@ -175,6 +199,7 @@ int main() {
         shm_unlink(shared_mem_name);
         exit(EXIT_FAILURE);
     }
+    fep_mem_report(shared_mem_name, shared_mem_size, fep_mem_prepare(r_count, shared_mem_size, 0));
 
     // Initialize shared memory if it is newly created
     if (is_initialized) {
@@ -184,6 +209,7 @@ int main() {
     } else {
         log_message("DEBUG", "shm", "Shared memory already exists. rc = %d\n", r_count->rc);
     }
+    fep_repl_sending(r_count->rc);
 
     // set file dir structure
     const char *home_dir = getenv("HOME");
@@ -263,6 +289,8 @@ int main() {
         // Convert the byte array back to a long
         log_message("DEBUG", "mq", "Received: %d\n", received_wc);
         if(received_wc > r_count->rc){
+            // sync replication: not to KRX before the standby has it
+            fep_repl_wait(received_wc);
             read_order_from_bin_file(file, r_count->rc, received_wc, r_count, sock);
         }
 
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,7 +11,14 @@
 #include <mqueue.h>
 #include <oms_fep_krx_struct.h>
 #include <envs.h>
-#include <mysql/mysql.h>
+#include <fep_affinity.h>
+#include <fep_memory.h>
+#include <fep_clock.h>
+#include <fep_validate.h>
+#include <fep_codec.h>
+#include <fep_stat.h>
+#include <fep_trace.h>
+#include <fep_metrics.h>
 
 // shared memory
 #include <sys/mman.h>
@@ -24,14 +32,10 @@
 
 #include <pthread.h>
 
-
-#define THREAD_COUNT 2  // Number of worker threads
-
 typedef struct {
     int wc; // Write counter
 } W_count;
 
-#define INSERT_QUEUE "/order_queue"
 #define QUEUE_NAME "/wc_queue"
 #define SUBMIT_QUEUE_NAME "/submit_queue"
 // socket
@@ -39,7 +43,6 @@ typedef struct {
 #define BUFFER_SIZE 1024
 
 #define LOG_FILE_PATH "/home/ubuntu/logs/oms_listener.log"
-#define ORDER_TIME_FORMAT "%Y%m%d%H%M%S"
 
 FILE *log_file = NULL;
 
@@ -64,14 +67,9 @@ void log_message(const char *level, const char *module, const char *format, ...)
         return;
     }
 
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    struct tm *tm_info = localtime(&tv.tv_sec);
-    char time_buffer[25];
-    snprintf(time_buffer, sizeof(time_buffer), "%04d-%02d-%02d %02d:%02d:%02d.%03ld",
-             tm_info->tm_year + 1900, tm_info->tm_mon + 1, tm_info->tm_mday,
-             tm_info->tm_hour, tm_info->tm_min, tm_info->tm_sec,
-             tv.tv_usec / 1000);
+    // YYYY-MM-DD HH:MM:SS.mmm, copied from the shared clock page
+    char time_buffer[FEP_CLOCK_LOG_TIME_LEN + 1];
+    fep_clock_log_time(time_buffer);
 
     fprintf(log_file, "[%s] [%s] [%s] ", time_buffer, level, module);
 
@@ -101,28 +99,15 @@ void print_fot_order_is_submitted(const fot_order_is_submitted *submit_result) {
     log_message("DEBUG", "order","Reject Code: %s\n", submit_result->reject_code);
 }
 
-void save_order_to_file_bin(fkq_order *order, FILE *file) {
+void save_order_to_file_bin(const fkq_order *order, FILE *file) {
         fwrite(order, sizeof(fkq_order), 1, file);    
         fflush(file);
 }
 
-void send_error_to_oms(fkq_order *order, char *reject_code, int sock){
-    fot_order_is_submitted tx_result;
-    memset(&tx_result, 0, sizeof(fot_order_is_submitted)); // Initialize the struct
-    tx_result.hdr.tr_id = 10;
-    tx_result.hdr.length = sizeof(fot_order_is_submitted);
-
-    strncpy(tx_result.transaction_code, order->transaction_code, sizeof(tx_result.transaction_code));
-    tx_result.transaction_code[sizeof(tx_result.transaction_code) - 1] = '\0'; // Null-terminate
-    strncpy(tx_result.user_id, order->user_id, sizeof(tx_result.user_id));
-    tx_result.user_id[sizeof(tx_result.user_id) - 1] = '\0'; // Null-terminate
-    strncpy(tx_result.time, order->order_time, sizeof(tx_result.time));
-    tx_result.time[sizeof(tx_result.time) - 1] = '\0'; // Null-terminate
+void send_error_to_oms(const fkq_order *order, int reject, fot_order_is_submitted *ack_template, int sock){
+    const fot_order_is_submitted *tx_result = fep_ack_patch(ack_template, order, reject);
 
-    strncpy(tx_result.reject_code, reject_code, sizeof(tx_result.reject_code));
-    tx_result.reject_code[sizeof(tx_result.reject_code) - 1] = '\0'; // Null-terminate
-
-    ssize_t bytes_sent = send(sock, &tx_result, sizeof(fot_order_is_submitted), 0);
+    ssize_t bytes_sent = send(sock, tx_result, sizeof(fot_order_is_submitted), 0);
     if (bytes_sent < 0) {
         log_message("ERROR", "socket", "Failed to send data to connected socket");
     } else if (bytes_sent == 0) {
@@ -134,150 +119,25 @@ void send_error_to_oms(fkq_order *order, char *reject_code, int sock){
         log_message("INFO", "socket", "Successfully sent response to OMS via connected socket. Sent %ld bytes.\n", bytes_sent);
     }
 
-    log_message("INFO", "validation", "sent oms back reject code: %s.\n", reject_code);
+    fep_metric_reject(reject);
+    log_message("INFO", "validation", "sent oms back reject code: %s.\n", fep_reject_codes[reject]);
     // fflush(log_file);
 }
 
-int is_order_time_future(const char *order_time) {
-    struct tm order_tm = {0};
-    time_t order_epoch, current_time;
-
-    // Convert order_time string to struct tm
-    if (strptime(order_time, ORDER_TIME_FORMAT, &order_tm) == NULL) {
-        fprintf(stderr, "Error parsing order_time: %s\n", order_time);
-        return -1; // Error case
-    }
-
-    // Convert struct tm to epoch time
-    order_epoch = mktime(&order_tm);
-    if (order_epoch == -1) {
-        fprintf(stderr, "Error converting order_time to epoch\n");
-        return -1;
-    }
-
-    // Get the current epoch time
-    current_time = time(NULL);
-    if (current_time == -1) {
-        fprintf(stderr, "Error getting current time\n");
-        return -1;
-    }
-
-    // Check if current time is more than 2 second past order time
-    if (order_epoch > current_time + 2) {
-        return 1; // order time is future => error
-    } else {
-        return 0; // within range
-    }
-}
-
-// Initialize MySQL connection
-MYSQL *init_mysql() {
-    MYSQL *conn = mysql_init(NULL);
-    // if (!conn) {
-    //     log_message("ERROR", "db", "MySQL init failed\n");
-    //     return NULL;
-    // }
-
-    // if (!mysql_real_connect(conn, MYSQL_IP, MYSQL_USER, MYSQL_PW, MYSQL_DBNAME, 0, NULL, 0)) {
-    //     log_message("ERROR", "db", "MySQL connection failed: %s\n", mysql_error(conn));
-    //     return NULL;
-    // }
-    // Set connection timeout to 5 seconds
-    unsigned int timeout = 5;
-    mysql_options(conn, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
-
-        // 데이터베이스 연결
-    if (mysql_real_connect(conn, MYSQL_IP, MYSQL_USER, MYSQL_PW, MYSQL_DBNAME, 3306, NULL, 0) == NULL) {
-        log_message("ERROR", "db", "mysql_real_connect() failed: %s\n", mysql_error(conn));
-        mysql_close(conn);
-        log_message("ERROR", "db", "process will be closed...\n");
-        fflush(log_file);
-        return EXIT_FAILURE;
-    }
-
-    return conn;
-}
-
-// Worker function for database inserts
-void *worker_thread(void *arg) {
-
-    int thread_id = *(int *)arg;  // Cast and get the thread ID
+int main() {
 
-    MYSQL *conn = init_mysql();
-    if (!conn) {
-        log_message("ERROR", "thread", "Failed to connect to MySQL");
-        return NULL;
+    init_log();
+    fep_affinity_pin(FEP_ROLE_REACTOR);
+    if (fep_stat_open() != 0) {
+        log_message("ERROR", "stat", "latency stats disabled, cannot map %s\n", FEP_STAT_SHM_NAME);
     }
-    struct mq_attr attr;
-
-
-    mqd_t mq = mq_open(INSERT_QUEUE, O_RDONLY);
-    if (mq == -1) {
-        log_message("ERROR", "mq", "Worker failed to open message queue");
-        mysql_close(conn);
-        return NULL;
+    if (fep_trace_open() != 0) {
+        log_message("ERROR", "trace", "order tracing disabled, cannot map %s\n", FEP_TRACE_SHM_NAME);
     }
-    log_message("DEBUG", "mq"," insert mq opened in a thread\n");
-
-    mq_getattr(mq, &attr);
-
-    fkq_order received_order;
-    while (1) {
-        ssize_t bytes_read = mq_receive(mq, (char *)&received_order, attr.mq_msgsize, NULL);
-        // if (bytes_read < 0) {
-        //     log_message("ERROR", "mq", "Thread %d: Failed to connect to MySQL", thread_id);
-        //     continue;
-        // }
-        // if (bytes_read == -1) {
-        //     log_message("ERROR", "mq "," insert mq_receive failed");
-        //     mq_close(mq);
-        //     exit(1);
-        // }
-
-         if (bytes_read == -1) { 
-            log_message("ERROR", "mq", "Thread %d: mq_receive failed: %s", thread_id, strerror(errno));
-            
-            if (errno == EAGAIN) {
-                // Queue is empty in non-blocking mode, retry
-                usleep(100000); // Sleep 100ms to avoid busy waiting
-                continue;
-            } else if (errno == EINTR) {
-                // Interrupted by a signal, retry
-                continue;
-            } else {
-                // Serious error, exit thread
-                mq_close(mq);
-                return NULL;
-            }
-        }
-
-        log_message("INFO", "mq", "Thread %d: Successfully received message of %ld bytes\n", thread_id, bytes_read);
-    
-
-        char insert_query[512];  // Large enough to hold the full query
-        snprintf(insert_query, sizeof(insert_query),
-                "INSERT INTO tx_history (stock_code, stock_name, transaction_code, user_id, order_type, quantity, order_time, price, original_order, status) "
-                "VALUES ('%s', '%s', '%s', '%s', '%c', %d, '%s', %d, '%s', 'W')",
-                received_order.stock_code, received_order.stock_name, received_order.transaction_code,
-                received_order.user_id, received_order.order_type, received_order.quantity,
-                received_order.order_time, received_order.price, received_order.original_order ? received_order.original_order : "NULL");
-
-
-        if (mysql_query(conn, insert_query)) {
-            log_message("ERROR", "db", "INSERT failed: %s\n", mysql_error(conn));
-        } else {
-            log_message("INFO", "db", "Thread %d: Order inserted successfully\n", thread_id);
-        }
+    if (fep_metrics_open(FEP_P_OMS_LISTENER) != 0) {
+        log_message("ERROR", "metrics", "metrics disabled, cannot map %s\n", FEP_METRICS_SHM_NAME);
     }
-
-    mysql_close(conn);
-    mq_close(mq);
-    return NULL;
-}
-
-int main() {
-
-    init_log();
+    fep_gauge_set(FEP_G_OMS_CONNECTIONS, 0);
 
     //set timezone as KST
     setenv("TZ", "Asia/Seoul", 1);
@@ -291,30 +151,6 @@ int main() {
     attr.mq_msgsize = sizeof(int); // Maximum size of each message in bytes
     attr.mq_curmsgs = 0;   // Current number of messages in the queue
     
-    struct mq_attr insert_attr = {0};
-    insert_attr.mq_flags = 0;
-    insert_attr.mq_maxmsg = 200;  // Max 200 messages in queue
-    insert_attr.mq_msgsize = sizeof(fkq_order);
-    insert_attr.mq_curmsgs = 0; 
-
-    mqd_t insert_mq = mq_open(INSERT_QUEUE, O_CREAT | O_WRONLY, 0666, NULL, &insert_attr);
-    if (insert_mq == -1) {
-        log_message("ERROR", "mq", "Failed to create insert message queue");
-        return EXIT_FAILURE;
-    }
-    log_message("DEBUG", "mq", "inseret message queue opened.\n");
-
-    // Start worker threads
-    pthread_t threads[THREAD_COUNT];
-    int thread_ids[THREAD_COUNT];  // Define thread IDs
-    for (int i = 0; i < THREAD_COUNT; i++) {
-        //
-        thread_ids[i] = i;
-        if (pthread_create(&threads[i], NULL, worker_thread, &thread_ids[i]) != 0) {
-            log_message("ERROR", "thread", "Failed to create worker thread");
-        }
-    }
-
     struct mq_attr submit_attr = {0};
 
     // mmap memory code
@@ -361,6 +197,7 @@ int main() {
         log_message("ERROR", "shm", "process will be closed...\n");
         exit(EXIT_FAILURE);
     }
+    fep_mem_report(shared_mem_name, shared_mem_size, fep_mem_prepare(w_count, shared_mem_size, 0));
 
     // Initialize shared memory if it is newly created
     if (is_initialized) {
@@ -418,6 +255,8 @@ int main() {
 
     // Poll array to monitor multiple file descriptors
     struct pollfd fds[MAX_CLIENTS];
+    fot_order_is_submitted ack_templates[MAX_CLIENTS];  // per connection, only the variable fields change
+    static fep_rx rx[MAX_CLIENTS];
 
     // Initialize poll array
     fds[0].fd = server_fd;  // Monitor the server socket for new connections
@@ -441,6 +280,7 @@ int main() {
         log_message("ERROR", "file", "Error opening file");
         return;
     }
+    fep_journal_reserve(fileno(file), filepath);
 
     // Open the message queue
     mq = mq_open(QUEUE_NAME, O_CREAT | O_WRONLY, 0644, NULL, &attr);
@@ -450,8 +290,8 @@ int main() {
     }
     log_message("DEBUG", "mq","wc queue opened.\n");
 
-     // Open the sender queue
-    submit_mq = mq_open(SUBMIT_QUEUE_NAME, O_RDONLY);
+     // Open the sender queue. Created here as well, so either side may start first
+    submit_mq = mq_open(SUBMIT_QUEUE_NAME, O_CREAT | O_RDONLY, 0666, NULL);
     if (submit_mq == -1) {
         log_message("ERROR", "mq","mq_open (submit mq) failed");
         mq_close(mq);
@@ -495,6 +335,9 @@ int main() {
                 if (fds[i].fd == -1) {
                     fds[i].fd = client_fd;
                     fds[i].events = POLLIN; // Monitor for incoming data
+                    fep_ack_template_init(&ack_templates[i]);
+                    fep_rx_reset(&rx[i]);
+                    fep_gauge_add(FEP_G_OMS_CONNECTIONS, 1);
                     // client_sockets[i] = new_socket;
                     break;
                 }
@@ -504,56 +347,54 @@ int main() {
         // Check all client sockets for activity
         for (int i = 1; i < MAX_CLIENTS; i++) {
             if (fds[i].fd != -1 && (fds[i].revents & POLLIN)) {
-                fkq_order received_order;
-                memset(&received_order, 0, sizeof(fkq_order)); // Initialize the struct
-                ssize_t bytes_received = recv(fds[i].fd, &received_order, sizeof(received_order), 0);
+                ssize_t bytes_received = fep_rx_recv(&rx[i], fds[i].fd);
+                uint64_t t_recv = fep_tick();
                 if (bytes_received <= 0) {
                     // Connection closed or error
                     log_message("INFO", "socket", "Client disconnected\n");
                     close(fds[i].fd);
                     fds[i].fd = -1;
-                // } else if (bytes_received == sizeof(received_order.hdr.length)) {
-                } else if (bytes_received == sizeof(received_order)) {
+                    fep_gauge_add(FEP_G_OMS_CONNECTIONS, -1);
+                    continue;
+                }
+                const void *message;
+                while ((message = fep_rx_next(&rx[i], sizeof(fkq_order))) != NULL) {
+                    const fkq_order *received_order = fep_view_fkq_order(message, sizeof(fkq_order));
+                    fep_counter_add(FEP_M_ORDERS_RECEIVED, 1);
                     // validation
-                    if (received_order.hdr.tr_id !=9 ) { // Example valid range
-                        send_error_to_oms(&received_order, "E002", fds[i].fd);
-                        continue; // Skip processing
-                    } else if (received_order.price < 0){
-                        send_error_to_oms(&received_order, "E102", fds[i].fd);
-                        continue; // Skip processing
-                    } else if (received_order.quantity <= 0){ 
-                        send_error_to_oms(&received_order, "E103", fds[i].fd);
-                        continue; // Skip processing
-                    } else if (!((received_order.order_type != 'B') || (received_order.order_type != 'C') || (received_order.order_type != 'S'))){
-                        send_error_to_oms(&received_order, "E104", fds[i].fd);
+                    int reject = fep_validate_order(received_order);
+                    if (reject != FEP_ACCEPTED) {
+                        send_error_to_oms(received_order, reject, &ack_templates[i], fds[i].fd);
                         continue; // Skip processing
-                    } else if (is_order_time_future(received_order.order_time)){
-                        send_error_to_oms(&received_order, "E105", fds[i].fd);
-                        continue; // Skip processing
-                    } else if ((received_order.order_type == 'C' && strcmp(received_order.original_order, "NA") !=0)) {
-                        send_error_to_oms(&received_order, "E106", fds[i].fd);
-                        continue; // Skip processing
-                    } 
+                    }
+                    uint64_t t_valid = fep_tick();
+                    fep_stat_record(FEP_SEG_VALIDATE, t_recv, t_valid);
                     log_message("INFO", "order", "Order received successfully.\n");
                     log_message("DEBUG", "order","%d,%d,%s,%s,%s,%s,%c,%d,%s,%d,%s\n",
-                            received_order.hdr.tr_id,
-                            received_order.hdr.length,
-                            received_order.stock_code,
-                            received_order.stock_name,
-                            received_order.transaction_code,
-                            received_order.user_id,
-                            received_order.order_type,
-                            received_order.quantity,
-                            received_order.order_time,
-                            received_order.price,
-                            received_order.original_order);
-                    
-                    mq_send(insert_mq, (const char *)&received_order, sizeof(fkq_order), 0);
-                    log_message("INFO", "server", "Order received and sent to queue");  
+                            received_order->hdr.tr_id,
+                            received_order->hdr.length,
+                            received_order->stock_code,
+                            received_order->stock_name,
+                            received_order->transaction_code,
+                            received_order->user_id,
+                            received_order->order_type,
+                            received_order->quantity,
+                            received_order->order_time,
+                            received_order->price,
+                            received_order->original_order);
                     
-                    // Save the order to file
-                    save_order_to_file_bin(&received_order, file);
+                    // Save the order to file. db_inserter picks it up from there for tx_history
+                    save_order_to_file_bin(received_order, file);
                     w_count->wc++;
+                    uint64_t t_journaled = fep_tick();
+                    fep_stat_record(FEP_SEG_JOURNAL, t_valid, t_journaled);
+                    fep_stat_order_journaled(w_count->wc - 1, t_recv, t_journaled);
+                    fep_counter_add(FEP_M_ORDERS_ACCEPTED, 1);
+                    if (fep_trace_sampled(received_order->transaction_code)) {
+                        fep_trace_put(FEP_TRACE_RECV, received_order->transaction_code, t_recv, w_count->wc - 1);
+                        fep_trace_put(FEP_TRACE_VALIDATED, received_order->transaction_code, t_valid, w_count->wc - 1);
+                        fep_trace_put(FEP_TRACE_JOURNALED, received_order->transaction_code, t_journaled, w_count->wc - 1);
+                    }
                     log_message("INFO", "shm", "wc increased. wc = %d\n", w_count->wc);
 
                     //send wc
@@ -564,40 +405,12 @@ int main() {
                     }           
                     log_message("DEBUG", "mq", "wc msg sent: %d", w_count->wc);   
                     
-                    // receive submit_result from queue
-                    fot_order_is_submitted submit_result;
-                    memset(&submit_result, 0, sizeof(fot_order_is_submitted));
-
-                    // strncpy for comm w javascript
-                    fot_order_is_submitted result_for_sending;
-                    memset(&result_for_sending, 0, sizeof(fot_order_is_submitted)); // Initialize the struct
-                    result_for_sending.hdr.tr_id = 10;
-                    result_for_sending.hdr.length = sizeof(fot_order_is_submitted);
-
-                    strncpy(result_for_sending.transaction_code, received_order.transaction_code, sizeof(result_for_sending.transaction_code));
-                    result_for_sending.transaction_code[sizeof(result_for_sending.transaction_code) - 1] = '\0'; // Null-terminate
-
-                    strncpy(result_for_sending.user_id, received_order.user_id, sizeof(result_for_sending.user_id));
-                    result_for_sending.user_id[sizeof(result_for_sending.user_id) - 1] = '\0'; // Null-terminate
+                    const fot_order_is_submitted *result_for_sending = fep_ack_patch(&ack_templates[i], received_order, FEP_ACCEPTED);
 
-                    strncpy(result_for_sending.time, received_order.order_time, sizeof(result_for_sending.time));
-                    result_for_sending.time[sizeof(result_for_sending.time) - 1] = '\0'; // Null-terminate
-
-                    strncpy(result_for_sending.reject_code, "0000", sizeof(result_for_sending.reject_code));
-                    result_for_sending.reject_code[sizeof(result_for_sending.reject_code) - 1] = '\0'; // Null-terminate
-                    ////
-
-                    // if (bytes_read == -1) {
-                    //     log_message("ERROR", "mq","submit_mq_receive failed");
-                    //     mq_close(submit_mq);
-                    //     log_message("ERROR", "mq", "process will be closed...\n");
-                    //     exit(1);
-                    // }
-
-                    print_fot_order_is_submitted(&result_for_sending);
+                    print_fot_order_is_submitted(result_for_sending);
 
                     // send back to oms by connected socket
-                    ssize_t bytes_sent = send(fds[i].fd, &result_for_sending, sizeof(fot_order_is_submitted), 0);
+                    ssize_t bytes_sent = send(fds[i].fd, result_for_sending, sizeof(fot_order_is_submitted), 0);
 
                     if (bytes_sent < 0) {
                         log_message("ERROR", "socket", "Failed to send data to connected socket");
@@ -608,10 +421,7 @@ int main() {
                         log_message("INFO", "socket", "Successfully sent response to OMS via connected socket. Sent %ld bytes.\n", bytes_sent);
                     }
 
-                } else {
-                    send_error_to_oms(&received_order, "E001", fds[i].fd);
-                    log_message("ERROR", "socket", "Incomplete data received. Expected %lu bytes, got %ld bytes.\n", sizeof(fkq_order), bytes_received);
-                }    
+                }
             }
         }
     }
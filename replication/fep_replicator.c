@@ -0,0 +1,369 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np, ppoll
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h> // For open()
+#include <errno.h>
+#include <oms_fep_krx_struct.h>
+#include <fep_affinity.h>
+#include <fep_memory.h>
+#include <fep_clock.h>
+#include <fep_repl.h>
+
+// shared memory
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+//log
+#include <stdarg.h>
+#include <time.h>
+
+// Primary side of the journal replication, see fep_repl.h. Runs on the FEP host next to
+// oms_listener and krx_listener (or the integrated FEP) and streams their journals to
+// fep_standby. It only reads the FEP's counters and journals, so it may be started,
+// stopped and restarted at any time; the standby tells it where to resume.
+
+#define LOG_FILE_PATH "/home/ubuntu/logs/fep_replicator.log"
+#define REPL_WINDOW 8192            // records per stream sent and not yet acked
+#define IDLE_WAIT_NS 100000         // journal counters are checked this often when idle
+#define RECONNECT_MS 500
+
+typedef struct {
+    const char *name;
+    const char *counter;            // the journal's write counter
+    const char *journal;
+    size_t record_size;
+    const int *wc;                  // NULL until the FEP has created the counter
+    int fd;
+    int sent;
+    int acked;
+    char *buffer;                   // one batch
+} repl_stream;
+
+FILE *log_file = NULL;
+
+repl_stream streams[] = {
+    {"orders", "/W_count", "received_data.txt", sizeof(fkq_order)},
+    {"executions", "/KRX_W_count", "krx_received_data.txt", sizeof(kft_execution)},
+};
+const char *reader_counters[] = {"/R_count", "/DB_R_count", "/KRX_R_count"};
+const int *readers[3];
+
+int batch_records = FEP_REPL_DEFAULT_BATCH;
+uint64_t behind_since_ns = 0;       // the standby lacks journaled orders since then
+int behind_orders, behind_sending;  // what was journaled and being sent at that time
+
+// Initialize logging
+void init_log() {
+    mkdir("/home/ubuntu/logs", 0777);
+    log_file = fopen(LOG_FILE_PATH, "a");
+    if (!log_file) {
+        perror("Failed to open log file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Log function with level and module
+void log_message(const char *level, const char *module, const char *format, ...) {
+    if (!log_file) return;
+
+    // YYYY-MM-DD HH:MM:SS.mmm, copied from the shared clock page
+    char time_buffer[FEP_CLOCK_LOG_TIME_LEN + 1];
+    fep_clock_log_time(time_buffer);
+
+    fprintf(log_file, "[%s] [%s] [%s] ", time_buffer, level, module);
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(log_file, format, args);
+    va_end(args);
+
+    fflush(log_file);
+}
+
+// Map one of the FEP's counters read-only; NULL while it does not exist
+const int *open_counter(const char *shared_mem_name) {
+    int shm_fd = shm_open(shared_mem_name, O_RDONLY, 0);
+    if (shm_fd == -1) {
+        return NULL;
+    }
+    const int *counter = mmap(NULL, sizeof(int), PROT_READ, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (counter == MAP_FAILED) {
+        log_message("ERROR", "shm", "mmap %s failed\n", shared_mem_name);
+        return NULL;
+    }
+    log_message("INFO", "shm", "following %s = %d\n", shared_mem_name, *counter);
+    return counter;
+}
+
+void open_counters() {
+    for (size_t s = 0; s < sizeof(streams) / sizeof(streams[0]); s++) {
+        if (streams[s].wc == NULL) {
+            streams[s].wc = open_counter(streams[s].counter);
+        }
+    }
+    for (int r = 0; r < 3; r++) {
+        if (readers[r] == NULL) {
+            readers[r] = open_counter(reader_counters[r]);
+        }
+    }
+}
+
+int counter_value(const int *counter) {
+    return counter != NULL ? __atomic_load_n(counter, __ATOMIC_ACQUIRE) : -1;
+}
+
+void open_journals() {
+    const char *home_dir = getenv("HOME");
+    for (size_t s = 0; s < sizeof(streams) / sizeof(streams[0]); s++) {
+        repl_stream *stream = &streams[s];
+        char filepath[256];
+        snprintf(filepath, sizeof(filepath), "%s/%s", home_dir != NULL ? home_dir : ".", stream->journal);
+        // created here as well, so either side may start first
+        stream->fd = open(filepath, O_RDONLY | O_CREAT, 0644);
+        stream->buffer = malloc(stream->record_size * batch_records);
+        if (stream->fd == -1 || stream->buffer == NULL) {
+            log_message("ERROR", "file", "Error opening %s\n", filepath);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+int connect_standby(const char *host, int port) {
+    struct sockaddr_in addr;
+    int one = 1;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) <= 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // the standby says what it already has
+    fep_repl_frame frame;
+    fep_repl_positions hello;
+    if (fep_repl_read(sock, &frame, sizeof(frame), NULL) != 0 || frame.magic != FEP_REPL_MAGIC
+            || frame.type != FEP_REPL_HELLO || frame.length != sizeof(hello)
+            || fep_repl_read(sock, &hello, sizeof(hello), NULL) != 0) {
+        log_message("ERROR", "repl", "no hello from the standby at %s:%d\n", host, port);
+        close(sock);
+        return -1;
+    }
+    int have[2] = {hello.order_wc, hello.exec_wc};
+    for (int s = 0; s < 2; s++) {
+        int journaled = counter_value(streams[s].wc);
+        if (have[s] > (journaled > 0 ? journaled : 0)) {
+            // a standby of another journal (another day, another primary) must be reset by hand
+            log_message("ERROR", "repl", "standby has %d %s, this journal only %d: not a standby of this FEP\n",
+                        have[s], streams[s].name, journaled);
+            exit(EXIT_FAILURE);
+        }
+        streams[s].sent = streams[s].acked = have[s];
+    }
+    __atomic_store_n(&fep_repl->sending_acked, hello.order_sending, __ATOMIC_RELEASE);
+    log_message("INFO", "repl", "connected to the standby at %s:%d, resuming at order %d, execution %d\n",
+                host, port, have[0], have[1]);
+    return sock;
+}
+
+// Acks that arrived. -1 when the link is gone.
+int read_acks(int sock) {
+    struct pollfd pfd = {sock, POLLIN, 0};
+    while (poll(&pfd, 1, 0) > 0) {
+        fep_repl_frame frame;
+        fep_repl_positions ack;
+        if (fep_repl_read(sock, &frame, sizeof(frame), NULL) != 0 || frame.magic != FEP_REPL_MAGIC
+                || frame.type != FEP_REPL_ACK || frame.length != sizeof(ack)
+                || fep_repl_read(sock, &ack, sizeof(ack), NULL) != 0) {
+            return -1;
+        }
+        streams[FEP_REPL_ORDERS].acked = ack.order_wc;
+        streams[FEP_REPL_EXECS].acked = ack.exec_wc;
+        __atomic_store_n(&fep_repl->order_acked, ack.order_wc, __ATOMIC_RELEASE);
+        __atomic_store_n(&fep_repl->exec_acked, ack.exec_wc, __ATOMIC_RELEASE);
+        __atomic_store_n(&fep_repl->sending_acked, ack.order_sending, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+// Send what was journaled since the last round, within the window. Records sent, -1 on error.
+int send_batches(int sock, repl_stream *stream, int stream_id) {
+    int end = counter_value(stream->wc);
+    int sent = 0;
+
+    while (stream->sent < end && stream->sent - stream->acked < REPL_WINDOW) {
+        int want = end - stream->sent;
+        if (want > batch_records) {
+            want = batch_records;
+        }
+        if (want > REPL_WINDOW - (stream->sent - stream->acked)) {
+            want = REPL_WINDOW - (stream->sent - stream->acked);
+        }
+        ssize_t bytes_read = pread(stream->fd, stream->buffer, stream->record_size * want,
+                                   (off_t)stream->sent * stream->record_size);
+        int got = bytes_read > 0 ? bytes_read / stream->record_size : 0;
+        if (got == 0) {
+            log_message("ERROR", "file", "%s journal is shorter than wc %d\n", stream->name, end);
+            break;
+        }
+        if (fep_repl_send(sock, FEP_REPL_BATCH, stream_id, stream->sent, got, stream->buffer,
+                          got * stream->record_size) != 0) {
+            return -1;
+        }
+        stream->sent += got;
+        sent += got;
+    }
+    return sent;
+}
+
+// The sender's order_sending, never past the journal: a position left by an earlier run
+int sending_position(int journaled) {
+    int sending = __atomic_load_n(&fep_repl->order_sending, __ATOMIC_ACQUIRE);
+    return sending < journaled ? sending : journaled;
+}
+
+// Sync mode falls back to async while the standby lags, and comes back once it caught up.
+// The lag is timed from the oldest order, or sending position, the standby has not acked.
+void update_mode() {
+    if (fep_repl->configured != FEP_REPL_SYNC) {
+        return;
+    }
+    int journaled = counter_value(streams[FEP_REPL_ORDERS].wc);
+    int acked = streams[FEP_REPL_ORDERS].acked;
+    int sending = sending_position(journaled);
+    int sending_acked = __atomic_load_n(&fep_repl->sending_acked, __ATOMIC_ACQUIRE);
+    uint64_t now = fep_repl_now_ns();
+
+    if (acked >= journaled && sending_acked >= sending) {
+        behind_since_ns = 0;
+        if (fep_repl->mode != FEP_REPL_SYNC) {
+            __atomic_store_n(&fep_repl->mode, FEP_REPL_SYNC, __ATOMIC_RELEASE);
+            log_message("INFO", "repl", "standby caught up at order %d, sync again\n", acked);
+        }
+    } else if (behind_since_ns == 0 || (acked >= behind_orders && sending_acked >= behind_sending)) {
+        // everything that was missing when the clock started has been acked since
+        behind_since_ns = now;
+        behind_orders = journaled;
+        behind_sending = sending;
+    } else if (fep_repl->mode == FEP_REPL_SYNC
+            && now - behind_since_ns > (uint64_t)fep_repl->sync_timeout_ms * 1000000ULL) {
+        __atomic_store_n(&fep_repl->mode, FEP_REPL_ASYNC, __ATOMIC_RELEASE);
+        log_message("ERROR", "repl", "standby has not acked for %u ms, async from order %d until it catches up\n",
+                    fep_repl->sync_timeout_ms, acked);
+    }
+}
+
+int main() {
+    const char *host = getenv("FEP_REPL_HOST");
+    const char *mode = getenv("FEP_REPL_MODE");
+    int port = fep_repl_env("FEP_REPL_PORT", FEP_REPL_DEFAULT_PORT);
+    int sync = mode != NULL && strcmp(mode, "sync") == 0;
+    fep_repl_positions last = {-1, -1, -1, -1, -1, -1};
+    uint64_t next_lookup_ns = 0, next_connect_ns = 0;
+    int sock = -1;
+
+    if (host == NULL || host[0] == '\0') {
+        host = FEP_REPL_DEFAULT_HOST;
+    }
+    batch_records = fep_repl_env("FEP_REPL_BATCH", FEP_REPL_DEFAULT_BATCH);
+    if (batch_records < 1) {
+        batch_records = FEP_REPL_DEFAULT_BATCH;
+    }
+
+    init_log();
+    fep_affinity_pin(FEP_ROLE_REPLICATOR);
+    signal(SIGPIPE, SIG_IGN);
+    if (fep_repl_open() != 0) {
+        log_message("ERROR", "shm", "cannot map %s\n", FEP_REPL_SHM_NAME);
+        return EXIT_FAILURE;
+    }
+    fep_mem_report(FEP_REPL_SHM_NAME, sizeof(fep_repl_page), fep_mem_prepare(fep_repl, sizeof(fep_repl_page), 0));
+    fep_repl->sync_timeout_ms = fep_repl_env("FEP_REPL_SYNC_TIMEOUT_MS", FEP_REPL_DEFAULT_SYNC_TIMEOUT_MS);
+    fep_repl->connected = 0;
+    fep_repl->order_acked = fep_repl->exec_acked = fep_repl->sending_acked = 0;
+    fep_repl->configured = sync ? FEP_REPL_SYNC : FEP_REPL_ASYNC;
+    __atomic_store_n(&fep_repl->heartbeat_ns, fep_repl_now_ns(), __ATOMIC_RELEASE);
+    __atomic_store_n(&fep_repl->mode, fep_repl->configured, __ATOMIC_RELEASE);
+
+    open_journals();
+    log_message("INFO", "repl", "replicating to %s:%d, %s, batches of %d records\n",
+                host, port, sync ? "sync" : "async", batch_records);
+
+    while (1) {
+        uint64_t now = fep_repl_now_ns();
+        __atomic_store_n(&fep_repl->heartbeat_ns, now, __ATOMIC_RELEASE);
+        if (now >= next_lookup_ns) {
+            open_counters();
+            next_lookup_ns = now + 1000000000ULL;
+        }
+        update_mode();
+
+        if (sock < 0) {
+            struct timespec nap = {0, IDLE_WAIT_NS};
+            if (now >= next_connect_ns) {
+                next_connect_ns = now + RECONNECT_MS * 1000000ULL;
+                sock = connect_standby(host, port);
+                if (sock >= 0) {
+                    __atomic_store_n(&fep_repl->order_acked, streams[FEP_REPL_ORDERS].acked, __ATOMIC_RELEASE);
+                    __atomic_store_n(&fep_repl->exec_acked, streams[FEP_REPL_EXECS].acked, __ATOMIC_RELEASE);
+                    fep_repl->connected = 1;
+                    memset(&last, 0xff, sizeof(last));
+                    continue;
+                }
+            }
+            nanosleep(&nap, NULL);
+            continue;
+        }
+
+        int sent = 0, failed = read_acks(sock) != 0;
+        for (int s = 0; s < 2 && !failed; s++) {
+            int n = send_batches(sock, &streams[s], s);
+            failed = n < 0;
+            sent += n > 0 ? n : 0;
+        }
+
+        // the reader positions, after the records they point into
+        int journaled = counter_value(streams[FEP_REPL_ORDERS].wc);
+        fep_repl_positions now_at = {
+            journaled, counter_value(readers[0]), counter_value(readers[1]),
+            counter_value(streams[FEP_REPL_EXECS].wc), counter_value(readers[2]), sending_position(journaled),
+        };
+        if (!failed && memcmp(&now_at, &last, sizeof(last)) != 0) {
+            failed = fep_repl_send(sock, FEP_REPL_POSITIONS, 0, 0, 0, &now_at, sizeof(now_at)) != 0;
+            last = now_at;
+        }
+
+        if (failed) {
+            log_message("ERROR", "repl", "lost the standby at order %d (acked %d), execution %d (acked %d)\n",
+                        streams[FEP_REPL_ORDERS].sent, streams[FEP_REPL_ORDERS].acked,
+                        streams[FEP_REPL_EXECS].sent, streams[FEP_REPL_EXECS].acked);
+            close(sock);
+            sock = -1;
+            fep_repl->connected = 0;
+            next_connect_ns = 0;
+            continue;
+        }
+        if (sent == 0) {
+            // until an ack arrives or it is time to look at the counters again
+            struct pollfd pfd = {sock, POLLIN, 0};
+            struct timespec wait = {0, IDLE_WAIT_NS};
+            ppoll(&pfd, 1, &wait, NULL);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,362 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h> // For open()
+#include <errno.h>
+#include <oms_fep_krx_struct.h>
+#include <fep_affinity.h>
+#include <fep_memory.h>
+#include <fep_clock.h>
+#include <fep_repl.h>
+
+// shared memory
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+//log
+#include <stdarg.h>
+#include <time.h>
+
+// Standby side of the journal replication, see fep_repl.h. Keeps copies of the order
+// and execution journals in its $HOME, under the FEP's own file names, and the
+// primary's reader positions in fep_standby.state next to them.
+//
+// kill -USR1 promotes it: the link is dropped first, so a primary that is still alive
+// cannot add to the journals. The journals are synced, /W_count, /R_count, /DB_R_count,
+// /KRX_W_count and /KRX_R_count are written and the standby exits; start the FEP with
+// the same $HOME. The counters are system-wide, so on loopback the primary must be gone.
+
+#define LOG_FILE_PATH "/home/ubuntu/logs/fep_standby.log"
+#define STATE_FILE "fep_standby.state"
+#define ACK_EVERY_FRAMES 64         // at most this many frames between acks
+#define MAX_FRAME_BYTES (64U << 20)
+
+typedef struct {
+    const char *name;
+    const char *journal;
+    size_t record_size;
+    int fd;
+    int count;                      // whole records in the journal
+} standby_journal;
+
+FILE *log_file = NULL;
+volatile int promote = 0;
+volatile uint64_t promote_ns = 0;   // when SIGUSR1 came
+
+standby_journal journals[] = {
+    {"orders", "received_data.txt", sizeof(fkq_order)},
+    {"executions", "krx_received_data.txt", sizeof(kft_execution)},
+};
+fep_repl_positions positions = {-1, -1, -1, -1, -1, -1};  // last POSITIONS of the primary
+int state_fd = -1;
+int sync_writes = 0;                // FEP_REPL_FSYNC
+char *payload = NULL;
+size_t payload_size = 0;
+
+// Initialize logging
+void init_log() {
+    mkdir("/home/ubuntu/logs", 0777);
+    log_file = fopen(LOG_FILE_PATH, "a");
+    if (!log_file) {
+        perror("Failed to open log file");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Log function with level and module
+void log_message(const char *level, const char *module, const char *format, ...) {
+    if (!log_file) return;
+
+    // YYYY-MM-DD HH:MM:SS.mmm, copied from the shared clock page
+    char time_buffer[FEP_CLOCK_LOG_TIME_LEN + 1];
+    fep_clock_log_time(time_buffer);
+
+    fprintf(log_file, "[%s] [%s] [%s] ", time_buffer, level, module);
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(log_file, format, args);
+    va_end(args);
+
+    fflush(log_file);
+}
+
+void handle_promote(int sig) {
+    (void)sig;
+    promote_ns = fep_repl_now_ns();
+    promote = 1;
+}
+
+void home_path(char *path, size_t size, const char *name) {
+    const char *home_dir = getenv("HOME");
+    snprintf(path, size, "%s/%s", home_dir != NULL ? home_dir : ".", name);
+}
+
+// Open a journal copy; a record cut short by a crash is dropped
+void open_journal(standby_journal *journal) {
+    char filepath[256];
+    struct stat st;
+
+    home_path(filepath, sizeof(filepath), journal->journal);
+    journal->fd = open(filepath, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (journal->fd < 0 || fstat(journal->fd, &st) != 0) {
+        log_message("ERROR", "file", "Error opening %s\n", filepath);
+        exit(EXIT_FAILURE);
+    }
+    journal->count = st.st_size / journal->record_size;
+    if ((size_t)st.st_size % journal->record_size != 0) {
+        log_message("ERROR", "file", "%s ends in a partial record, cut back to %d records\n", filepath, journal->count);
+        if (ftruncate(journal->fd, (off_t)journal->count * journal->record_size) != 0) {
+            exit(EXIT_FAILURE);
+        }
+    }
+    fep_journal_reserve(journal->fd, filepath);
+    log_message("INFO", "file", "%s: %d %s\n", filepath, journal->count, journal->name);
+}
+
+void open_state() {
+    char filepath[256];
+    home_path(filepath, sizeof(filepath), STATE_FILE);
+    state_fd = open(filepath, O_RDWR | O_CREAT, 0644);
+    if (state_fd < 0) {
+        log_message("ERROR", "file", "Error opening %s\n", filepath);
+        exit(EXIT_FAILURE);
+    }
+    if (pread(state_fd, &positions, sizeof(positions), 0) != sizeof(positions)) {
+        memset(&positions, 0xff, sizeof(positions));
+    }
+}
+
+int open_server_socket(int port) {
+    struct sockaddr_in address;
+    int opt = 1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        log_message("ERROR", "socket", "Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 1) < 0) {
+        log_message("ERROR", "socket", "bind/listen failed on port %d\n", port);
+        exit(EXIT_FAILURE);
+    }
+    log_message("INFO", "socket", "standby listening on port %d\n", port);
+    return fd;
+}
+
+int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// One frame from the primary. 1 when it is to be acked, 0 otherwise, -1 to drop the link.
+int handle_frame(int sock) {
+    fep_repl_frame frame;
+
+    if (fep_repl_read(sock, &frame, sizeof(frame), &promote) != 0) {
+        return -1;
+    }
+    if (frame.magic != FEP_REPL_MAGIC || frame.length > MAX_FRAME_BYTES) {
+        log_message("ERROR", "repl", "bad frame from the primary\n");
+        return -1;
+    }
+    if (frame.length > payload_size) {
+        free(payload);
+        payload = malloc(frame.length);
+        payload_size = payload != NULL ? frame.length : 0;
+    }
+    if (payload == NULL || fep_repl_read(sock, payload, frame.length, &promote) != 0) {
+        return -1;
+    }
+
+    if (frame.type == FEP_REPL_POSITIONS && frame.length == sizeof(positions)) {
+        // a new order_sending holds the primary's sender back until it is acked
+        int sending = positions.order_sending;
+        memcpy(&positions, payload, sizeof(positions));
+        pwrite(state_fd, &positions, sizeof(positions), 0);
+        return positions.order_sending != sending;
+    }
+    if (frame.type != FEP_REPL_BATCH || frame.stream > FEP_REPL_EXECS) {
+        log_message("ERROR", "repl", "unexpected frame type %d\n", frame.type);
+        return -1;
+    }
+    standby_journal *journal = &journals[frame.stream];
+    if (frame.first != journal->count || frame.count <= 0
+            || frame.length != (uint32_t)frame.count * journal->record_size) {
+        log_message("ERROR", "repl", "%s batch %d+%d does not follow the %d here\n",
+                    journal->name, frame.first, frame.count, journal->count);
+        return -1;
+    }
+    if (write_all(journal->fd, payload, frame.length) != 0) {
+        log_message("ERROR", "file", "cannot append %d %s\n", frame.count, journal->name);
+        exit(EXIT_FAILURE);
+    }
+    journal->count += frame.count;
+    return 1;
+}
+
+int send_positions(int sock, int type) {
+    fep_repl_positions have = positions;
+    have.order_wc = journals[FEP_REPL_ORDERS].count;
+    have.exec_wc = journals[FEP_REPL_EXECS].count;
+    return fep_repl_send(sock, type, 0, 0, 0, &have, sizeof(have));
+}
+
+// Follow one primary until the link drops or a promotion
+void serve_primary(int sock) {
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (send_positions(sock, FEP_REPL_HELLO) != 0) {
+        return;
+    }
+    log_message("INFO", "repl", "primary connected, have order %d, execution %d\n",
+                journals[FEP_REPL_ORDERS].count, journals[FEP_REPL_EXECS].count);
+
+    while (!promote) {
+        struct pollfd pfd = {sock, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        // take what is there, then ack it all at once
+        int to_ack = 0, frames = 0, result;
+        do {
+            if ((result = handle_frame(sock)) < 0) {
+                log_message("INFO", "repl", "primary gone, have order %d, execution %d\n",
+                            journals[FEP_REPL_ORDERS].count, journals[FEP_REPL_EXECS].count);
+                return;
+            }
+            to_ack |= result;
+        } while (++frames < ACK_EVERY_FRAMES && !promote && poll(&pfd, 1, 0) > 0);
+
+        if (to_ack) {
+            if (sync_writes) {
+                fdatasync(journals[FEP_REPL_ORDERS].fd);
+                fdatasync(journals[FEP_REPL_EXECS].fd);
+                fdatasync(state_fd);
+            }
+            if (send_positions(sock, FEP_REPL_ACK) != 0) {
+                return;
+            }
+        }
+    }
+}
+
+// Set a counter to value, creating it if need be
+void write_counter(const char *shared_mem_name, int value) {
+    int shm_fd = shm_open(shared_mem_name, O_CREAT | O_RDWR, 0666);
+    if (shm_fd == -1 || ftruncate(shm_fd, sizeof(int)) == -1) {
+        log_message("ERROR", "shm", "cannot write %s\n", shared_mem_name);
+        exit(EXIT_FAILURE);
+    }
+    int *counter = mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    close(shm_fd);
+    if (counter == MAP_FAILED) {
+        log_message("ERROR", "shm", "mmap %s failed\n", shared_mem_name);
+        exit(EXIT_FAILURE);
+    }
+    __atomic_store_n(counter, value, __ATOMIC_RELEASE);
+    munmap(counter, sizeof(int));
+}
+
+// a reader can not be ahead of the records it reads
+int clamp(int rc, int count) {
+    return rc < count ? rc : count;
+}
+
+void promote_standby(uint64_t t_signal) {
+    int orders = journals[FEP_REPL_ORDERS].count;
+    int execs = journals[FEP_REPL_EXECS].count;
+
+    fdatasync(journals[FEP_REPL_ORDERS].fd);
+    fdatasync(journals[FEP_REPL_EXECS].fd);
+    write_counter("/W_count", orders);
+    write_counter("/KRX_W_count", execs);
+    int sent = clamp(positions.order_rc > 0 ? positions.order_rc : 0, orders);
+    int sending = clamp(positions.order_sending, orders);
+    if (sending > sent) {
+        // in flight to KRX when the primary was lost: sending them again could trade twice
+        log_message("ERROR", "repl", "orders %d-%d may have reached KRX, not sent again; reconcile them with KRX:\n",
+                    sent, sending - 1);
+        for (int i = sent; i < sending; i++) {
+            fkq_order order;
+            if (pread(journals[FEP_REPL_ORDERS].fd, &order, sizeof(order), (off_t)i * sizeof(order)) == sizeof(order)) {
+                log_message("ERROR", "repl", "  order %d transaction_code %.*s\n",
+                            i, (int)sizeof(order.transaction_code), order.transaction_code);
+            }
+        }
+        sent = sending;
+    }
+    write_counter("/R_count", sent);
+    write_counter("/KRX_R_count", clamp(positions.exec_rc > 0 ? positions.exec_rc : 0, execs));
+    if (positions.db_rc >= 0) {
+        write_counter("/DB_R_count", clamp(positions.db_rc, orders));
+    }
+    log_message("INFO", "repl", "promoted in %.1f ms: orders %d (sent %d, inserted %d), executions %d (applied %d)\n",
+                (fep_repl_now_ns() - t_signal) / 1e6, orders, sent,
+                clamp(positions.db_rc, orders), execs, clamp(positions.exec_rc, execs));
+    if (positions.order_wc > orders) {
+        log_message("ERROR", "repl", "the primary had journaled %d orders, %d did not arrive\n",
+                    positions.order_wc, positions.order_wc - orders);
+    }
+}
+
+int main() {
+    struct sigaction sa;
+    int port = fep_repl_env("FEP_REPL_PORT", FEP_REPL_DEFAULT_PORT);
+
+    init_log();
+    fep_affinity_pin(FEP_ROLE_REPLICATOR);
+    sync_writes = fep_repl_env("FEP_REPL_FSYNC", 0) != 0;
+
+    // no SA_RESTART: the promotion interrupts a blocked read
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_promote;
+    sigaction(SIGUSR1, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    open_journal(&journals[FEP_REPL_ORDERS]);
+    open_journal(&journals[FEP_REPL_EXECS]);
+    open_state();
+    int server_fd = open_server_socket(port);
+
+    while (!promote) {
+        struct pollfd pfd = {server_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        int sock = accept(server_fd, NULL, NULL);
+        if (sock < 0) {
+            continue;
+        }
+        serve_primary(sock);
+        close(sock);
+    }
+
+    // fence the old primary off before the journals become the FEP's
+    close(server_fd);
+    promote_standby(promote_ns);
+    return 0;
+}
@@ -0,0 +1,361 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <oms_fep_krx_struct.h>
+#include <fep_store.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+
+// End-of-day bulk loader.
+// Rebuilds tx_history from the binary journals in one pass:
+//   1. execution journal segments are scanned in parallel, keeping the last state per transaction_code
+//   2. order journal segments are turned into complete rows with that final state, in parallel
+//   3. rows go either to a LOAD DATA file (-t) or to the store in multi-row batches
+//
+// Loading is an upsert keyed by transaction_code, so it can run against a table that
+// already holds rows (a reconcile, or db_inserter's db_dead_orders.txt): a row already
+// there only takes the journal's final status and reject_code. The LOAD DATA statement
+// printed for -t uses REPLACE. On MySQL both need a unique key on transaction_code.
+//
+// usage: eod_loader [-o received_data.txt] [-e krx_received_data.txt] [-j threads] [-t rows.tsv]
+
+#define MAX_THREADS 64
+#define LOAD_BATCH 4096          // rows per store call
+
+typedef struct {
+    char transaction_code[7];
+    char status;
+    long seq;                    // journal position of the execution, last one wins
+    char reject_code[5];
+} final_state;
+
+typedef struct {
+    final_state *slots;
+    unsigned long mask;
+} state_table;
+
+typedef struct {
+    int id;
+    long begin, end;             // record range of this segment
+    state_table local;           // phase 1 output
+    fep_order_row *rows;         // phase 2 output
+    long row_count;
+    char *tsv;                   // phase 2 output for -t
+    size_t tsv_len;
+    long load_errors;
+} segment;
+
+const kft_execution *executions = NULL;
+long execution_count = 0;
+const fkq_order *orders = NULL;
+long order_count = 0;
+state_table final_states;
+fep_store *store = NULL;
+const char *tsv_path = NULL;
+
+pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void log_message(const char *level, const char *module, const char *format, ...) {
+    pthread_mutex_lock(&log_mutex);
+    fprintf(stderr, "[%s] [%s] ", level, module);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    pthread_mutex_unlock(&log_mutex);
+}
+
+double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+const void *map_journal(const char *path, size_t record_size, long *count) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    if (st.st_size % record_size != 0) {
+        // another record layout (kft_execution was 56 bytes before seq_no) or a torn tail
+        fprintf(stderr, "%s: %ld bytes is not a whole number of %zu-byte records\n", path, (long)st.st_size, record_size);
+        exit(EXIT_FAILURE);
+    }
+    *count = st.st_size / record_size;
+    if (*count == 0) {
+        close(fd);
+        return NULL;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "mmap %s failed: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    return data;
+}
+
+unsigned int hash_transaction_code(const char *transaction_code) {
+    unsigned int h = 2166136261u; // FNV-1a
+    for (int i = 0; i < 7 && transaction_code[i] != '\0'; i++) {
+        h ^= (unsigned char)transaction_code[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void state_table_init(state_table *table, long entries) {
+    unsigned long size = 1024;
+    while (size < (unsigned long)entries * 2) {
+        size <<= 1;
+    }
+    table->slots = calloc(size, sizeof(final_state));
+    table->mask = size - 1;
+    if (table->slots == NULL) {
+        fprintf(stderr, "out of memory for %lu states\n", size);
+        exit(EXIT_FAILURE);
+    }
+}
+
+final_state *state_slot(state_table *table, const char *transaction_code) {
+    unsigned long slot = hash_transaction_code(transaction_code) & table->mask;
+    while (table->slots[slot].transaction_code[0] != '\0' &&
+           strncmp(table->slots[slot].transaction_code, transaction_code, 6) != 0) {
+        slot = (slot + 1) & table->mask;
+    }
+    return &table->slots[slot];
+}
+
+void state_merge(state_table *table, const final_state *state) {
+    final_state *slot = state_slot(table, state->transaction_code);
+    if (slot->transaction_code[0] == '\0' || slot->seq < state->seq) {
+        *slot = *state;
+    }
+}
+
+char status_of(const kft_execution *execution) {
+    if (execution->status_code == 0) {
+        return 'D';
+    } else if (execution->status_code == 1) {
+        return 'C';
+    } else if (execution->status_code == 99) {
+        return 'R';
+    }
+    return 0;
+}
+
+// Phase 1: last state per transaction_code within one execution journal segment
+void *scan_executions(void *arg) {
+    segment *seg = arg;
+    state_table_init(&seg->local, seg->end - seg->begin);
+
+    for (long i = seg->begin; i < seg->end; i++) {
+        final_state state;
+        memset(&state, 0, sizeof(state));
+        state.status = status_of(&executions[i]);
+        if (state.status == 0 || executions[i].transaction_code[0] == '\0') {
+            continue;
+        }
+        memcpy(state.transaction_code, executions[i].transaction_code, 6);
+        memcpy(state.reject_code, executions[i].reject_code, 4);
+        state.seq = i;
+        state_merge(&seg->local, &state);
+    }
+    return NULL;
+}
+
+// Append one row in LOAD DATA's default format: tab separated, \N for NULL
+void tsv_append(segment *seg, size_t *cap, const fep_order_row *row) {
+    if (seg->tsv_len + 512 > *cap) {
+        *cap = *cap ? *cap * 2 : 1 << 20;
+        seg->tsv = realloc(seg->tsv, *cap);
+        if (seg->tsv == NULL) {
+            fprintf(stderr, "out of memory for the row file\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    char *out = seg->tsv + seg->tsv_len;
+    const char *fields[] = {row->stock_code, row->stock_name, row->transaction_code, row->user_id};
+    int widths[] = {sizeof(row->stock_code), sizeof(row->stock_name), sizeof(row->transaction_code), sizeof(row->user_id)};
+
+    for (int f = 0; f < 4; f++) {
+        for (int i = 0; i < widths[f] && fields[f][i] != '\0'; i++) {
+            char c = fields[f][i];
+            if (c == '\t' || c == '\n' || c == '\\') {
+                *out++ = '\\';
+                c = c == '\t' ? 't' : c == '\n' ? 'n' : '\\';
+            }
+            *out++ = c;
+        }
+        *out++ = '\t';
+    }
+    out += sprintf(out, "%c\t%d\t%.14s\t%d\t%.6s\t%c\t", row->order_type, row->quantity,
+                   row->order_time, row->price, row->original_order, row->status);
+    out += row->reject_code[0] ? sprintf(out, "%.4s\n", row->reject_code) : sprintf(out, "\\N\n");
+    seg->tsv_len = out - seg->tsv;
+}
+
+// Phase 2: rows for one order journal segment, joined with the final execution state
+void *build_rows(void *arg) {
+    segment *seg = arg;
+    size_t tsv_cap = 0;
+    long batch = 0;
+
+    seg->rows = malloc(sizeof(fep_order_row) * LOAD_BATCH);
+    if (seg->rows == NULL) {
+        fprintf(stderr, "out of memory for %d rows\n", LOAD_BATCH);
+        exit(EXIT_FAILURE);
+    }
+    for (long i = seg->begin; i < seg->end; i++) {
+        const fkq_order *order = &orders[i];
+        fep_order_row *row = &seg->rows[batch];
+        memset(row, 0, sizeof(fep_order_row));
+        memcpy(row->stock_code, order->stock_code, sizeof(row->stock_code) - 1);
+        memcpy(row->stock_name, order->stock_name, sizeof(row->stock_name) - 1);
+        memcpy(row->transaction_code, order->transaction_code, sizeof(row->transaction_code) - 1);
+        memcpy(row->user_id, order->user_id, sizeof(row->user_id) - 1);
+        row->order_type = order->order_type;
+        row->quantity = order->quantity;
+        row->price = order->price;
+        memcpy(row->order_time, order->order_time, sizeof(row->order_time) - 1);
+        memcpy(row->original_order, order->original_order, sizeof(row->original_order) - 1);
+
+        final_state *state = state_slot(&final_states, order->transaction_code);
+        if (state->transaction_code[0] != '\0') {
+            row->status = state->status;
+            memcpy(row->reject_code, state->reject_code, sizeof(row->reject_code) - 1);
+        } else {
+            row->status = 'W';
+        }
+        seg->row_count++;
+
+        if (tsv_path) {
+            tsv_append(seg, &tsv_cap, row);
+        } else if (++batch == LOAD_BATCH) {
+            if (fep_store_load_rows(store, seg->rows, batch) != 0) {
+                seg->load_errors += batch;
+            }
+            batch = 0;
+        }
+    }
+    if (!tsv_path && batch > 0 && fep_store_load_rows(store, seg->rows, batch) != 0) {
+        seg->load_errors += batch;
+    }
+    free(seg->rows);
+    return NULL;
+}
+
+void run_segments(segment *segs, int threads, long count, void *(*fn)(void *)) {
+    pthread_t tids[MAX_THREADS];
+    for (int t = 0; t < threads; t++) {
+        segs[t].id = t;
+        segs[t].begin = count * t / threads;
+        segs[t].end = count * (t + 1) / threads;
+        pthread_create(&tids[t], NULL, fn, &segs[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    char order_path[256], exec_path[256];
+    const char *home_dir = getenv("HOME");
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    snprintf(order_path, sizeof(order_path), "%s/received_data.txt", home_dir ? home_dir : ".");
+    snprintf(exec_path, sizeof(exec_path), "%s/krx_received_data.txt", home_dir ? home_dir : ".");
+
+    while ((opt = getopt(argc, argv, "o:e:j:t:")) != -1) {
+        switch (opt) {
+        case 'o': snprintf(order_path, sizeof(order_path), "%s", optarg); break;
+        case 'e': snprintf(exec_path, sizeof(exec_path), "%s", optarg); break;
+        case 'j': threads = atoi(optarg); break;
+        case 't': tsv_path = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-o order_journal] [-e execution_journal] [-j threads] [-t rows.tsv]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (threads < 1) {
+        threads = 1;
+    } else if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+
+    orders = map_journal(order_path, sizeof(fkq_order), &order_count);
+    executions = map_journal(exec_path, sizeof(kft_execution), &execution_count);
+    printf("orders: %ld, executions: %ld, threads: %d\n", order_count, execution_count, threads);
+
+    if (!tsv_path) {
+        store = fep_store_open("eod_loader", threads, threads);
+        if (store == NULL) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    static segment segs[MAX_THREADS];
+    double started = now_sec();
+
+    // phase 1
+    run_segments(segs, threads, execution_count, scan_executions);
+    state_table_init(&final_states, execution_count);
+    for (int t = 0; t < threads; t++) {
+        for (unsigned long k = 0; k <= segs[t].local.mask; k++) {
+            if (segs[t].local.slots[k].transaction_code[0] != '\0') {
+                state_merge(&final_states, &segs[t].local.slots[k]);
+            }
+        }
+        free(segs[t].local.slots);
+    }
+    double scanned = now_sec();
+    printf("executions folded in %.3f s (%.0f records/s)\n", scanned - started,
+           execution_count / (scanned - started > 0 ? scanned - started : 1e-9));
+
+    // phase 2
+    memset(segs, 0, sizeof(segs));
+    run_segments(segs, threads, order_count, build_rows);
+
+    long rows = 0, errors = 0;
+    FILE *tsv = tsv_path ? fopen(tsv_path, "w") : NULL;
+    if (tsv_path && tsv == NULL) {
+        fprintf(stderr, "cannot write %s: %s\n", tsv_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    for (int t = 0; t < threads; t++) {
+        rows += segs[t].row_count;
+        errors += segs[t].load_errors;
+        if (tsv) {
+            fwrite(segs[t].tsv, 1, segs[t].tsv_len, tsv);
+        }
+        free(segs[t].tsv);
+    }
+    if (tsv) {
+        fclose(tsv);
+    }
+    double finished = now_sec();
+
+    printf("rows: %ld, failed: %ld, total %.3f s (%.0f rows/s)\n", rows, errors, finished - started,
+           rows / (finished - started > 0 ? finished - started : 1e-9));
+    if (tsv_path) {
+        printf("LOAD DATA LOCAL INFILE '%s' REPLACE INTO TABLE tx_history "
+               "(stock_code, stock_name, transaction_code, user_id, order_type, quantity, order_time, price, original_order, status, reject_code);\n",
+               tsv_path);
+    }
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
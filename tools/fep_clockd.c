@@ -0,0 +1,110 @@
+#define _GNU_SOURCE  // pthread_setaffinity_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <fep_clock.h>
+#include <fep_memory.h>
+#include <fep_affinity.h>
+
+// Keeps the shared clock page /fep_clock current for every FEP process on the box.
+// Start it before the FEP; the processes format their timestamps locally while it
+// is not running.
+//
+// usage: fep_clockd [-i microseconds]
+//   -i  update interval, default 1000 (every millisecond, on the millisecond), below
+//       FEP_CLOCK_STALE_MS
+
+static volatile sig_atomic_t running = 1;
+
+void log_message(const char *level, const char *module, const char *format, ...) {
+    char time_buffer[FEP_CLOCK_LOG_TIME_LEN + 1];
+    fep_clock_log_time(time_buffer);
+    fprintf(stderr, "[%s] [%s] [%s] ", time_buffer, level, module);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+int main(int argc, char *argv[]) {
+    long interval_us = 1000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        switch (opt) {
+        case 'i': interval_us = atol(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-i microseconds]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (interval_us <= 0) {
+        interval_us = 1000;
+    }
+    if (interval_us >= FEP_CLOCK_STALE_MS * 1000L) {
+        // readers would take every page between two updates for stale
+        fprintf(stderr, "%s: -i must be below %d000 microseconds\n", argv[0], FEP_CLOCK_STALE_MS);
+        return EXIT_FAILURE;
+    }
+
+    // the FEP keeps order and execution times in KST
+    setenv("TZ", "Asia/Seoul", 1);
+    tzset();
+
+    // reuse the page across restarts: readers keep their mapping
+    int fd = shm_open(FEP_CLOCK_SHM_NAME, O_CREAT | O_RDWR, 0644);
+    if (fd == -1) {
+        perror("shm_open");
+        return EXIT_FAILURE;
+    }
+    if (ftruncate(fd, sizeof(fep_clock_page)) == -1) {
+        perror("ftruncate");
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    fep_clock_page *page = mmap(NULL, sizeof(fep_clock_page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+    fep_mem_report(FEP_CLOCK_SHM_NAME, sizeof(fep_clock_page), fep_mem_prepare(page, sizeof(fep_clock_page), 0));
+    fep_affinity_pin(FEP_ROLE_CLOCK);
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    fep_clock_writer writer;
+    fep_clock_writer_init(&writer, page);
+    fep_clock_update(&writer);
+    log_message("INFO", "clock", "%s updated every %ld us, now %s (UTC%+d)\n",
+                FEP_CLOCK_SHM_NAME, interval_us, page->log_time, page->utc_offset_s / 3600);
+
+    // wake on interval boundaries of the wall clock, so the milliseconds turn on time
+    long interval_ns = interval_us * 1000;
+    struct timespec next;
+    while (running) {
+        clock_gettime(CLOCK_REALTIME, &next);
+        long ns = (next.tv_nsec / interval_ns + 1) * interval_ns;
+        next.tv_sec += ns / 1000000000;
+        next.tv_nsec = ns % 1000000000;
+        clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &next, NULL);
+        fep_clock_update(&writer);
+    }
+
+    // readers see the page go stale and format locally again
+    log_message("INFO", "clock", "stopped\n");
+    munmap(page, sizeof(fep_clock_page));
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <time.h>
+#include <fep_stat.h>
+
+// Live per-stage latency from the /fep_stat page.
+// Every interval prints, per segment, the values recorded during that interval
+// (or since start with -c).
+//
+// usage: fep_stat [-i seconds] [-n reports] [-c] [-r]
+//   -i  report interval, default 1
+//   -n  stop after n reports, default run until killed
+//   -c  cumulative figures instead of per interval
+//   -r  clear all histograms and exit (run it between test runs)
+
+void log_message(const char *level, const char *module, const char *format, ...) {
+    fprintf(stderr, "[%s] [%s] ", level, module);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+static fep_hist previous[FEP_SEG_COUNT];
+static fep_hist current[FEP_SEG_COUNT];
+static fep_hist interval[FEP_SEG_COUNT];
+
+void print_report(const fep_hist *hists, double seconds, int cumulative) {
+    char time_buffer[20];
+    time_t now = time(NULL);
+    strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+    printf("%s  %s %.1f s\n", time_buffer, cumulative ? "since start, report every" : "interval", seconds);
+    printf("%-14s %10s %10s %10s %10s %10s %10s\n", "segment", "count", "mean(us)", "p50(us)", "p99(us)", "p99.9(us)", "max(us)");
+    for (int s = 0; s < FEP_SEG_COUNT; s++) {
+        const fep_hist *h = &hists[s];
+        if (h->count == 0) {
+            printf("%-14s %10d %10s %10s %10s %10s %10s\n", fep_seg_names[s], 0, "-", "-", "-", "-", "-");
+            continue;
+        }
+        printf("%-14s %10lu %10.2f %10.2f %10.2f %10.2f %10.2f\n", fep_seg_names[s], (unsigned long)h->count,
+               fep_hist_mean(h) / 1000.0,
+               fep_hist_percentile(h, 50.0) / 1000.0,
+               fep_hist_percentile(h, 99.0) / 1000.0,
+               fep_hist_percentile(h, 99.9) / 1000.0,
+               h->max / 1000.0);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = 1.0;
+    long reports = 0;
+    int cumulative = 0, reset = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:n:cr")) != -1) {
+        switch (opt) {
+        case 'i': seconds = atof(optarg); break;
+        case 'n': reports = atol(optarg); break;
+        case 'c': cumulative = 1; break;
+        case 'r': reset = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-i seconds] [-n reports] [-c] [-r]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (seconds <= 0) {
+        seconds = 1.0;
+    }
+
+    if (fep_stat_open() != 0) {
+        fprintf(stderr, "cannot map %s\n", FEP_STAT_SHM_NAME);
+        return EXIT_FAILURE;
+    }
+    if (reset) {
+        for (int s = 0; s < FEP_SEG_COUNT; s++) {
+            fep_hist_reset(&fep_stat->hist[s]);
+        }
+        printf("histograms cleared\n");
+        return 0;
+    }
+    printf("%.4f ns per tick\n\n", fep_stat->ns_per_tick);
+
+    for (int s = 0; s < FEP_SEG_COUNT; s++) {
+        fep_hist_snapshot(&previous[s], &fep_stat->hist[s]);
+    }
+    for (long n = 0; reports == 0 || n < reports; n++) {
+        struct timespec wait = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+        nanosleep(&wait, NULL);
+
+        for (int s = 0; s < FEP_SEG_COUNT; s++) {
+            fep_hist_snapshot(&current[s], &fep_stat->hist[s]);
+            if (cumulative) {
+                interval[s] = current[s];
+            } else {
+                fep_hist_diff(&interval[s], &current[s], &previous[s]);
+            }
+            previous[s] = current[s];
+        }
+        print_report(interval, seconds, cumulative);
+    }
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <time.h>
+#include <mqueue.h>
+#include <fep_metrics.h>
+
+// Live view of the pipeline: process liveness, rates, queue depths, journal lag,
+// connections, rejects per code and DB batch latency.
+// Everything is read from shared memory and message queue attributes opened
+// read-only, so watching never attaches to or slows down a process.
+//
+// usage: fep_top [-i seconds] [-n reports] [-b]
+//   -i  refresh interval, default 1
+//   -n  stop after n reports, default run until killed
+//   -b  batch mode: append reports instead of redrawing the screen
+
+typedef struct {
+    const char *name;
+    mqd_t mq;
+} watched_queue;
+
+typedef struct {
+    const char *name;
+    const int *count;
+} watched_counter;
+
+static watched_queue queues[] = {
+    {"/wc_queue", (mqd_t)-1},
+    {"/submit_queue", (mqd_t)-1},
+    {"/execution_wc_queue", (mqd_t)-1},
+};
+#define QUEUE_COUNT (int)(sizeof(queues) / sizeof(queues[0]))
+
+// W/R pairs of the journals; the order journal has two readers
+static watched_counter journal_counters[] = {
+    {"/W_count", NULL}, {"/R_count", NULL},
+    {"/KRX_W_count", NULL}, {"/KRX_R_count", NULL},
+    {"/DB_R_count", NULL},
+};
+#define JOURNAL_COUNTER_COUNT (int)(sizeof(journal_counters) / sizeof(journal_counters[0]))
+
+static fep_metrics_page previous, current;
+
+void log_message(const char *level, const char *module, const char *format, ...) {
+    fprintf(stderr, "[%s] [%s] ", level, module);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+const int *map_counter_readonly(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        return NULL;
+    }
+    const int *count = mmap(NULL, sizeof(int), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return count == MAP_FAILED ? NULL : count;
+}
+
+// Queues and counters appear as the processes start, so keep retrying the missing ones
+void attach_sources() {
+    for (int q = 0; q < QUEUE_COUNT; q++) {
+        if (queues[q].mq == (mqd_t)-1) {
+            queues[q].mq = mq_open(queues[q].name, O_RDONLY | O_NONBLOCK);
+        }
+    }
+    for (int c = 0; c < JOURNAL_COUNTER_COUNT; c++) {
+        if (journal_counters[c].count == NULL) {
+            journal_counters[c].count = map_counter_readonly(journal_counters[c].name);
+        }
+    }
+}
+
+void snapshot(fep_metrics_page *dst, const fep_metrics_page *src) {
+    for (int p = 0; p < FEP_P_COUNT; p++) {
+        dst->pids[p] = __atomic_load_n(&src->pids[p], __ATOMIC_RELAXED);
+    }
+    for (int m = 0; m < FEP_M_COUNT; m++) {
+        dst->counters[m].value = __atomic_load_n(&src->counters[m].value, __ATOMIC_RELAXED);
+    }
+    for (int g = 0; g < FEP_G_COUNT; g++) {
+        dst->gauges[g].value = __atomic_load_n(&src->gauges[g].value, __ATOMIC_RELAXED);
+    }
+    for (int r = 0; r < FEP_REJECT_COUNT; r++) {
+        dst->rejects[r] = __atomic_load_n(&src->rejects[r], __ATOMIC_RELAXED);
+    }
+}
+
+int process_alive(uint32_t pid) {
+    return pid != 0 && (kill((pid_t)pid, 0) == 0 || errno == EPERM);
+}
+
+void print_journal_lag(const char *name, const watched_counter *w, const watched_counter *r) {
+    if (w->count == NULL || r->count == NULL) {
+        printf("  %-12s %10s %10s %10s\n", name, "-", "-", "-");
+        return;
+    }
+    int wc = __atomic_load_n(w->count, __ATOMIC_RELAXED);
+    int rc = __atomic_load_n(r->count, __ATOMIC_RELAXED);
+    printf("  %-12s %10d %10d %10d\n", name, wc, rc, wc - rc);
+}
+
+void print_report(double seconds, int redraw) {
+    char time_buffer[20];
+    time_t now = time(NULL);
+    strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+    if (redraw) {
+        printf("\033[H\033[2J");
+    }
+    printf("fep_top  %s  every %.1f s\n\n", time_buffer, seconds);
+
+    printf("  %-16s %8s %6s\n", "process", "pid", "state");
+    for (int p = 0; p < FEP_P_COUNT; p++) {
+        if (current.pids[p] != 0) {
+            printf("  %-16s %8u %6s\n", fep_process_names[p], current.pids[p],
+                   process_alive(current.pids[p]) ? "up" : "down");
+        }
+    }
+
+    printf("\n  %-16s %12s %10s\n", "counter", "total", "per s");
+    for (int m = 0; m < FEP_M_COUNT; m++) {
+        if (m == FEP_M_DB_BATCH_NS || m == FEP_M_INSERT_BATCH_NS) {
+            continue;
+        }
+        printf("  %-16s %12lu %10.0f\n", fep_counter_names[m], (unsigned long)current.counters[m].value,
+               (current.counters[m].value - previous.counters[m].value) / seconds);
+    }
+    uint64_t batches = current.counters[FEP_M_DB_BATCHES].value - previous.counters[FEP_M_DB_BATCHES].value;
+    uint64_t batch_ns = current.counters[FEP_M_DB_BATCH_NS].value - previous.counters[FEP_M_DB_BATCH_NS].value;
+    printf("  %-16s %12s %10.1f  (last %.1f us)\n", "db_batch_us", "mean",
+           batches ? batch_ns / 1000.0 / batches : 0.0,
+           current.gauges[FEP_G_DB_BATCH_LAST_NS].value / 1000.0);
+    uint64_t insert_batches = current.counters[FEP_M_INSERT_BATCHES].value - previous.counters[FEP_M_INSERT_BATCHES].value;
+    uint64_t insert_batch_ns = current.counters[FEP_M_INSERT_BATCH_NS].value - previous.counters[FEP_M_INSERT_BATCH_NS].value;
+    printf("  %-16s %12s %10.1f\n", "insert_batch_us", "mean",
+           insert_batches ? insert_batch_ns / 1000.0 / insert_batches : 0.0);
+
+    printf("\n  %-16s %12s\n", "gauge", "value");
+    for (int g = 0; g < FEP_G_COUNT; g++) {
+        if (g != FEP_G_DB_BATCH_LAST_NS) {
+            printf("  %-16s %12ld\n", fep_gauge_names[g], (long)current.gauges[g].value);
+        }
+    }
+
+    printf("\n  %-20s %8s %8s\n", "queue", "depth", "max");
+    for (int q = 0; q < QUEUE_COUNT; q++) {
+        struct mq_attr attr;
+        if (queues[q].mq != (mqd_t)-1 && mq_getattr(queues[q].mq, &attr) == 0) {
+            printf("  %-20s %8ld %8ld\n", queues[q].name, attr.mq_curmsgs, attr.mq_maxmsg);
+        } else {
+            printf("  %-20s %8s %8s\n", queues[q].name, "-", "-");
+        }
+    }
+
+    printf("\n  %-12s %10s %10s %10s\n", "journal", "W", "R", "lag");
+    print_journal_lag("orders", &journal_counters[0], &journal_counters[1]);
+    print_journal_lag("inserts", &journal_counters[0], &journal_counters[4]);
+    print_journal_lag("executions", &journal_counters[2], &journal_counters[3]);
+
+    printf("\n  %-8s %10s %10s\n", "reject", "total", "per s");
+    for (int r = FEP_ACCEPTED + 1; r < FEP_REJECT_COUNT; r++) {
+        printf("  %-8s %10lu %10.0f\n", fep_reject_codes[r], (unsigned long)current.rejects[r],
+               (current.rejects[r] - previous.rejects[r]) / seconds);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = 1.0;
+    long reports = 0;
+    int redraw = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:n:b")) != -1) {
+        switch (opt) {
+        case 'i': seconds = atof(optarg); break;
+        case 'n': reports = atol(optarg); break;
+        case 'b': redraw = 0; break;
+        default:
+            fprintf(stderr, "usage: %s [-i seconds] [-n reports] [-b]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (seconds <= 0) {
+        seconds = 1.0;
+    }
+
+    const fep_metrics_page *page = fep_metrics_map(0);
+    if (page == NULL) {
+        fprintf(stderr, "cannot map %s, no FEP process has started yet\n", FEP_METRICS_SHM_NAME);
+        return EXIT_FAILURE;
+    }
+
+    attach_sources();
+    snapshot(&previous, page);
+    for (long n = 0; reports == 0 || n < reports; n++) {
+        struct timespec wait = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+        nanosleep(&wait, NULL);
+
+        attach_sources();
+        snapshot(&current, page);
+        print_report(seconds, redraw);
+        previous = current;
+    }
+    return 0;
+}
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <fep_trace.h>
+
+// Per-order timelines from the /fep_trace ring.
+// Joins the events the four processes wrote for each sampled transaction_code,
+// then lists the orders whose time inside the FEP went over the threshold:
+// recv -> sent on the order path, or executed -> persisted on the execution path.
+//
+// usage: fep_trace [-f file] [-o file] [-t us] [-n orders] [-x code] [-a] [-s every] [-r]
+//   -f  read a snapshot saved with -o instead of the live ring
+//   -o  save the live ring to file and exit (analyse later with -f)
+//   -t  outlier threshold in microseconds, default 1000
+//   -n  print at most n outliers, worst first, default 20
+//   -x  print the timeline of one transaction_code
+//   -a  print every timeline
+//   -s  set sampling live (0 = off, 1 = every order, N = 1 in N) and exit
+//   -r  clear the ring and exit (run it between test runs)
+
+#define SNAPSHOT_MAGIC 0x46455444u    // "FEPD"
+#define DEFAULT_THRESHOLD_US 1000.0
+#define DEFAULT_OUTLIERS 20
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    double ns_per_tick;
+    uint64_t count;
+} trace_snapshot_header;
+
+typedef struct {
+    int first;              // index of the order's first event in events[]
+    int count;
+    uint64_t tick_to_trade; // ns, 0 if recv or sent is missing
+    uint64_t persist;       // ns, worst executed -> persisted, 0 if none
+} trace_order;
+
+void log_message(const char *level, const char *module, const char *format, ...) {
+    fprintf(stderr, "[%s] [%s] ", level, module);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+static fep_trace_event *events;
+static uint64_t event_count;
+static trace_order *orders;
+static int order_count;
+static double ns_per_tick = 1.0;
+
+int by_code_then_tick(const void *a, const void *b) {
+    const fep_trace_event *x = a, *y = b;
+    int c = strncmp(x->transaction_code, y->transaction_code, sizeof(x->transaction_code));
+    if (c != 0) {
+        return c;
+    }
+    return x->tick < y->tick ? -1 : x->tick > y->tick;
+}
+
+uint64_t worst_of(const trace_order *o) {
+    return o->tick_to_trade > o->persist ? o->tick_to_trade : o->persist;
+}
+
+int by_worst_desc(const void *a, const void *b) {
+    uint64_t x = worst_of(a), y = worst_of(b);
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+uint64_t ticks_ns(uint64_t from, uint64_t to) {
+    return to > from ? (uint64_t)((to - from) * ns_per_tick) : 0;
+}
+
+int load_live() {
+    if (fep_trace_open() != 0) {
+        fprintf(stderr, "cannot map %s\n", FEP_TRACE_SHM_NAME);
+        return -1;
+    }
+    ns_per_tick = fep_trace->ns_per_tick;
+    events = malloc(sizeof(fep_trace_event) * FEP_TRACE_RING);
+    if (events == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < FEP_TRACE_RING; i++) {
+        if (fep_trace_read(&fep_trace->ring[i], &events[event_count])) {
+            event_count++;
+        }
+    }
+    return 0;
+}
+
+int load_file(const char *path) {
+    trace_snapshot_header header;
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != SNAPSHOT_MAGIC
+            || header.version != FEP_TRACE_VERSION || header.count > FEP_TRACE_RING) {
+        fprintf(stderr, "%s is not a trace snapshot\n", path);
+        fclose(file);
+        return -1;
+    }
+    ns_per_tick = header.ns_per_tick;
+    events = malloc(sizeof(fep_trace_event) * (header.count ? header.count : 1));
+    if (events == NULL || fread(events, sizeof(fep_trace_event), header.count, file) != header.count) {
+        fprintf(stderr, "%s is truncated\n", path);
+        fclose(file);
+        return -1;
+    }
+    event_count = header.count;
+    fclose(file);
+    return 0;
+}
+
+int save_file(const char *path) {
+    trace_snapshot_header header = {SNAPSHOT_MAGIC, FEP_TRACE_VERSION, ns_per_tick, event_count};
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fwrite(&header, sizeof(header), 1, file) != 1
+            || fwrite(events, sizeof(fep_trace_event), event_count, file) != event_count) {
+        perror(path);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    printf("%lu events saved to %s\n", (unsigned long)event_count, path);
+    return 0;
+}
+
+// Group the sorted events by transaction_code and measure each order
+void join_orders() {
+    orders = malloc(sizeof(trace_order) * (event_count ? event_count : 1));
+    for (uint64_t i = 0; i < event_count; ) {
+        trace_order *o = &orders[order_count++];
+        uint64_t recv = 0, sent = 0, executed = 0;
+
+        memset(o, 0, sizeof(*o));
+        o->first = (int)i;
+        for (; i < event_count && strncmp(events[i].transaction_code, events[o->first].transaction_code,
+                                          sizeof(events[i].transaction_code)) == 0; i++) {
+            const fep_trace_event *e = &events[i];
+            o->count++;
+            if (e->stage == FEP_TRACE_RECV && recv == 0) {
+                recv = e->tick;
+            } else if (e->stage == FEP_TRACE_SENT && sent == 0) {
+                sent = e->tick;
+            } else if (e->stage == FEP_TRACE_EXECUTED) {
+                executed = e->tick;
+            } else if (e->stage == FEP_TRACE_PERSISTED && executed != 0) {
+                // partial fills of one order may share a persisted event
+                uint64_t persist = ticks_ns(executed, e->tick);
+                if (persist > o->persist) {
+                    o->persist = persist;
+                }
+                executed = 0;
+            }
+        }
+        if (recv != 0 && sent != 0) {
+            o->tick_to_trade = ticks_ns(recv, sent);
+        }
+    }
+}
+
+void print_timeline(const trace_order *o) {
+    const fep_trace_event *first = &events[o->first];
+    uint64_t previous = first->tick;
+
+    printf("order %s  tick_to_trade %.2f us  persist %.2f us\n", first->transaction_code,
+           o->tick_to_trade / 1000.0, o->persist / 1000.0);
+    for (int k = 0; k < o->count; k++) {
+        const fep_trace_event *e = &events[o->first + k];
+        printf("  %12.2f us %+12.2f us  %-15s pid %-7u pos %u\n",
+               ticks_ns(first->tick, e->tick) / 1000.0, ticks_ns(previous, e->tick) / 1000.0,
+               e->stage < FEP_TRACE_STAGE_COUNT ? fep_trace_stage_names[e->stage] : "?", e->pid, e->pos);
+        previous = e->tick;
+    }
+}
+
+void print_summary(double threshold_us, int max_outliers) {
+    fep_hist tick_to_trade, persist;
+    int outliers = 0;
+
+    fep_hist_reset(&tick_to_trade);
+    fep_hist_reset(&persist);
+    for (int k = 0; k < order_count; k++) {
+        if (orders[k].tick_to_trade != 0) {
+            fep_hist_record(&tick_to_trade, orders[k].tick_to_trade);
+        }
+        if (orders[k].persist != 0) {
+            fep_hist_record(&persist, orders[k].persist);
+        }
+        if (worst_of(&orders[k]) > threshold_us * 1000.0) {
+            outliers++;
+        }
+    }
+
+    printf("%lu events, %d orders traced\n", (unsigned long)event_count, order_count);
+    printf("%-14s %10s %10s %10s %10s %10s\n", "path", "orders", "p50(us)", "p99(us)", "max(us)", "over");
+    const fep_hist *hists[2] = {&tick_to_trade, &persist};
+    const char *names[2] = {"tick_to_trade", "persist"};
+    for (int p = 0; p < 2; p++) {
+        int over = 0;
+        for (int k = 0; k < order_count; k++) {
+            over += (p == 0 ? orders[k].tick_to_trade : orders[k].persist) > threshold_us * 1000.0;
+        }
+        printf("%-14s %10lu %10.2f %10.2f %10.2f %10d\n", names[p], (unsigned long)hists[p]->count,
+               fep_hist_percentile(hists[p], 50.0) / 1000.0, fep_hist_percentile(hists[p], 99.0) / 1000.0,
+               hists[p]->max / 1000.0, over);
+    }
+    printf("\n%d orders over %.0f us", outliers, threshold_us);
+    if (outliers > max_outliers) {
+        printf(", worst %d shown", max_outliers);
+    }
+    printf("\n\n");
+
+    qsort(orders, order_count, sizeof(trace_order), by_worst_desc);
+    for (int k = 0; k < order_count && k < max_outliers && worst_of(&orders[k]) > threshold_us * 1000.0; k++) {
+        print_timeline(&orders[k]);
+        printf("\n");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *in_path = NULL, *out_path = NULL, *code = NULL;
+    double threshold_us = DEFAULT_THRESHOLD_US;
+    int max_outliers = DEFAULT_OUTLIERS;
+    int all = 0, reset = 0;
+    long sample_every = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:o:t:n:x:as:r")) != -1) {
+        switch (opt) {
+        case 'f': in_path = optarg; break;
+        case 'o': out_path = optarg; break;
+        case 't': threshold_us = atof(optarg); break;
+        case 'n': max_outliers = atoi(optarg); break;
+        case 'x': code = optarg; break;
+        case 'a': all = 1; break;
+        case 's': sample_every = atol(optarg); break;
+        case 'r': reset = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-f file] [-o file] [-t us] [-n orders] [-x code] [-a] [-s every] [-r]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (sample_every >= 0 || reset) {
+        if (fep_trace_open() != 0) {
+            fprintf(stderr, "cannot map %s\n", FEP_TRACE_SHM_NAME);
+            return EXIT_FAILURE;
+        }
+        if (sample_every >= 0) {
+            __atomic_store_n(&fep_trace->sample_every, (uint32_t)sample_every, __ATOMIC_RELAXED);
+            printf("sampling every %ld\n", sample_every);
+        }
+        if (reset) {
+            // only consistent while no process is writing
+            for (int i = 0; i < FEP_TRACE_RING; i++) {
+                __atomic_store_n(&fep_trace->ring[i].seq, 0, __ATOMIC_RELAXED);
+            }
+            printf("trace ring cleared\n");
+        }
+        return 0;
+    }
+
+    if ((in_path != NULL ? load_file(in_path) : load_live()) != 0) {
+        return EXIT_FAILURE;
+    }
+    if (out_path != NULL) {
+        return save_file(out_path) == 0 ? 0 : EXIT_FAILURE;
+    }
+
+    qsort(events, event_count, sizeof(fep_trace_event), by_code_then_tick);
+    join_orders();
+
+    if (code != NULL || all) {
+        for (int k = 0; k < order_count; k++) {
+            if (all || strncmp(events[orders[k].first].transaction_code, code, sizeof(events[0].transaction_code)) == 0) {
+                print_timeline(&orders[k]);
+                printf("\n");
+            }
+        }
+        return 0;
+    }
+    print_summary(threshold_us, max_outliers);
+    return 0;
+}